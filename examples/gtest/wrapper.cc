@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 
+#include "thunk/ggutils.hh"
 #include "thunk/thunk.hh"
 #include "thunk/thunk_reader.hh"
 #include "util/exception.hh"
@@ -55,7 +56,12 @@ int main( int argc, char * argv [] )
     }
 
     const roost::path thunk_path = safe_getenv( "__GG_THUNK_PATH__" );
-    const roost::path gg_path = safe_getenv( "__GG_DIR__" );
+
+    /* setting the GG_DIR, so we can find the objects */
+    setenv( "GG_DIR",
+            roost::dirname( safe_getenv( "__GG_DIR__" ) ).string().c_str(),
+            true );
+
     const Thunk thunk = ThunkReader::read( thunk_path );
     vector<TempSymlink> symlinks;
     symlinks.reserve( thunk.values().size() );
@@ -67,7 +73,7 @@ int main( int argc, char * argv [] )
           throw runtime_error( "paths are not supported yet" );
         }
 
-        symlinks.emplace_back( gg_path / value.first, value.second );
+        symlinks.emplace_back( gg::paths::blob( value.first ), value.second );
       }
     }
 
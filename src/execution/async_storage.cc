@@ -0,0 +1,297 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "async_storage.hh"
+
+#include <memory>
+#include <algorithm>
+
+#include "net/object_receiver.hh"
+#include "util/pipe.hh"
+
+using namespace std;
+using namespace storage;
+using namespace PollerShortNames;
+
+constexpr size_t AsyncStorage::DEFAULT_MAX_CONNECTIONS;
+
+AsyncStorage::AsyncStorage( StorageBackend & backend, ExecutionLoop & loop,
+                            const size_t max_connections )
+  : backend_( backend ), loop_( loop ), max_connections_( max_connections ),
+    prepared_pipe_( make_pipe() )
+{
+  if ( max_connections_ == 0 ) {
+    throw runtime_error( "max connections cannot be zero" );
+  }
+
+  const Optional<RedisClientConfig> redis_config = backend_.redis_config();
+
+  if ( redis_config.initialized() ) {
+    redis_ = make_unique<Redis>( *redis_config, loop_.poller() );
+  }
+}
+
+AsyncStorage::~AsyncStorage()
+{
+  {
+    unique_lock<mutex> lock { prepare_mutex_ };
+    stopping_ = true;
+  }
+
+  prepare_available_.notify_all();
+
+  for ( thread & prepare_thread : prepare_threads_ ) {
+    prepare_thread.join();
+  }
+
+  if ( prepare_threads_.size() ) {
+    loop_.poller().remove_actions( { prepared_pipe_.first.fd_num() } );
+  }
+}
+
+const Address & AsyncStorage::address()
+{
+  if ( not address_.initialized() ) {
+    address_.initialize( backend_.endpoint(), "https" );
+
+    ExecutionLoop::ConnectionPoolOptions pool_options;
+    pool_options.max_connections = max_connections_;
+    loop_.set_pool_options<SSLConnection>( *address_, pool_options );
+  }
+
+  return *address_;
+}
+
+void AsyncStorage::start_waiting()
+{
+  while ( running_ < max_connections_ and not waiting_.empty() ) {
+    auto start = move( waiting_.front() );
+    waiting_.pop();
+
+    running_++;
+    start();
+  }
+}
+
+void AsyncStorage::finish_one()
+{
+  running_--;
+  start_waiting();
+}
+
+/* the compression threads */
+void AsyncStorage::prepare_puts()
+{
+  while ( true ) {
+    shared_ptr<PendingPut> put;
+
+    {
+      unique_lock<mutex> lock { prepare_mutex_ };
+      prepare_available_.wait( lock, [this] { return stopping_ or not to_prepare_.empty(); } );
+
+      if ( stopping_ ) {
+        return;
+      }
+
+      put = move( to_prepare_.front() );
+      to_prepare_.pop_front();
+    }
+
+    /* e.g., the compression dictionary couldn't be fetched */
+    try {
+      put->prepared = make_shared<PreparedPut>( backend_.prepare_put( put->request ) );
+    }
+    catch ( const exception & e ) {
+      put->error = e.what();
+    }
+
+    unique_lock<mutex> lock { prepare_mutex_ };
+
+    /* the loop takes everything that's ready when it wakes up */
+    if ( prepared_.empty() ) {
+      prepared_pipe_.second.write( "x" );
+    }
+
+    prepared_.push_back( move( put ) );
+  }
+}
+
+void AsyncStorage::send_prepared()
+{
+  vector<shared_ptr<PendingPut>> prepared;
+
+  {
+    unique_lock<mutex> lock { prepare_mutex_ };
+    swap( prepared, prepared_ );
+  }
+
+  for ( const shared_ptr<PendingPut> & put : prepared ) {
+    if ( put->prepared == nullptr ) {
+      finish_one();
+      put->failure_callback( put->request.object_key, put->error );
+    }
+    else {
+      send_put( *put );
+    }
+  }
+}
+
+void AsyncStorage::start_put( const PutRequest & request,
+                              const PutCallback & success_callback,
+                              const FailureCallback & failure_callback )
+{
+  if ( prepare_threads_.empty() ) {
+    loop_.poller().add_action( Poller::Action( prepared_pipe_.first, Direction::In,
+      [this] ()
+      {
+        prepared_pipe_.first.read();
+        send_prepared();
+        return ResultType::Continue;
+      } ) );
+
+    /* there are never more puts running than connections */
+    const size_t thread_count = min<size_t>( max_connections_,
+                                             max( 1u, thread::hardware_concurrency() ) );
+
+    for ( size_t i = 0; i < thread_count; i++ ) {
+      prepare_threads_.emplace_back( &AsyncStorage::prepare_puts, this );
+    }
+  }
+
+  {
+    unique_lock<mutex> lock { prepare_mutex_ };
+    to_prepare_.push_back( make_shared<PendingPut>(
+      PendingPut { request, success_callback, failure_callback } ) );
+  }
+
+  prepare_available_.notify_one();
+}
+
+void AsyncStorage::send_put( const PendingPut & put )
+{
+  /* the compressed copy, if any, has to outlive the transfer */
+  const shared_ptr<PreparedPut> prepared = put.prepared;
+  const PutRequest & request = put.request;
+  const PutCallback & success_callback = put.success_callback;
+  const FailureCallback & failure_callback = put.failure_callback;
+
+  if ( redis_ ) {
+    redis_->put( { prepared->request },
+      [this, request, prepared, success_callback] ( const PutRequest & )
+      {
+        finish_one();
+        success_callback( request );
+      },
+      [this, prepared, failure_callback] ( const string & object_key, const string & error )
+      {
+        finish_one();
+        failure_callback( object_key, error );
+      } );
+
+    return;
+  }
+
+  const string filename = prepared->request.filename.string();
+  const HTTPRequest http_request = backend_.put_request( prepared->request,
+                                                         roost::file_size( filename ) );
+
+  loop_.make_pooled_http_request<SSLConnection>( request.object_key, address(), http_request,
+    [this, request, prepared, success_callback, failure_callback]
+    ( const uint64_t, const string &, const HTTPResponse & response )
+    {
+      finish_one();
+
+      if ( response.status_code() != "200" ) {
+        failure_callback( request.object_key, response.first_line() );
+      }
+      else {
+        success_callback( request );
+      }
+    },
+    [this, prepared, failure_callback] ( const uint64_t, const string & object_key )
+    {
+      finish_one();
+      failure_callback( object_key, "connection failed" );
+    },
+    {}, filename );
+}
+
+void AsyncStorage::start_get( const GetRequest & request,
+                              const GetCallback & success_callback,
+                              const FailureCallback & failure_callback )
+{
+  auto receiver = make_shared<ObjectReceiver>( request.filename, request.mode,
+                                               request.content_hash );
+
+  loop_.make_pooled_http_request<SSLConnection>( request.object_key, address(),
+    backend_.get_request( request ),
+    [this, request, receiver, success_callback, failure_callback]
+    ( const uint64_t, const string &, const HTTPResponse & response )
+    {
+      finish_one();
+
+      if ( response.status_code() != "200" ) {
+        failure_callback( request.object_key, response.first_line() );
+        return;
+      }
+
+      /* e.g., the object doesn't have the hash it should have */
+      try {
+        receiver->commit();
+      }
+      catch ( const exception & e ) {
+        failure_callback( request.object_key, e.what() );
+        return;
+      }
+
+      success_callback( request );
+    },
+    [this, failure_callback] ( const uint64_t, const string & object_key )
+    {
+      finish_one();
+      failure_callback( object_key, "connection failed" );
+    },
+    [receiver] ( const string & data ) { receiver->append( data ); } );
+}
+
+void AsyncStorage::put( const vector<PutRequest> & requests,
+                        const PutCallback & success_callback,
+                        const FailureCallback & failure_callback )
+{
+  if ( not backend_.signs_requests() and not redis_ ) {
+    backend_.put( requests, success_callback );
+    return;
+  }
+
+  for ( const PutRequest & request : requests ) {
+    waiting_.emplace( [this, request, success_callback, failure_callback]
+                      { start_put( request, success_callback, failure_callback ); } );
+  }
+
+  start_waiting();
+}
+
+void AsyncStorage::get( const vector<GetRequest> & requests,
+                        const GetCallback & success_callback,
+                        const FailureCallback & failure_callback )
+{
+  if ( not backend_.signs_requests() and not redis_ ) {
+    backend_.get( requests, success_callback );
+    return;
+  }
+
+  backend_.prepare_compression();
+
+  /* the objects are fetched in MGETs, and only go to the disk as they
+     arrive, so there is nothing to hold back */
+  if ( redis_ ) {
+    redis_->get( requests, success_callback, failure_callback );
+    return;
+  }
+
+  for ( const GetRequest & request : requests ) {
+    waiting_.emplace( [this, request, success_callback, failure_callback]
+                      { start_get( request, success_callback, failure_callback ); } );
+  }
+
+  start_waiting();
+}
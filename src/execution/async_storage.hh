@@ -0,0 +1,110 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef ASYNC_STORAGE_HH
+#define ASYNC_STORAGE_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "loop.hh"
+#include "net/address.hh"
+#include "net/redis.hh"
+#include "storage/backend.hh"
+#include "util/file_descriptor.hh"
+#include "util/optional.hh"
+
+/* Runs the transfers of a StorageBackend on an ExecutionLoop. For backends
+   that sign their requests (S3 and Google Storage), the objects are moved
+   over a pool of at most max_connections keep-alive connections; for Redis,
+   the commands are pipelined over the Redis client's own pool. Either way,
+   the callbacks are called from the loop. Bodies are
+   streamed from and to the disk, and compressed and decompressed as the
+   backend says; uploads are compressed by a pool of threads, so that the
+   loop doesn't wait for them. Any other backend falls back to its blocking
+   put() and get(). */
+class AsyncStorage
+{
+public:
+  typedef std::function<void( const std::string & /* object_key */,
+                              const std::string & /* error */ )> FailureCallback;
+
+  static constexpr size_t DEFAULT_MAX_CONNECTIONS = 32;
+
+private:
+  StorageBackend & backend_;
+  ExecutionLoop & loop_;
+  size_t max_connections_;
+
+  Optional<Address> address_ {};
+  std::unique_ptr<Redis> redis_ { nullptr };
+
+  std::queue<std::function<void()>> waiting_ {};
+  size_t running_ { 0 };
+
+  /* a put on its way through the compression threads */
+  struct PendingPut
+  {
+    storage::PutRequest request;
+    PutCallback success_callback;
+    FailureCallback failure_callback;
+
+    std::shared_ptr<PreparedPut> prepared { nullptr };
+    std::string error {};
+  };
+
+  std::mutex prepare_mutex_ {};
+  std::condition_variable prepare_available_ {};
+  std::deque<std::shared_ptr<PendingPut>> to_prepare_ {};
+  std::vector<std::shared_ptr<PendingPut>> prepared_ {};
+  bool stopping_ { false };
+
+  /* the threads write to the pipe when they hand a put back to the loop */
+  std::pair<FileDescriptor, FileDescriptor> prepared_pipe_;
+  std::vector<std::thread> prepare_threads_ {};
+
+  const Address & address();
+  void start_waiting();
+  void finish_one();
+
+  void prepare_puts();
+  void send_prepared();
+
+  void start_put( const storage::PutRequest & request,
+                  const PutCallback & success_callback,
+                  const FailureCallback & failure_callback );
+
+  void send_put( const PendingPut & put );
+
+  void start_get( const storage::GetRequest & request,
+                  const GetCallback & success_callback,
+                  const FailureCallback & failure_callback );
+
+public:
+  AsyncStorage( StorageBackend & backend, ExecutionLoop & loop,
+                const size_t max_connections = DEFAULT_MAX_CONNECTIONS );
+
+  ~AsyncStorage();
+
+  AsyncStorage( const AsyncStorage & ) = delete;
+  AsyncStorage & operator=( const AsyncStorage & ) = delete;
+
+  void put( const std::vector<storage::PutRequest> & requests,
+            const PutCallback & success_callback,
+            const FailureCallback & failure_callback );
+
+  void get( const std::vector<storage::GetRequest> & requests,
+            const GetCallback & success_callback,
+            const FailureCallback & failure_callback );
+
+  /* the number of transfers that haven't finished yet */
+  size_t pending() const { return running_ + waiting_.size() + ( redis_ ? redis_->pending() : 0 ); }
+};
+
+#endif /* ASYNC_STORAGE_HH */
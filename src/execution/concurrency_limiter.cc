@@ -0,0 +1,56 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "concurrency_limiter.hh"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+using namespace std::chrono;
+
+ConcurrencyLimiter::ConcurrencyLimiter( const size_t cap )
+  : ConcurrencyLimiter( cap, Options {} )
+{}
+
+ConcurrencyLimiter::ConcurrencyLimiter( const size_t cap, const Options & options )
+  : cap_( cap ), options_( options ), limit_( cap )
+{
+  if ( cap == 0 ) {
+    throw runtime_error( "concurrency cap cannot be zero" );
+  }
+
+  if ( options_.decrease <= 0.0 or options_.decrease >= 1.0 ) {
+    throw runtime_error( "decrease factor must be in (0, 1)" );
+  }
+}
+
+void ConcurrencyLimiter::success()
+{
+  consecutive_overloads_ = 0;
+  limit_ = min<double>( cap_, limit_ + options_.increase / limit_ );
+}
+
+void ConcurrencyLimiter::overload( const Clock::time_point & now )
+{
+  if ( backing_off( now ) ) {
+    return;
+  }
+
+  limit_ = max( 1.0, limit_ * options_.decrease );
+
+  /* the backoff doubles with every overload in a row, and a random half of
+     it is dropped, so that the retries don't arrive all at once */
+  const double backoff_ms = min<double>( options_.max_backoff.count(),
+                                         options_.min_backoff.count()
+                                         * pow( 2.0, min<size_t>( consecutive_overloads_, 30 ) ) );
+  consecutive_overloads_++;
+
+  uniform_real_distribution<double> jitter { backoff_ms / 2, backoff_ms };
+  backoff_until_ = now + duration_cast<Clock::duration>( duration<double, milli>( jitter( random_ ) ) );
+}
+
+size_t ConcurrencyLimiter::limit() const
+{
+  return max<size_t>( 1, static_cast<size_t>( limit_ ) );
+}
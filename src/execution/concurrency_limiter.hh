@@ -0,0 +1,52 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef CONCURRENCY_LIMITER_HH
+#define CONCURRENCY_LIMITER_HH
+
+#include <chrono>
+#include <random>
+
+/* An additive-increase, multiplicative-decrease limit on the number of jobs
+   an engine keeps in flight. Every success grows the limit by about one job
+   per window of jobs, up to the cap; an overloaded service halves it, and
+   holds back new jobs for a jittered, exponentially growing backoff. */
+class ConcurrencyLimiter
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Options
+  {
+    double increase { 1.0 };
+    double decrease { 0.5 };
+    std::chrono::milliseconds min_backoff { 100 };
+    std::chrono::milliseconds max_backoff { 10000 };
+  };
+
+private:
+  size_t cap_;
+  Options options_;
+  double limit_;
+
+  size_t consecutive_overloads_ { 0 };
+  Clock::time_point backoff_until_ {};
+  std::mt19937 random_ { std::random_device {}() };
+
+public:
+  ConcurrencyLimiter( const size_t cap );
+  ConcurrencyLimiter( const size_t cap, const Options & options );
+
+  void success();
+
+  /* the overloads reported while backing off are from the same burst, and
+     only count once */
+  void overload( const Clock::time_point & now = Clock::now() );
+
+  size_t limit() const;
+  size_t cap() const { return cap_; }
+
+  bool backing_off( const Clock::time_point & now = Clock::now() ) const { return now < backoff_until_; }
+  Clock::time_point backoff_until() const { return backoff_until_; }
+};
+
+#endif /* CONCURRENCY_LIMITER_HH */
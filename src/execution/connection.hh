@@ -4,11 +4,14 @@
 #define CONNECTION_HH
 
 #include <string>
-#include <queue>
+#include <deque>
+#include <utility>
 #include <iostream>
 
 #include "net/socket.hh"
 #include "net/nb_secure_socket.hh"
+#include "util/file_descriptor.hh"
+#include "util/ipc_socket.hh"
 
 class ExecutionLoop;
 
@@ -21,6 +24,23 @@ private:
   SocketType socket_ {};
   std::string write_buffer_ {};
 
+  /* files that are sent after the write buffer, one buffer at a time, each
+     followed by whatever was enqueued after it */
+  std::deque<std::pair<FileDescriptor, std::string>> write_files_ {};
+
+  void refill_write_buffer()
+  {
+    if ( write_buffer_.empty() and not write_files_.empty() ) {
+      auto & file = write_files_.front();
+      write_buffer_ = file.first.read();
+
+      if ( file.first.eof() ) {
+        write_buffer_.append( file.second );
+        write_files_.pop_front();
+      }
+    }
+  }
+
 public:
   Connection() {}
 
@@ -37,11 +57,34 @@ public:
     }
   }
 
-  void enqueue_write( const std::string & str ) { write_buffer_.append( str ); }
+  void enqueue_write( const std::string & str )
+  {
+    ( write_files_.empty() ? write_buffer_ : write_files_.back().second ).append( str );
+  }
+
+  void enqueue_file( FileDescriptor && file ) { write_files_.emplace_back( std::move( file ), std::string {} ); }
+  bool something_to_write() const { return write_buffer_.size() or write_files_.size(); }
+
+  /* writes as much as the socket takes without blocking (not for
+     NBSecureSocket, which buffers everything it's given) */
+  void write_some()
+  {
+    refill_write_buffer();
+
+    if ( write_buffer_.size() ) {
+      std::string::const_iterator last_write = socket_.write( write_buffer_.cbegin(),
+                                                              write_buffer_.cend() );
+
+      write_buffer_.erase( 0, last_write - write_buffer_.cbegin() );
+    }
+  }
+
+  SocketType & socket() { return socket_; }
   const SocketType & socket() const { return socket_; }
 };
 
 using TCPConnection = Connection<TCPSocket>;
 using SSLConnection = Connection<NBSecureSocket>;
+using IPCConnection = Connection<IPCSocket>;
 
 #endif /* CONNECTION_HH */
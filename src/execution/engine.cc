@@ -0,0 +1,62 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "engine.hh"
+
+#include <iostream>
+#include <algorithm>
+#include <unordered_set>
+
+#include "thunk/blob_store.hh"
+#include "thunk/ggutils.hh"
+#include "util/base64.hh"
+
+using namespace std;
+using namespace gg;
+
+void ExecutionEngine::process_response( const vector<string> & thunk_hashes,
+                                        ExecutionResponse && response,
+                                        const float cost )
+{
+  /* print the output, if there's any */
+  if ( response.stdout.length() ) {
+    cerr << response.stdout << endl;
+  }
+
+  unordered_set<string> executed;
+
+  for ( auto & executed_thunk : response.executed_thunks ) {
+    const string & thunk_hash = executed_thunk.thunk_hash;
+
+    if ( find( thunk_hashes.begin(), thunk_hashes.end(), thunk_hash ) == thunk_hashes.end() ) {
+      throw runtime_error( "got output for " + thunk_hash + ", which wasn't requested" );
+    }
+
+    for ( const auto & output : executed_thunk.outputs ) {
+      gg::cache::insert( gg::hash::for_output( thunk_hash, output.tag ), output.hash );
+
+      if ( output.data.length() ) {
+        gg::blobs::insert( output.hash, base64::decode( output.data ) );
+      }
+    }
+
+    gg::cache::insert( thunk_hash, executed_thunk.outputs.at( 0 ).hash );
+
+    vector<ThunkOutput> thunk_outputs;
+    for ( auto & output : executed_thunk.outputs ) {
+      thunk_outputs.emplace_back( move( output.hash ), move( output.tag ) );
+    }
+
+    executed.insert( thunk_hash );
+    success_callback_( thunk_hash, move( thunk_outputs ), cost / thunk_hashes.size() );
+  }
+
+  const JobStatus failure = ( response.status == JobStatus::Success )
+                            ? JobStatus::OperationalFailure
+                            : response.status;
+
+  for ( const string & thunk_hash : thunk_hashes ) {
+    if ( executed.count( thunk_hash ) == 0 ) {
+      failure_callback_( thunk_hash, failure );
+    }
+  }
+}
@@ -4,10 +4,13 @@
 #define ENGINE_HH
 
 #include <string>
+#include <vector>
 #include <stdexcept>
 #include <functional>
+#include <algorithm>
 
 #include "loop.hh"
+#include "concurrency_limiter.hh"
 #include "response.hh"
 #include "thunk/thunk.hh"
 
@@ -28,25 +31,79 @@ protected:
   FailureCallbackFunc failure_callback_ {};
 
   size_t max_jobs_ { 0 };
+  ConcurrencyLimiter limiter_;
+
+  /* hands each thunk in the response to the success callback, with an equal
+     share of the cost, and each requested thunk that isn't in it to the
+     failure callback */
+  void process_response( const std::vector<std::string> & thunk_hashes,
+                         ExecutionResponse && response,
+                         const float cost = 0.0 );
 
 public:
   ExecutionEngine( const size_t max_jobs = 1 )
-    : max_jobs_( max_jobs )
+    : max_jobs_( max_jobs ), limiter_( std::max<size_t>( max_jobs, 1 ) )
   {
     if ( max_jobs == 0 ) {
       throw std::runtime_error( "max jobs cannot be zero" );
     }
   }
 
-  void set_success_callback( SuccessCallbackFunc func ) { success_callback_ = func; }
-  void set_failure_callback( FailureCallbackFunc func ) { failure_callback_ = func; }
+  /* the limiter hears about every job that finishes */
+  void set_success_callback( SuccessCallbackFunc func )
+  {
+    success_callback_ =
+      [this, func] ( const std::string & hash, std::vector<gg::ThunkOutput> && outputs,
+                     const float cost )
+      {
+        limiter_.success();
+        func( hash, std::move( outputs ), cost );
+      };
+  }
+
+  void set_failure_callback( FailureCallbackFunc func )
+  {
+    failure_callback_ =
+      [this, func] ( const std::string & hash, const JobStatus status )
+      {
+        if ( status == JobStatus::RateLimit or status == JobStatus::InvocationFailure ) {
+          limiter_.overload();
+        }
+
+        func( hash, status );
+      };
+  }
 
   virtual void init( ExecutionLoop & ) {}
   virtual void force_thunk( const gg::thunk::Thunk & thunk, ExecutionLoop & exec_loop ) = 0;
+
+  /* runs the thunks in one invocation, if the engine can; a batch counts as
+     one job toward max_jobs() */
+  virtual void force_thunks( const std::vector<gg::thunk::Thunk> & thunks, ExecutionLoop & exec_loop )
+  {
+    for ( const auto & thunk : thunks ) {
+      force_thunk( thunk, exec_loop );
+    }
+  }
+
+  /* stops the copies of this thunk that are still running, once one copy of
+     it has finished; an engine that can't stop its jobs lets them run to the
+     end, and the reductor ignores what they return */
+  virtual void cancel_thunk( const std::string &, ExecutionLoop & ) {}
+
+  /* what a millisecond of a job costs on this engine, in dollars */
+  virtual double cost_per_ms() const { return 0.0; }
+
+  virtual bool can_batch() const { return false; }
   virtual bool is_remote() const = 0;
   virtual bool can_execute( const gg::thunk::Thunk & thunk ) const = 0;
   virtual size_t job_count() const = 0;
   size_t max_jobs() const { return max_jobs_; }
+
+  /* how many jobs the engine should have in flight right now, which is less
+     than max_jobs() while the service behind it is pushing back */
+  size_t job_limit() const { return limiter_.limit(); }
+  const ConcurrencyLimiter & limiter() const { return limiter_; }
   virtual std::string label() const = 0;
 
   virtual ~ExecutionEngine() {}
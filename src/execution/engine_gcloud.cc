@@ -6,11 +6,9 @@
 #include <cmath>
 
 #include "response.hh"
-#include "thunk/ggutils.hh"
 #include "net/http_request.hh"
 #include "net/http_response.hh"
 #include "net/nb_secure_socket.hh"
-#include "util/base64.hh"
 #include "util/optional.hh"
 #include "util/system_runner.hh"
 #include "util/units.hh"
@@ -56,49 +54,12 @@ void GCFExecutionEngine::force_thunk( const Thunk & thunk,
         return false;
       }
 
-      ExecutionResponse response = ExecutionResponse::parse_message( http_response.body() );
-
-      /* print the output, if there's any */
-      if ( response.stdout.length() ) {
-        cerr << response.stdout << endl;
-      }
-
-      switch ( response.status ) {
-      case JobStatus::Success:
-      {
-        if ( response.thunk_hash != thunk_hash ) {
-          cerr << http_response.str() << endl;
-          throw runtime_error( "expected output for " +
-                               thunk_hash + ", got output for " +
-                               response.thunk_hash );
-        }
-
-        for ( const auto & output : response.outputs ) {
-          gg::cache::insert( gg::hash::for_output( response.thunk_hash, output.tag ), output.hash );
-
-          if ( output.data.length() ) {
-            roost::atomic_create( base64::decode( output.data ),
-                                  gg::paths::blob( output.hash ) );
-          }
-        }
-
-        gg::cache::insert( response.thunk_hash, response.outputs.at( 0 ).hash );
-
-        vector<ThunkOutput> thunk_outputs;
-        for ( auto & output : response.outputs ) {
-          thunk_outputs.emplace_back( move( output.hash ), move( output.tag ) );
-        }
-
-        success_callback_( response.thunk_hash, move( thunk_outputs ),
-                           compute_cost( start_times_.at( id ) ) );
-
-        start_times_.erase( id );
-        break;
-      }
+      const float cost = compute_cost( start_times_.at( id ) );
+      start_times_.erase( id );
 
-      default: /* in case of any other failure */
-        failure_callback_( thunk_hash, response.status );
-      }
+      process_response( { thunk_hash },
+                        ExecutionResponse::parse_message( http_response.body() ),
+                        cost );
 
       return false;
     },
@@ -14,7 +14,7 @@ private:
 
   size_t running_jobs_ { 0 };
 
-  HTTPRequest generate_request( const gg::thunk::Thunk & thunk );
+  HTTPRequest generate_request( const std::vector<gg::thunk::Thunk> & thunks );
 
 public:
   GGExecutionEngine( const size_t max_jobs, const Address & address )
@@ -23,6 +23,9 @@ public:
 
   void force_thunk( const gg::thunk::Thunk & thunk,
                     ExecutionLoop & exec_loop ) override;
+  void force_thunks( const std::vector<gg::thunk::Thunk> & thunks,
+                     ExecutionLoop & exec_loop ) override;
+  bool can_batch() const override { return true; }
   size_t job_count() const override;
 
   bool is_remote() const { return true; }
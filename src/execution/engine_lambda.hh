@@ -20,10 +20,13 @@ private:
   Address address_;
   SSLContext ssl_context_ {};
 
+  /* Lambda bills every 100 ms */
+  static constexpr double COST_PER_100_MS = 2.501e-6;
+
   size_t running_jobs_ { 0 };
   std::map<uint64_t, std::chrono::steady_clock::time_point> start_times_ {};
 
-  HTTPRequest generate_request( const gg::thunk::Thunk & thunk );
+  HTTPRequest generate_request( const std::vector<gg::thunk::Thunk> & thunks );
 
   static float compute_cost( const std::chrono::steady_clock::time_point & begin,
                              const std::chrono::steady_clock::time_point & end = std::chrono::steady_clock::now() );
@@ -38,6 +41,10 @@ public:
 
   void force_thunk( const gg::thunk::Thunk & thunk,
                     ExecutionLoop & exec_loop ) override;
+  void force_thunks( const std::vector<gg::thunk::Thunk> & thunks,
+                     ExecutionLoop & exec_loop ) override;
+  bool can_batch() const override { return true; }
+  double cost_per_ms() const override { return COST_PER_100_MS / 100; }
 
   bool is_remote() const { return true; }
   bool can_execute( const gg::thunk::Thunk & thunk ) const override;
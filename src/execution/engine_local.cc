@@ -3,57 +3,192 @@
 #include "engine_local.hh"
 
 #include <stdexcept>
+#include <algorithm>
 
 #include "thunk/ggutils.hh"
 #include "util/optional.hh"
+#include "util/path.hh"
 #include "util/system_runner.hh"
+#include "util/util.hh"
 
 using namespace std;
 using namespace gg;
 using namespace gg::thunk;
+using namespace meow;
 
-void LocalExecutionEngine::force_thunk( const Thunk & thunk,
-                                        ExecutionLoop & exec_loop )
+constexpr size_t LocalExecutionEngine::JOBS_PER_WORKER;
+
+/* the outputs of a thunk that ran locally are in the cache */
+static vector<ThunkOutput> cached_outputs( const string & hash,
+                                           const vector<string> & tags )
+{
+  vector<ThunkOutput> thunk_outputs;
+
+  for ( const auto & tag : tags ) {
+    Optional<cache::ReductionResult> result = cache::check( gg::hash::for_output( hash, tag ) );
+
+    if ( not result.initialized() ) {
+      throw runtime_error( "could not find the reduction entry" );
+    }
+
+    thunk_outputs.emplace_back( move( result->hash ), tag );
+  }
+
+  return thunk_outputs;
+}
+
+void LocalExecutionEngine::init( ExecutionLoop & exec_loop )
 {
-  exec_loop.add_child_process( thunk.hash(),
-    [this, outputs=thunk.outputs()] ( const uint64_t, const string & hash, const int )
+  socket_dir_ = make_unique<TempDirectory>( "/tmp/gg-local" );
+  const string socket_path = socket_dir_->name() + "/socket";
+
+  exec_loop.make_ipc_listener( socket_path,
+    [this] ( ExecutionLoop & loop, IPCSocket && socket )
     {
-      running_jobs_--; /* XXX not thread-safe */
+      const size_t index = workers_.size();
+      workers_.push_back( make_unique<Worker>() );
+
+      workers_.back()->connection = loop.add_connection<IPCSocket>( move( socket ),
+        [this, index] ( shared_ptr<IPCConnection>, string && data )
+        {
+          Worker & worker = *workers_[ index ];
+          worker.parser.parse( data );
 
-      vector<ThunkOutput> thunk_outputs;
+          while ( not worker.parser.empty() ) {
+            worker_message( index, worker.parser.front() );
+            worker.parser.pop();
+          }
 
-      for ( const auto & tag : outputs ) {
-        Optional<cache::ReductionResult> result = cache::check( gg::hash::for_output( hash, tag ) );
+          return true;
+        },
+        [] () {},
+        [] () { throw runtime_error( "a local worker went away" ); } );
 
-        if ( not result.initialized() ) {
-          throw runtime_error( "could not find the reduction entry" );
+      return workers_.size() < worker_count_;
+    } );
+
+  /* the workers are killed outright when the loop goes away, like a
+     gg-execute would be */
+  for ( size_t i = 0; i < worker_count_; i++ ) {
+    exec_loop.add_child_process( "gg-execute --serve",
+      [] ( const uint64_t, const string &, const int )
+      { throw runtime_error( "a local worker exited" ); },
+      [mixed=mixed_, exec_each=exec_each_, socket_path] ()
+      {
+        vector<string> command { "gg-execute" };
+
+        if ( mixed ) {
+          command.insert( command.end(), { "--get-dependencies", "--put-output" } );
         }
 
-        thunk_outputs.emplace_back( move( result->hash ), tag );
-      }
+        if ( exec_each ) {
+          command.push_back( "--exec" );
+        }
 
-      success_callback_( hash, move( thunk_outputs ), 0 );
-    },
-    [mixed=this->mixed_, &thunk]()
-    {
-      vector<string> command;
+        command.push_back( "--serve=" + socket_path );
+        return ezexec( command[ 0 ], command, {}, true, true );
+      },
+      false, SIGKILL );
+  }
+
+  while ( workers_.size() < worker_count_ ) {
+    exec_loop.loop_once( -1 );
+  }
+
+  roost::remove( socket_path );
+}
+
+void LocalExecutionEngine::worker_message( const size_t index, const Message & message )
+{
+  string hash = message.payload();
+  Optional<JobStatus> failure;
+
+  switch ( message.opcode() ) {
+  case Message::OpCode::Executed:
+    break;
 
-      if ( mixed ) {
-          command = { "gg-execute", "--get-dependencies", "--put-output",
-                      thunk.hash() };
-      }
-      else {
-          command = { "gg-execute", thunk.hash() };
-      }
+  case Message::OpCode::ExecutionFailed:
+  {
+    const size_t space = hash.find( ' ' );
 
-      return ezexec( command[ 0 ], command, {}, true, true );
-    },
-    true
-  );
+    if ( space == string::npos ) {
+      throw runtime_error( "invalid failure message from a local worker" );
+    }
+
+    const int status = stoi( hash.substr( space + 1 ) );
+    hash.resize( space );
+
+    failure.initialize( ( status > 0 and status <= to_underlying( JobStatus::ChildProcessFailure ) )
+                        ? static_cast<JobStatus>( status )
+                        : JobStatus::ChildProcessFailure );
+    break;
+  }
+
+  default:
+    throw runtime_error( "unexpected message from a local worker" );
+  }
+
+  /* a copy that finished before the worker heard it was canceled */
+  auto job_it = pool_jobs_.find( hash );
+  if ( job_it == pool_jobs_.end() ) {
+    return;
+  }
+
+  workers_[ index ]->job_count--;
+
+  PoolJob & job = job_it->second;
+  job.workers.erase( find( job.workers.begin(), job.workers.end(), index ) );
+  running_jobs_--;
+
+  const vector<string> outputs = job.outputs;
+
+  if ( job.workers.empty() ) {
+    pool_jobs_.erase( job_it );
+  }
+
+  if ( failure.initialized() ) {
+    failure_callback_( hash, *failure );
+  }
+  else {
+    success_callback_( hash, cached_outputs( hash, outputs ), 0 );
+  }
+}
+
+void LocalExecutionEngine::force_thunk( const Thunk & thunk, ExecutionLoop & )
+{
+  auto worker = min_element( workers_.begin(), workers_.end(),
+    [] ( const unique_ptr<Worker> & a, const unique_ptr<Worker> & b )
+    { return a->job_count < b->job_count; } );
+
+  PoolJob & job = pool_jobs_[ thunk.hash() ];
+  job.outputs = thunk.outputs();
+  job.workers.push_back( worker - workers_.begin() );
+
+  ( *worker )->job_count++;
+  ( *worker )->connection->enqueue_write(
+    Message { Message::OpCode::Execute, string { thunk.hash() } }.str() );
 
   running_jobs_++;
 }
 
+void LocalExecutionEngine::cancel_thunk( const string & hash, ExecutionLoop & )
+{
+  auto job = pool_jobs_.find( hash );
+
+  if ( job == pool_jobs_.end() ) {
+    return;
+  }
+
+  for ( const size_t index : job->second.workers ) {
+    workers_[ index ]->connection->enqueue_write(
+      Message { Message::OpCode::Cancel, string { hash } }.str() );
+    workers_[ index ]->job_count--;
+    running_jobs_--;
+  }
+
+  pool_jobs_.erase( job );
+}
+
 size_t LocalExecutionEngine::job_count() const
 {
   return running_jobs_;
@@ -4,27 +4,71 @@
 #define ENGINE_LOCAL_HH
 
 #include <thread>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
 
 #include "engine.hh"
+#include "connection.hh"
+#include "meow/message.hh"
+#include "util/temp_dir.hh"
 
 class LocalExecutionEngine : public ExecutionEngine
 {
+public:
+  /* with a pool and no worker count, one worker for this many jobs */
+  static constexpr size_t JOBS_PER_WORKER = 16;
+
 private:
   bool mixed_ { false };
   size_t running_jobs_ { 0 };
 
+  /* the thunks go to gg-execute workers that are started once, in init().
+     without a pool, a single worker runs a new gg-execute for each thunk, so
+     that this process doesn't have to fork while it has other threads */
+  struct Worker
+  {
+    std::shared_ptr<IPCConnection> connection { nullptr };
+    meow::MessageParser parser {};
+    size_t job_count { 0 };
+  };
+
+  struct PoolJob
+  {
+    std::vector<std::string> outputs {};
+
+    /* the workers running a copy of the job */
+    std::vector<size_t> workers {};
+  };
+
+  bool exec_each_ { true };
+  size_t worker_count_ { 1 };
+  std::unique_ptr<TempDirectory> socket_dir_ { nullptr };
+  std::vector<std::unique_ptr<Worker>> workers_ {};
+
+  std::unordered_map<std::string, PoolJob> pool_jobs_ {};
+
+  void worker_message( const size_t index, const meow::Message & message );
+
 public:
+  /* `workers` 0 starts a gg-execute for every thunk */
   LocalExecutionEngine( const bool mixed = false,
-                        const size_t max_jobs = std::thread::hardware_concurrency() )
-    : ExecutionEngine( max_jobs ), mixed_( mixed )
+                        const size_t max_jobs = std::thread::hardware_concurrency(),
+                        const size_t workers = 0 )
+    : ExecutionEngine( max_jobs ), mixed_( mixed ),
+      exec_each_( workers == 0 ), worker_count_( std::max<size_t>( workers, 1 ) )
   {}
 
+  void init( ExecutionLoop & exec_loop ) override;
   void force_thunk( const gg::thunk::Thunk & thunk,
                     ExecutionLoop & exec_loop ) override;
+  void cancel_thunk( const std::string & hash, ExecutionLoop & exec_loop ) override;
   size_t job_count() const override;
 
   bool is_remote() const override { return mixed_; }
-  std::string label() const override { return "local"; }
+  std::string label() const override { return exec_each_ ? "local" : "local-pool"; }
   bool can_execute( const gg::thunk::Thunk & ) const override { return true; }
 };
 
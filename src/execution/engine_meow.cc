@@ -3,16 +3,22 @@
 #include "engine_meow.hh"
 
 #include <iostream>
+#include <limits>
+#include <unordered_set>
+#include <sys/timerfd.h>
 
 #include "protobufs/gg.pb.h"
 #include "protobufs/meow.pb.h"
 #include "protobufs/util.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "execution/meow/message.hh"
 #include "execution/meow/util.hh"
 #include "util/base64.hh"
+#include "util/exception.hh"
 #include "util/iterator.hh"
 #include "util/units.hh"
+#include "util/util.hh"
 
 using namespace std;
 using namespace gg;
@@ -45,9 +51,21 @@ MeowExecutionEngine::MeowExecutionEngine( const size_t max_jobs,
                                           const Address & listen_addr )
   : ExecutionEngine( max_jobs ), credentials_( credentials ), region_( region ),
     aws_addr_( LambdaInvocationRequest::endpoint( region_ ), "https" ),
-    listen_addr_( listen_addr ), listen_socket_()
+    listen_addr_( listen_addr ), listen_socket_(),
+    relay_timer_( CheckSystemCall( "timerfd_create",
+                                   timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC ) ) )
 {}
 
+MeowExecutionEngine::~MeowExecutionEngine()
+{
+  if ( bytes_shipped_ + bytes_relayed_ + bytes_from_backend_ + bytes_saved_ > 0 ) {
+    cerr << "[meow] shipped " << format_bytes( bytes_shipped_ ) << " to workers, "
+         << format_bytes( bytes_relayed_ ) << " between workers, "
+         << format_bytes( bytes_from_backend_ ) << " left to storage, "
+         << format_bytes( bytes_saved_ ) << " was already there" << endl;
+  }
+}
+
 void MeowExecutionEngine::init( ExecutionLoop & exec_loop )
 {
   exec_loop.make_listener( { "0.0.0.0", listen_addr_.port() },
@@ -72,8 +90,9 @@ void MeowExecutionEngine::init( ExecutionLoop & exec_loop )
 
             case Message::OpCode::Put:
             {
+              /* an object we asked this worker for */
               const string hash = handle_put_message( message );
-              // cerr << "[meow:worker@" << id << ":put] " << hash << endl;
+              relay_object( hash );
               break;
             }
 
@@ -90,13 +109,20 @@ void MeowExecutionEngine::init( ExecutionLoop & exec_loop )
                 // XXX gg::remote::set_available( output.hash() );
 
                 if ( output.data().length() ) {
-                  roost::atomic_create( base64::decode( output.data() ),
-                                        gg::paths::blob( output.hash() ) );
+                  gg::blobs::insert( output.hash(), base64::decode( output.data() ) );
                 }
               }
 
               gg::cache::insert( thunk_hash, execution_response.outputs( 0 ).hash() );
-              lambdas_.at( id ).state = Lambda::State::Idle;
+
+              /* the outputs stay on the worker, for the thunks that need them */
+              Lambda & lambda = lambdas_.at( id );
+              for ( const auto & output : execution_response.outputs() ) {
+                lambda.objects.touch( output.hash() );
+              }
+
+              lambda.fetching.clear();
+              lambda.state = Lambda::State::Idle;
               free_lambdas_.insert( id );
               running_jobs_--;
 
@@ -143,35 +169,186 @@ void MeowExecutionEngine::init( ExecutionLoop & exec_loop )
     }
   );
 
+  const timespec interval { RELAY_TIMEOUT.count() / 2, 0 };
+  const itimerspec timer_spec { interval, interval };
+  CheckSystemCall( "timerfd_settime",
+                   timerfd_settime( relay_timer_.fd_num(), 0, &timer_spec, nullptr ) );
+
+  exec_loop.poller().add_action( Poller::Action( relay_timer_, Direction::In,
+    [this] ()
+    {
+      relay_timer_.read();
+      expire_relays();
+      return ResultType::Continue;
+    } ) );
+
   cerr << "[meow] Listening for incoming connections on " << listen_addr_.str() << endl;
 }
 
+constexpr size_t MeowExecutionEngine::WORKER_CACHE_SIZE;
+constexpr chrono::seconds MeowExecutionEngine::RELAY_TIMEOUT;
+
+size_t MeowExecutionEngine::Lambda::missing_bytes( const Thunk & thunk ) const
+{
+  size_t missing = 0;
+
+  for ( const auto & item : join_containers( thunk.values(), thunk.executables() ) ) {
+    if ( not objects.contains( item.first ) ) {
+      missing += gg::hash::size( item.first );
+    }
+  }
+
+  return missing;
+}
+
+Optional<uint64_t> MeowExecutionEngine::find_holder( const string & hash,
+                                                     const uint64_t exclude ) const
+{
+  for ( const auto & lambda : lambdas_ ) {
+    if ( lambda.first != exclude and lambda.second.holds( hash ) ) {
+      return { true, lambda.first };
+    }
+  }
+
+  return {};
+}
+
 void MeowExecutionEngine::prepare_lambda( Lambda & lambda, const Thunk & thunk )
 {
-  /** (1) send all the dependencies **/
-  unordered_set<string> lambda_objects;
+  /** (1) get the worker the dependencies that it doesn't have: from our
+      disk, or from another worker that has them. anything else the worker
+      fetches from the storage backend itself. **/
+  unordered_set<string> thunk_objects;
+  size_t shipped = 0;
+  size_t relayed = 0;
+  size_t from_backend = 0;
+  size_t saved = 0;
+
   for ( const auto & item : join_containers( thunk.values(), thunk.executables() ) ) {
-    if ( not lambda.objects.count( item.first ) /* XXX and
-         not gg::remote::is_available( item.first ) */ ) {
-      lambda.connection->enqueue_write( meow::create_put_message( item.first ).str() );
+    const string & hash = item.first;
+
+    if ( not thunk_objects.insert( hash ).second ) {
+      continue;
     }
 
-    lambda_objects.insert( item.first );
+    if ( lambda.objects.contains( hash ) ) {
+      saved += gg::hash::size( hash );
+    }
+    else if ( gg::blobs::exists( hash ) ) {
+      meow::send_put_message( *lambda.connection, hash );
+      shipped += gg::hash::size( hash );
+    }
+    else {
+      Optional<uint64_t> holder = find_holder( hash, lambda.id );
+
+      if ( holder.initialized() ) {
+        Relay & relay = relays_[ hash ];
+
+        if ( relay.waiting.empty() ) {
+          Message get_message { Message::OpCode::Get, string { hash } };
+          lambdas_.at( *holder ).connection->enqueue_write( get_message.str() );
+          relay.deadline = chrono::steady_clock::now() + RELAY_TIMEOUT;
+        }
+
+        relay.waiting.push_back( lambda.id );
+        lambda.awaiting.insert( hash );
+        relayed += gg::hash::size( hash );
+      }
+      else {
+        lambda.fetching.insert( hash );
+        from_backend += gg::hash::size( hash );
+      }
+    }
+
+    lambda.objects.touch( hash );
   }
 
-  lambda.objects = move( lambda_objects );
+  /** (2) make room for them, without dropping what this thunk needs **/
+  const vector<string> evicted = lambda.objects.evict( thunk_objects );
 
-  /** (2) send the request for thunk execution */
-  lambda.connection->enqueue_write( meow::create_execute_message( thunk ).str() );
+  if ( not evicted.empty() ) {
+    lambda.connection->enqueue_write( meow::create_drop_message( evicted ).str() );
+  }
+
+  bytes_shipped_ += shipped;
+  bytes_relayed_ += relayed;
+  bytes_from_backend_ += from_backend;
+  bytes_saved_ += saved;
+
+  cerr << "[meow] force " << thunk.hash() << " on worker@" << lambda.id
+       << " (shipped " << format_bytes( shipped )
+       << ", from peers " << format_bytes( relayed )
+       << ", from storage " << format_bytes( from_backend )
+       << ", already there " << format_bytes( saved ) << ")" << endl;
 
   /** (3) update Lambda's state **/
   lambda.state = Lambda::State::Busy;
   free_lambdas_.erase( lambda.id );
   lambda.executing_thunk.reset( thunk );
 
-  /** (4) ??? **/
+  /** (4) send the request for thunk execution, unless it has to wait **/
+  if ( lambda.awaiting.empty() ) {
+    start_execution( lambda );
+  }
+}
+
+void MeowExecutionEngine::start_execution( Lambda & lambda )
+{
+  lambda.connection->enqueue_write( meow::create_execute_message( *lambda.executing_thunk ).str() );
+}
+
+void MeowExecutionEngine::relay_object( const string & hash )
+{
+  auto relay = relays_.find( hash );
+
+  if ( relay == relays_.end() ) {
+    return;
+  }
+
+  for ( const uint64_t id : relay->second.waiting ) {
+    Lambda & lambda = lambdas_.at( id );
+    meow::send_put_message( *lambda.connection, hash );
+    lambda.awaiting.erase( hash );
+
+    if ( lambda.awaiting.empty() ) {
+      start_execution( lambda );
+    }
+  }
+
+  relays_.erase( relay );
+}
+
+void MeowExecutionEngine::expire_relays()
+{
+  const auto now = chrono::steady_clock::now();
+
+  for ( auto relay = relays_.begin(); relay != relays_.end(); ) {
+    if ( now < relay->second.deadline ) {
+      relay++;
+      continue;
+    }
+
+    /* the holder ran the thunk with --put-output, so the object is in the
+       storage backend. if it still shows up, relay_object() ignores it. */
+    const string & hash = relay->first;
+    const size_t size = gg::hash::size( hash ) * relay->second.waiting.size();
+
+    cerr << "[meow] relay of " << hash << " timed out, fetching it from storage" << endl;
+
+    for ( const uint64_t id : relay->second.waiting ) {
+      Lambda & lambda = lambdas_.at( id );
+      lambda.awaiting.erase( hash );
+      lambda.fetching.insert( hash );
 
-  /** (5) PROFIT **/
+      if ( lambda.awaiting.empty() ) {
+        start_execution( lambda );
+      }
+    }
+
+    bytes_relayed_ -= size;
+    bytes_from_backend_ += size;
+    relay = relays_.erase( relay );
+  }
 }
 
 uint64_t MeowExecutionEngine::pick_lambda( const Thunk & thunk,
@@ -187,37 +364,22 @@ uint64_t MeowExecutionEngine::pick_lambda( const Thunk & thunk,
 
   case SelectionStrategy::MostObjects:
   {
-    size_t max_common_size = 0;
-    size_t selected_lambda = numeric_limits<size_t>::max();
-
-    unordered_set<string> thunk_objects;
-    for ( const auto & item : join_containers( thunk.values(), thunk.executables() ) ) {
-      thunk_objects.insert( item.first );
-    }
+    /* the worker that needs the fewest bytes shipped to it */
+    uint64_t selected_lambda = *free_lambdas_.begin();
+    size_t min_missing = numeric_limits<size_t>::max();
 
     for ( const auto & free_lambda : free_lambdas_ ) {
-      const Lambda & lambda = lambdas_.at( free_lambda );
-      size_t common_size = 0;
-
-      for ( const string & obj : thunk_objects ) {
-        if ( lambda.objects.count( obj ) ) {
-          common_size += gg::hash::size( obj );
-        }
-      }
+      const size_t missing = lambdas_.at( free_lambda ).missing_bytes( thunk );
 
-      if ( common_size > max_common_size ) {
+      if ( missing < min_missing ) {
         selected_lambda = free_lambda;
-        max_common_size = common_size;
+        min_missing = missing;
+
+        if ( missing == 0 ) { break; }
       }
     }
 
-    if ( selected_lambda != numeric_limits<size_t>::max() ) {
-      cerr << "picked a lambda with " << max_common_size << " bytes in common" << endl;
-      return selected_lambda;
-    }
-    else {
-      return *free_lambdas_.begin();
-    }
+    return selected_lambda;
   }
 
   case SelectionStrategy::LargestObject:
@@ -235,7 +397,7 @@ uint64_t MeowExecutionEngine::pick_lambda( const Thunk & thunk,
 
     if ( largest_hash.length() ) {
       for ( const auto & free_lambda : free_lambdas_ ) {
-        if ( lambdas_.at( free_lambda ).objects.count( largest_hash ) ) {
+        if ( lambdas_.at( free_lambda ).objects.contains( largest_hash ) ) {
           return free_lambda;
         }
       }
@@ -254,7 +416,6 @@ uint64_t MeowExecutionEngine::pick_lambda( const Thunk & thunk,
 
 void MeowExecutionEngine::force_thunk( const Thunk & thunk, ExecutionLoop & loop )
 {
-  cerr << "[meow] force " << thunk.hash() << endl;
   running_jobs_++;
   /* do we have a free Lambda for this? */
   if ( free_lambdas_.size() > 0 ) {
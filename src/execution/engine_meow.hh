@@ -5,18 +5,30 @@
 
 #include <vector>
 #include <memory>
+#include <chrono>
 #include <queue>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "engine.hh"
+#include "execution/meow/object_cache.hh"
 #include "net/address.hh"
 #include "net/aws.hh"
 #include "net/lambda.hh"
 #include "net/socket.hh"
+#include "util/file_descriptor.hh"
+#include "util/units.hh"
 
 class MeowExecutionEngine : public ExecutionEngine
 {
 private:
+  /* how much of a worker's disk the coordinator lets its objects take */
+  static constexpr size_t WORKER_CACHE_SIZE = 256_MiB;
+
+  /* how long a worker waits for an object from another worker, before it
+     fetches the object from the storage backend instead */
+  static constexpr std::chrono::seconds RELAY_TIMEOUT { 10 };
+
   struct Lambda
   {
     enum class State { Idle, Busy };
@@ -24,11 +36,28 @@ private:
     size_t id;
     State state { State::Idle };
     std::shared_ptr<TCPConnection> connection;
-    std::unordered_set<std::string> objects {};
+    meow::ObjectCache objects { WORKER_CACHE_SIZE };
     Optional<gg::thunk::Thunk> executing_thunk {};
 
+    /* objects that are on their way from other workers; the thunk is sent
+       for execution once they're all here */
+    std::unordered_set<std::string> awaiting {};
+
+    /* objects the worker is fetching from the storage backend; they're
+       only there once the thunk is done */
+    std::unordered_set<std::string> fetching {};
+
+    bool holds( const std::string & hash ) const
+    {
+      return objects.contains( hash ) and not awaiting.count( hash )
+             and not fetching.count( hash );
+    }
+
     Lambda( const size_t id, std::shared_ptr<TCPConnection> && connection )
       : id( id ), connection( std::move( connection ) ) {}
+
+    /* the bytes of this thunk's inputs that the worker doesn't have */
+    size_t missing_bytes( const gg::thunk::Thunk & thunk ) const;
   };
 
   enum class SelectionStrategy
@@ -50,17 +79,43 @@ private:
 
   std::queue<gg::thunk::Thunk> thunks_queue_ {};
 
+  struct Relay
+  {
+    std::vector<uint64_t> waiting {};
+    std::chrono::steady_clock::time_point deadline {};
+  };
+
+  /* objects requested from a worker -> the workers waiting for them */
+  std::unordered_map<std::string, Relay> relays_ {};
+
+  /* goes off every RELAY_TIMEOUT / 2, to look for the relays that are late */
+  FileDescriptor relay_timer_;
+
+  size_t bytes_shipped_ { 0 };
+  size_t bytes_relayed_ { 0 };
+  size_t bytes_from_backend_ { 0 };
+  size_t bytes_saved_ { 0 };
+
   HTTPRequest generate_request();
 
   uint64_t pick_lambda( const gg::thunk::Thunk & thunk,
                         const SelectionStrategy s = SelectionStrategy::First );
 
   void prepare_lambda( Lambda & lambda, const gg::thunk::Thunk & thunk );
+  void start_execution( Lambda & lambda );
+
+  /* a worker, other than `exclude`, that has the object on its disk */
+  Optional<uint64_t> find_holder( const std::string & hash, const uint64_t exclude ) const;
+
+  void relay_object( const std::string & hash );
+  void expire_relays();
 
 public:
   MeowExecutionEngine( const size_t max_jobs, const AWSCredentials & credentials,
                        const std::string & region, const Address & listen_addr );
 
+  ~MeowExecutionEngine();
+
   void init( ExecutionLoop & loop ) override;
 
   void force_thunk( const gg::thunk::Thunk & thunk,
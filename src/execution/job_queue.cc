@@ -0,0 +1,43 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "job_queue.hh"
+
+#include <stdexcept>
+
+using namespace std;
+
+void JobQueue::push( const string & hash, const double priority )
+{
+  queue_.push( { hash,
+                 ( policy_ == Policy::FIFO ) ? 0.0 : priority,
+                 next_back_++ } );
+}
+
+void JobQueue::push_front( Entry && entry )
+{
+  entry.sequence = next_front_--;
+  queue_.push( move( entry ) );
+}
+
+JobQueue::Entry JobQueue::pop()
+{
+  if ( queue_.empty() ) {
+    throw runtime_error( "job queue is empty" );
+  }
+
+  Entry entry = queue_.top();
+  queue_.pop();
+  return entry;
+}
+
+JobQueue::Policy JobQueue::parse_policy( const string & name )
+{
+  if ( name == "fifo" ) {
+    return Policy::FIFO;
+  }
+  else if ( name == "critical-path" ) {
+    return Policy::CriticalPath;
+  }
+
+  throw runtime_error( "unknown scheduling policy: " + name );
+}
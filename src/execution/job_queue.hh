@@ -0,0 +1,67 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef JOB_QUEUE_HH
+#define JOB_QUEUE_HH
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <cstdint>
+
+/* The queue of thunks that are ready to be executed. With the FIFO policy,
+   the jobs are handed out in the order they became ready; with the
+   CriticalPath policy, the job with the highest priority (the longest
+   remaining path to a target) goes first, and ties are broken in FIFO
+   order. */
+class JobQueue
+{
+public:
+  enum class Policy { FIFO, CriticalPath };
+
+  struct Entry
+  {
+    std::string hash;
+    double priority;
+    int64_t sequence;
+  };
+
+private:
+  struct Compare
+  {
+    bool operator()( const Entry & a, const Entry & b ) const
+    {
+      if ( a.priority != b.priority ) {
+        return a.priority < b.priority;
+      }
+
+      return a.sequence > b.sequence;
+    }
+  };
+
+  Policy policy_;
+  std::priority_queue<Entry, std::vector<Entry>, Compare> queue_ {};
+
+  int64_t next_back_ { 0 };
+  int64_t next_front_ { -1 };
+
+public:
+  JobQueue( const Policy policy = Policy::CriticalPath )
+    : policy_( policy )
+  {}
+
+  /* adds a job behind all the other jobs with the same priority */
+  void push( const std::string & hash, const double priority = 0.0 );
+
+  /* puts back a job that was just popped, ahead of its peers */
+  void push_front( Entry && entry );
+
+  Entry pop();
+
+  bool empty() const { return queue_.empty(); }
+  size_t size() const { return queue_.size(); }
+  Policy policy() const { return policy_; }
+
+  static Policy parse_policy( const std::string & name );
+};
+
+#endif /* JOB_QUEUE_HH */
@@ -3,6 +3,7 @@
 #include "loop.hh"
 
 #include <stdexcept>
+#include <fcntl.h>
 
 #include "net/http_response_parser.hh"
 #include "thunk/ggutils.hh"
@@ -26,13 +27,22 @@ ExecutionLoop::ExecutionLoop()
       [&]() { return handle_signal( signal_fd_.read_signal() ); },
       [&]() { return ( child_processes_.size() > 0 or
                        connections_.size() > 0 or
-                       ssl_connections_.size() > 0 ); }
+                       ssl_connections_.size() > 0 or
+                       ipc_connections_.size() > 0 ); }
     )
   );
 }
 
 Poller::Result ExecutionLoop::loop_once( const int timeout_ms )
 {
+  const auto now = chrono::steady_clock::now();
+
+  if ( now >= next_reap_ ) {
+    reap_idle_connections<TCPConnection>( now );
+    reap_idle_connections<SSLConnection>( now );
+    next_reap_ = now + 1s;
+  }
+
   return poller_.poll( timeout_ms );
 }
 
@@ -52,6 +62,14 @@ ExecutionLoop::create_connection( NBSecureSocket && socket )
                                    make_shared<SSLConnection>( move( socket ) ) );
 }
 
+template<>
+typename list<shared_ptr<IPCConnection>>::iterator
+ExecutionLoop::create_connection( IPCSocket && socket )
+{
+  return ipc_connections_.emplace( ipc_connections_.end(),
+                                   make_shared<IPCConnection>( move( socket ) ) );
+}
+
 template<>
 void ExecutionLoop::remove_connection<TCPConnection>( const list<shared_ptr<TCPConnection>>::iterator & it )
 {
@@ -65,20 +83,52 @@ void ExecutionLoop::remove_connection<SSLConnection>( const list<shared_ptr<SSLC
 }
 
 template<>
-shared_ptr<TCPConnection>
-ExecutionLoop::add_connection( TCPSocket && socket,
-                               const function<bool(shared_ptr<TCPConnection>, string &&)> & data_callback,
-                               const function<void()> & error_callback,
-                               const function<void()> & close_callback )
+void ExecutionLoop::remove_connection<IPCConnection>( const list<shared_ptr<IPCConnection>>::iterator & it )
 {
-  auto connection_it = create_connection<TCPSocket>( move( socket ) );
-  shared_ptr<TCPConnection> & connection = *connection_it;
+  ipc_connections_.erase( it );
+}
+
+template<>
+list<shared_ptr<TCPConnection>> & ExecutionLoop::connection_list<TCPConnection>()
+{
+  return connections_;
+}
+
+template<>
+list<shared_ptr<SSLConnection>> & ExecutionLoop::connection_list<SSLConnection>()
+{
+  return ssl_connections_;
+}
+
+template<>
+unordered_map<string, ExecutionLoop::ConnectionPool<TCPConnection>> &
+ExecutionLoop::connection_pools<TCPConnection>()
+{
+  return tcp_pools_;
+}
+
+template<>
+unordered_map<string, ExecutionLoop::ConnectionPool<SSLConnection>> &
+ExecutionLoop::connection_pools<SSLConnection>()
+{
+  return ssl_pools_;
+}
+
+template<class SocketType>
+shared_ptr<Connection<SocketType>>
+ExecutionLoop::add_plain_connection( SocketType && socket,
+                                     const function<bool(shared_ptr<Connection<SocketType>>, string &&)> & data_callback,
+                                     const function<void()> & error_callback,
+                                     const function<void()> & close_callback )
+{
+  auto connection_it = create_connection<SocketType>( move( socket ) );
+  shared_ptr<Connection<SocketType>> & connection = *connection_it;
 
   auto real_close_callback =
     [connection_it, cc=move( close_callback ), this] ()
     {
       cc();
-      remove_connection<TCPConnection>( connection_it );
+      remove_connection<Connection<SocketType>>( connection_it );
     };
 
   auto fderror_callback =
@@ -93,14 +143,10 @@ ExecutionLoop::add_connection( TCPSocket && socket,
       connection->socket_, Direction::Out,
       [connection] ()
       {
-        string::const_iterator last_write =
-          connection->socket_.write( connection->write_buffer_.begin(),
-                                     connection->write_buffer_.cend() );
-
-        connection->write_buffer_.erase( 0, last_write - connection->write_buffer_.cbegin() );
+        connection->write_some();
         return ResultType::Continue;
       },
-      [connection] { return connection->write_buffer_.size(); },
+      [connection] { return connection->something_to_write(); },
       fderror_callback
     )
   );
@@ -121,7 +167,7 @@ ExecutionLoop::add_connection( TCPSocket && socket,
 
         return ResultType::Continue;
       },
-      [connection]() { return true; },
+      {},
       fderror_callback
     )
   );
@@ -129,6 +175,27 @@ ExecutionLoop::add_connection( TCPSocket && socket,
   return *connection_it;
 }
 
+template<>
+shared_ptr<TCPConnection>
+ExecutionLoop::add_connection( TCPSocket && socket,
+                               const function<bool(shared_ptr<TCPConnection>, string &&)> & data_callback,
+                               const function<void()> & error_callback,
+                               const function<void()> & close_callback )
+{
+  return add_plain_connection( move( socket ), data_callback, error_callback, close_callback );
+}
+
+template<>
+shared_ptr<IPCConnection>
+ExecutionLoop::add_connection( IPCSocket && socket,
+                               const function<bool(shared_ptr<IPCConnection>, string &&)> & data_callback,
+                               const function<void()> & error_callback,
+                               const function<void()> & close_callback )
+{
+  socket.set_blocking( false );
+  return add_plain_connection( move( socket ), data_callback, error_callback, close_callback );
+}
+
 template<>
 shared_ptr<SSLConnection>
 ExecutionLoop::add_connection( NBSecureSocket && socket,
@@ -159,11 +226,16 @@ ExecutionLoop::add_connection( NBSecureSocket && socket,
       connection->socket_, Direction::Out,
       [connection] ()
       {
-        connection->socket_.ezwrite( move( connection->write_buffer_ ) );
-        connection->write_buffer_ = string {};
+        connection->refill_write_buffer();
+
+        if ( connection->write_buffer_.size() ) {
+          connection->socket_.ezwrite( move( connection->write_buffer_ ) );
+          connection->write_buffer_ = string {};
+        }
+
         return ResultType::Continue;
       },
-      [connection] { return connection->write_buffer_.size(); },
+      [connection] { return connection->something_to_write(); },
       fderror_callback
     )
   );
@@ -184,7 +256,7 @@ ExecutionLoop::add_connection( NBSecureSocket && socket,
 
         return ResultType::Continue;
       },
-      [connection]() { return true; },
+      {},
       fderror_callback
     )
   );
@@ -227,18 +299,24 @@ uint64_t ExecutionLoop::make_http_request( const string & tag,
                                            const Address & address,
                                            const HTTPRequest & request,
                                            HTTPResponseCallbackFunc response_callback,
-                                           FailureCallbackFunc failure_callback )
+                                           FailureCallbackFunc failure_callback,
+                                           const HTTPMessage::BodySink & body_sink,
+                                           const string & body_filename )
 {
   const uint64_t connection_id = current_id_++;
 
   auto parser = make_shared<HTTPResponseParser>();
-  parser->new_request_arrived( request );
+  parser->new_request_arrived( request, body_sink );
+
+  /* the response and failure callbacks are called at most once between them */
+  auto finished = make_shared<bool>( false );
 
   auto data_callback =
-    [parser, connection_id, tag, response_callback] ( shared_ptr<ConnectionType>, string && data ) {
+    [parser, finished, connection_id, tag, response_callback] ( shared_ptr<ConnectionType>, string && data ) {
       parser->parse( data );
 
       if ( not parser->empty() ) {
+        *finished = true;
         response_callback( connection_id, tag, parser->front() );
         parser->pop();
         return false;
@@ -248,18 +326,260 @@ uint64_t ExecutionLoop::make_http_request( const string & tag,
     };
 
   auto error_callback =
-    [connection_id, tag, failure_callback]
-    { failure_callback( connection_id, tag ); };
+    [finished, connection_id, tag, failure_callback]
+    {
+      if ( not *finished ) {
+        *finished = true;
+        failure_callback( connection_id, tag );
+      }
+    };
 
-  auto close_callback = [] {};
+  /* a connection that is closed before the response arrives has failed */
+  auto close_callback = error_callback;
 
   auto connection = make_connection<ConnectionType>( address, data_callback, error_callback, close_callback );
 
-  connection->write_buffer_ = move( request.str() );
+  if ( body_filename.empty() ) {
+    connection->write_buffer_ = move( request.str() );
+  }
+  else {
+    connection->write_buffer_ = request.headers_str();
+    connection->enqueue_file( FileDescriptor { CheckSystemCall( "open (" + body_filename + ")",
+                                                                open( body_filename.c_str(), O_RDONLY ) ) } );
+  }
 
   return connection_id;
 }
 
+template<class ConnectionType>
+ExecutionLoop::ConnectionPool<ConnectionType> &
+ExecutionLoop::connection_pool( const Address & address )
+{
+  auto & pools = connection_pools<ConnectionType>();
+  const string endpoint = address.str();
+
+  auto pool_it = pools.find( endpoint );
+
+  if ( pool_it == pools.end() ) {
+    pool_it = pools.emplace( piecewise_construct, forward_as_tuple( endpoint ),
+                             forward_as_tuple( address, default_pool_options_ ) ).first;
+  }
+
+  return pool_it->second;
+}
+
+template<class ConnectionType>
+void ExecutionLoop::set_pool_options( const Address & address,
+                                      const ConnectionPoolOptions & options )
+{
+  if ( options.pipeline_depth == 0 ) {
+    throw runtime_error( "pipeline depth cannot be zero" );
+  }
+
+  connection_pool<ConnectionType>( address ).options = options;
+}
+
+template<class ConnectionType>
+shared_ptr<ExecutionLoop::PooledConnection<ConnectionType>>
+ExecutionLoop::open_pooled_connection( const string & endpoint,
+                                       ConnectionPool<ConnectionType> & pool )
+{
+  auto pooled = make_shared<PooledConnection<ConnectionType>>();
+
+  auto data_callback =
+    [pooled] ( shared_ptr<ConnectionType>, string && data )
+    {
+      pooled->parser.parse( data );
+
+      while ( not pooled->parser.empty() ) {
+        const HTTPResponse & response = pooled->parser.front();
+
+        if ( response.has_header( "Connection" ) and
+             response.get_header_value( "Connection" ) == "close" ) {
+          pooled->closing = true;
+        }
+
+        PooledRequest request = move( pooled->in_flight.front() );
+        pooled->in_flight.pop_front();
+
+        if ( pooled->in_flight.empty() ) {
+          pooled->idle_since = chrono::steady_clock::now();
+        }
+
+        request.response_callback( request.id, request.tag, response );
+        pooled->parser.pop();
+      }
+
+      /* a connection the server is closing is let go once it's drained */
+      return not ( pooled->closing and pooled->in_flight.empty() );
+    };
+
+  /* called on errors and when the connection is closed, by either side */
+  auto close_callback =
+    [this, endpoint, pooled]
+    {
+      if ( not pooled->closed ) {
+        close_pooled_connection<ConnectionType>( endpoint, pooled );
+      }
+    };
+
+  pooled->connection = make_connection<ConnectionType>( pool.address, data_callback,
+                                                        close_callback, close_callback );
+  pool.connections.push_back( pooled );
+  pool_stats_.connections_opened++;
+
+  return pooled;
+}
+
+template<class ConnectionType>
+void ExecutionLoop::send_pooled_request( PooledConnection<ConnectionType> & pooled,
+                                         PooledRequest && request )
+{
+  HTTPMessage::BodySink body_sink {};
+
+  if ( request.body_sink ) {
+    body_sink =
+      [started=request.body_started, sink=request.body_sink] ( const string & data )
+      {
+        *started = true;
+        sink( data );
+      };
+  }
+
+  pooled.parser.new_request_arrived( request.request, body_sink );
+
+  if ( request.body_filename.empty() ) {
+    pooled.connection->enqueue_write( request.request.str() );
+  }
+  else {
+    pooled.connection->enqueue_write( request.request.headers_str() );
+    pooled.connection->enqueue_file(
+      FileDescriptor { CheckSystemCall( "open (" + request.body_filename + ")",
+                                        open( request.body_filename.c_str(), O_RDONLY ) ) } );
+  }
+
+  request.reused_connection = ( pooled.requests_sent > 0 );
+
+  if ( request.reused_connection and pooled.in_flight.empty() ) {
+    pool_stats_.handshakes_avoided++;
+  }
+  else if ( not pooled.in_flight.empty() ) {
+    pool_stats_.pipelined_requests++;
+  }
+
+  pooled.requests_sent++;
+  pooled.in_flight.push_back( move( request ) );
+}
+
+template<class ConnectionType>
+void ExecutionLoop::dispatch_pooled_requests( const string & endpoint )
+{
+  ConnectionPool<ConnectionType> & pool = connection_pools<ConnectionType>().at( endpoint );
+
+  while ( not pool.waiting.empty() ) {
+    shared_ptr<PooledConnection<ConnectionType>> best;
+
+    for ( const auto & pooled : pool.connections ) {
+      if ( pooled->closing or
+           pooled->in_flight.size() >= pool.options.pipeline_depth ) {
+        continue;
+      }
+
+      if ( not best or pooled->in_flight.size() < best->in_flight.size() ) {
+        best = pooled;
+      }
+    }
+
+    /* rather open a new connection than pipeline behind another request */
+    if ( ( not best or best->in_flight.size() ) and
+         ( pool.options.max_connections == 0 or
+           pool.connections.size() < pool.options.max_connections ) ) {
+      best = open_pooled_connection<ConnectionType>( endpoint, pool );
+    }
+
+    if ( not best ) {
+      break;
+    }
+
+    send_pooled_request<ConnectionType>( *best, move( pool.waiting.front() ) );
+    pool.waiting.pop_front();
+  }
+}
+
+template<class ConnectionType>
+void ExecutionLoop::close_pooled_connection( const string & endpoint,
+                                             const shared_ptr<PooledConnection<ConnectionType>> & pooled )
+{
+  ConnectionPool<ConnectionType> & pool = connection_pools<ConnectionType>().at( endpoint );
+
+  pooled->closed = true;
+  pool.connections.remove( pooled );
+
+  deque<PooledRequest> in_flight = move( pooled->in_flight );
+  pooled->in_flight.clear();
+
+  /* a request that went out on a reused connection may have raced the server
+     closing it; unless it already got part of its response, try it again */
+  for ( auto it = in_flight.rbegin(); it != in_flight.rend(); it++ ) {
+    if ( it->reused_connection and not it->retried and not *it->body_started ) {
+      it->retried = true;
+      pool_stats_.retried_requests++;
+      pool.waiting.push_front( move( *it ) );
+    }
+    else {
+      it->failure_callback( it->id, it->tag );
+    }
+  }
+
+  dispatch_pooled_requests<ConnectionType>( endpoint );
+}
+
+template<class ConnectionType>
+void ExecutionLoop::reap_idle_connections( const chrono::steady_clock::time_point & now )
+{
+  for ( auto & endpoint_pool : connection_pools<ConnectionType>() ) {
+    ConnectionPool<ConnectionType> & pool = endpoint_pool.second;
+
+    for ( auto it = pool.connections.begin(); it != pool.connections.end(); ) {
+      PooledConnection<ConnectionType> & pooled = **it;
+
+      if ( pooled.in_flight.empty() and
+           not pooled.connection->something_to_write() and
+           now - pooled.idle_since > pool.options.idle_timeout ) {
+        pooled.closed = true;
+        poller_.remove_actions( { pooled.connection->socket_.fd_num() } );
+        connection_list<ConnectionType>().remove( pooled.connection );
+        it = pool.connections.erase( it );
+        pool_stats_.connections_reaped++;
+      }
+      else {
+        it++;
+      }
+    }
+  }
+}
+
+template<class ConnectionType>
+uint64_t ExecutionLoop::make_pooled_http_request( const string & tag,
+                                                  const Address & address,
+                                                  const HTTPRequest & request,
+                                                  HTTPResponseCallbackFunc response_callback,
+                                                  FailureCallbackFunc failure_callback,
+                                                  const HTTPMessage::BodySink & body_sink,
+                                                  const string & body_filename )
+{
+  const uint64_t request_id = current_id_++;
+
+  connection_pool<ConnectionType>( address ).waiting.push_back(
+    { request_id, tag, request, response_callback, failure_callback,
+      body_sink, body_filename } );
+
+  pool_stats_.requests++;
+  dispatch_pooled_requests<ConnectionType>( address.str() );
+
+  return request_id;
+}
+
 uint64_t ExecutionLoop::make_listener( const Address & address,
                                        const function<bool(ExecutionLoop &,
                                                            TCPSocket &&)> & connection_callback )
@@ -288,16 +608,57 @@ uint64_t ExecutionLoop::make_listener( const Address & address,
   return current_id_++;
 }
 
+uint64_t ExecutionLoop::make_ipc_listener( const string & path,
+                                           const function<bool(ExecutionLoop &,
+                                                               IPCSocket &&)> & connection_callback )
+{
+  IPCSocket socket;
+  socket.bind( path );
+  socket.listen();
+
+  auto connection_it = create_connection<IPCSocket>( move( socket ) );
+  shared_ptr<IPCConnection> & connection_ptr = *connection_it;
+
+  poller_.add_action( Poller::Action( (*connection_it)->socket_,
+    Direction::In,
+    [connection_ptr, connection_it, connection_callback, this] () -> ResultType
+    {
+      if ( not connection_callback( *this, IPCSocket { connection_ptr->socket_.accept() } ) ) {
+        remove_connection<IPCConnection>( connection_it );
+        return ResultType::CancelAll;
+      }
+
+      return ResultType::Continue;
+    } ) );
+
+  return current_id_++;
+}
+
 uint64_t ExecutionLoop::add_child_process( const string & tag,
                                            LocalCallbackFunc callback,
                                            function<int()> && child_procedure,
-                                           const bool throw_if_failed )
+                                           const bool throw_if_failed,
+                                           const int termination_signal )
 {
   child_processes_.emplace_back( current_id_, throw_if_failed, callback,
-                                 ChildProcess( tag, move( child_procedure ) ) );
+                                 ChildProcess( tag, move( child_procedure ),
+                                               termination_signal ) );
   return current_id_++;
 }
 
+void ExecutionLoop::kill_child_process( const uint64_t id )
+{
+  for ( auto & child : child_processes_ ) {
+    if ( get<0>( child ) == id ) {
+      /* it's reaped as usual, but nobody hears about it */
+      get<1>( child ) = false;
+      get<2>( child ) = [] ( const uint64_t, const string &, const int ) {};
+      get<3>( child ).signal( SIGKILL );
+      return;
+    }
+  }
+}
+
 Poller::Action::Result ExecutionLoop::handle_signal( const signalfd_siginfo & sig )
 {
   switch ( sig.ssi_signo ) {
@@ -357,11 +718,41 @@ uint64_t ExecutionLoop::make_http_request<TCPConnection>( const string &,
                                                           const Address &,
                                                           const HTTPRequest &,
                                                           HTTPResponseCallbackFunc,
-                                                          FailureCallbackFunc );
+                                                          FailureCallbackFunc,
+                                                          const HTTPMessage::BodySink &,
+                                                          const string & );
 
 template
 uint64_t ExecutionLoop::make_http_request<SSLConnection>( const string &,
                                                           const Address &,
                                                           const HTTPRequest &,
                                                           HTTPResponseCallbackFunc,
-                                                          FailureCallbackFunc );
+                                                          FailureCallbackFunc,
+                                                          const HTTPMessage::BodySink &,
+                                                          const string & );
+
+template
+uint64_t ExecutionLoop::make_pooled_http_request<TCPConnection>( const string &,
+                                                                 const Address &,
+                                                                 const HTTPRequest &,
+                                                                 HTTPResponseCallbackFunc,
+                                                                 FailureCallbackFunc,
+                                                                 const HTTPMessage::BodySink &,
+                                                                 const string & );
+
+template
+uint64_t ExecutionLoop::make_pooled_http_request<SSLConnection>( const string &,
+                                                                 const Address &,
+                                                                 const HTTPRequest &,
+                                                                 HTTPResponseCallbackFunc,
+                                                                 FailureCallbackFunc,
+                                                                 const HTTPMessage::BodySink &,
+                                                                 const string & );
+
+template
+void ExecutionLoop::set_pool_options<TCPConnection>( const Address &,
+                                                     const ConnectionPoolOptions & );
+
+template
+void ExecutionLoop::set_pool_options<SSLConnection>( const Address &,
+                                                     const ConnectionPoolOptions & );
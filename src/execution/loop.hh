@@ -4,7 +4,10 @@
 #define LOOP_HH
 
 #include <list>
+#include <deque>
 #include <vector>
+#include <chrono>
+#include <memory>
 #include <functional>
 #include <unordered_map>
 #include <type_traits>
@@ -30,7 +33,71 @@ public:
   typedef std::function<void( const uint64_t /* id */,
                               const std::string & /* tag */ )> FailureCallbackFunc;
 
+  struct ConnectionPoolOptions
+  {
+    /* the most connections kept open to the endpoint (0 means no limit);
+       once they are all open, requests are pipelined on them */
+    size_t max_connections { 0 };
+
+    /* the most requests outstanding on one connection */
+    size_t pipeline_depth { 1 };
+
+    std::chrono::milliseconds idle_timeout { 30000 };
+  };
+
+  struct ConnectionPoolStats
+  {
+    size_t requests { 0 };
+    size_t connections_opened { 0 };
+    size_t handshakes_avoided { 0 };
+    size_t pipelined_requests { 0 };
+    size_t retried_requests { 0 };
+    size_t connections_reaped { 0 };
+  };
+
 private:
+  struct PooledRequest
+  {
+    uint64_t id;
+    std::string tag;
+    HTTPRequest request;
+    HTTPResponseCallbackFunc response_callback;
+    FailureCallbackFunc failure_callback;
+    HTTPMessage::BodySink body_sink;
+    std::string body_filename;
+
+    /* set once the body sink was given any data; after that, the request
+       cannot be retried */
+    std::shared_ptr<bool> body_started { std::make_shared<bool>( false ) };
+
+    bool reused_connection { false };
+    bool retried { false };
+  };
+
+  template<class ConnectionType>
+  struct PooledConnection
+  {
+    std::shared_ptr<ConnectionType> connection { nullptr };
+    HTTPResponseParser parser {};
+    std::deque<PooledRequest> in_flight {};
+    size_t requests_sent { 0 };
+    bool closing { false };
+    bool closed { false };
+    std::chrono::steady_clock::time_point idle_since {};
+  };
+
+  template<class ConnectionType>
+  struct ConnectionPool
+  {
+    Address address;
+    ConnectionPoolOptions options;
+    std::list<std::shared_ptr<PooledConnection<ConnectionType>>> connections {};
+    std::deque<PooledRequest> waiting {};
+
+    ConnectionPool( const Address & address, const ConnectionPoolOptions & options )
+      : address( address ), options( options ) {}
+  };
+
   uint64_t current_id_{ 0 };
 
   SignalMask signals_;
@@ -40,24 +107,73 @@ private:
   std::list<std::tuple<uint64_t, bool, LocalCallbackFunc, ChildProcess>> child_processes_ {};
   std::list<std::shared_ptr<TCPConnection>> connections_ {};
   std::list<std::shared_ptr<SSLConnection>> ssl_connections_ {};
+  std::list<std::shared_ptr<IPCConnection>> ipc_connections_ {};
 
   SSLContext ssl_context_ {};
 
+  /* keep-alive connections, by endpoint */
+  std::unordered_map<std::string, ConnectionPool<TCPConnection>> tcp_pools_ {};
+  std::unordered_map<std::string, ConnectionPool<SSLConnection>> ssl_pools_ {};
+  ConnectionPoolOptions default_pool_options_ {};
+  ConnectionPoolStats pool_stats_ {};
+  std::chrono::steady_clock::time_point next_reap_ { std::chrono::steady_clock::now() };
+
   Poller::Action::Result handle_signal( const signalfd_siginfo & );
 
   template<typename SocketType>
   typename std::list<std::shared_ptr<Connection<SocketType>>>::iterator create_connection( SocketType && socket );
 
+  /* for the sockets that are read and written as they are */
+  template<class SocketType>
+  std::shared_ptr<Connection<SocketType>>
+  add_plain_connection( SocketType && socket,
+                        const std::function<bool(std::shared_ptr<Connection<SocketType>>,
+                                                 std::string &&)> & data_callback,
+                        const std::function<void()> & error_callback,
+                        const std::function<void()> & close_callback );
+
   template<typename ConnectionType>
   void remove_connection( const typename std::list<std::shared_ptr<ConnectionType>>::iterator & it );
 
+  template<class ConnectionType>
+  std::list<std::shared_ptr<ConnectionType>> & connection_list();
+
+  template<class ConnectionType>
+  std::unordered_map<std::string, ConnectionPool<ConnectionType>> & connection_pools();
+
+  template<class ConnectionType>
+  ConnectionPool<ConnectionType> & connection_pool( const Address & address );
+
+  template<class ConnectionType>
+  std::shared_ptr<PooledConnection<ConnectionType>>
+  open_pooled_connection( const std::string & endpoint,
+                          ConnectionPool<ConnectionType> & pool );
+
+  template<class ConnectionType>
+  void send_pooled_request( PooledConnection<ConnectionType> & pooled,
+                            PooledRequest && request );
+
+  template<class ConnectionType>
+  void dispatch_pooled_requests( const std::string & endpoint );
+
+  template<class ConnectionType>
+  void close_pooled_connection( const std::string & endpoint,
+                                const std::shared_ptr<PooledConnection<ConnectionType>> & pooled );
+
+  template<class ConnectionType>
+  void reap_idle_connections( const std::chrono::steady_clock::time_point & now );
+
 public:
   ExecutionLoop();
 
   uint64_t add_child_process( const std::string & tag,
                               LocalCallbackFunc callback,
                               std::function<int()> && child_procedure,
-                              const bool throw_if_failed = true );
+                              const bool throw_if_failed = true,
+                              const int termination_signal = SIGHUP );
+
+  /* the child's callback is not called */
+  void kill_child_process( const uint64_t id );
 
   template<class SocketType>
   std::shared_ptr<Connection<SocketType>>
@@ -75,18 +191,50 @@ public:
                    const std::function<void()> & error_callback = [](){},
                    const std::function<void()> & close_callback = [](){} );
 
+  /* if a body sink is given, the response body is handed to it as it
+     arrives; if a body file is given, the request is sent without its body,
+     followed by the contents of the file */
   template<class ConnectionType>
   uint64_t make_http_request( const std::string & tag,
                               const Address & address,
                               const HTTPRequest & request,
                               HTTPResponseCallbackFunc response_callback,
-                              FailureCallbackFunc failure_callback );
+                              FailureCallbackFunc failure_callback,
+                              const HTTPMessage::BodySink & body_sink = {},
+                              const std::string & body_filename = {} );
+
+  /* like make_http_request, but the request goes over a keep-alive
+     connection from the endpoint's pool */
+  template<class ConnectionType>
+  uint64_t make_pooled_http_request( const std::string & tag,
+                                     const Address & address,
+                                     const HTTPRequest & request,
+                                     HTTPResponseCallbackFunc response_callback,
+                                     FailureCallbackFunc failure_callback,
+                                     const HTTPMessage::BodySink & body_sink = {},
+                                     const std::string & body_filename = {} );
+
+  template<class ConnectionType>
+  void set_pool_options( const Address & address, const ConnectionPoolOptions & options );
+
+  /* the options of every pool that is created after this call */
+  void set_default_pool_options( const ConnectionPoolOptions & options ) { default_pool_options_ = options; }
+
+  const ConnectionPoolStats & pool_stats() const { return pool_stats_; }
 
   uint64_t make_listener( const Address & address,
                           const std::function<bool(ExecutionLoop &,
                                                    TCPSocket &&)> & connection_callback );
 
+  /* listens on a Unix domain socket at `path` */
+  uint64_t make_ipc_listener( const std::string & path,
+                              const std::function<bool(ExecutionLoop &,
+                                                       IPCSocket &&)> & connection_callback );
+
   Poller::Result loop_once( const int timeout_ms = -1 );
+
+  /* for clients that keep connections of their own on the loop (see Redis) */
+  Poller & poller() { return poller_; }
 };
 
 #endif /* LOOP_HH */
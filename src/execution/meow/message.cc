@@ -37,16 +37,20 @@ Message::Message( const OpCode opcode, string && payload )
     payload_( move( payload ) )
 {}
 
-string Message::str() const
+string Message::header( const OpCode opcode, const uint32_t payload_length )
 {
   string output;
-  output += put_field( payload_length_ );
-  output += to_underlying( opcode_ );
-  output += payload_;
+  output += put_field( payload_length );
+  output += to_underlying( opcode );
 
   return output;
 }
 
+string Message::str() const
+{
+  return header( opcode_, payload_length_ ) + payload_;
+}
+
 uint32_t Message::expected_length( const Chunk & chunk )
 {
   return 5 + ( ( chunk.size() < 5 ) ? 0 : chunk( 0, 4 ).be32() );
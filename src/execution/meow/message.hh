@@ -24,6 +24,8 @@ namespace meow {
       Executed,
       ExecutionFailed,
       Bye,
+      Drop,
+      Cancel,
     };
 
   private:
@@ -41,6 +43,9 @@ namespace meow {
 
     std::string str() const;
 
+    /* what goes before a payload of this length */
+    static std::string header( const OpCode opcode, const uint32_t payload_length );
+
     static uint32_t expected_length( const Chunk & chunk );
   };
 
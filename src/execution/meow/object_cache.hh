@@ -0,0 +1,79 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef MEOW_OBJECT_CACHE_HH
+#define MEOW_OBJECT_CACHE_HH
+
+#include <string>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "thunk/ggutils.hh"
+
+namespace meow {
+
+  /* the coordinator's view of the objects a worker holds. the worker never
+     evicts anything on its own; whatever this cache evicts is sent to the
+     worker in a Drop message, so the two stay in agreement. */
+  class ObjectCache
+  {
+  private:
+    size_t capacity_;
+    size_t size_ { 0 };
+
+    /* most recently used first */
+    std::list<std::string> lru_ {};
+    std::unordered_map<std::string, std::list<std::string>::iterator> entries_ {};
+
+  public:
+    ObjectCache( const size_t capacity ) : capacity_( capacity ) {}
+
+    bool contains( const std::string & hash ) const { return entries_.count( hash ) > 0; }
+
+    /* marks the object as the most recently used, adding it if necessary */
+    void touch( const std::string & hash )
+    {
+      auto it = entries_.find( hash );
+
+      if ( it != entries_.end() ) {
+        lru_.splice( lru_.begin(), lru_, it->second );
+        return;
+      }
+
+      lru_.push_front( hash );
+      entries_.emplace( hash, lru_.begin() );
+      size_ += gg::hash::size( hash );
+    }
+
+    /* evicts the least recently used objects until the cache fits its
+       capacity again, skipping the pinned ones; returns what was evicted */
+    std::vector<std::string> evict( const std::unordered_set<std::string> & pinned )
+    {
+      std::vector<std::string> evicted;
+
+      auto it = lru_.end();
+      while ( size_ > capacity_ and it != lru_.begin() ) {
+        --it;
+
+        if ( pinned.count( *it ) ) {
+          continue;
+        }
+
+        size_ -= gg::hash::size( *it );
+        evicted.push_back( *it );
+        entries_.erase( *it );
+        it = lru_.erase( it );
+      }
+
+      return evicted;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    size_t count() const { return entries_.size(); }
+  };
+
+}
+
+#endif /* MEOW_OBJECT_CACHE_HH */
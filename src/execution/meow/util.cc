@@ -2,11 +2,18 @@
 
 #include "util.hh"
 
+#include <algorithm>
+#include <fcntl.h>
+
 #include "protobufs/gg.pb.h"
 #include "protobufs/util.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "util/path.hh"
 #include "thunk/thunk.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/tokenize.hh"
 
 using namespace std;
 using namespace gg;
@@ -23,15 +30,18 @@ string meow::handle_put_message( const Message & message )
                     : ObjectType::Thunk;
 
   const string hash = gg::hash::compute( data, type );
-  roost::atomic_create( data, gg::paths::blob( hash ) );
+  gg::blobs::insert( hash, data );
 
   return hash;
 }
 
-Message meow::create_put_message( const string & hash )
+void meow::send_put_message( TCPConnection & connection, const string & hash )
 {
-  string requested_file = roost::read_file( gg::paths::blob( hash ) );
-  return { Message::OpCode::Put, move( requested_file ) };
+  const string path = gg::blobs::path( hash ).string();
+
+  connection.enqueue_write( Message::header( Message::OpCode::Put, gg::hash::size( hash ) ) );
+  connection.enqueue_file( FileDescriptor { CheckSystemCall( "open (" + path + ")",
+                                                             open( path.c_str(), O_RDONLY ) ) } );
 }
 
 Message meow::create_execute_message( const Thunk & thunk )
@@ -39,3 +49,34 @@ Message meow::create_execute_message( const Thunk & thunk )
   string execution_payload = protoutil::to_string( Thunk::execution_request( thunk ) );
   return { Message::OpCode::Execute, move( execution_payload ) };
 }
+
+Message meow::create_drop_message( const vector<string> & hashes )
+{
+  string payload;
+
+  for ( const string & hash : hashes ) {
+    payload += hash;
+    payload += '\n';
+  }
+
+  return { Message::OpCode::Drop, move( payload ) };
+}
+
+vector<string> meow::handle_drop_message( const Message & message )
+{
+  assert( message.opcode() == Message::OpCode::Drop );
+
+  vector<string> hashes = split( message.payload(), "\n" );
+  hashes.erase( remove( hashes.begin(), hashes.end(), "" ), hashes.end() );
+
+  for ( const string & hash : hashes ) {
+    /* packed objects are small, and stay where they are */
+    const roost::path path = gg::paths::blob( hash );
+
+    if ( roost::exists( path ) ) {
+      roost::remove( path );
+    }
+  }
+
+  return hashes;
+}
@@ -4,6 +4,8 @@
 #define MEOW_UTIL_HHs
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "execution/connection.hh"
 #include "execution/meow/message.hh"
@@ -12,9 +14,16 @@
 namespace meow {
 
   std::string handle_put_message( const Message & message );
-  Message create_put_message( const std::string & hash );
+
+  /* the object is streamed from its file, not read into memory first */
+  void send_put_message( TCPConnection & connection, const std::string & hash );
+
   Message create_execute_message( const gg::thunk::Thunk & thunk );
 
+  /* tells a worker to remove objects from its disk */
+  Message create_drop_message( const std::vector<std::string> & hashes );
+  std::vector<std::string> handle_drop_message( const Message & message );
+
 }
 
 #endif /* MEOW_UTIL_HHs */
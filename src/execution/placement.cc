@@ -0,0 +1,128 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "placement.hh"
+
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+constexpr double Placement::TRANSFER_BYTES_PER_MS;
+constexpr double Placement::MS_PER_DOLLAR;
+
+Placement::Placement( const Policy policy, const size_t engine_count )
+  : policy_( policy ), latencies_( engine_count )
+{}
+
+void Placement::record( const size_t engine, const string & function_hash,
+                        const chrono::steady_clock::duration & runtime )
+{
+  latencies_.at( engine ).record( function_hash, runtime );
+  overall_.record( function_hash, runtime );
+}
+
+double Placement::latency_ms( const size_t engine, const string & function_hash ) const
+{
+  const RuntimeModel & latencies = latencies_.at( engine );
+
+  /* what we've seen for this function on this engine, or on any engine, or
+     for any function on this engine */
+  Optional<double> estimate = latencies.estimate_ms( function_hash );
+
+  if ( not estimate.initialized() ) {
+    estimate = overall_.estimate_ms( function_hash );
+  }
+
+  if ( not estimate.initialized() and latencies.size() > 0 ) {
+    estimate.initialize( latencies.default_estimate_ms() );
+  }
+
+  return estimate.get_or( overall_.default_estimate_ms() );
+}
+
+double Placement::transfer_ms( const Engine & engine, const Job & job ) const
+{
+  /* a remote engine fetches all of the inputs from the storage backend */
+  const uint64_t bytes = engine.is_remote
+                       ? job.missing_remote_size + job.infiles_size
+                       : job.missing_local_size;
+
+  return bytes / TRANSFER_BYTES_PER_MS;
+}
+
+double Placement::score( const size_t engine_index, const Engine & engine,
+                         const Job & job ) const
+{
+  const double latency = latency_ms( engine_index, job.function_hash );
+  const double time = latency + transfer_ms( engine, job )
+                      + ( engine.has_capacity ? 0.0 : latency );
+  const double cost = engine.cost_per_ms * latency;
+
+  switch ( policy_ ) {
+  case Policy::Fastest:
+    return time;
+
+  case Policy::Cheapest:
+    /* the time only breaks the ties */
+    return cost * MS_PER_DOLLAR * 1e6 + time;
+
+  case Policy::Balanced:
+    return time + cost * MS_PER_DOLLAR;
+
+  default:
+    throw runtime_error( "invalid placement policy" );
+  }
+}
+
+Optional<size_t> Placement::choose( const Job & job, const vector<Engine> & engines ) const
+{
+  if ( policy_ == Policy::First ) {
+    for ( size_t i = 0; i < engines.size(); i++ ) {
+      if ( engines[ i ].can_execute and engines[ i ].has_capacity ) {
+        return { true, i };
+      }
+    }
+
+    return {};
+  }
+
+  Optional<size_t> best;
+  double best_score = numeric_limits<double>::infinity();
+
+  for ( size_t i = 0; i < engines.size(); i++ ) {
+    if ( not engines[ i ].can_execute ) {
+      continue;
+    }
+
+    const double engine_score = score( i, engines[ i ], job );
+
+    if ( engine_score < best_score ) {
+      best.reset( i );
+      best_score = engine_score;
+    }
+  }
+
+  if ( best.initialized() and not engines[ *best ].has_capacity ) {
+    return {};
+  }
+
+  return best;
+}
+
+Placement::Policy Placement::parse_policy( const string & name )
+{
+  if ( name == "first" ) {
+    return Policy::First;
+  }
+  else if ( name == "fastest" ) {
+    return Policy::Fastest;
+  }
+  else if ( name == "cheapest" ) {
+    return Policy::Cheapest;
+  }
+  else if ( name == "balanced" ) {
+    return Policy::Balanced;
+  }
+
+  throw runtime_error( "unknown placement policy: " + name );
+}
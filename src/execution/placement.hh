@@ -0,0 +1,78 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef PLACEMENT_HH
+#define PLACEMENT_HH
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include "runtime_model.hh"
+#include "util/optional.hh"
+
+/* Decides which execution engine a thunk runs on. With the First policy, it
+   is the first engine that can run the thunk and has room for it. The other
+   policies score every engine that can run the thunk by how long the job
+   would take there (the runtime we've seen for its function on that engine,
+   plus the time to move its inputs) and by what it would cost, and pick the
+   lowest score; a busy engine is charged one more job's runtime for the wait,
+   and if it still wins, the thunk waits for it. */
+class Placement
+{
+public:
+  enum class Policy { First, Fastest, Cheapest, Balanced };
+
+  struct Engine
+  {
+    bool can_execute { true };
+    bool has_capacity { true };
+    bool is_remote { false };
+    double cost_per_ms { 0.0 }; /* in dollars */
+  };
+
+  struct Job
+  {
+    std::string function_hash {};
+    uint64_t infiles_size { 0 };
+
+    /* the inputs that aren't on this machine, which a local engine would
+       have to download, and the inputs that aren't in the storage backend,
+       which would have to be uploaded before a remote engine can run it */
+    uint64_t missing_local_size { 0 };
+    uint64_t missing_remote_size { 0 };
+  };
+
+  /* how fast we assume inputs move to and from the storage backend */
+  static constexpr double TRANSFER_BYTES_PER_MS = 50 * 1000.0;
+
+  /* with the Balanced policy, a dollar weighs as much as an hour */
+  static constexpr double MS_PER_DOLLAR = 3600 * 1000.0;
+
+private:
+  Policy policy_;
+
+  /* the runtimes on each engine, and on all of them */
+  std::vector<RuntimeModel> latencies_;
+  RuntimeModel overall_ {};
+
+public:
+  Placement( const Policy policy, const size_t engine_count );
+
+  void record( const size_t engine, const std::string & function_hash,
+               const std::chrono::steady_clock::duration & runtime );
+
+  double latency_ms( const size_t engine, const std::string & function_hash ) const;
+  double transfer_ms( const Engine & engine, const Job & job ) const;
+  double score( const size_t engine_index, const Engine & engine, const Job & job ) const;
+
+  /* returns the engine to run the job on, or nothing if it has to wait (or
+     if none of the engines can run it) */
+  Optional<size_t> choose( const Job & job, const std::vector<Engine> & engines ) const;
+
+  Policy policy() const { return policy_; }
+
+  static Policy parse_policy( const std::string & name );
+};
+
+#endif /* PLACEMENT_HH */
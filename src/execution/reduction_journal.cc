@@ -0,0 +1,127 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "reduction_journal.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "util/exception.hh"
+#include "util/tokenize.hh"
+
+using namespace std;
+
+ReductionJournal::Contents ReductionJournal::read( const roost::path & path )
+{
+  Contents contents;
+
+  if ( not roost::exists( path ) ) {
+    return contents;
+  }
+
+  const string data = roost::read_file( path );
+  vector<string> dispatched;
+  unordered_set<string> completed;
+
+  size_t line_start = 0;
+  size_t line_end;
+
+  /* a line without a newline at the end never made it to the disk in full */
+  while ( ( line_end = data.find( '\n', line_start ) ) != string::npos ) {
+    const vector<string> fields = split( data.substr( line_start, line_end - line_start ), "\t" );
+    line_start = line_end + 1;
+
+    const string & type = fields[ 0 ];
+
+    if ( type == "T" and fields.size() == 2 ) {
+      contents.targets.push_back( fields[ 1 ] );
+    }
+    else if ( type == "D" and fields.size() == 2 ) {
+      dispatched.push_back( fields[ 1 ] );
+    }
+    else if ( type == "C" and fields.size() >= 4 and fields.size() % 2 == 0 ) {
+      Completion completion;
+      completion.hash = fields[ 1 ];
+
+      for ( size_t i = 2; i < fields.size(); i += 2 ) {
+        completion.outputs.emplace_back( fields[ i ], fields[ i + 1 ] );
+      }
+
+      completed.insert( completion.hash );
+      contents.completions.push_back( move( completion ) );
+    }
+    else if ( type == "U" and fields.size() == 3 ) {
+      contents.updates.emplace_back( fields[ 1 ], fields[ 2 ] );
+    }
+    else {
+      throw runtime_error( "invalid record in reduction journal: " + path.string() );
+    }
+  }
+
+  if ( line_start != data.length() ) {
+    CheckSystemCall( "truncate", truncate( path.string().c_str(), line_start ) );
+  }
+
+  unordered_set<string> in_flight;
+
+  for ( string & hash : dispatched ) {
+    if ( not completed.count( hash ) and in_flight.insert( hash ).second ) {
+      contents.in_flight.push_back( move( hash ) );
+    }
+  }
+
+  return contents;
+}
+
+ReductionJournal::ReductionJournal( const roost::path & path,
+                                    const vector<string> & targets )
+  : path_( path ), previous_( read( path ) ),
+    fd_( CheckSystemCall( "open (" + path.string() + ")",
+                          open( path.string().c_str(),
+                                O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                                S_IRUSR | S_IWUSR ) ) )
+{
+  if ( previous_.targets.empty() ) {
+    string header;
+
+    for ( const string & target : targets ) {
+      header += "T\t" + target + "\n";
+    }
+
+    append( header );
+  }
+  else if ( previous_.targets != targets ) {
+    throw runtime_error( "reduction journal is for a different set of targets: "
+                         + path.string() );
+  }
+}
+
+/* every record goes out in a single write, so that a record is either all
+   there or cut short at the end of the file */
+void ReductionJournal::append( const string & record )
+{
+  fd_.write( record );
+}
+
+void ReductionJournal::dispatched( const string & hash )
+{
+  append( "D\t" + hash + "\n" );
+}
+
+void ReductionJournal::completed( const string & hash,
+                                  const vector<gg::ThunkOutput> & outputs )
+{
+  string record = "C\t" + hash;
+
+  for ( const gg::ThunkOutput & output : outputs ) {
+    record += "\t" + output.hash + "\t" + output.tag;
+  }
+
+  append( record + "\n" );
+}
+
+void ReductionJournal::updated( const string & old_hash, const string & new_hash )
+{
+  append( "U\t" + old_hash + "\t" + new_hash + "\n" );
+}
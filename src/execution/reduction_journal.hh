@@ -0,0 +1,67 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef REDUCTION_JOURNAL_HH
+#define REDUCTION_JOURNAL_HH
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "thunk/thunk.hh"
+#include "util/file_descriptor.hh"
+#include "util/path.hh"
+
+/* An append-only record of a reduction, from which gg-force can pick up
+   where an earlier run left off. Every line is a record, with the fields
+   separated by tabs:
+
+     T TARGET                         one for each target, at the top
+     D THUNK                          the thunk was sent to an engine
+     C THUNK HASH TAG [HASH TAG]...   the thunk was reduced to these outputs
+     U OLD NEW                        the graph renamed OLD to NEW
+
+   A record that was cut short when the process died is dropped. */
+class ReductionJournal
+{
+public:
+  struct Completion
+  {
+    std::string hash {};
+    std::vector<gg::ThunkOutput> outputs {};
+  };
+
+  /* what an earlier run left behind */
+  struct Contents
+  {
+    std::vector<std::string> targets {};
+    std::vector<Completion> completions {};
+    std::vector<std::pair<std::string, std::string>> updates {};
+
+    /* dispatched, and never heard back from, in the order they were sent */
+    std::vector<std::string> in_flight {};
+  };
+
+private:
+  roost::path path_;
+  Contents previous_;
+  FileDescriptor fd_;
+
+  static Contents read( const roost::path & path );
+  void append( const std::string & record );
+
+public:
+  /* opens the journal, or starts a new one. throws if the journal is for
+     another set of targets. */
+  ReductionJournal( const roost::path & path,
+                    const std::vector<std::string> & targets );
+
+  const Contents & previous() const { return previous_; }
+  void forget_previous() { previous_ = {}; }
+
+  void dispatched( const std::string & hash );
+  void completed( const std::string & hash,
+                  const std::vector<gg::ThunkOutput> & outputs );
+  void updated( const std::string & old_hash, const std::string & new_hash );
+};
+
+#endif /* REDUCTION_JOURNAL_HH */
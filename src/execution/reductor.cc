@@ -8,9 +8,12 @@
 #include <cmath>
 #include <numeric>
 #include <chrono>
+#include <algorithm>
 
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "thunk/thunk_reader.hh"
+#include "net/compression.hh"
 #include "net/s3.hh"
 #include "tui/status_bar.hh"
 #include "util/optional.hh"
@@ -18,6 +21,8 @@
 #include "util/timeit.hh"
 #include "util/path.hh"
 #include "util/digest.hh"
+#include "util/iterator.hh"
+#include "util/temp_file.hh"
 
 using namespace std;
 using namespace gg;
@@ -26,6 +31,12 @@ using namespace std::chrono;
 
 using ReductionResult = gg::cache::ReductionResult;
 
+constexpr uint64_t Reductor::MAX_BATCHED_INFILES_SIZE;
+constexpr double Reductor::MAX_BATCHED_RUNTIME_MS;
+constexpr size_t Reductor::MAX_SPECULATIVE_COPIES;
+constexpr milliseconds Reductor::SPECULATION_CHECK_INTERVAL;
+constexpr milliseconds Reductor::LOADING_POLL_INTERVAL;
+
 #define COLOR_DEFAULT "\033[39m"
 #define COLOR_RED     "\033[31m"
 #define COLOR_GREEN   "\033[32m"
@@ -56,7 +67,13 @@ void Reductor::print_status() const
          << job_queue_.size() << color_reset;
 
     for ( auto & ee : exec_engines_ ) {
-      data << " " << ee->label() << " (" << ee->max_jobs() << "): "
+      data << " " << ee->label() << " (";
+
+      if ( ee->job_limit() < ee->max_jobs() ) {
+        data << ee->job_limit() << "/";
+      }
+
+      data << ee->max_jobs() << "): "
            << BOLD << COLOR_RED << setw( 5 ) << left << ee->job_count()
            << color_reset;
     }
@@ -83,31 +100,20 @@ Reductor::Reductor( const vector<string> & target_hashes,
                     std::unique_ptr<StorageBackend> && storage_backend,
                     const std::chrono::milliseconds default_timeout,
                     const size_t timeout_multiplier,
-                    const bool status_bar )
+                    const bool status_bar,
+                    const JobQueue::Policy scheduling_policy )
   : target_hashes_( target_hashes ),
     remaining_targets_(),
-    status_bar_( status_bar ), default_timeout_( default_timeout ),
+    status_bar_( status_bar ), job_queue_( scheduling_policy ),
+    default_timeout_( default_timeout ),
     timeout_multiplier_( timeout_multiplier ),
     exec_engines_( move( execution_engines ) ),
     fallback_engines_( move( fallback_engines ) ),
     storage_backend_( move( storage_backend ) )
 {
-  cerr << "\u2192 Loading the thunks... ";
-  auto graph_load_time = time_it<milliseconds>(
-    [this] ()
-    {
-      for ( const string & hash : target_hashes_ ) {
-        string inserted_hash = dep_graph_.add_thunk( hash );
-
-        if ( remaining_targets_.count( inserted_hash ) == 0) {
-          remaining_targets_.insert( move ( inserted_hash ) );
-          unordered_set<string> thunk_o1_deps = dep_graph_.order_one_dependencies( hash );
-          job_queue_.insert( job_queue_.end(), thunk_o1_deps.begin(), thunk_o1_deps.end() );
-        }
-      }
-    } ).count();
-
-  cerr << " done (" << graph_load_time << " ms)." << endl;
+  if ( storage_backend_ != nullptr ) {
+    async_storage_ = make_unique<AsyncStorage>( *storage_backend_, exec_loop_ );
+  }
 
   auto success_callback =
     [this] ( const string & old_hash, vector<ThunkOutput> && outputs, const float cost )
@@ -156,7 +162,7 @@ Reductor::Reductor( const vector<string> & target_hashes,
       }
 
       /* let's retry */
-      job_queue_.push_back( old_hash );
+      enqueue( old_hash );
     };
 
 
@@ -164,6 +170,8 @@ Reductor::Reductor( const vector<string> & target_hashes,
     throw runtime_error( "no execution engines are available" );
   }
 
+  placement_ = { Placement::Policy::First, exec_engines_.size() };
+
   for ( auto & ee : exec_engines_ ) {
     ee->set_success_callback( success_callback );
     ee->set_failure_callback( failure_callback );
@@ -175,23 +183,528 @@ Reductor::Reductor( const vector<string> & target_hashes,
     fe->set_failure_callback( failure_callback );
     fe->init( exec_loop_ );
   }
+
+  /* the engines may start processes of their own, which has to happen
+     before the loader's threads are running */
+  graph_loader_ = make_unique<GraphLoader>( target_hashes_ );
+}
+
+void Reductor::load_thunks( const bool wait )
+{
+  while ( loading() ) {
+    bool released = false;
+    vector<string> dependencies;
+
+    for ( GraphLoader::LoadedThunk & loaded : graph_loader_->take( wait ) ) {
+      const bool leaf = loaded.thunk->can_be_executed();
+
+      if ( uploading_ ) {
+        for ( const auto & item : loaded.thunk->values() ) {
+          dependencies.push_back( item.first );
+        }
+
+        for ( const auto & item : loaded.thunk->executables() ) {
+          dependencies.push_back( item.first );
+        }
+      }
+
+      dep_graph_.stage_thunk( loaded.hash, move( loaded.thunk ) );
+
+      /* when resuming, what an earlier run left behind decides what's left
+         to run */
+      if ( not leaf or resuming() ) {
+        continue;
+      }
+
+      released = true;
+
+      /* nothing it depends on needs to run first, so it can start right
+         away */
+      dep_graph_.add_thunk( loaded.hash );
+      released_jobs_.insert( loaded.hash );
+      enqueue( loaded.hash );
+    }
+
+    /* the released jobs look for their dependencies' uploads only once
+       they are taken off the queue */
+    if ( not dependencies.empty() ) {
+      start_uploads( dependencies );
+    }
+
+    if ( graph_loader_->done() ) {
+      finish_loading();
+    }
+    else if ( released or not wait ) {
+      break;
+    }
+  }
+}
+
+void Reductor::finish_loading()
+{
+  graph_loader_.reset();
+
+  for ( const string & hash : target_hashes_ ) {
+    remaining_targets_.insert( dep_graph_.add_thunk( hash ) );
+  }
+
+  dep_graph_.clear_staged();
+
+  if ( journal_ ) {
+    replay_journal();
+  }
+
+  vector<string> initial_jobs;
+  unordered_set<string> seen_targets;
+
+  for ( const string & target_hash : target_hashes_ ) {
+    const string hash = gg::hash::base( target_hash );
+
+    if ( remaining_targets_.count( hash ) and seen_targets.insert( hash ).second ) {
+      unordered_set<string> thunk_o1_deps =
+        dep_graph_.order_one_dependencies( dep_graph_.updated_hash( hash ) );
+      initial_jobs.insert( initial_jobs.end(), thunk_o1_deps.begin(), thunk_o1_deps.end() );
+    }
+  }
+
+  /* the priorities are computed once the whole graph is loaded */
+  for ( const string & hash : initial_jobs ) {
+    if ( not released_jobs_.count( hash ) ) {
+      enqueue( hash );
+    }
+  }
+
+  cerr << "\u2192 Loading the thunks... done ("
+       << duration_cast<milliseconds>( Clock::now() - load_start_ ).count() << " ms";
+
+  if ( not released_jobs_.empty() ) {
+    cerr << ", " << released_jobs_.size() << " started early";
+  }
+
+  cerr << ")." << endl;
+
+  released_jobs_.clear();
+
+  if ( uploading_ ) {
+    print_upload_summary();
+
+    if ( upload_count_ > 0 and jobs_waiting_on_.empty() ) {
+      print_uploads_done();
+    }
+  }
+
+  /* the jobs that finished while the graph was loading */
+  vector<DeferredCompletion> completions;
+  completions.swap( deferred_completions_ );
+
+  for ( DeferredCompletion & completion : completions ) {
+    finalize_execution( completion.hash, move( completion.outputs ), completion.cost );
+  }
+}
+
+bool Reductor::resuming() const
+{
+  return journal_ and ( not journal_->previous().completions.empty() or
+                        not journal_->previous().in_flight.empty() );
+}
+
+void Reductor::set_journal( const string & path )
+{
+  journal_ = make_unique<ReductionJournal>( path, target_hashes_ );
+  replayed_updates_ = 0;
+
+  dep_graph_.set_update_callback(
+    [this] ( const string & old_hash, const string & new_hash )
+    {
+      const auto & journaled = journal_->previous().updates;
+
+      if ( replayed_updates_ < journaled.size() ) {
+        if ( journaled[ replayed_updates_ ].first != old_hash or
+             journaled[ replayed_updates_ ].second != new_hash ) {
+          throw runtime_error( "the reduction journal does not match the graph: "
+                               + old_hash );
+        }
+
+        replayed_updates_++;
+        return;
+      }
+
+      journal_->updated( old_hash, new_hash );
+    } );
+}
+
+void Reductor::replay_journal()
+{
+  if ( not resuming() ) {
+    journal_->forget_previous();
+    return;
+  }
+
+  const ReductionJournal::Contents & previous = journal_->previous();
+  const auto replay_start = Clock::now();
+
+  for ( const ReductionJournal::Completion & completion : previous.completions ) {
+    if ( not dep_graph_.has_thunk( completion.hash ) ) {
+      throw runtime_error( "the reduction journal does not match the graph: "
+                           + completion.hash );
+    }
+
+    vector<ThunkOutput> outputs = completion.outputs;
+    dep_graph_.force_thunk( completion.hash, move( outputs ) );
+
+    if ( gg::hash::type( completion.outputs.at( 0 ).hash ) == gg::ObjectType::Value ) {
+      remaining_targets_.erase( dep_graph_.original_hash( completion.hash ) );
+    }
+
+    finished_jobs_++;
+  }
+
+  /* the journal is written a record at a time, so it can't know of an update
+     that replaying its completions doesn't make */
+  if ( replayed_updates_ != previous.updates.size() ) {
+    throw runtime_error( "the reduction journal does not match the graph" );
+  }
+
+  /* the jobs that were running when the last run stopped may have finished
+     since. the ones whose results made it to the cache are picked up from
+     there when they're dequeued; the rest are looked up remotely. */
+  vector<string> unsettled;
+
+  for ( const string & hash : previous.in_flight ) {
+    if ( dep_graph_.has_thunk( hash ) and not gg::cache::check( hash ).initialized() ) {
+      unsettled.push_back( hash );
+    }
+  }
+
+  if ( not unsettled.empty() and async_storage_ != nullptr ) {
+    fetch_reductions( unsettled );
+  }
+
+  cerr << "\u21ba Replaying the journal... done ("
+       << previous.completions.size() << " completed, "
+       << previous.in_flight.size() << " in flight, "
+       << duration_cast<milliseconds>( Clock::now() - replay_start ).count()
+       << " ms)." << endl;
+
+  journal_->forget_previous();
+  replayed_updates_ = 0;
+}
+
+void Reductor::fetch_reductions( const vector<string> & hashes )
+{
+  vector<unique_ptr<TempFile>> files;
+  vector<bool> fetched( hashes.size(), false );
+
+  for ( size_t i = 0; i < hashes.size(); i++ ) {
+    files.push_back( make_unique<TempFile>( "/tmp/gg-reduction" ) );
+    storage::GetRequest request { gg::remote::reduction_key( hashes[ i ] ),
+                                  files.back()->name() };
+
+    /* a missing record only means the job has to run again */
+    try {
+      async_storage_->get( { request },
+        [&fetched, i] ( const storage::GetRequest & ) { fetched[ i ] = true; },
+        [] ( const string &, const string & ) {} );
+    }
+    catch ( const exception & ) {}
+  }
+
+  while ( async_storage_->pending() ) {
+    exec_loop_.loop_once();
+  }
+
+  vector<pair<string, vector<ThunkOutput>>> reductions;
+  vector<string> thunk_outputs;
+
+  for ( size_t i = 0; i < hashes.size(); i++ ) {
+    if ( not fetched[ i ] ) {
+      continue;
+    }
+
+    try {
+      reductions.emplace_back( hashes[ i ],
+        gg::remote::parse_reduction( roost::read_file( files[ i ]->name() ) ) );
+    }
+    catch ( const exception & ) {
+      continue;
+    }
+
+    for ( const ThunkOutput & output : reductions.back().second ) {
+      if ( gg::hash::type( output.hash ) == gg::ObjectType::Thunk ) {
+        thunk_outputs.push_back( output.hash );
+      }
+    }
+  }
+
+  /* the graph reads the thunks that a thunk was reduced to */
+  start_downloads( thunk_outputs );
+
+  while ( async_storage_->pending() ) {
+    exec_loop_.loop_once();
+  }
+
+  for ( const auto & reduction : reductions ) {
+    for ( const ThunkOutput & output : reduction.second ) {
+      gg::cache::insert( gg::hash::for_output( reduction.first, output.tag ), output.hash );
+    }
+
+    gg::cache::insert( reduction.first, reduction.second.at( 0 ).hash );
+  }
+}
+
+void Reductor::enqueue( const string & hash )
+{
+  if ( job_queue_.policy() == JobQueue::Policy::FIFO ) {
+    job_queue_.push( hash );
+    return;
+  }
+
+  const double default_weight = runtime_model_.default_estimate_ms();
+
+  /* another copy of the job may have finished already, in which case the
+     thunk is gone from the graph, and the cache check in reduce() takes
+     care of this one */
+  if ( not dep_graph_.has_thunk( hash ) ) {
+    job_queue_.push( hash, default_weight );
+    return;
+  }
+
+  /* the rest of the graph isn't there to tell the critical path yet */
+  if ( loading() ) {
+    const string & function_hash = dep_graph_.get_thunk( hash ).function().hash();
+    job_queue_.push( hash, runtime_model_.estimate_ms( function_hash ).get_or( default_weight ) );
+    return;
+  }
+
+  const double priority = dep_graph_.critical_path( hash,
+    [this, default_weight] ( const Thunk & thunk )
+    {
+      return runtime_model_.estimate_ms( thunk.function().hash() ).get_or( default_weight );
+    } );
+
+  job_queue_.push( hash, priority );
+}
+
+void Reductor::set_max_batch_size( const size_t max_batch_size )
+{
+  if ( max_batch_size == 0 ) {
+    throw runtime_error( "batch size cannot be zero" );
+  }
+
+  max_batch_size_ = max_batch_size;
+}
+
+void Reductor::set_speculation_percentile( const double percentile )
+{
+  if ( percentile < 0.0 or percentile >= 1.0 ) {
+    throw runtime_error( "speculation percentile must be in [0, 1)" );
+  }
+
+  speculation_percentile_ = percentile;
+
+  if ( speculation_percentile_ > 0.0 and
+       ( timeout_check_interval_ == 0s or
+         timeout_check_interval_ > SPECULATION_CHECK_INTERVAL ) ) {
+    timeout_check_interval_ = SPECULATION_CHECK_INTERVAL;
+    next_timeout_check_ = Clock::now() + timeout_check_interval_;
+  }
+}
+
+bool Reductor::batches( ExecutionEngine & engine, const Thunk & thunk ) const
+{
+  if ( max_batch_size_ == 1 or not engine.can_batch() or
+       thunk.infiles_size() > MAX_BATCHED_INFILES_SIZE ) {
+    return false;
+  }
+
+  return runtime_model_.estimate_ms( thunk.function().hash() ).get_or( 0.0 )
+         <= MAX_BATCHED_RUNTIME_MS;
+}
+
+bool Reductor::has_capacity( ExecutionEngine & engine, const Thunk & thunk ) const
+{
+  size_t open_batches = 0;
+
+  for ( const auto & batch : batches_ ) {
+    if ( batch.first.first == &engine ) {
+      open_batches++;
+    }
+  }
+
+  if ( open_batches > 0 and batches( engine, thunk ) and
+       batches_.count( { &engine, thunk.executable_hash() } ) ) {
+    /* it joins a batch that was already counted */
+    return true;
+  }
+
+  if ( engine.limiter().backing_off() ) {
+    return false;
+  }
+
+  return engine.job_count() + open_batches < engine.job_limit();
+}
+
+void Reductor::start_thunk( ExecutionEngine & engine, const Thunk & thunk )
+{
+  running_jobs_[ thunk.hash() ].batch_size = 1;
+
+  if ( not batches( engine, thunk ) ) {
+    engine.force_thunk( thunk, exec_loop_ );
+    return;
+  }
+
+  auto batch_it = batches_.emplace( make_pair( &engine, thunk.executable_hash() ),
+                                    vector<Thunk> {} ).first;
+  batch_it->second.push_back( thunk );
+
+  if ( batch_it->second.size() >= max_batch_size_ ) {
+    vector<Thunk> thunks = move( batch_it->second );
+    batches_.erase( batch_it );
+    start_batch( engine, move( thunks ) );
+  }
+}
+
+void Reductor::start_batch( ExecutionEngine & engine, vector<Thunk> && thunks )
+{
+  for ( const Thunk & thunk : thunks ) {
+    running_jobs_[ thunk.hash() ].batch_size = thunks.size();
+  }
+
+  if ( thunks.size() == 1 ) {
+    engine.force_thunk( thunks.front(), exec_loop_ );
+  }
+  else {
+    engine.force_thunks( thunks, exec_loop_ );
+  }
+}
+
+void Reductor::start_batches()
+{
+  auto batches = move( batches_ );
+  batches_.clear();
+
+  for ( auto & batch : batches ) {
+    start_batch( *batch.first.first, move( batch.second ) );
+  }
+}
+
+void Reductor::record_completion( const string & hash,
+                                  const Optional<Clock::duration> & runtime )
+{
+  if ( runtime.initialized() ) {
+    const string & function_hash = dep_graph_.get_thunk( hash ).function().hash();
+
+    if ( runtime_model_.record( function_hash, *runtime ) ) {
+      /* the weights have changed, and so have the path lengths */
+      dep_graph_.clear_critical_paths();
+    }
+  }
+
+  const string key = dep_graph_.original_hash( hash );
+  Clock::duration finish = runtime.get_or( Clock::duration { 0 } );
+
+  auto ready_it = ready_at_.find( key );
+  if ( ready_it != ready_at_.end() ) {
+    finish += ready_it->second;
+    ready_at_.erase( ready_it );
+  }
+
+  critical_path_ = max( critical_path_, finish );
+
+  for ( const string & referencing_hash : dep_graph_.referencing_thunks( hash ) ) {
+    Clock::duration & ready = ready_at_[ dep_graph_.original_hash( referencing_hash ) ];
+    ready = max( ready, finish );
+  }
+
+  /* finalize_execution() picks this up, in case the thunk has returned
+     another thunk whose dependencies must start after this one */
+  ready_at_[ key ] = finish;
 }
 
 void Reductor::finalize_execution( const string & old_hash,
                                    vector<ThunkOutput> && outputs,
                                    const float cost )
 {
-  running_jobs_.erase( old_hash );
+  if ( loading() ) {
+    deferred_completions_.push_back( { old_hash, move( outputs ), cost } );
+    return;
+  }
+
+  Optional<Clock::duration> runtime;
+
+  auto job_it = running_jobs_.find( old_hash );
+  if ( job_it != running_jobs_.end() ) {
+    const JobInfo & job = job_it->second;
+    const auto now = Clock::now();
+    const size_t winner = settle_copies( old_hash, job, now );
+
+    runtime.reset( ( now - job.copy_starts[ winner ] )
+                   / static_cast<Clock::rep>( job.batch_size ) );
+
+    /* only the main engines take part in the placement */
+    auto engine_it = find_if( exec_engines_.begin(), exec_engines_.end(),
+                              [&job, winner] ( const unique_ptr<ExecutionEngine> & engine )
+                              { return engine.get() == job.copy_engines[ winner ]; } );
+
+    if ( engine_it != exec_engines_.end() and dep_graph_.has_thunk( old_hash ) ) {
+      const size_t engine_index = engine_it - exec_engines_.begin();
+      const Thunk & thunk = dep_graph_.get_thunk( old_hash );
+      placement_.record( engine_index, thunk.function().hash(), *runtime );
+
+      if ( trace_ ) {
+        const Placement::Job & placed = job.placed;
+
+        *trace_ << duration_cast<milliseconds>( job.copy_starts[ winner ] - reduce_start_ ).count()
+                << '\t' << old_hash << '\t' << placed.function_hash
+                << '\t' << placed.infiles_size << '\t' << placed.missing_local_size
+                << '\t' << placed.missing_remote_size << '\t' << engine_index
+                << '\t' << duration_cast<milliseconds>( *runtime ).count()
+                << '\t' << cost << '\n';
+      }
+    }
+
+    running_jobs_.erase( job_it );
+  }
+
   const string main_output_hash = outputs.at( 0 ).hash;
+  const string original_hash = dep_graph_.original_hash( old_hash );
+
+  const bool first_completion = dep_graph_.has_thunk( old_hash );
+
+  if ( first_completion ) {
+    record_completion( old_hash, runtime );
+
+    if ( journal_ ) {
+      journal_->completed( old_hash, outputs );
+    }
+  }
 
   Optional<unordered_set<string>> new_o1s = dep_graph_.force_thunk( old_hash, move ( outputs ) );
   estimated_cost_ += cost;
 
+  if ( first_completion ) {
+    const Clock::duration finish = ready_at_.at( original_hash );
+    ready_at_.erase( original_hash );
+
+    if ( new_o1s.initialized() and
+         gg::hash::type( main_output_hash ) == gg::ObjectType::Thunk ) {
+      for ( const string & hash : *new_o1s ) {
+        Clock::duration & ready = ready_at_[ dep_graph_.original_hash( hash ) ];
+        ready = max( ready, finish );
+      }
+    }
+  }
+
   if ( new_o1s.initialized() ) {
-    job_queue_.insert( job_queue_.end(), new_o1s->begin(), new_o1s->end() );
+    for ( const string & hash : *new_o1s ) {
+      enqueue( hash );
+    }
 
     if ( gg::hash::type( main_output_hash ) == gg::ObjectType::Value ) {
-      remaining_targets_.erase( dep_graph_.original_hash( old_hash ) );
+      if ( remaining_targets_.erase( dep_graph_.original_hash( old_hash ) )
+           and prefetch_targets_ ) {
+        start_downloads( { main_output_hash } );
+      }
     }
 
     finished_jobs_++;
@@ -200,12 +713,22 @@ void Reductor::finalize_execution( const string & old_hash,
 
 vector<string> Reductor::reduce()
 {
+  reduce_start_ = Clock::now();
+
   while ( true ) {
+    if ( loading() ) {
+      /* with nothing else to do, there's no point in polling */
+      load_thunks( job_queue_.empty() and running_jobs_.empty() );
+    }
+
+    /* the jobs that are waiting for a busy engine they'd rather run on */
+    vector<JobQueue::Entry> deferred_jobs;
+
     while ( not job_queue_.empty() ) {
       print_status();
 
-      const string thunk_hash { move( job_queue_.front() ) };
-      job_queue_.pop_front();
+      JobQueue::Entry job = job_queue_.pop();
+      const string thunk_hash = job.hash;
 
       /* don't bother executing gg-execute if it's in the cache */
       Optional<ReductionResult> cache_entry;
@@ -223,7 +746,7 @@ vector<string> Reductor::reduce()
       }
 
       if ( cache_entry.initialized() ) {
-        Thunk thunk { ThunkReader::read( gg::paths::blob( thunk_hash ), thunk_hash ) };
+        Thunk thunk { ThunkReader::read( gg::blobs::map( thunk_hash ), thunk_hash ) };
         vector<ThunkOutput> new_outputs;
 
         for ( const auto & tag : thunk.outputs() ) {
@@ -241,21 +764,51 @@ vector<string> Reductor::reduce()
       else {
         const Thunk & thunk = dep_graph_.get_thunk( thunk_hash );
 
+        if ( wait_for_uploads( job, thunk ) ) {
+          continue;
+        }
+
         enum { CANNOT_BE_EXECUTED,
                FULL_CAPACITY,
                FULL_FALLBACK_CAPACITY,
                EXECUTING } exec_state = CANNOT_BE_EXECUTED;
 
+        ExecutionEngine * engine = nullptr;
+        vector<Placement::Engine> candidates;
+
         for ( auto & exec_engine : exec_engines_ ) {
-          if ( exec_engine->can_execute( thunk ) ) {
-            if ( exec_engine->job_count() >= exec_engine->max_jobs() ) {
-              exec_state = FULL_CAPACITY;
-              continue;
-            }
+          Placement::Engine candidate;
+          candidate.can_execute = exec_engine->can_execute( thunk );
+          candidate.has_capacity = candidate.can_execute and has_capacity( *exec_engine, thunk );
+          candidate.is_remote = exec_engine->is_remote();
+          candidate.cost_per_ms = exec_engine->cost_per_ms();
+          candidates.push_back( candidate );
+
+          if ( candidate.can_execute ) {
+            exec_state = FULL_CAPACITY;
+          }
+        }
 
-            exec_engine->force_thunk( thunk, exec_loop_ );
+        /* what the placement (and the trace) needs to know about the job */
+        Placement::Job placed;
+
+        if ( placement_.policy() != Placement::Policy::First or trace_ ) {
+          placed = placement_job( thunk );
+        }
+
+        if ( exec_state == FULL_CAPACITY ) {
+          const Optional<size_t> chosen = placement_.choose( placed, candidates );
+
+          if ( chosen.initialized() ) {
+            engine = exec_engines_[ *chosen ].get();
+            start_thunk( *engine, thunk );
             exec_state = EXECUTING;
-            break;
+          }
+          else if ( any_of( candidates.begin(), candidates.end(),
+                            [] ( const Placement::Engine & e ) { return e.has_capacity; } ) ) {
+            /* it's waiting by choice, and the jobs behind it don't have to */
+            deferred_jobs.push_back( move( job ) );
+            continue;
           }
         }
 
@@ -263,12 +816,13 @@ vector<string> Reductor::reduce()
         if ( exec_state == CANNOT_BE_EXECUTED ) {
           for ( auto & fallback_engine : fallback_engines_ ) {
             if ( fallback_engine->can_execute( thunk ) ) {
-              if ( fallback_engine->job_count() >= fallback_engine->max_jobs() ) {
+              if ( not has_capacity( *fallback_engine, thunk ) ) {
                 exec_state = FULL_FALLBACK_CAPACITY;
                 continue;
               }
 
-              fallback_engine->force_thunk( thunk, exec_loop_ );
+              engine = fallback_engine.get();
+              start_thunk( *fallback_engine, thunk );
               exec_state = EXECUTING;
               break;
             }
@@ -277,7 +831,22 @@ vector<string> Reductor::reduce()
 
         if ( exec_state == EXECUTING ) {
           JobInfo & job_info = running_jobs_[ thunk_hash ];
-          job_info.start = Clock::now();
+          const auto now = Clock::now();
+
+          if ( job_info.copy_starts.empty() ) {
+            job_info.start = now;
+            job_info.placed = move( placed );
+
+            if ( journal_ ) {
+              journal_->dispatched( thunk_hash );
+            }
+          }
+
+          job_info.copy_starts.push_back( now );
+          job_info.last_start = now;
+
+          job_info.copy_engines.push_back( engine );
+
           job_info.timeout = thunk.timeout() * timeout_multiplier_;
           job_info.restarts++;
 
@@ -286,7 +855,7 @@ vector<string> Reductor::reduce()
           }
         }
         else if ( exec_state == FULL_CAPACITY or exec_state == FULL_FALLBACK_CAPACITY ) {
-          job_queue_.push_front( thunk_hash );
+          job_queue_.push_front( move( job ) );
           break;
         }
         else { /* CANNOT_BE_EXECUTED */
@@ -295,34 +864,19 @@ vector<string> Reductor::reduce()
       }
     } /* while(Q is not empty) */
 
+    for ( auto it = deferred_jobs.rbegin(); it != deferred_jobs.rend(); it++ ) {
+      job_queue_.push_front( move( *it ) );
+    }
+
+    start_batches();
     print_status();
 
-    const auto poll_result = exec_loop_.loop_once( timeout_check_interval_ == 0s
-                                                   ? -1
-                                                   : timeout_check_interval_.count() );
+    const auto poll_result = exec_loop_.loop_once( poll_timeout_ms() );
     const auto clock_now = Clock::now();
 
     if ( timeout_check_interval_ != 0s and clock_now >= next_timeout_check_ ) {
-      size_t count = 0;
-
-      for ( auto & job : running_jobs_ ) {
-        if ( job.second.timeout != 0ms and
-             ( clock_now - job.second.start ) > job.second.timeout ) {
-          job_queue_.push_back( job.first );
-          job.second.start = clock_now;
-          job.second.timeout += job.second.restarts * job.second.timeout;
-          job.second.restarts++;
-
-          count ++;
-        }
-      }
-
+      check_stragglers( clock_now );
       next_timeout_check_ += timeout_check_interval_;
-
-      if ( count > 0 ) {
-        print_gg_message( "info", "duplicating " + to_string( count ) +
-                                  " job" + ( ( count == 1 ) ? "" : "s" ) );
-      }
     }
 
     if ( is_finished() or poll_result.result == Poller::Result::Type::Exit ) {
@@ -341,91 +895,391 @@ vector<string> Reductor::reduce()
         final_hashes.emplace_back( answer->hash );
       }
 
+      makespan_ = Clock::now() - reduce_start_;
       return final_hashes;
     }
   }
 }
 
-void Reductor::upload_dependencies() const
+int Reductor::poll_timeout_ms() const
 {
-  if ( storage_backend_ == nullptr ) {
+  int timeout_ms = ( timeout_check_interval_ == 0s ) ? -1 : timeout_check_interval_.count();
+
+  if ( loading() ) {
+    timeout_ms = ( timeout_ms < 0 ) ? LOADING_POLL_INTERVAL.count()
+                                    : min<int>( timeout_ms, LOADING_POLL_INTERVAL.count() );
+  }
+
+  if ( job_queue_.empty() ) {
+    return timeout_ms;
+  }
+
+  /* the queued jobs may be waiting for an engine to stop backing off */
+  const auto now = Clock::now();
+
+  for ( const auto & engines : { &exec_engines_, &fallback_engines_ } ) {
+    for ( const auto & engine : *engines ) {
+      if ( engine->limiter().backing_off( now ) ) {
+        const auto wait = engine->limiter().backoff_until() - now;
+        const int wait_ms = static_cast<int>( ceil( duration<double, milli>( wait ).count() ) );
+
+        if ( timeout_ms < 0 or wait_ms < timeout_ms ) {
+          timeout_ms = wait_ms;
+        }
+      }
+    }
+  }
+
+  return timeout_ms;
+}
+
+void Reductor::check_stragglers( const Clock::time_point & now )
+{
+  size_t count = 0;
+
+  for ( auto & job : running_jobs_ ) {
+    JobInfo & info = job.second;
+
+    Optional<double> threshold_ms;
+    if ( speculation_percentile_ > 0.0 ) {
+      threshold_ms = runtime_model_.percentile_ms( dep_graph_.get_thunk( job.first ).function().hash(),
+                                                   speculation_percentile_ );
+    }
+
+    /* we know what this function's runtimes look like; once the copies run
+       out, a job that still hangs is retried on its timeout */
+    if ( threshold_ms.initialized() and info.speculative < MAX_SPECULATIVE_COPIES ) {
+      const duration<double, milli> threshold { *threshold_ms * info.batch_size };
+
+      if ( ( now - info.last_start ) > threshold ) {
+        enqueue( job.first );
+        info.last_start = now;
+        info.speculative++;
+        speculation_stats_.launched++;
+        count++;
+      }
+    }
+    else if ( info.timeout != 0ms and ( now - info.last_start ) > info.timeout ) {
+      enqueue( job.first );
+      info.last_start = now;
+      info.timeout += info.restarts * info.timeout;
+      info.restarts++;
+      count++;
+    }
+  }
+
+  if ( count > 0 ) {
+    print_gg_message( "info", "duplicating " + to_string( count ) +
+                              " job" + ( ( count == 1 ) ? "" : "s" ) );
+  }
+}
+
+size_t Reductor::settle_copies( const string & hash, const JobInfo & job,
+                                const Clock::time_point & now )
+{
+  if ( job.copy_starts.size() <= 1 ) {
+    return 0;
+  }
+
+  /* we don't hear which copy finished; it's the latest one that has run at
+     least as long as the fastest run of this function we have seen */
+  const string & function_hash = dep_graph_.get_thunk( hash ).function().hash();
+  const duration<double, milli> fastest {
+    runtime_model_.percentile_ms( function_hash, 0.0 ).get_or( 0.0 ) * job.batch_size };
+
+  size_t winner = 0;
+  for ( size_t i = job.copy_starts.size(); i-- > 0; ) {
+    if ( ( now - job.copy_starts[ i ] ) >= fastest ) {
+      winner = i;
+      break;
+    }
+  }
+
+  if ( job.speculative > 0 and winner > 0 ) {
+    speculation_stats_.won++;
+    speculation_stats_.time_saved += duration_cast<milliseconds>( now - job.start );
+  }
+
+  unordered_set<ExecutionEngine *> engines { job.copy_engines.begin(),
+                                             job.copy_engines.end() };
+
+  for ( ExecutionEngine * engine : engines ) {
+    engine->cancel_thunk( hash, exec_loop_ );
+  }
+
+  return winner;
+}
+
+Placement::Job Reductor::placement_job( const Thunk & thunk ) const
+{
+  Placement::Job job;
+  job.function_hash = thunk.function().hash();
+  job.infiles_size = thunk.infiles_size();
+
+  for ( const auto & item : join_containers( thunk.values(), thunk.executables() ) ) {
+    const string & hash = item.first;
+
+    if ( not gg::blobs::exists( hash ) ) {
+      job.missing_local_size += gg::hash::size( hash );
+    }
+
+    if ( storage_backend_ != nullptr and not storage_backend_->is_available( hash ) ) {
+      job.missing_remote_size += gg::hash::size( hash );
+    }
+  }
+
+  return job;
+}
+
+void Reductor::set_placement_policy( const Placement::Policy policy )
+{
+  placement_ = { policy, exec_engines_.size() };
+}
+
+void Reductor::set_trace_file( const string & path )
+{
+  trace_ = make_unique<ofstream>( path );
+
+  if ( not trace_->good() ) {
+    throw runtime_error( "could not open " + path );
+  }
+
+  write_trace_header();
+}
+
+void Reductor::write_trace_header()
+{
+  for ( size_t i = 0; i < exec_engines_.size(); i++ ) {
+    const ExecutionEngine & engine = *exec_engines_[ i ];
+
+    *trace_ << "#engine\t" << i << '\t' << engine.label() << '\t'
+            << engine.max_jobs() << '\t' << engine.is_remote() << '\t'
+            << engine.cost_per_ms() << '\n';
+  }
+}
+
+milliseconds Reductor::critical_path_length() const
+{
+  return duration_cast<milliseconds>( critical_path_ );
+}
+
+milliseconds Reductor::makespan() const
+{
+  return duration_cast<milliseconds>( makespan_ );
+}
+
+bool Reductor::wait_for_uploads( JobQueue::Entry & job, const Thunk & thunk )
+{
+  if ( jobs_waiting_on_.empty() ) {
+    return false;
+  }
+  else if ( waiting_jobs_.count( job.hash ) ) {
+    return true;
+  }
+
+  size_t missing = 0;
+
+  auto check_dependency =
+    [&] ( const Thunk::DataItem & item )
+    {
+      auto waiting_it = jobs_waiting_on_.find( item.first );
+
+      if ( waiting_it != jobs_waiting_on_.end() ) {
+        waiting_it->second.push_back( job.hash );
+        missing++;
+      }
+    };
+
+  for_each( thunk.values().cbegin(), thunk.values().cend(), check_dependency );
+  for_each( thunk.executables().cbegin(), thunk.executables().cend(), check_dependency );
+
+  if ( missing > 0 ) {
+    waiting_jobs_.emplace( job.hash, make_pair( move( job ), missing ) );
+    return true;
+  }
+
+  return false;
+}
+
+void Reductor::upload_finished( const string & hash )
+{
+  storage_backend_->set_available( hash );
+
+  auto waiting_it = jobs_waiting_on_.find( hash );
+
+  if ( waiting_it == jobs_waiting_on_.end() ) {
     return;
   }
 
-  vector<storage::PutRequest> upload_requests;
-  size_t total_size = 0;
+  for ( const string & job_hash : waiting_it->second ) {
+    auto job_it = waiting_jobs_.find( job_hash );
 
-  for ( const string & dep : dep_graph_.value_dependencies() ) {
-    if ( storage_backend_->is_available( dep ) ) {
-      continue;
+    if ( job_it != waiting_jobs_.end() and --job_it->second.second == 0 ) {
+      job_queue_.push( job_it->second.first.hash, job_it->second.first.priority );
+      waiting_jobs_.erase( job_it );
     }
+  }
 
-    total_size += gg::hash::size( dep );
-    upload_requests.push_back( { gg::paths::blob( dep ), dep,
-                                 gg::hash::to_hex( dep ) } );
+  jobs_waiting_on_.erase( waiting_it );
+
+  /* more uploads may start while the graph is loading */
+  if ( jobs_waiting_on_.empty() and not loading() ) {
+    print_uploads_done();
   }
+}
 
-  for ( const string & dep : dep_graph_.executable_dependencies() ) {
-    if ( storage_backend_->is_available( dep ) ) {
+void Reductor::print_upload_summary() const
+{
+  if ( upload_count_ == 0 ) {
+    cerr << "No files to upload." << endl;
+    return;
+  }
+
+  const string plural = upload_count_ == 1 ? "" : "s";
+  cerr << "\u2197 Uploading " << upload_count_ << " file" << plural
+       << " (" << format_bytes( upload_size_ ) << ") in the background." << endl;
+}
+
+void Reductor::print_uploads_done() const
+{
+  const auto upload_time = duration_cast<milliseconds>( Clock::now() - upload_start_ );
+  const auto & counters = storage::compression::counters();
+  string sent;
+
+  if ( counters.put_sent < counters.put_uncompressed ) {
+    sent = ", " + format_bytes( counters.put_sent ) + " sent for "
+           + format_bytes( counters.put_uncompressed );
+  }
+
+  print_gg_message( "info", "uploads done (" + to_string( upload_time.count() ) + " ms"
+                            + sent + ")" );
+}
+
+void Reductor::start_uploads( const vector<string> & all_dependencies )
+{
+  vector<string> dependencies;
+  unordered_set<string> seen;
+
+  for ( const string & dep : all_dependencies ) {
+    if ( not jobs_waiting_on_.count( dep ) and seen.insert( dep ).second ) {
+      dependencies.push_back( dep );
+    }
+  }
+
+  /* the objects that someone else put in a shared storage, or that were
+     uploaded already, don't have to be uploaded again */
+  const vector<bool> available = storage_backend_->find_available( dependencies );
+
+  vector<storage::PutRequest> upload_requests;
+
+  for ( size_t i = 0; i < dependencies.size(); i++ ) {
+    const string & dep = dependencies[ i ];
+
+    if ( available[ i ] ) {
       continue;
     }
 
-    total_size += gg::hash::size( dep );
-    upload_requests.push_back( { gg::paths::blob( dep ), dep,
+    upload_size_ += gg::hash::size( dep );
+    jobs_waiting_on_[ dep ];
+    upload_requests.push_back( { gg::blobs::path( dep ), dep,
                                  gg::hash::to_hex( dep ) } );
   }
 
-  if ( upload_requests.size() == 0 ) {
-    cerr << "No files to upload." << endl;
+  if ( upload_requests.empty() ) {
     return;
   }
 
-  const string plural = upload_requests.size() == 1 ? "" : "s";
-  cerr << "\u2197 Uploading " << upload_requests.size() << " file" << plural
-       << " (" << format_bytes( total_size ) << ")... ";
+  upload_count_ += upload_requests.size();
 
-  auto upload_time = time_it<milliseconds>(
-    [&upload_requests, this]()
-    {
-      storage_backend_->put(
-        upload_requests,
-        [this] ( const storage::PutRequest & upload_request )
-        { storage_backend_->set_available( upload_request.object_key ); }
-      );
+  async_storage_->put( upload_requests,
+    [this] ( const storage::PutRequest & upload_request )
+    { upload_finished( upload_request.object_key ); },
+    [] ( const string & object_key, const string & error )
+    { throw runtime_error( "upload failed for " + object_key + ": " + error ); } );
+}
+
+void Reductor::upload_dependencies()
+{
+  if ( storage_backend_ == nullptr ) {
+    return;
+  }
+
+  uploading_ = true;
+  upload_start_ = Clock::now();
+
+  /* the thunks' dependencies are uploaded as the thunks are read, so that
+     the ones that start early don't wait for the whole graph */
+  if ( loading() ) {
+    return;
+  }
+
+  vector<string> dependencies = dep_graph_.value_dependencies();
+  const vector<string> executable_dependencies = dep_graph_.executable_dependencies();
+  dependencies.insert( dependencies.end(), executable_dependencies.cbegin(),
+                       executable_dependencies.cend() );
+
+  start_uploads( dependencies );
+  print_upload_summary();
+}
+
+size_t Reductor::start_downloads( const vector<string> & hashes )
+{
+  vector<storage::GetRequest> download_requests;
+  size_t total_size = 0;
+
+  for ( const string & hash : hashes ) {
+    if ( gg::blobs::exists( hash ) or started_downloads_.count( hash ) ) {
+      continue;
     }
-  );
 
-  cerr << "done (" << upload_time.count() << " ms)." << endl;
+    started_downloads_.insert( hash );
+    download_requests.push_back( { hash, gg::paths::blob( hash ) } );
+    download_requests.back().content_hash.initialize( gg::hash::to_hex( hash ) );
+    total_size += gg::hash::size( hash );
+  }
+
+  if ( download_requests.size() > 0 ) {
+    async_storage_->get( download_requests,
+      [] ( const storage::GetRequest & ) {},
+      [] ( const string & object_key, const string & error )
+      { throw runtime_error( "download failed for " + object_key + ": " + error ); } );
+  }
+
+  return total_size;
 }
 
-void Reductor::download_targets( const vector<string> & hashes ) const
+void Reductor::download_targets( const vector<string> & hashes )
 {
   if ( storage_backend_ == nullptr ) {
     return;
   }
 
-  vector<storage::GetRequest> download_requests;
+  start_downloads( hashes );
+
+  size_t file_count = 0;
   size_t total_size = 0;
 
   for ( const string & hash : hashes ) {
-    if ( not roost::exists( gg::paths::blob( hash ) ) ) {
-      download_requests.push_back( { hash, gg::paths::blob( hash ) } );
+    if ( not gg::blobs::exists( hash ) ) {
+      file_count++;
       total_size += gg::hash::size( hash );
     }
   }
 
-  if ( download_requests.size() == 0 ) {
+  if ( file_count == 0 ) {
     cerr << "No files to download." << endl;
     return;
   }
 
-  const string plural = download_requests.size() == 1 ? "" : "s";
+  const string plural = file_count == 1 ? "" : "s";
   cerr << "\u2198 Downloading output file" << plural
        << " (" << format_bytes( total_size ) << ")... ";
   auto download_time = time_it<milliseconds>(
-    [&download_requests, this]()
+    [this]()
     {
-      storage_backend_->get( download_requests );
+      while ( async_storage_->pending() ) {
+        exec_loop_.loop_once();
+      }
     }
   );
 
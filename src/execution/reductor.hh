@@ -3,21 +3,39 @@
 #ifndef REDUCTOR_HH
 #define REDUCTOR_HH
 
+#include <map>
 #include <string>
 #include <vector>
-#include <deque>
 #include <memory>
 #include <chrono>
 #include <unordered_set>
 #include <unordered_map>
+#include <fstream>
 
 #include "loop.hh"
+#include "async_storage.hh"
 #include "engine.hh"
+#include "job_queue.hh"
+#include "runtime_model.hh"
+#include "placement.hh"
+#include "reduction_journal.hh"
 #include "thunk/graph.hh"
+#include "thunk/graph_loader.hh"
 #include "storage/backend.hh"
 
 class Reductor
 {
+public:
+  struct SpeculationStats
+  {
+    size_t launched { 0 };
+    size_t won { 0 };
+
+    /* assuming that a straggler would have run as long again as it had
+       already run when a duplicate beat it */
+    std::chrono::milliseconds time_saved { 0 };
+  };
+
 private:
   using Clock = std::chrono::steady_clock;
 
@@ -26,6 +44,40 @@ private:
     Clock::time_point start {};
     std::chrono::milliseconds timeout { 0 };
     uint8_t restarts { std::numeric_limits<uint8_t>::max() };
+
+    /* the thunks of a batch run one after the other */
+    size_t batch_size { 1 };
+
+    /* when each copy of the job started (the first one is the original), and
+       the engine running it; retries and speculative duplicates alike */
+    std::vector<Clock::time_point> copy_starts {};
+    std::vector<ExecutionEngine *> copy_engines {};
+    Clock::time_point last_start {};
+    size_t speculative { 0 };
+
+    /* the job as the placement saw it when it was first started */
+    Placement::Job placed {};
+  };
+
+  /* only small thunks are batched: by the size of their inputs, and by the
+     runtime we've seen for their function, if we've seen any */
+  static constexpr uint64_t MAX_BATCHED_INFILES_SIZE = 16 * 1024 * 1024;
+  static constexpr double MAX_BATCHED_RUNTIME_MS = 1000.0;
+
+  /* a job is duplicated at most this many times on account of its function's
+     runtimes, and the running jobs are checked for stragglers this often */
+  static constexpr size_t MAX_SPECULATIVE_COPIES = 2;
+  static constexpr std::chrono::milliseconds SPECULATION_CHECK_INTERVAL { 100 };
+
+  /* while the graph is loading, the loop is polled this often for the
+     thunks that have been read in the meantime */
+  static constexpr std::chrono::milliseconds LOADING_POLL_INTERVAL { 5 };
+
+  struct DeferredCompletion
+  {
+    std::string hash;
+    std::vector<gg::ThunkOutput> outputs;
+    float cost;
   };
 
   const std::vector<std::string> target_hashes_;
@@ -34,27 +86,129 @@ private:
 
   ExecutionGraph dep_graph_ {};
 
-  std::deque<std::string> job_queue_ {};
+  /* the thunks are read in the background; meanwhile, the ones that depend
+     on no other thunk are started as soon as they are read, and the jobs
+     that finish wait for the rest of the graph before they're recorded */
+  std::unique_ptr<GraphLoader> graph_loader_ { nullptr };
+  Clock::time_point load_start_ { Clock::now() };
+  std::unordered_set<std::string> released_jobs_ {};
+  std::vector<DeferredCompletion> deferred_completions_ {};
+
+  JobQueue job_queue_;
   std::unordered_map<std::string, JobInfo> running_jobs_ {};
   size_t finished_jobs_ { 0 };
   float estimated_cost_ { 0.0 };
 
+  RuntimeModel runtime_model_ {};
+  Placement placement_ { Placement::Policy::First, 0 };
+
+  /* one line for every job that finishes, for replaying its placement */
+  std::unique_ptr<std::ofstream> trace_ { nullptr };
+  Clock::time_point reduce_start_ {};
+
+  /* for each thunk (by its original hash), the earliest time it could have
+     started if we had infinite parallelism; used to measure the critical path */
+  std::unordered_map<std::string, Clock::duration> ready_at_ {};
+  Clock::duration critical_path_ { 0 };
+  Clock::duration makespan_ { 0 };
+
   std::chrono::milliseconds default_timeout_;
   size_t timeout_multiplier_;
+  double speculation_percentile_ { 0.0 };
   std::chrono::milliseconds timeout_check_interval_ { default_timeout_ / 2 };
   Clock::time_point next_timeout_check_ { Clock::now() + timeout_check_interval_ };
 
+  SpeculationStats speculation_stats_ {};
+
+  /* what has been dispatched and reduced so far, for picking up where we
+     left off; the updates that an earlier run journaled are checked against
+     the ones replaying its completions makes, instead of being written again */
+  std::unique_ptr<ReductionJournal> journal_ { nullptr };
+  size_t replayed_updates_ { 0 };
+
   ExecutionLoop exec_loop_ {};
   std::vector<std::unique_ptr<ExecutionEngine>> exec_engines_;
   std::vector<std::unique_ptr<ExecutionEngine>> fallback_engines_;
 
   std::unique_ptr<StorageBackend> storage_backend_;
+  std::unique_ptr<AsyncStorage> async_storage_ { nullptr };
+
+  /* the dependencies that are still being uploaded; a job that needs any of
+     them waits, with the number of them it needs, until they are there */
+  std::unordered_map<std::string, std::vector<std::string>> jobs_waiting_on_ {};
+  std::unordered_map<std::string, std::pair<JobQueue::Entry, size_t>> waiting_jobs_ {};
+  Clock::time_point upload_start_ {};
+
+  /* while the graph is loading, each thunk's dependencies start uploading
+     as soon as it's read */
+  bool uploading_ { false };
+  size_t upload_count_ { 0 };
+  size_t upload_size_ { 0 };
+
+  /* ready thunks that are going to run together, by engine and executable */
+  size_t max_batch_size_ { 1 };
+  std::map<std::pair<ExecutionEngine *, std::string>,
+           std::vector<gg::thunk::Thunk>> batches_ {};
+
+  bool prefetch_targets_ { false };
+  std::unordered_set<std::string> started_downloads_ {};
+
+  void enqueue( const std::string & hash );
+
+  bool loading() const { return graph_loader_ != nullptr; }
+
+  /* adds the thunks that have been read so far to the graph; once all of
+     them are there, starts the rest of the jobs. with `wait`, waits until
+     there's a job to start or the whole graph is loaded. */
+  void load_thunks( const bool wait );
+  void finish_loading();
+
+  bool resuming() const;
+
+  /* applies the completions an earlier run journaled, and looks up the ones
+     it dispatched but never heard back from in the storage backend */
+  void replay_journal();
+  void fetch_reductions( const std::vector<std::string> & hashes );
+
+  bool batches( ExecutionEngine & engine, const gg::thunk::Thunk & thunk ) const;
+  bool has_capacity( ExecutionEngine & engine, const gg::thunk::Thunk & thunk ) const;
+  void start_thunk( ExecutionEngine & engine, const gg::thunk::Thunk & thunk );
+  void start_batch( ExecutionEngine & engine, std::vector<gg::thunk::Thunk> && thunks );
+  void start_batches();
+
+  /* returns true if the job has to wait for its dependencies to be uploaded */
+  bool wait_for_uploads( JobQueue::Entry & job, const gg::thunk::Thunk & thunk );
+  void upload_finished( const std::string & hash );
+  void start_uploads( const std::vector<std::string> & dependencies );
+  void print_upload_summary() const;
+  void print_uploads_done() const;
+
+  /* returns the total size of the downloads it started */
+  size_t start_downloads( const std::vector<std::string> & hashes );
+
+  /* how long the loop may sleep: until the next straggler check, or until an
+     engine that the queued jobs are waiting for stops backing off */
+  int poll_timeout_ms() const;
+
+  /* launches duplicates of the jobs that are taking too long */
+  void check_stragglers( const Clock::time_point & now );
+
+  /* picks the copy of a finished job that most likely finished first,
+     cancels the others, and returns the winner's index */
+  size_t settle_copies( const std::string & hash, const JobInfo & job,
+                        const Clock::time_point & now );
+
+  Placement::Job placement_job( const gg::thunk::Thunk & thunk ) const;
+  void write_trace_header();
+
+  void record_completion( const std::string & hash,
+                          const Optional<Clock::duration> & runtime );
 
   void finalize_execution( const std::string & old_hash,
                            std::vector<gg::ThunkOutput> && outputs,
                            const float cost = 0.0 );
 
-  bool is_finished() const { return ( remaining_targets_.size() == 0 ); }
+  bool is_finished() const { return not loading() and remaining_targets_.size() == 0; }
 
 public:
   Reductor( const std::vector<std::string> & target_hashes,
@@ -63,12 +217,43 @@ public:
             std::unique_ptr<StorageBackend> && storage_backend,
             const std::chrono::milliseconds default_timeout = std::chrono::milliseconds { 0 },
             const size_t timeout_multiplier = 1,
-            const bool status_bar = false );
+            const bool status_bar = false,
+            const JobQueue::Policy scheduling_policy = JobQueue::Policy::CriticalPath );
 
   std::vector<std::string> reduce();
-  void upload_dependencies() const;
-  void download_targets( const std::vector<std::string> & hashes ) const;
+
+  /* starts uploading the dependencies in the background, or, if the graph
+     is still loading, as the thunks are read; reduce() holds back each thunk
+     until its own dependencies are uploaded */
+  void upload_dependencies();
+
+  /* start downloading each final output as soon as it is known */
+  void set_prefetch_targets( const bool prefetch ) { prefetch_targets_ = prefetch; }
+
+  void set_max_batch_size( const size_t max_batch_size );
+  void set_placement_policy( const Placement::Policy policy );
+
+  /* see gg-replay-placement for the format */
+  void set_trace_file( const std::string & path );
+
+  /* duplicate a job once it has run longer than this percentile (0 < p < 1)
+     of its function's recent runtimes; 0 leaves only the timeouts */
+  void set_speculation_percentile( const double percentile );
+
+  /* keeps a journal of the reduction at `path`, and first replays what's
+     already in it; see ReductionJournal */
+  void set_journal( const std::string & path );
+
+  void download_targets( const std::vector<std::string> & hashes );
   void print_status() const;
+
+  /* the longest chain of dependent executions in the last reduce() call,
+     i.e. the makespan we would have achieved with infinite parallelism */
+  std::chrono::milliseconds critical_path_length() const;
+  std::chrono::milliseconds makespan() const;
+
+  const ExecutionLoop::ConnectionPoolStats & connection_stats() const { return exec_loop_.pool_stats(); }
+  const SpeculationStats & speculation_stats() const { return speculation_stats_; }
 };
 
 #endif /* REDUCTOR_HH */
@@ -28,23 +28,22 @@ ExecutionResponse ExecutionResponse::parse_message( const std::string & message
   response.status = static_cast<JobStatus>( response_proto.return_code() );
   response.stdout = response_proto.stdout();
 
-  if ( response.status != JobStatus::Success ) {
-    return response;
-  }
-
-  if ( response_proto.executed_thunks_size() != 1 ) {
-    throw runtime_error( "current implementation only supports one thunk execution per response" );
+  for ( const auto & executed_proto : response_proto.executed_thunks() ) {
+    response.executed_thunks.push_back( { executed_proto.thunk_hash(), {} } );
+    vector<Output> & outputs = response.executed_thunks.back().outputs;
+
+    for ( const auto & output_proto : executed_proto.outputs() ) {
+      outputs.push_back( { output_proto.tag(),
+                           output_proto.hash(),
+                           output_proto.size(),
+                           output_proto.executable(),
+                           output_proto.data() } );
+    }
+
+    if ( outputs.empty() ) {
+      throw runtime_error( "no outputs for " + executed_proto.thunk_hash() );
+    }
   }
 
-  for ( const auto & output_proto : response_proto.executed_thunks( 0 ).outputs() ) {
-    response.outputs.push_back( { output_proto.tag(),
-                                  output_proto.hash(),
-                                  output_proto.size(),
-                                  output_proto.executable(),
-                                  output_proto.data() } );
-  }
-
-  response.thunk_hash = response_proto.executed_thunks( 0 ).thunk_hash();
-
   return response;
 }
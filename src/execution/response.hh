@@ -40,14 +40,22 @@ public:
     std::string data;
   };
 
+  struct ExecutedThunk
+  {
+    std::string thunk_hash;
+    std::vector<Output> outputs;
+  };
+
 private:
   ExecutionResponse() {}
 
 public:
   JobStatus status {};
 
-  std::string thunk_hash {};
-  std::vector<Output> outputs {};
+  /* when several thunks are executed together and one of them fails, the
+     ones that were executed before it are still here, and status is the
+     failure of the first one that isn't */
+  std::vector<ExecutedThunk> executed_thunks {};
 
   std::string stdout {};
 
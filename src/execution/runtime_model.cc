@@ -0,0 +1,79 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "runtime_model.hh"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr double RuntimeModel::ALPHA;
+constexpr double RuntimeModel::SIGNIFICANT_CHANGE;
+constexpr size_t RuntimeModel::MAX_RECENT;
+constexpr size_t RuntimeModel::MIN_RECENT;
+
+bool RuntimeModel::record( const string & function_hash,
+                           const steady_clock::duration & runtime )
+{
+  const double sample_ms = duration_cast<duration<double, milli>>( runtime ).count();
+  Estimate & estimate = estimates_[ function_hash ];
+
+  estimate.recent_ms.push_back( sample_ms );
+  if ( estimate.recent_ms.size() > MAX_RECENT ) {
+    estimate.recent_ms.pop_front();
+  }
+
+  if ( estimate.samples == 0 ) {
+    estimate.mean_ms = sample_ms;
+    estimate.samples = 1;
+    total_mean_ms_ += sample_ms;
+    return true;
+  }
+
+  const double old_mean = estimate.mean_ms;
+  estimate.mean_ms = ALPHA * sample_ms + ( 1 - ALPHA ) * old_mean;
+  estimate.samples++;
+  total_mean_ms_ += estimate.mean_ms - old_mean;
+
+  return fabs( estimate.mean_ms - old_mean ) > SIGNIFICANT_CHANGE * old_mean;
+}
+
+Optional<double> RuntimeModel::estimate_ms( const string & function_hash ) const
+{
+  auto it = estimates_.find( function_hash );
+
+  if ( it == estimates_.end() ) {
+    return {};
+  }
+
+  return { true, it->second.mean_ms };
+}
+
+Optional<double> RuntimeModel::percentile_ms( const string & function_hash,
+                                              const double p ) const
+{
+  auto it = estimates_.find( function_hash );
+
+  if ( it == estimates_.end() or it->second.recent_ms.size() < MIN_RECENT ) {
+    return {};
+  }
+
+  vector<double> sorted { it->second.recent_ms.begin(), it->second.recent_ms.end() };
+  /* nearest rank */
+  const size_t rank = min( sorted.size(),
+                           max<size_t>( 1, ceil( p * sorted.size() ) ) ) - 1;
+
+  nth_element( sorted.begin(), sorted.begin() + rank, sorted.end() );
+  return { true, sorted[ rank ] };
+}
+
+double RuntimeModel::default_estimate_ms() const
+{
+  if ( estimates_.empty() or total_mean_ms_ <= 0.0 ) {
+    return 1.0;
+  }
+
+  return total_mean_ms_ / estimates_.size();
+}
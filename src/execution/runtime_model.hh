@@ -0,0 +1,59 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef RUNTIME_MODEL_HH
+#define RUNTIME_MODEL_HH
+
+#include <string>
+#include <chrono>
+#include <deque>
+#include <unordered_map>
+
+#include "util/optional.hh"
+
+/* Keeps an online estimate of how long each function (identified by the hash
+   of its executable) takes to run, along with its most recent runtimes. */
+class RuntimeModel
+{
+private:
+  struct Estimate
+  {
+    double mean_ms { 0.0 };
+    size_t samples { 0 };
+    std::deque<double> recent_ms {};
+  };
+
+  /* how many of the most recent runtimes are kept for each function */
+  static constexpr size_t MAX_RECENT = 64;
+
+  /* percentiles aren't reported for functions with fewer runtimes than this */
+  static constexpr size_t MIN_RECENT = 5;
+
+  /* weight of the newest sample in the moving average */
+  static constexpr double ALPHA = 0.2;
+
+  /* an estimate that moves by more than this fraction is reported as changed */
+  static constexpr double SIGNIFICANT_CHANGE = 0.25;
+
+  std::unordered_map<std::string, Estimate> estimates_ {};
+  double total_mean_ms_ { 0.0 };
+
+public:
+  /* returns true if the estimate for this function changed significantly */
+  bool record( const std::string & function_hash,
+               const std::chrono::steady_clock::duration & runtime );
+
+  Optional<double> estimate_ms( const std::string & function_hash ) const;
+
+  /* the p-th percentile (0 <= p <= 1) of the function's recent runtimes */
+  Optional<double> percentile_ms( const std::string & function_hash,
+                                  const double p ) const;
+
+  /* the estimate for a function we have never seen: the average of the
+     estimates we have, or 1 ms if we have none, so that an unknown graph is
+     ranked by its depth */
+  double default_estimate_ms() const;
+
+  size_t size() const { return estimates_.size(); }
+};
+
+#endif /* RUNTIME_MODEL_HH */
@@ -2,6 +2,7 @@
 
 #include <iostream>
 
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "util/exception.hh"
 #include "util/path.hh"
@@ -28,17 +29,12 @@ int main( int argc, char * argv[] )
 
     gg::paths::blobs(); // Trigger the exception if GG_DIR is not set.
 
-    for ( int i = 1; i < argc; i++ ) {
-      roost::path src { argv[ i ] };
-      string hash = gg::hash::file( src );
-      roost::path dst = gg::paths::blob( hash );
+    const vector<roost::path> srcs { argv + 1, argv + argc };
+    const vector<string> hashes = gg::hash::files( srcs );
 
-      if ( not roost::exists( dst ) ) {
-        const mode_t permission = roost::is_executable( src ) ? 0500 : 0400;
-        roost::copy_then_rename( src, dst, true, permission );
-      }
-
-      cout << hash << endl;
+    for ( size_t i = 0; i < srcs.size(); i++ ) {
+      BlobStore::local().insert_file( srcs[ i ], hashes[ i ] );
+      cout << hashes[ i ] << endl;
     }
 
     return EXIT_SUCCESS;
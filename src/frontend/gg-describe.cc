@@ -9,6 +9,7 @@
 #include "protobufs/util.hh"
 #include "thunk/thunk.hh"
 #include "thunk/thunk_reader.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "trace/syscall.hh"
 #include "util/exception.hh"
@@ -70,10 +71,13 @@ int main( int argc, char * argv[] )
     roost::path thunk_path { argv[ optind ] };
 
     if ( not roost::exists( thunk_path ) ) {
-      thunk_path = gg::paths::blob( argv[ optind ] );
-
-      if ( not roost::exists( thunk_path ) ) {
-        roost::path pattern { thunk_path.string() + "*" };
+      if ( gg::blobs::exists( argv[ optind ] ) ) {
+        thunk_path = gg::blobs::path( argv[ optind ] );
+      }
+      else {
+        /* the shard is named after the beginning of the hash, but the
+           partial hash might be too short to tell which one it is */
+        roost::path pattern { gg::paths::blobs() / "*" / ( string( argv[ optind ] ) + "*" ) };
 
         glob_t glob_result;
 
@@ -13,6 +13,7 @@
 #include "net/http_response.hh"
 #include "net/http_request_parser.hh"
 #include "execution/loop.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "thunk/thunk.hh"
 #include "util/system_runner.hh"
@@ -91,8 +92,8 @@ int main( int argc, char * argv[] )
               cerr << http_request.first_line() << endl;
               if ( http_request.first_line().compare( 0, reset_line.length(), reset_line ) == 0 ) {
                 /* the user wants us to clean up the .gg directory */
-                roost::empty_directory( gg::paths::blobs() );
-                roost::empty_directory( gg::paths::reductions() );
+                BlobStore::local().clear();
+                gg::cache::clear();
                 // XXX roost::empty_directory( gg::paths::remotes() );
                 cerr << "cleared" << endl;
 
@@ -139,7 +140,7 @@ int main( int argc, char * argv[] )
                         break;
                       }
 
-                      const auto output_path = paths::blob( result->hash );
+                      const auto output_path = gg::blobs::path( result->hash );
                       const string output_data = result->hash[ 0 ] == 'T'
                                                ? base64::encode( roost::read_file( output_path ) )
                                                : "";
@@ -153,6 +154,8 @@ int main( int argc, char * argv[] )
                       *execution_response.add_outputs() = output_item;
                     }
 
+                    /* gg-execute stops at the first thunk that fails, so
+                       none of the ones after it ran */
                     if ( discard_rest ) { break; }
                     *response.add_executed_thunks() = execution_response;
                   }
@@ -185,8 +188,8 @@ int main( int argc, char * argv[] )
                   };
 
                   for ( auto & request_item : exec_request.thunks() ) {
-                    roost::atomic_create( base64::decode( request_item.data() ),
-                                          paths::blob( request_item.hash() ) );
+                    gg::blobs::insert( request_item.hash(),
+                                       base64::decode( request_item.data() ) );
 
                     command.emplace_back( request_item.hash() );
                   }
@@ -4,13 +4,21 @@
 #include <string>
 #include <memory>
 #include <sys/fcntl.h>
+#include <sys/prctl.h>
+#include <unistd.h>
 #include <getopt.h>
 #include <vector>
 #include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+#include <csignal>
 
+#include "execution/loop.hh"
 #include "execution/response.hh"
+#include "execution/meow/message.hh"
 #include "net/requests.hh"
 #include "storage/backend.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "thunk/factory.hh"
 #include "thunk/thunk_reader.hh"
@@ -19,7 +27,9 @@
 #include "util/child_process.hh"
 #include "util/digest.hh"
 #include "util/exception.hh"
+#include "util/ipc_socket.hh"
 #include "util/path.hh"
+#include "util/system_runner.hh"
 #include "util/temp_dir.hh"
 #include "util/temp_file.hh"
 #include "util/timelog.hh"
@@ -31,10 +41,9 @@ using namespace gg::thunk;
 using ReductionResult = gg::cache::ReductionResult;
 
 const bool sandboxed = ( getenv( "GG_SANDBOXED" ) != NULL );
-const string temp_dir_template = "/tmp/thunk-execute";
 const string temp_file_template = "/tmp/thunk-file";
 
-vector<string> execute_thunk( const Thunk & original_thunk )
+vector<string> execute_thunk( const Thunk & original_thunk, Optional<TimeLog> & timelog )
 {
   Thunk thunk = original_thunk;
 
@@ -64,20 +73,32 @@ vector<string> execute_thunk( const Thunk & original_thunk )
 
   /* when executing the thunk, we create a temp directory, and execute the thunk
      in that directory. then we take the outfile, compute the hash, and move it
-     to the .gg directory. */
+     to the .gg directory. the directory is under the scratch root, and moving
+     the outputs is a rename when that's on the same filesystem as .gg. */
 
   // PREPARING THE ENV
-  TempDirectory exec_dir { temp_dir_template };
+  TempDirectory exec_dir { ( gg::paths::scratch() / "thunk-execute" ).string() };
   roost::path exec_dir_path { exec_dir.name() };
   roost::path outfile_path { "output" };
 
   roost::create_directories( exec_dir_path );
 
+  // EXTRACTING THE PACKED DEPENDENCIES
+  for ( const Thunk::DataItem & item : thunk.values() ) {
+    gg::blobs::path( item.first );
+  }
+
+  for ( const Thunk::DataItem & item : thunk.executables() ) {
+    gg::blobs::path( item.first );
+  }
+
   // CREATING THE LINKS
   for ( auto & link : thunk.links() ) {
-    roost::symlink( gg::paths::blob( link.second ), exec_dir_path / link.first );
+    roost::symlink( gg::blobs::path( link.second ), exec_dir_path / link.first );
   }
 
+  if ( timelog.initialized() ) { timelog->add_point( "prepare" ); }
+
   // EXECUTING THE THUNK
   if ( not sandboxed ) {
     ChildProcess process {
@@ -124,6 +145,8 @@ vector<string> execute_thunk( const Thunk & original_thunk )
     }
   }
 
+  if ( timelog.initialized() ) { timelog->add_point( "execute" ); }
+
   vector<string> output_hashes;
 
   // GRABBING THE OUTPUTS & CREATING CACHE ENTRIES
@@ -134,19 +157,15 @@ vector<string> execute_thunk( const Thunk & original_thunk )
       throw ExecutionError {};
     }
 
-    /* let's check if the output is a thunk or not */
-    string outfile_hash = gg::hash::file( outfile );
-    roost::path outfile_gg = gg::paths::blob( outfile_hash );
-
-    if ( not roost::exists( outfile_gg ) ) {
-      roost::move_file( outfile, outfile_gg );
-    } else {
-      roost::remove( outfile );
-    }
+    /* the file is hashed on its way into the store; it's about to be moved
+       away, so there's no point in keeping its hash in the hash cache */
+    string outfile_hash = BlobStore::local().capture_file( outfile );
 
     output_hashes.emplace_back( move( outfile_hash ) );
   }
 
+  if ( timelog.initialized() ) { timelog->add_point( "store_outputs" ); }
+
   // REMOVING THE LINKS
   for ( auto & link : thunk.links() ) {
     roost::remove( exec_dir_path / link.first );
@@ -169,6 +188,8 @@ vector<string> execute_thunk( const Thunk & original_thunk )
     }
   }
 
+  if ( timelog.initialized() ) { timelog->add_point( "cache_outputs" ); }
+
   return output_hashes;
 }
 
@@ -186,10 +207,25 @@ void do_cleanup( const Thunk & thunk )
     infile_hashes.emplace( item.first );
   }
 
-  for ( const string & blob : roost::list_directory( gg::paths::blobs() ) ) {
-    const roost::path path = gg::paths::blob( blob );
-    if ( ( not roost::is_directory( path ) ) and infile_hashes.count( blob ) == 0 ) {
-      roost::remove( path );
+  auto cleanup_directory =
+    [&infile_hashes] ( const roost::path & directory )
+    {
+      for ( const string & blob : roost::get_directory_listing( directory ) ) {
+        const roost::path path = directory / blob;
+        if ( blob[ 0 ] != '.' and ( not roost::is_directory( path ) )
+             and infile_hashes.count( blob ) == 0 ) {
+          roost::remove( path );
+        }
+      }
+    };
+
+  /* the packfiles are left alone */
+  const roost::path blobs_path = gg::paths::blobs();
+  cleanup_directory( blobs_path );
+
+  for ( const string & shard : roost::get_directory_listing( blobs_path ) ) {
+    if ( shard.length() == 2 and roost::is_directory( blobs_path / shard ) ) {
+      cleanup_directory( blobs_path / shard );
     }
   }
 }
@@ -206,14 +242,16 @@ void fetch_dependencies( unique_ptr<StorageBackend> & storage_backend,
       {
         const auto target_path = gg::paths::blob( item.first );
 
-        if ( not roost::exists( target_path )
-             or roost::file_size( target_path ) != gg::hash::size( item.first ) ) {
+        if ( not gg::blobs::exists( item.first )
+             or roost::file_size( gg::blobs::path( item.first ) ) != gg::hash::size( item.first ) ) {
           if ( executables ) {
             download_items.push_back( { item.first, target_path, 0544 } );
           }
           else {
             download_items.push_back( { item.first, target_path, 0444 } );
           }
+
+          download_items.back().content_hash.initialize( gg::hash::to_hex( item.first ) );
         }
       };
 
@@ -234,30 +272,238 @@ void fetch_dependencies( unique_ptr<StorageBackend> & storage_backend,
 }
 
 void upload_output( unique_ptr<StorageBackend> & storage_backend,
+                    const string & thunk_hash, const Thunk & thunk,
                     const vector<string> & output_hashes )
 {
   try {
     vector<storage::PutRequest> requests;
     for ( const string & output_hash : output_hashes ) {
-      requests.push_back( { gg::paths::blob( output_hash ), output_hash,
+      requests.push_back( { gg::blobs::path( output_hash ), output_hash,
                             gg::hash::to_hex( output_hash ) } );
     }
     storage_backend->put( requests );
+
+    /* the record goes up last, so that it's only there once the outputs are */
+    vector<ThunkOutput> outputs;
+    for ( size_t i = 0; i < output_hashes.size(); i++ ) {
+      outputs.emplace_back( output_hashes[ i ], thunk.outputs().at( i ) );
+    }
+
+    TempFile record { temp_file_template };
+    record.fd().write( gg::remote::serialize_reduction( outputs ), true );
+    record.fd().close();
+
+    storage_backend->put( { { record.name(), gg::remote::reduction_key( thunk_hash ) } } );
   }
   catch ( const exception & ex ) {
     throw_with_nested( UploadOutputError {} );
   }
 }
 
+void execute_one( const string & thunk_hash,
+                  unique_ptr<StorageBackend> & storage_backend,
+                  const bool get_dependencies, const bool put_output,
+                  const bool cleanup, Optional<TimeLog> & timelog )
+{
+  /* take out an advisory lock on the thunk, in case
+     other gg-execute processes are running at the same time */
+  const string thunk_path = gg::blobs::path( thunk_hash ).string();
+  FileDescriptor raw_thunk { CheckSystemCall( "open( " + thunk_path + " )",
+                                              open( thunk_path.c_str(), O_RDONLY ) ) };
+  raw_thunk.block_for_exclusive_lock();
+
+  Thunk thunk = ThunkReader::read( thunk_path );
+
+  if ( timelog.initialized() ) { timelog->add_point( "read_thunk" ); }
+
+  if ( cleanup ) {
+    do_cleanup( thunk );
+  }
+
+  if ( timelog.initialized() ) { timelog->add_point( "do_cleanup" ); }
+
+  if ( get_dependencies ) {
+    fetch_dependencies( storage_backend, thunk );
+  }
+
+  if ( timelog.initialized() ) { timelog->add_point( "get_dependencies" ); }
+
+  vector<string> output_hashes = execute_thunk( thunk, timelog );
+
+  if ( put_output ) {
+    upload_output( storage_backend, thunk_hash, thunk, output_hashes );
+  }
+
+  if ( timelog.initialized() ) { timelog->add_point( "upload_output" ); }
+
+  if ( timelog.initialized() and storage_backend != nullptr ) {
+    TempFile tmplog { "/tmp/timelog" };
+    tmplog.fd().write( timelog->str(), true );
+    tmplog.fd().close();
+
+    vector<storage::PutRequest> requests;
+    requests.emplace_back( tmplog.name(), "timelog/" + thunk_hash );
+    storage_backend->put( requests );
+  }
+  else if ( timelog.initialized() ) {
+    cout << timelog->str() << endl;
+  }
+}
+
+/* prints the exception that is being handled, and returns the exit status
+   that tells the engine what went wrong */
+int failure_status( const char * argv0 )
+{
+  try {
+    throw;
+  }
+  catch ( const FetchDependenciesError & e ) {
+    print_nested_exception( e );
+    return to_underlying( JobStatus::FetchDependenciesFailure );
+  }
+  catch ( const ExecutionError & e ) {
+    print_nested_exception( e );
+    return to_underlying( JobStatus::ExecutionFailure );
+  }
+  catch ( const UploadOutputError & e ) {
+    print_nested_exception( e );
+    return to_underlying( JobStatus::UploadOutputFailure );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv0, e );
+    return to_underlying( JobStatus::OperationalFailure );
+  }
+}
+
+/* runs as one of the local engine's workers: connects to the engine at
+   `socket_path`, and runs every thunk it's sent in a process forked off this
+   one, so that the thunks don't pay for starting gg-execute (and setting up
+   the storage backend) anew. any number of them can run at once. with
+   `exec_each`, the forked process runs a new gg-execute for the thunk. */
+void serve( const char * argv0, const string & socket_path,
+            unique_ptr<StorageBackend> & storage_backend,
+            const bool get_dependencies, const bool put_output,
+            const bool exec_each )
+{
+  using meow::Message;
+
+  ExecutionLoop loop;
+  IPCSocket socket;
+  socket.connect( socket_path );
+
+  meow::MessageParser message_parser;
+  bool connected = true;
+
+  shared_ptr<IPCConnection> connection = loop.add_connection<IPCSocket>( move( socket ),
+    [&message_parser] ( shared_ptr<IPCConnection>, string && data )
+    {
+      message_parser.parse( data );
+      return true;
+    },
+    [] () {},
+    [&connected] () { connected = false; } );
+
+  /* the processes running each thunk */
+  unordered_map<string, vector<uint64_t>> running;
+
+  while ( connected and loop.loop_once( -1 ).result == Poller::Result::Type::Success ) {
+    while ( not message_parser.empty() ) {
+      const Message & message = message_parser.front();
+      const string & hash = message.payload();
+
+      switch ( message.opcode() ) {
+      case Message::OpCode::Execute:
+      {
+        const uint64_t id = loop.add_child_process( hash,
+          [&running, &connection] ( const uint64_t id, const string & hash, const int status )
+          {
+            vector<uint64_t> & children = running.at( hash );
+            children.erase( find( children.begin(), children.end(), id ) );
+            if ( children.empty() ) {
+              running.erase( hash );
+            }
+
+            if ( status == 0 ) {
+              connection->enqueue_write( Message { Message::OpCode::Executed, string { hash } }.str() );
+            }
+            else {
+              connection->enqueue_write(
+                Message { Message::OpCode::ExecutionFailed, hash + " " + to_string( status ) }.str() );
+            }
+          },
+          [argv0, hash, &storage_backend, get_dependencies, put_output, exec_each,
+           server=getpid()] ()
+          {
+            /* the thunk doesn't outlive the worker, which is killed when the
+               engine goes away */
+            CheckSystemCall( "prctl(PR_SET_PDEATHSIG)", prctl( PR_SET_PDEATHSIG, SIGKILL ) );
+
+            if ( getppid() != server ) {
+              return to_underlying( JobStatus::OperationalFailure );
+            }
+
+            if ( exec_each ) {
+              vector<string> command { "gg-execute" };
+
+              if ( get_dependencies ) { command.push_back( "--get-dependencies" ); }
+              if ( put_output ) { command.push_back( "--put-output" ); }
+
+              command.push_back( hash );
+              return ezexec( command[ 0 ], command, {}, true, true );
+            }
+
+            try {
+              Optional<TimeLog> no_timelog;
+              execute_one( hash, storage_backend, get_dependencies, put_output,
+                           false, no_timelog );
+              return to_underlying( JobStatus::Success );
+            }
+            catch ( const exception & ) {
+              return failure_status( argv0 );
+            }
+          },
+          false );
+
+        running[ hash ].push_back( id );
+        break;
+      }
+
+      case Message::OpCode::Cancel:
+      {
+        auto children = running.find( hash );
+
+        if ( children != running.end() ) {
+          for ( const uint64_t id : children->second ) {
+            loop.kill_child_process( id );
+          }
+
+          running.erase( children );
+        }
+
+        break;
+      }
+
+      default:
+        throw runtime_error( "unexpected message from the engine" );
+      }
+
+      message_parser.pop();
+    }
+  }
+}
+
 void usage( const char * argv0 )
 {
   cerr << "Usage: " << argv0 << " [options] THUNK-HASH..." << endl
+  << "       " << argv0 << " [-g] [-p] [-x] --serve=SOCKET" << endl
   << endl
   << "Options: " << endl
   << " -g, --get-dependencies  Fetch the missing dependencies from the remote storage" << endl
   << " -p, --put-output        Upload the output to the remote storage" << endl
   << " -C, --cleanup           Remove unnecessary blobs in .gg dir" << endl
   << " -T, --timelog           Produce timing log for this execution" << endl
+  << " -s, --serve=SOCKET      Run the thunks the local engine at SOCKET sends" << endl
+  << " -x, --exec              With --serve, run each thunk in a new gg-execute" << endl
   << endl;
 }
 
@@ -276,19 +522,23 @@ int main( int argc, char * argv[] )
     bool get_dependencies = false;
     bool put_output = false;
     bool cleanup = false;
+    string serve_socket;
+    bool exec_each = false;
     Optional<TimeLog> timelog;
     unique_ptr<StorageBackend> storage_backend;
 
     const option command_line_options[] = {
-      { "get-dependencies", no_argument, nullptr, 'g' },
-      { "put-output",       no_argument, nullptr, 'p' },
-      { "cleanup",          no_argument, nullptr, 'C' },
-      { "timelog",          no_argument, nullptr, 'T' },
+      { "get-dependencies", no_argument,       nullptr, 'g' },
+      { "put-output",       no_argument,       nullptr, 'p' },
+      { "cleanup",          no_argument,       nullptr, 'C' },
+      { "timelog",          no_argument,       nullptr, 'T' },
+      { "serve",            required_argument, nullptr, 's' },
+      { "exec",             no_argument,       nullptr, 'x' },
       { nullptr, 0, nullptr, 0 },
     };
 
     while ( true ) {
-      const int opt = getopt_long( argc, argv, "gpCT", command_line_options, nullptr );
+      const int opt = getopt_long( argc, argv, "gpCTs:x", command_line_options, nullptr );
 
       if ( opt == -1 ) {
         break;
@@ -299,6 +549,8 @@ int main( int argc, char * argv[] )
       case 'p': put_output = true; break;
       case 'C': cleanup = true; break;
       case 'T': timelog.reset(); break;
+      case 's': serve_socket = optarg; break;
+      case 'x': exec_each = true; break;
 
       default:
         throw runtime_error( "invalid option: " + string { argv[ optind - 1 ] } );
@@ -311,81 +563,32 @@ int main( int argc, char * argv[] )
       thunk_hashes.push_back( argv[ i ] );
     }
 
-    if ( thunk_hashes.size() == 0 ) {
+    if ( thunk_hashes.size() == 0 and serve_socket.empty() ) {
       usage( argv[ 0 ] );
       return to_underlying( JobStatus::OperationalFailure );
     }
 
     gg::models::init();
 
-    for ( const string & thunk_hash : thunk_hashes ) {
-      /* take out an advisory lock on the thunk, in case
-         other gg-execute processes are running at the same time */
-      const string thunk_path = gg::paths::blob( thunk_hash ).string();
-      FileDescriptor raw_thunk { CheckSystemCall( "open( " + thunk_path + " )",
-                                                  open( thunk_path.c_str(), O_RDONLY ) ) };
-      raw_thunk.block_for_exclusive_lock();
-
-      Thunk thunk = ThunkReader::read( thunk_path );
-
-      if ( timelog.initialized() ) { timelog->add_point( "read_thunk" ); }
-
-      if ( get_dependencies or put_output ) {
-        storage_backend = StorageBackend::create_backend( gg::remote::storage_backend_uri() );
-      }
-
-      if ( cleanup ) {
-        do_cleanup( thunk );
-      }
-
-      if ( timelog.initialized() ) { timelog->add_point( "do_cleanup" ); }
-
-      if ( get_dependencies ) {
-        fetch_dependencies( storage_backend, thunk );
-      }
-
-      if ( timelog.initialized() ) { timelog->add_point( "get_dependencies" ); }
-
-      vector<string> output_hashes = execute_thunk( thunk );
-
-      if ( timelog.initialized() ) { timelog->add_point( "execute" ); }
-
-      if ( put_output ) {
-        upload_output( storage_backend, output_hashes );
-      }
-
-      if ( timelog.initialized() ) { timelog->add_point( "upload_output" ); }
+    /* with --exec, the thunks' own gg-executes talk to the storage */
+    if ( ( get_dependencies or put_output ) and not exec_each ) {
+      storage_backend = StorageBackend::create_backend( gg::remote::storage_backend_uri() );
+    }
 
-      if ( timelog.initialized() and storage_backend != nullptr ) {
-        TempFile tmplog { "/tmp/timelog" };
-        tmplog.fd().write( timelog->str(), true );
-        tmplog.fd().close();
+    if ( not serve_socket.empty() ) {
+      serve( argv[ 0 ], serve_socket, storage_backend, get_dependencies, put_output,
+             exec_each );
+      return EXIT_SUCCESS;
+    }
 
-        vector<storage::PutRequest> requests;
-        requests.emplace_back( tmplog.name(), "timelog/" + thunk_hash );
-        storage_backend->put( requests );
-      }
-      else if ( timelog.initialized() ) {
-        cout << timelog->str() << endl;
-      }
+    for ( const string & thunk_hash : thunk_hashes ) {
+      execute_one( thunk_hash, storage_backend, get_dependencies, put_output,
+                   cleanup, timelog );
     }
 
     return to_underlying( JobStatus::Success );
   }
-  catch ( const FetchDependenciesError & e ) {
-    print_nested_exception( e );
-    return to_underlying( JobStatus::FetchDependenciesFailure );
-  }
-  catch ( const ExecutionError & e ) {
-    print_nested_exception( e );
-    return to_underlying( JobStatus::ExecutionFailure );
-  }
-  catch ( const UploadOutputError & e ) {
-    print_nested_exception( e );
-    return to_underlying( JobStatus::UploadOutputFailure );
-  }
   catch ( const exception & e ) {
-    print_exception( argv[ 0 ], e );
-    return to_underlying( JobStatus::OperationalFailure );
+    return failure_status( argv[ 0 ] );
   }
 }
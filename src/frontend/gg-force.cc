@@ -1,6 +1,8 @@
 /* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
 
 #include <iostream>
+#include <fstream>
+#include <iomanip>
 #include <vector>
 #include <thread>
 #include <tuple>
@@ -13,6 +15,7 @@
 #include "net/s3.hh"
 #include "storage/backend_local.hh"
 #include "storage/backend_s3.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "thunk/placeholder.hh"
 #include "thunk/thunk_reader.hh"
@@ -29,6 +32,7 @@
 #include "util/optional.hh"
 #include "util/path.hh"
 #include "util/timeit.hh"
+#include "util/tokenize.hh"
 #include "util/util.hh"
 
 using namespace std;
@@ -50,15 +54,40 @@ void usage( const char * argv0 )
        << "       " << "[-s|--no-status] [-d|--no-download] [-S|--sandboxed]" << endl
        << "       " << "[[-j|--jobs=<N>] [-e|--engine=<name>[=ENGINE_ARGS]]]... " << endl
        << "       " << "[[-j|--jobs=<N>] [-f|--fallback-engine=<name>[=ENGINE_ARGS]]]..." << endl
-       << "       " << "[-T|--timeout=<t>] [-m|--timeout-multiplier=<N>] THUNKS..." << endl
+       << "       " << "[-T|--timeout=<t>] [-m|--timeout-multiplier=<N>]" << endl
+       << "       " << "[-P|--scheduler=<fifo|critical-path>] [-b|--batch-size=<N>]" << endl
+       << "       " << "[-p|--speculate-at=<P>] [-l|--placement=<policy>]" << endl
+       << "       " << "[-t|--placement-trace=<file>] [-J|--journal=<file>] THUNKS..." << endl
        << endl
        << "Available engines:" << endl
-       << "  - local   Executes the jobs on the local machine" << endl
+       << "  - local   Executes the jobs on the local machine; local=pool[:N] keeps" << endl
+       << "            N gg-execute workers running instead of starting one per job" << endl
        << "  - lambda  Executes the jobs on AWS Lambda" << endl
        << "  - remote  Executes the jobs on a remote machine" << endl
        << "  - meow    Executes the jobs on AWS Lambda with long-running workers" << endl
        << "  - gcloud  Executes the jobs on Google Cloud Functions" << endl
        << endl
+       << "Placement policies (with more than one engine):" << endl
+       << "  - first     The first engine that has room for the job (default)" << endl
+       << "  - fastest   The engine that should finish the job first" << endl
+       << "  - cheapest  The engine that should run the job for the least money" << endl
+       << "  - balanced  Both, with a dollar weighing as much as an hour" << endl
+       << endl
+       << "Schedulers:" << endl
+       << "  - critical-path  Runs the jobs on the longest remaining path first (default)" << endl
+       << "  - fifo           Runs the jobs in the order they become ready" << endl
+       << endl
+       << "With a batch size above 1, the lambda and remote engines run up to that" << endl
+       << "many small thunks with the same executable in one invocation." << endl
+       << endl
+       << "A job that runs longer than the P-th percentile of its function's recent" << endl
+       << "runtimes is duplicated, and whichever copy finishes first wins. Only the" << endl
+       << "local engine stops the copies that lose (default: 0, which only duplicates" << endl
+       << "the jobs that pass their timeout)." << endl
+       << endl
+       << "With a journal, the progress of the reduction is written to the file, and a" << endl
+       << "later run with the same journal and thunks picks up where this one stopped." << endl
+       << endl
        << "Environment variables:" << endl
        << "  - " << FORCE_NO_STATUS << endl
        << "  - " << FORCE_DEFAULT_ENGINE << endl
@@ -102,8 +131,30 @@ unique_ptr<ExecutionEngine> make_execution_engine( const EngineInfo & engine )
   const size_t max_jobs = get<2>( engine );
 
   if ( engine_name == "local" ) {
-    const bool mixed = (engine_params == "mixed");
-    return make_unique<LocalExecutionEngine>( mixed, max_jobs );
+    bool mixed = false;
+    size_t workers = 0;
+
+    for ( const string & param : split( engine_params, "," ) ) {
+      if ( param == "mixed" ) {
+        mixed = true;
+      }
+      else if ( param == "pool" ) {
+        workers = ( max_jobs + LocalExecutionEngine::JOBS_PER_WORKER - 1 )
+                  / LocalExecutionEngine::JOBS_PER_WORKER;
+      }
+      else if ( param.compare( 0, 5, "pool:" ) == 0 ) {
+        workers = stoul( param.substr( 5 ) );
+
+        if ( workers == 0 ) {
+          throw runtime_error( "local: a pool needs at least one worker" );
+        }
+      }
+      else if ( not param.empty() ) {
+        throw runtime_error( "local: unknown parameter: " + param );
+      }
+    }
+
+    return make_unique<LocalExecutionEngine>( mixed, max_jobs, workers );
   }
   else if ( engine_name == "lambda" ) {
     return make_unique<AWSLambdaExecutionEngine>( max_jobs, AWSCredentials(),
@@ -168,6 +219,12 @@ int main( int argc, char * argv[] )
     size_t timeout_multiplier = 1;
     bool status_bar = !( getenv( FORCE_NO_STATUS ) != nullptr );
     bool no_download = false;
+    JobQueue::Policy scheduling_policy = JobQueue::Policy::CriticalPath;
+    size_t batch_size = 1;
+    double speculation_percentile = 0.0;
+    Placement::Policy placement_policy = Placement::Policy::First;
+    string placement_trace;
+    string journal;
 
     size_t total_max_jobs = 0;
     size_t max_jobs = thread::hardware_concurrency();
@@ -183,11 +240,17 @@ int main( int argc, char * argv[] )
       { "engine",             required_argument, nullptr, 'e' },
       { "fallback-engine",    required_argument, nullptr, 'f' },
       { "no-download",        no_argument,       nullptr, 'd' },
+      { "scheduler",          required_argument, nullptr, 'P' },
+      { "batch-size",         required_argument, nullptr, 'b' },
+      { "speculate-at",       required_argument, nullptr, 'p' },
+      { "placement",          required_argument, nullptr, 'l' },
+      { "placement-trace",    required_argument, nullptr, 't' },
+      { "journal",            required_argument, nullptr, 'J' },
       { nullptr,              0,                 nullptr,  0  },
     };
 
     while ( true ) {
-      const int opt = getopt_long( argc, argv, "sSj:T:e:d", long_options, NULL );
+      const int opt = getopt_long( argc, argv, "sSj:T:e:dP:b:p:l:t:J:", long_options, NULL );
 
       if ( opt == -1 ) {
         break;
@@ -228,6 +291,30 @@ int main( int argc, char * argv[] )
         timeout_multiplier = stoul( optarg );
         break;
 
+      case 'P':
+        scheduling_policy = JobQueue::parse_policy( optarg );
+        break;
+
+      case 'b':
+        batch_size = stoul( optarg );
+        break;
+
+      case 'p':
+        speculation_percentile = stod( optarg );
+        break;
+
+      case 'l':
+        placement_policy = Placement::parse_policy( optarg );
+        break;
+
+      case 't':
+        placement_trace = optarg;
+        break;
+
+      case 'J':
+        journal = optarg;
+        break;
+
       default:
         throw runtime_error( "invalid option" );
       }
@@ -319,15 +406,64 @@ int main( int argc, char * argv[] )
                         move( fallback_engines ),
                         move( storage_backend ),
                         std::chrono::milliseconds { timeout * 1000 },
-                        timeout_multiplier, status_bar };
+                        timeout_multiplier, status_bar,
+                        scheduling_policy };
+
+    reductor.set_prefetch_targets( not no_download );
+    reductor.set_max_batch_size( batch_size );
+    reductor.set_speculation_percentile( speculation_percentile );
+    reductor.set_placement_policy( placement_policy );
+
+    if ( not placement_trace.empty() ) {
+      reductor.set_trace_file( placement_trace );
+    }
+
+    if ( not journal.empty() ) {
+      reductor.set_journal( journal );
+    }
 
     reductor.upload_dependencies();
     vector<string> reduced_hashes = reductor.reduce();
+
+    const auto critical_path = reductor.critical_path_length();
+    const auto makespan = reductor.makespan();
+
+    cerr << "\u2192 Critical path: " << critical_path.count() << " ms, makespan: "
+         << makespan.count() << " ms";
+
+    if ( makespan.count() > 0 ) {
+      cerr << " (" << fixed << setprecision( 1 )
+           << ( 100.0 * critical_path.count() / makespan.count() )
+           << "% of the makespan)";
+    }
+
+    cerr << "." << endl;
+
+    const auto & connection_stats = reductor.connection_stats();
+
+    if ( connection_stats.requests > 0 ) {
+      cerr << "\u2192 Requests: " << connection_stats.requests << " over "
+           << connection_stats.connections_opened << " connection"
+           << ( connection_stats.connections_opened == 1 ? "" : "s" ) << " ("
+           << connection_stats.handshakes_avoided << " handshakes avoided, "
+           << connection_stats.pipelined_requests << " pipelined, "
+           << connection_stats.retried_requests << " retried)." << endl;
+    }
+
+    const auto & speculation_stats = reductor.speculation_stats();
+
+    if ( speculation_stats.launched > 0 ) {
+      cerr << "\u2192 Stragglers: " << speculation_stats.launched << " duplicate"
+           << ( speculation_stats.launched == 1 ? "" : "s" ) << " launched, "
+           << speculation_stats.won << " won, ~"
+           << speculation_stats.time_saved.count() << " ms saved." << endl;
+    }
+
     if ( not no_download and not reduced_hashes.empty() ) {
       reductor.download_targets( reduced_hashes );
 
       for ( size_t i = 0; i < reduced_hashes.size(); i++ ) {
-        roost::copy_then_rename( gg::paths::blob( reduced_hashes[ i ] ), actual_targets[ i ] );
+        roost::copy_then_rename( gg::blobs::path( reduced_hashes[ i ] ), actual_targets[ i ] );
 
         /* HACK this is a just a dirty hack... it's not always right */
         roost::make_executable( actual_targets[ i ] );
@@ -5,6 +5,7 @@
 
 #include "net/requests.hh"
 #include "storage/backend.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.cc"
 
 using namespace std;
@@ -31,6 +32,13 @@ int main( int argc, char * argv[] )
     vector<storage::GetRequest> get_requests;
     for ( int i = 1; i < argc; i++ ) {
       const string hash { argv[ i ] };
+
+      /* the store may have it already, possibly in a packfile */
+      if ( gg::blobs::exists( hash ) ) {
+        cerr << "HAVE " << hash << endl;
+        continue;
+      }
+
       get_requests.emplace_back( hash, gg::paths::blob( hash ) );
     }
     storage_backend->get( get_requests,
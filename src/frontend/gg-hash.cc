@@ -17,7 +17,7 @@ using namespace gg;
 
 void usage( const char * argv0 )
 {
-  cerr << argv0 << " FILENAME" << endl;
+  cerr << argv0 << " FILENAME..." << endl;
 }
 
 int main( int argc, char * argv[] )
@@ -27,12 +27,16 @@ int main( int argc, char * argv[] )
       abort();
     }
 
-    if ( argc != 2 ) {
+    if ( argc < 2 ) {
       usage( argv[ 0 ] );
       return EXIT_FAILURE;
     }
 
-    cout << gg::hash::file_force( argv[ 1 ] ) << endl;
+    const vector<roost::path> paths { argv + 1, argv + argc };
+
+    for ( const string & hash : gg::hash::files( paths, true ) ) {
+      cout << hash << endl;
+    }
   }
   catch ( const exception &  e ) {
     print_exception( argv[ 0 ], e );
@@ -12,6 +12,7 @@
 #include "net/address.hh"
 #include "net/http_response.hh"
 #include "net/http_request.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "execution/loop.hh"
 #include "execution/meow/message.hh"
@@ -86,22 +87,28 @@ int main( int argc, char * argv[] )
 
         case Message::OpCode::Get:
         {
+          /* another worker needs this object, and the coordinator relays it */
           const string & hash = message.payload();
-          string object_data = roost::read_file( gg::paths::blob( hash ) );
-          Message message { Message::OpCode::Put, move( object_data ) };
-          connection->enqueue_write( message.str() );
+          send_put_message( *connection, hash );
           cerr << "[get] " << hash << endl;
           break;
         }
 
+        case Message::OpCode::Drop:
+        {
+          const vector<string> hashes = handle_drop_message( message );
+          cerr << "[drop] " << hashes.size() << " object(s)" << endl;
+          break;
+        }
+
         case Message::OpCode::Execute:
         {
           protobuf::RequestItem execution_request;
           protoutil::from_string( message.payload(), execution_request );
 
-          /* let's write the thunk to disk first */
-          roost::atomic_create( base64::decode( execution_request.data() ),
-                                gg::paths::blob( execution_request.hash() ) );
+          /* let's store the thunk first */
+          gg::blobs::insert( execution_request.hash(),
+                             base64::decode( execution_request.data() ) );
 
           /* making it cheaper to copy */
           execution_request.set_data( "" );
@@ -130,7 +137,7 @@ int main( int argc, char * argv[] )
                   throw runtime_error( "output not found" );
                 }
 
-                const auto output_path = paths::blob( result->hash );
+                const auto output_path = gg::blobs::path( result->hash );
                 const string output_data = ""; // base64::encode( roost::read_file( output_path ) );
 
                 output_item.set_tag( tag );
@@ -147,10 +154,11 @@ int main( int argc, char * argv[] )
             },
             [hash=execution_request.hash()]()
             {
+              /* no --cleanup: the coordinator decides what stays on disk,
+                 and tells us with Drop messages */
               vector<string> command { "gg-execute-static",
                                        "--get-dependencies",
                                        "--put-output",
-                                       "--cleanup",
                                        hash };
 
               if ( timelog ) {
@@ -9,6 +9,7 @@
 #include <cstring>
 #include <unordered_map>
 #include <sys/ptrace.h>
+#include <sys/syscall.h>
 
 #include "thunk/ggutils.hh"
 #include "thunk/placeholder.hh"
@@ -37,6 +38,15 @@ int main( int argc, char * argv[] )
       return EXIT_FAILURE;
     }
 
+    /* only the opens stop the build, if the kernel can filter the rest */
+    const SystemCallFilter filter = SystemCallFilter::available()
+      ? SystemCallFilter::only( { SYS_open, SYS_openat,
+#ifdef SYS_openat2
+                                  SYS_openat2,
+#endif
+                                } )
+      : SystemCallFilter {};
+
     Tracer tracer {
       argv[ 1 ],
       [&argv] { return execvp( argv[ 1 ], &argv[ 1 ] ); },
@@ -44,60 +54,94 @@ int main( int argc, char * argv[] )
         {
           Optional<SystemCallInvocation> & invocation = tcb.syscall_invocation;
 
+          /* glibc's open() is an openat() */
+          int dirfd = AT_FDCWD;
+          string open_path;
+          long open_flags;
+
           switch ( invocation->syscall_no() ) {
           case SYS_open:
-            {
-              invocation->fetch_arguments();
-              string open_path = invocation->arguments()->at( 0 ).value<string>();
+            open_path = invocation->string_argument( 0 );
+            open_flags = invocation->raw_argument( 1 );
+            break;
 
-              if ( open_path == gg::models::OPEN_TO_DETACH_PATH ) {
-                tcb.detach = true;
-                break;
-              }
+          case SYS_openat:
+            dirfd = invocation->raw_argument( 0 );
+            open_path = invocation->string_argument( 1 );
+            open_flags = invocation->raw_argument( 2 );
+            break;
 
-              // cerr << invocation->to_string() << endl;
+#ifdef SYS_openat2
+          case SYS_openat2:
+            /* the flags are the first member of struct open_how */
+            dirfd = invocation->raw_argument( 0 );
+            open_path = invocation->string_argument( 1 );
+            errno = 0;
+            open_flags = ptrace( PTRACE_PEEKDATA, tcb.pid, invocation->raw_argument( 2 ), nullptr );
+            if ( errno ) { throw unix_error( "ptrace(PEEKDATA)" ); }
+            break;
+#endif
 
-              /* if process wants to truncate the file, we don't
-                 care whether it's a thunk placeholder or not */
-              const int open_flags = invocation->arguments()->at( 1 ).value<int>();
-              if ( open_flags & O_TRUNC ) {
-                break;
-              }
+          default:
+            return;
+          }
 
-              /* otherwise: does the file
-                 (1) exist,
-                 (2) as a regular file,
-                 (3) that we can open,
-                 (4) and as a thunk placeholder? */
-
-              struct stat stat_buf;
-              const int stat_ret = stat( open_path.c_str(), &stat_buf );
-              if ( stat_ret == 0 ) {
-                /* (1) it exists -- is it a regular file? */
-                if ( S_ISREG( stat_buf.st_mode ) ) {
-                  /* (2) it's a regular file -- can we open it? */
-                  const int fd_num = open( open_path.c_str(), O_RDONLY );
-                  if ( fd_num >= 0 ) {
-                    /* (3) successfully opened -- is it a thunk placeholder? */
-                    if ( ThunkPlaceholder::is_placeholder( FileDescriptor { fd_num } ) ) {
-                      /* (4) it's a thunk placeholder! let's force it */
-                      tcb.pause = true;
-                      ChildProcess reducer { "gg-force " + open_path,
-                          [&](){ return ezexec( "gg-force", { "gg-force", open_path },
-                                                {}, true, true ); } };
-                      const pid_t reducer_pid = reducer.pid();
-                      flock.add_child_process( move( reducer ) );
-                      flock.resume_after_termination( reducer_pid, tcb.pid );
-                    }
-                  }
+          if ( open_path == gg::models::OPEN_TO_DETACH_PATH ) {
+            tcb.detach = true;
+            return;
+          }
+
+          // cerr << invocation->to_string() << endl;
+
+          /* if process wants to truncate the file, we don't
+             care whether it's a thunk placeholder or not */
+          if ( open_flags & O_TRUNC ) {
+            return;
+          }
+
+          /* the path is relative to the tracee's directory, not ours */
+          if ( open_path.empty() ) {
+            return;
+          }
+          else if ( open_path[ 0 ] != '/' ) {
+            open_path = "/proc/" + to_string( tcb.pid )
+                      + ( dirfd == AT_FDCWD ? "/cwd/" : "/fd/" + to_string( dirfd ) + "/" )
+                      + open_path;
+          }
+
+          /* otherwise: does the file
+             (1) exist,
+             (2) as a regular file,
+             (3) that we can open,
+             (4) and as a thunk placeholder? */
+
+          struct stat stat_buf;
+          const int stat_ret = stat( open_path.c_str(), &stat_buf );
+          if ( stat_ret == 0 ) {
+            /* (1) it exists -- is it a regular file? */
+            if ( S_ISREG( stat_buf.st_mode ) ) {
+              /* (2) it's a regular file -- can we open it? */
+              const int fd_num = open( open_path.c_str(), O_RDONLY );
+              if ( fd_num >= 0 ) {
+                /* (3) successfully opened -- is it a thunk placeholder? */
+                if ( ThunkPlaceholder::is_placeholder( FileDescriptor { fd_num } ) ) {
+                  /* (4) it's a thunk placeholder! let's force it */
+                  tcb.pause = true;
+                  ChildProcess reducer { "gg-force " + open_path,
+                      [&](){ return ezexec( "gg-force", { "gg-force", open_path },
+                                            {}, true, true ); } };
+                  const pid_t reducer_pid = reducer.pid();
+                  flock.add_child_process( move( reducer ) );
+                  flock.resume_after_termination( reducer_pid, tcb.pid );
                 }
               }
             }
-            break;
           }
         },
 
-        [&]( const TracedThreadInfo & ) {}
+        [&]( const TracedThreadInfo & ) {},
+        [](){},
+        filter
     };
 
     tracer.loop_until_done();
@@ -9,6 +9,7 @@
 #include "net/http_response.hh"
 #include "net/http_request_parser.hh"
 #include "execution/loop.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "util/path.hh"
 
@@ -91,15 +92,13 @@ int main( int argc, char * argv[] )
               const string requested_object = first_line.substr( first_space + 2,
                                                                  last_space - first_space - 2 );
 
-              const roost::path object_path = gg::paths::blob( requested_object );
-              if ( not roost::exists( object_path ) or
-                   roost::is_directory( object_path ) or
-                   requested_object.find( '/' ) != string::npos ) {
+              if ( requested_object.find( '/' ) != string::npos or
+                   not gg::blobs::exists( requested_object ) ) {
                 connection->enqueue_write( get_canned_response( 404, request ) );
                 continue;
               }
 
-              const string payload = roost::read_file( object_path );
+              const string payload = gg::blobs::read( requested_object );
               HTTPResponse response;
               response.set_request( request );
               response.set_first_line( "HTTP/1.1 200 OK" );
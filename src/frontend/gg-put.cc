@@ -30,14 +30,13 @@ int main( int argc, char * argv[] )
 
     unique_ptr<StorageBackend> storage_backend = StorageBackend::create_backend( gg::remote::storage_backend_uri() );
 
-    vector<storage::PutRequest> put_requests;
+    vector<pair<string, string>> files; /* name, hash */
     int arg_index = 1;
     bool last_batch = false;
     string line;
 
     while ( not last_batch ) {
       string file_name;
-      string file_hash;
 
       if ( read_names_from_stdin ) {
         if ( getline( cin, line ) ) {
@@ -57,21 +56,34 @@ int main( int argc, char * argv[] )
       }
 
       if ( not last_batch ) {
-        file_hash = gg::hash::file_force( file_name );
-        if ( not storage_backend->is_available( file_hash ) ) {
-          put_requests.emplace_back( file_name, file_hash, gg::hash::to_hex( file_hash ) );
-        }
+        files.emplace_back( file_name, gg::hash::file_force( file_name ) );
       }
 
-      if ( put_requests.size() >= BATCH_SIZE or
-           ( put_requests.size() > 0 and last_batch ) ) {
+      if ( files.size() >= BATCH_SIZE or
+           ( files.size() > 0 and last_batch ) ) {
+        /* the objects in a shared storage might be there already */
+        vector<string> hashes;
+        for ( const auto & file : files ) {
+          hashes.push_back( file.second );
+        }
+
+        const vector<bool> available = storage_backend->find_available( hashes );
+        vector<storage::PutRequest> put_requests;
+
+        for ( size_t i = 0; i < files.size(); i++ ) {
+          if ( not available[ i ] ) {
+            put_requests.emplace_back( files[ i ].first, files[ i ].second,
+                                       gg::hash::to_hex( files[ i ].second ) );
+          }
+        }
+
         storage_backend->put( put_requests,
           [&storage_backend]( const storage::PutRequest & request ) {
             storage_backend->set_available( request.object_key );
             cerr << "PUT " << request.filename.string() << " -> " << request.object_key << endl;
           } );
 
-        put_requests.clear();
+        files.clear();
       }
     }
   }
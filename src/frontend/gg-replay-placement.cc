@@ -0,0 +1,371 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* replays the jobs of a gg-force placement trace against the placement
+   policies, in simulated time */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <deque>
+#include <tuple>
+#include <limits>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <getopt.h>
+
+#include "execution/placement.hh"
+#include "util/exception.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+/* The trace has a line for each of the engines:
+
+     #engine INDEX LABEL MAX_JOBS IS_REMOTE COST_PER_MS
+
+   and one for each job that finished, in the order they finished:
+
+     START_MS THUNK FUNCTION INFILES_SIZE MISSING_LOCAL MISSING_REMOTE ENGINE RUNTIME_MS COST
+
+   with the fields separated by tabs. */
+
+struct TraceEngine
+{
+  string label {};
+  size_t max_jobs { 1 };
+  Placement::Engine engine {};
+};
+
+struct TraceJob
+{
+  double start_ms { 0 };
+  string thunk {};
+  Placement::Job job {};
+  size_t engine { 0 };
+  double runtime_ms { 0 };
+};
+
+struct Trace
+{
+  vector<TraceEngine> engines {};
+  vector<TraceJob> jobs {};
+};
+
+Trace read_trace( const string & path )
+{
+  ifstream fin { path };
+
+  if ( not fin.good() ) {
+    throw runtime_error( "could not open " + path );
+  }
+
+  Trace trace;
+  string line;
+
+  while ( getline( fin, line ) ) {
+    if ( line.empty() ) {
+      continue;
+    }
+
+    istringstream fields { line };
+    fields.exceptions( ios::failbit | ios::badbit );
+
+    if ( line[ 0 ] == '#' ) {
+      string tag;
+      size_t index;
+      TraceEngine engine;
+
+      fields >> tag >> index >> engine.label >> engine.max_jobs
+             >> engine.engine.is_remote >> engine.engine.cost_per_ms;
+
+      if ( index != trace.engines.size() ) {
+        throw runtime_error( "engines are out of order in the trace" );
+      }
+
+      trace.engines.push_back( engine );
+      continue;
+    }
+
+    TraceJob job;
+    double cost;
+
+    fields >> job.start_ms >> job.thunk >> job.job.function_hash
+           >> job.job.infiles_size >> job.job.missing_local_size
+           >> job.job.missing_remote_size >> job.engine >> job.runtime_ms >> cost;
+
+    if ( job.engine >= trace.engines.size() ) {
+      throw runtime_error( "unknown engine in the trace: " + to_string( job.engine ) );
+    }
+
+    trace.jobs.push_back( job );
+  }
+
+  stable_sort( trace.jobs.begin(), trace.jobs.end(),
+               [] ( const TraceJob & a, const TraceJob & b )
+               { return a.start_ms < b.start_ms; } );
+
+  return trace;
+}
+
+/* how long a traced job would have run on any of the engines: as recorded, if
+   it ran there; otherwise the mean runtime of its function on that engine, or
+   its own runtime scaled by how the engines compare overall. the difference
+   in moving its inputs around is added on top. */
+class RuntimeOracle
+{
+private:
+  const Trace & trace_;
+  map<pair<size_t, string>, pair<double, size_t>> function_runtimes_ {};
+  vector<pair<double, size_t>> engine_runtimes_;
+
+  static double mean( const pair<double, size_t> & sum ) { return sum.first / sum.second; }
+
+public:
+  RuntimeOracle( const Trace & trace )
+    : trace_( trace ), engine_runtimes_( trace.engines.size() )
+  {
+    for ( const TraceJob & job : trace.jobs ) {
+      auto & function_sum = function_runtimes_[ { job.engine, job.job.function_hash } ];
+      function_sum.first += job.runtime_ms;
+      function_sum.second++;
+
+      engine_runtimes_[ job.engine ].first += job.runtime_ms;
+      engine_runtimes_[ job.engine ].second++;
+    }
+  }
+
+  double runtime_ms( const TraceJob & job, const size_t engine,
+                     const Placement & placement ) const
+  {
+    if ( engine == job.engine ) {
+      return job.runtime_ms;
+    }
+
+    double runtime = job.runtime_ms;
+    auto function_it = function_runtimes_.find( { engine, job.job.function_hash } );
+
+    if ( function_it != function_runtimes_.end() ) {
+      runtime = mean( function_it->second );
+    }
+    else if ( engine_runtimes_[ engine ].second > 0 ) {
+      runtime *= mean( engine_runtimes_[ engine ] ) / mean( engine_runtimes_[ job.engine ] );
+    }
+
+    runtime += placement.transfer_ms( trace_.engines[ engine ].engine, job.job )
+               - placement.transfer_ms( trace_.engines[ job.engine ].engine, job.job );
+
+    return max( 1.0, runtime );
+  }
+};
+
+struct ReplayResult
+{
+  double makespan_ms { 0 };
+  double mean_latency_ms { 0 };
+  double cost { 0 };
+  vector<size_t> jobs_per_engine {};
+};
+
+ReplayResult replay( const Trace & trace, const Placement::Policy policy )
+{
+  Placement placement { policy, trace.engines.size() };
+  RuntimeOracle oracle { trace };
+
+  ReplayResult result;
+  result.jobs_per_engine.resize( trace.engines.size() );
+
+  vector<size_t> running( trace.engines.size() );
+
+  /* (finish time, job index, engine) */
+  using Completion = tuple<double, size_t, size_t>;
+  priority_queue<Completion, vector<Completion>, greater<Completion>> completions;
+
+  deque<size_t> waiting;
+  size_t next_arrival = 0;
+  double now = 0;
+  double total_latency = 0;
+
+  while ( next_arrival < trace.jobs.size() or not waiting.empty()
+          or not completions.empty() ) {
+    /* advance to the next event */
+    double next_event = numeric_limits<double>::infinity();
+
+    if ( next_arrival < trace.jobs.size() ) {
+      next_event = trace.jobs[ next_arrival ].start_ms;
+    }
+
+    if ( not completions.empty() ) {
+      next_event = min( next_event, get<0>( completions.top() ) );
+    }
+
+    if ( next_event == numeric_limits<double>::infinity() ) {
+      throw runtime_error( "jobs are waiting for engines that can't run them" );
+    }
+
+    now = max( now, next_event );
+
+    while ( not completions.empty() and get<0>( completions.top() ) <= now ) {
+      const Completion completion = completions.top();
+      completions.pop();
+
+      const TraceJob & job = trace.jobs[ get<1>( completion ) ];
+      const size_t engine = get<2>( completion );
+      const double runtime = oracle.runtime_ms( job, engine, placement );
+
+      placement.record( engine, job.job.function_hash,
+                        duration_cast<steady_clock::duration>( duration<double, milli>( runtime ) ) );
+      running[ engine ]--;
+      total_latency += now - job.start_ms;
+    }
+
+    while ( next_arrival < trace.jobs.size() and trace.jobs[ next_arrival ].start_ms <= now ) {
+      waiting.push_back( next_arrival++ );
+    }
+
+    /* like the reductor: once every engine is full, the rest of the jobs
+       wait; a job that waits for a busy engine by choice doesn't hold up the
+       ones behind it */
+    for ( auto it = waiting.begin(); it != waiting.end(); ) {
+      const TraceJob & job = trace.jobs[ *it ];
+
+      vector<Placement::Engine> engines;
+      bool any_capacity = false;
+
+      for ( size_t i = 0; i < trace.engines.size(); i++ ) {
+        engines.push_back( trace.engines[ i ].engine );
+        engines.back().has_capacity = running[ i ] < trace.engines[ i ].max_jobs;
+        any_capacity |= engines.back().has_capacity;
+      }
+
+      if ( not any_capacity ) {
+        break;
+      }
+
+      const Optional<size_t> chosen = placement.choose( job.job, engines );
+
+      if ( not chosen.initialized() ) {
+        it++;
+        continue;
+      }
+
+      const double runtime = oracle.runtime_ms( job, *chosen, placement );
+
+      running[ *chosen ]++;
+      result.jobs_per_engine[ *chosen ]++;
+      result.cost += runtime * trace.engines[ *chosen ].engine.cost_per_ms;
+      completions.emplace( now + runtime, *it, *chosen );
+      it = waiting.erase( it );
+    }
+  }
+
+  result.makespan_ms = now;
+  result.mean_latency_ms = trace.jobs.empty() ? 0 : total_latency / trace.jobs.size();
+  return result;
+}
+
+void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [-l|--placement=<policy>]... "
+       << "[-j|--jobs=<ENGINE>=<N>]... TRACE" << endl
+       << endl
+       << "Replays a trace that gg-force --placement-trace wrote against the given" << endl
+       << "placement policies (default: all of them). The jobs arrive when they" << endl
+       << "started in the trace, and their runtimes on the other engines are" << endl
+       << "estimated from the rest of the trace." << endl;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    vector<pair<string, Placement::Policy>> policies;
+    vector<pair<size_t, size_t>> max_jobs;
+
+    struct option long_options[] = {
+      { "placement", required_argument, nullptr, 'l' },
+      { "jobs",      required_argument, nullptr, 'j' },
+      { nullptr,     0,                 nullptr,  0  },
+    };
+
+    while ( true ) {
+      const int opt = getopt_long( argc, argv, "l:j:", long_options, NULL );
+
+      if ( opt == -1 ) {
+        break;
+      }
+
+      switch ( opt ) {
+      case 'l':
+        policies.emplace_back( optarg, Placement::parse_policy( optarg ) );
+        break;
+
+      case 'j':
+      {
+        const string arg { optarg };
+        const size_t eqpos = arg.find( '=' );
+
+        if ( eqpos == string::npos ) {
+          throw runtime_error( "expected ENGINE=N: " + arg );
+        }
+
+        max_jobs.emplace_back( stoul( arg.substr( 0, eqpos ) ), stoul( arg.substr( eqpos + 1 ) ) );
+        break;
+      }
+
+      default:
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+
+    if ( optind != argc - 1 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    Trace trace = read_trace( argv[ optind ] );
+
+    for ( const auto & engine_jobs : max_jobs ) {
+      trace.engines.at( engine_jobs.first ).max_jobs = engine_jobs.second;
+    }
+
+    if ( policies.empty() ) {
+      for ( const char * name : { "first", "fastest", "cheapest", "balanced" } ) {
+        policies.emplace_back( name, Placement::parse_policy( name ) );
+      }
+    }
+
+    cout << trace.jobs.size() << " jobs on " << trace.engines.size() << " engines" << endl;
+
+    for ( const auto & policy : policies ) {
+      const ReplayResult result = replay( trace, policy.second );
+
+      cout << setw( 10 ) << left << policy.first
+           << " makespan " << setw( 9 ) << right << fixed << setprecision( 0 )
+           << result.makespan_ms << " ms"
+           << "  latency " << setw( 8 ) << result.mean_latency_ms << " ms"
+           << "  cost $" << setprecision( 6 ) << result.cost << " ";
+
+      for ( size_t i = 0; i < trace.engines.size(); i++ ) {
+        cout << " " << trace.engines[ i ].label << ":" << result.jobs_per_engine[ i ];
+      }
+
+      cout << endl;
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "net/s3.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "util/path.hh"
 
@@ -39,6 +40,11 @@ int main( int argc, char * const argv[] )
 
   string object_key;
   while ( cin >> object_key ) {
+    /* the store may have it already, possibly in a packfile */
+    if ( gg::blobs::exists( object_key ) ) {
+      continue;
+    }
+
     files.push_back( { object_key, gg::paths::blob( object_key ) } );
   }
 
@@ -4,6 +4,7 @@
 #include <cstring>
 #include <iostream>
 
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "thunk/thunk_reader.hh"
 #include "thunk/thunk.hh"
@@ -48,7 +49,7 @@ struct ThunkStats
 
 ThunkStats print_thunk_info( const string & hash, unsigned int indent )
 {
-  const Thunk thunk { move( ThunkReader::read( gg::paths::blob( hash ) ) ) };
+  const Thunk thunk { move( ThunkReader::read( gg::blobs::map( hash ) ) ) };
   const string indentation( indent, ' ' );
 
   const string display_name = shortn( hash );
@@ -0,0 +1,111 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <iostream>
+#include <vector>
+#include <getopt.h>
+
+#include "net/compression.hh"
+#include "net/requests.hh"
+#include "storage/backend.hh"
+#include "thunk/blob_store.hh"
+#include "thunk/ggutils.hh"
+#include "util/exception.hh"
+#include "util/path.hh"
+#include "util/util.hh"
+
+using namespace std;
+
+void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << endl
+       << "       " << "[-s|--size KiB] [-u|--upload]" << endl
+       << "       " << "SAMPLE..." << endl;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc < 2 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    size_t capacity = 110 * 1024;
+    bool upload = false;
+
+    const option command_line_options[] = {
+      { "size",   required_argument, nullptr, 's' },
+      { "upload", no_argument,       nullptr, 'u' },
+      { 0, 0, 0, 0 }
+    };
+
+    while ( true ) {
+      const int opt = getopt_long( argc, argv, "s:u", command_line_options, nullptr );
+
+      if ( opt == -1 ) { break; }
+
+      switch ( opt ) {
+      case 's':
+        capacity = stoul( optarg ) * 1024;
+        break;
+
+      case 'u':
+        upload = true;
+        break;
+
+      default:
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+    }
+
+    if ( optind >= argc ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    gg::paths::blobs(); // Trigger the exception if GG_DIR is not set.
+
+    /* the dictionary only helps the objects that are small enough to be
+       compressed with it */
+    const size_t max_sample_size = storage::CompressionOptions {}.dictionary_max_size;
+
+    vector<string> samples;
+    size_t samples_size = 0;
+
+    for ( int i = optind; i < argc; i++ ) {
+      if ( static_cast<size_t>( roost::file_size( argv[ i ] ) ) <= max_sample_size ) {
+        samples.push_back( roost::read_file( argv[ i ] ) );
+        samples_size += samples.back().size();
+      }
+    }
+
+    cerr << "Training on " << samples.size() << " sample"
+         << ( samples.size() == 1 ? "" : "s" )
+         << " (" << format_bytes( samples_size ) << ")... ";
+
+    const string dictionary = storage::compression::train_dictionary( samples, capacity );
+    const string hash = gg::hash::compute( dictionary, gg::ObjectType::Value );
+    gg::blobs::insert( hash, dictionary );
+
+    cerr << "done (" << format_bytes( dictionary.size() ) << ")." << endl;
+
+    if ( upload ) {
+      auto storage_backend = StorageBackend::create_backend( gg::remote::storage_backend_uri() );
+      storage_backend->put( { { gg::blobs::path( hash ), hash, gg::hash::to_hex( hash ) } } );
+      storage_backend->set_available( hash );
+    }
+
+    cout << "dictionary=" << hash << endl;
+  }
+  catch ( const exception &  e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
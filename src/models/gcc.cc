@@ -21,6 +21,7 @@
 #include "protobufs/util.hh"
 #include "thunk/factory.hh"
 #include "thunk/placeholder.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "thunk/thunk.hh"
 #include "util/digest.hh"
@@ -181,8 +182,7 @@ string GCCModelGenerator::do_preprocessing( const InputFile & input )
   run( args[ 0 ], args, {}, true, true );
 
   const string hash = gg::hash::file( temp_output.name() );
-  const auto & actual_path = gg::paths::blob( hash );
-  roost::move_file( temp_output.name(), actual_path );
+  BlobStore::local().move_file( temp_output.name(), hash );
 
   return hash;
 }
@@ -409,8 +409,8 @@ string GCCModelGenerator::generate_thunk( const GCCStage first_stage,
       cc1_program = CC1PLUS;
     }
 
-    for ( const string & dep : dependencies ) {
-      base_infiles.emplace_back( dep );
+    for ( ThunkFactory::Data & dep : ThunkFactory::Data::from_files( dependencies ) ) {
+      base_infiles.push_back( move( dep ) );
     }
 
     for ( const string & dir : include_path ) {
@@ -471,12 +471,7 @@ string GCCModelGenerator::generate_thunk( const GCCStage first_stage,
           }
 
           const string hash = blueprints.get( canonical_dir );
-          const roost::path src = gg::paths::blueprint( hash );
-          const roost::path dst = gg::paths::blob( hash );
-
-          if ( not roost::exists( dst ) ) {
-            roost::copy_then_rename( src, dst, true, 0400 );
-          }
+          BlobStore::local().insert_file( gg::paths::blueprint( hash ), hash );
 
           tarballs.insert( hash );
         };
@@ -5,6 +5,7 @@
 
 #include "gcc.hh"
 #include "timeouts.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/thunk.hh"
 #include "thunk/thunk_reader.hh"
 #include "thunk/thunk_writer.hh"
@@ -43,7 +44,7 @@ void prepare_include_path( const roost::path & sysroot,
   /* (1) extract the tarballs */
   for ( const string & tarball_hash : tarballs ) {
     vector<string> extract_args { "/bin/tar", "xf",
-                                  gg::paths::blob( tarball_hash ).string(),
+                                  gg::blobs::path( tarball_hash ).string(),
                                   "-C", sysroot.string(), "-I", "/bin/gzip" };
 
     cerr << "Extracting " << tarball_hash << "...";
@@ -124,8 +125,8 @@ int main( int argc, char * argv[] )
     const string path_envar = "PATH=" + gcc_dir.string();
     const roost::path gcc_path = gcc_dir / ( ( op_mode == OperationMode::GCC ) ? "gcc" : "g++" );
     const roost::path cc1_path = gcc_dir / cc1_function_name;
-    roost::symlink( gg::paths::blob( gcc_function_hash ), gcc_path );
-    roost::symlink( gg::paths::blob( cc1_function_hash ), cc1_path );
+    roost::symlink( gg::blobs::path( gcc_function_hash ), gcc_path );
+    roost::symlink( gg::blobs::path( cc1_function_hash ), cc1_path );
 
     /* extract the tarballs containig stripped header files *********/
     const vector<string> tarballs = split( include_tarballs, ":" );
@@ -148,7 +149,7 @@ int main( int argc, char * argv[] )
       cerr << "Putting file " << value.second << "...";
       roost::create_directories( roost::dirname( filepath ) );
       if ( roost::exists( filepath ) ) { roost::remove( filepath ); }
-      roost::symlink( gg::paths::blob( value.first ), filepath );
+      roost::symlink( gg::blobs::path( value.first ), filepath );
       cerr << "done." << endl;
     }
 
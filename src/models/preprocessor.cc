@@ -203,9 +203,12 @@ GCCModelGenerator::generate_dependencies_file( const OperationMode op_mode,
 
   /* assemble the infiles */
   const vector<string> infiles_list = parse_dependencies_file( output_name, target_name );
+  const vector<string> infiles_hashes =
+    gg::hash::files( { infiles_list.begin(), infiles_list.end() } );
+
   vector<Thunk::DataItem> dependencies;
-  for ( const auto & str : infiles_list ) {
-    dependencies.emplace_back( make_pair( gg::hash::file( str ), str ) );
+  for ( size_t i = 0; i < infiles_list.size(); i++ ) {
+    dependencies.emplace_back( infiles_hashes[ i ], infiles_list[ i ] );
   }
 
   Thunk dep_cache_entry( makedep_fn, dependencies,
@@ -41,7 +41,7 @@ HTTPRequest AWSRequest::to_http_request() const
   req.done_with_headers();
 
   req.read_in_body( contents_ );
-  assert( req.state() == COMPLETE );
+  assert( req.state() == COMPLETE or contents_.empty() );
 
   return req;
 }
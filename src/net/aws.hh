@@ -52,6 +52,8 @@ protected:
               const std::string & first_line, const std::string & contents );
 
 public:
+  /* if the request has a content-length but no contents, its body is
+     streamed by the caller, after the request's headers_str() */
   HTTPRequest to_http_request() const;
 };
 
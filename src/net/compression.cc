@@ -0,0 +1,342 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "compression.hh"
+
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zstd.h>
+#include <zdict.h>
+
+#include "util/exception.hh"
+
+using namespace std;
+using namespace storage;
+using storage::compression::MAGIC;
+
+const string compression::MAGIC { "\x89ggz\r\n\x1a\n", 8 };
+
+/* a zstd frame header is at most this long, and it has the dictionary id */
+static constexpr size_t FRAME_HEADER_MAX_SIZE = 18;
+
+/* objects that don't shrink by at least 1/COMPRESSION_MIN_GAIN go as they are */
+static constexpr size_t COMPRESSION_MIN_GAIN = 10;
+
+static size_t CheckZSTD( const string & s_attempt, const size_t return_value )
+{
+  if ( ZSTD_isError( return_value ) ) {
+    throw runtime_error( s_attempt + ": " + ZSTD_getErrorName( return_value ) );
+  }
+
+  return return_value;
+}
+
+namespace {
+
+  struct Dictionaries
+  {
+    mutex lock {};
+    map<unsigned, shared_ptr<ZSTD_DDict>> by_id {};
+  };
+
+  Dictionaries & dictionaries()
+  {
+    static Dictionaries dictionaries;
+    return dictionaries;
+  }
+
+}
+
+compression::Counters & compression::counters()
+{
+  static Counters counters;
+  return counters;
+}
+
+unsigned compression::add_dictionary( const string & dictionary )
+{
+  const unsigned id = ZSTD_getDictID_fromDict( dictionary.data(), dictionary.size() );
+
+  if ( id == 0 ) {
+    throw runtime_error( "not a zstd dictionary" );
+  }
+
+  shared_ptr<ZSTD_DDict> ddict { ZSTD_createDDict( dictionary.data(), dictionary.size() ),
+                                 ZSTD_freeDDict };
+
+  if ( ddict == nullptr ) {
+    throw runtime_error( "ZSTD_createDDict failed" );
+  }
+
+  Dictionaries & known = dictionaries();
+  unique_lock<mutex> lock { known.lock };
+  known.by_id[ id ] = ddict;
+
+  return id;
+}
+
+string compression::train_dictionary( const vector<string> & samples,
+                                      const size_t capacity )
+{
+  string samples_buffer;
+  vector<size_t> sample_sizes;
+
+  for ( const string & sample : samples ) {
+    samples_buffer.append( sample );
+    sample_sizes.push_back( sample.size() );
+  }
+
+  string dictionary( capacity, '\0' );
+  const size_t dictionary_size = ZDICT_trainFromBuffer( &dictionary[ 0 ], capacity,
+                                                        samples_buffer.data(),
+                                                        sample_sizes.data(),
+                                                        sample_sizes.size() );
+
+  if ( ZDICT_isError( dictionary_size ) ) {
+    throw runtime_error( string( "ZDICT_trainFromBuffer: " ) + ZDICT_getErrorName( dictionary_size ) );
+  }
+
+  dictionary.resize( dictionary_size );
+  return dictionary;
+}
+
+ObjectEncoder::ObjectEncoder( const CompressionOptions & options,
+                              const string & dictionary )
+  : options_( options )
+{
+  if ( dictionary.empty() ) {
+    return;
+  }
+
+  dictionary_.reset( ZSTD_createCDict( dictionary.data(), dictionary.size(), options_.level ),
+                     ZSTD_freeCDict );
+
+  if ( dictionary_ == nullptr ) {
+    throw runtime_error( "ZSTD_createCDict failed" );
+  }
+}
+
+bool ObjectEncoder::worth_compressing( const size_t size, const string & head ) const
+{
+  if ( not options_.enabled or size < options_.min_size ) {
+    return false;
+  }
+
+  /* the formats that are compressed already */
+  static const vector<string> compressed_formats {
+    "\x1f\x8b",           /* gzip */
+    "\x28\xb5\x2f\xfd",   /* zstd */
+    "\xfd" "7zXZ",        /* xz */
+    "BZh",                /* bzip2 */
+    "PK\x03\x04",         /* zip, jar */
+    "\x89PNG",
+    "\xff\xd8\xff",       /* jpeg */
+    "\x37\xa4\x30\xec",   /* zstd dictionary, which has to be readable without itself */
+  };
+
+  for ( const string & format : compressed_formats ) {
+    if ( head.compare( 0, format.size(), format ) == 0 ) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+unique_ptr<TempFile> ObjectEncoder::encode( const roost::path & source,
+                                            const string & temp_template ) const
+{
+  FileDescriptor file { CheckSystemCall( "open (" + source.string() + ")",
+                                         open( source.string().c_str(), O_RDONLY ) ) };
+
+  const size_t size = roost::file_size( source );
+  const string head = file.read_exactly( min( size, MAGIC.size() ), true );
+  const bool forced = ( head == MAGIC );
+
+  if ( not forced and not worth_compressing( size, head ) ) {
+    return nullptr;
+  }
+
+  unique_ptr<ZSTD_CCtx, size_t ( * )( ZSTD_CCtx * )> context { ZSTD_createCCtx(), ZSTD_freeCCtx };
+
+  if ( context == nullptr ) {
+    throw runtime_error( "ZSTD_createCCtx failed" );
+  }
+
+  CheckZSTD( "ZSTD_CCtx_setParameter",
+             ZSTD_CCtx_setParameter( context.get(), ZSTD_c_compressionLevel, options_.level ) );
+  CheckZSTD( "ZSTD_CCtx_setPledgedSrcSize",
+             ZSTD_CCtx_setPledgedSrcSize( context.get(), size ) );
+
+  if ( dictionary_ != nullptr and size <= options_.dictionary_max_size ) {
+    CheckZSTD( "ZSTD_CCtx_refCDict", ZSTD_CCtx_refCDict( context.get(), dictionary_.get() ) );
+  }
+
+  thread_local string input;
+  thread_local string output;
+  input.resize( ZSTD_CStreamInSize() );
+  output.resize( ZSTD_CStreamOutSize() );
+
+  auto compressed = make_unique<TempFile>( temp_template );
+  FileDescriptor & destination = compressed->fd();
+
+  destination.write( MAGIC );
+  size_t compressed_size = MAGIC.size();
+
+  auto compress =
+    [&] ( const char * data, const size_t length, const ZSTD_EndDirective mode )
+    {
+      ZSTD_inBuffer in { data, length, 0 };
+      size_t remaining;
+
+      do {
+        ZSTD_outBuffer out { &output[ 0 ], output.size(), 0 };
+        remaining = CheckZSTD( "ZSTD_compressStream2",
+                               ZSTD_compressStream2( context.get(), &out, &in, mode ) );
+
+        if ( out.pos ) {
+          destination.write( output.cbegin(), output.cbegin() + out.pos );
+          compressed_size += out.pos;
+        }
+      } while ( ( mode == ZSTD_e_end ) ? ( remaining != 0 ) : ( in.pos != in.size ) );
+    };
+
+  compress( head.data(), head.size(), ZSTD_e_continue );
+
+  while ( true ) {
+    const ssize_t bytes_read = CheckSystemCall( "read (" + source.string() + ")",
+                                                ::read( file.fd_num(), &input[ 0 ], input.size() ) );
+
+    if ( bytes_read == 0 ) {
+      break;
+    }
+
+    compress( input.data(), bytes_read, ZSTD_e_continue );
+  }
+
+  compress( nullptr, 0, ZSTD_e_end );
+
+  if ( not forced and compressed_size > size - size / COMPRESSION_MIN_GAIN ) {
+    return nullptr;
+  }
+
+  return compressed;
+}
+
+void ObjectDecoder::start_frame()
+{
+  /* the frame header says which dictionary, if any, the object needs */
+  const unsigned dictionary_id = ZSTD_getDictID_fromFrame( head_.data() + MAGIC.size(),
+                                                           head_.size() - MAGIC.size() );
+
+  context_ = { ZSTD_createDCtx(), ZSTD_freeDCtx };
+
+  if ( context_ == nullptr ) {
+    throw runtime_error( "ZSTD_createDCtx failed" );
+  }
+
+  if ( dictionary_id != 0 ) {
+    Dictionaries & known = dictionaries();
+    unique_lock<mutex> lock { known.lock };
+
+    auto dictionary = known.by_id.find( dictionary_id );
+
+    if ( dictionary == known.by_id.end() ) {
+      throw runtime_error( "object was compressed with unknown dictionary "
+                           + to_string( dictionary_id ) );
+    }
+
+    CheckZSTD( "ZSTD_DCtx_refDDict", ZSTD_DCtx_refDDict( context_.get(), dictionary->second.get() ) );
+  }
+
+  buffer_.resize( ZSTD_DStreamOutSize() );
+  frame_remaining_ = 1;
+}
+
+void ObjectDecoder::decompress( const char * data, const size_t length, const Sink & sink )
+{
+  ZSTD_inBuffer in { data, length, 0 };
+
+  /* a full buffer means the decoder may be holding more output */
+  bool buffer_full = false;
+
+  while ( in.pos < in.size or buffer_full ) {
+    if ( frame_remaining_ == 0 ) {
+      if ( in.pos < in.size ) {
+        throw runtime_error( "unexpected data after the end of a compressed object" );
+      }
+
+      break;
+    }
+
+    ZSTD_outBuffer out { buffer_.data(), buffer_.size(), 0 };
+    frame_remaining_ = CheckZSTD( "ZSTD_decompressStream",
+                                  ZSTD_decompressStream( context_.get(), &out, &in ) );
+
+    if ( out.pos ) {
+      sink( buffer_.data(), out.pos );
+    }
+
+    buffer_full = ( out.pos == out.size );
+  }
+}
+
+void ObjectDecoder::append( const string & data, const Sink & sink )
+{
+  switch ( state_ ) {
+  case State::Raw:
+    if ( data.size() ) {
+      sink( data.data(), data.size() );
+    }
+    break;
+
+  case State::Compressed:
+    decompress( data.data(), data.size(), sink );
+    break;
+
+  case State::Sniffing:
+    head_.append( data );
+
+    if ( head_.compare( 0, min( head_.size(), MAGIC.size() ), MAGIC, 0,
+                        min( head_.size(), MAGIC.size() ) ) != 0 ) {
+      state_ = State::Raw;
+      sink( head_.data(), head_.size() );
+      head_.clear();
+    }
+    else if ( head_.size() >= MAGIC.size() + FRAME_HEADER_MAX_SIZE ) {
+      state_ = State::Compressed;
+      start_frame();
+      decompress( head_.data() + MAGIC.size(), head_.size() - MAGIC.size(), sink );
+      head_.clear();
+    }
+
+    break;
+  }
+}
+
+void ObjectDecoder::finish( const Sink & sink )
+{
+  if ( state_ == State::Sniffing ) {
+    if ( head_.size() < MAGIC.size() ) {
+      /* too short to be compressed */
+      state_ = State::Raw;
+
+      if ( head_.size() ) {
+        sink( head_.data(), head_.size() );
+      }
+    }
+    else {
+      state_ = State::Compressed;
+      start_frame();
+      decompress( head_.data() + MAGIC.size(), head_.size() - MAGIC.size(), sink );
+    }
+
+    head_.clear();
+  }
+
+  if ( state_ == State::Compressed and frame_remaining_ != 0 ) {
+    throw runtime_error( "compressed object was cut short" );
+  }
+}
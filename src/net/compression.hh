@@ -0,0 +1,111 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef STORAGE_COMPRESSION_HH
+#define STORAGE_COMPRESSION_HH
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+#include "util/file_descriptor.hh"
+#include "util/path.hh"
+#include "util/temp_file.hh"
+
+/* The objects in a storage backend may be compressed with zstd. A compressed
+   object is MAGIC followed by a single zstd frame, stored under the same key
+   as the uncompressed object would be (its gg hash). An object that starts
+   with MAGIC is never stored as it is, so the two forms can't be confused. */
+
+/* from zstd.h */
+struct ZSTD_CDict_s;
+struct ZSTD_DCtx_s;
+
+namespace storage {
+
+  namespace compression {
+
+    extern const std::string MAGIC;
+
+    /* the bytes that the transfers moved, and what they amounted to */
+    struct Counters
+    {
+      std::atomic<uint64_t> put_uncompressed { 0 };
+      std::atomic<uint64_t> put_sent { 0 };
+      std::atomic<uint64_t> get_received { 0 };
+      std::atomic<uint64_t> get_uncompressed { 0 };
+    };
+
+    Counters & counters();
+
+    /* makes a dictionary known to the decoders, and returns its id */
+    unsigned add_dictionary( const std::string & dictionary );
+
+    /* trains a dictionary of at most `capacity` bytes on small objects that
+       look alike, e.g. preprocessed sources */
+    std::string train_dictionary( const std::vector<std::string> & samples,
+                                  const size_t capacity );
+  }
+
+  struct CompressionOptions
+  {
+    bool enabled { false };
+    int level { 3 };
+
+    /* smaller objects go as they are */
+    size_t min_size { 1024 };
+
+    /* the dictionary is only used for objects up to this size; it makes
+       little difference to larger ones */
+    size_t dictionary_max_size { 256 * 1024 };
+  };
+
+  class ObjectEncoder
+  {
+  private:
+    CompressionOptions options_;
+    std::shared_ptr<ZSTD_CDict_s> dictionary_ { nullptr };
+
+  public:
+    ObjectEncoder( const CompressionOptions & options,
+                   const std::string & dictionary = {} );
+
+    /* should an object of this size, that starts with `head`, be compressed? */
+    bool worth_compressing( const size_t size, const std::string & head ) const;
+
+    /* compresses `source` into a temporary file named after `temp_template`,
+       or returns nullptr if it should go as it is. an object that starts
+       with MAGIC is compressed no matter what. */
+    std::unique_ptr<TempFile> encode( const roost::path & source,
+                                      const std::string & temp_template ) const;
+  };
+
+  /* Undoes ObjectEncoder as the object arrives, and passes uncompressed
+     objects through. The sink is never called with nothing. */
+  class ObjectDecoder
+  {
+  public:
+    typedef std::function<void( const char *, const size_t )> Sink;
+
+  private:
+    enum class State { Sniffing, Raw, Compressed } state_ { State::Sniffing };
+
+    std::string head_ {};
+    std::unique_ptr<ZSTD_DCtx_s, size_t ( * )( ZSTD_DCtx_s * )> context_ { nullptr, nullptr };
+    std::vector<char> buffer_ {};
+    size_t frame_remaining_ { 0 };
+
+    void start_frame();
+    void decompress( const char * data, const size_t length, const Sink & sink );
+
+  public:
+    void append( const std::string & data, const Sink & sink );
+
+    /* throws if the object was cut short */
+    void finish( const Sink & sink );
+  };
+
+}
+
+#endif /* STORAGE_COMPRESSION_HH */
@@ -27,6 +27,12 @@ void HTTPMessage::add_header( const HTTPHeader & header )
     headers_.push_back( header );
 }
 
+void HTTPMessage::set_body_sink( const BodySink & body_sink )
+{
+    assert( state_ < BODY_PENDING );
+    body_sink_ = body_sink;
+}
+
 void HTTPMessage::done_with_headers()
 {
     assert( state_ == HEADERS_PENDING );
@@ -49,12 +55,22 @@ size_t HTTPMessage::read_in_body( const std::string & str )
     if ( body_size_is_known() ) {
         /* body size known in advance */
 
-        assert( body_.size() <= expected_body_size() );
-        const size_t amount_to_append = min( expected_body_size() - body_.size(),
+        assert( body_bytes_read_ <= expected_body_size() );
+        const size_t amount_to_append = min( expected_body_size() - body_bytes_read_,
                                              str.size() );
 
-        body_.append( str.substr( 0, amount_to_append ) );
-        if ( body_.size() == expected_body_size() ) {
+        if ( body_sink_ ) {
+            if ( amount_to_append == str.size() ) {
+                body_sink_( str );
+            } else if ( amount_to_append > 0 ) {
+                body_sink_( str.substr( 0, amount_to_append ) );
+            }
+        } else {
+            body_.append( str, 0, amount_to_append );
+        }
+
+        body_bytes_read_ += amount_to_append;
+        if ( body_bytes_read_ == expected_body_size() ) {
             state_ = COMPLETE;
         }
 
@@ -163,6 +179,14 @@ std::string HTTPMessage::str() const
 {
     assert( state_ == COMPLETE );
 
+    /* add body to request */
+    return headers_str().append( body_ );
+}
+
+std::string HTTPMessage::headers_str() const
+{
+    assert( state_ > HEADERS_PENDING );
+
     /* start with first line */
     string ret( first_line_ + CRLF );
 
@@ -174,8 +198,5 @@ std::string HTTPMessage::str() const
     /* blank line between headers and body */
     ret.append( CRLF );
 
-    /* add body to request */
-    ret.append( body_ );
-
     return ret;
 }
@@ -5,6 +5,7 @@
 
 #include <string>
 #include <vector>
+#include <functional>
 
 #include "http_header.hh"
 
@@ -15,6 +16,10 @@ static const std::string CRLF = "\r\n";
 
 class HTTPMessage
 {
+public:
+    /* receives the body of a message as it arrives */
+    typedef std::function<void( const std::string & )> BodySink;
+
 private:
     /* first member of pair specifies whether body size is known in advance,
        and second member is size (if known in advance) */
@@ -40,6 +45,10 @@ protected:
     /* body may be empty */
     std::string body_ {};
 
+    /* if set, a body of known size goes here instead of into body_ */
+    BodySink body_sink_ {};
+    size_t body_bytes_read_ { 0 };
+
     /* state of an in-progress request or response */
     HTTPMessageState state_ { FIRST_LINE_PENDING };
 
@@ -57,8 +66,9 @@ public:
     size_t read_in_body( const std::string & str );
     void eof();
 
-    /* setter */
+    /* setters */
     void add_header( const HTTPHeader & header );
+    void set_body_sink( const BodySink & body_sink );
 
     /* getters */
     bool body_size_is_known() const;
@@ -75,6 +85,10 @@ public:
     /* serialize the request or response as one string */
     std::string str() const;
 
+    /* serialize only the first line and the headers, for a message whose
+       body is sent separately */
+    std::string headers_str() const;
+
     /* compare two strings for (case-insensitive) equality,
        in ASCII without sensitivity to locale */
     static bool equivalent_strings( const std::string & a, const std::string & b );
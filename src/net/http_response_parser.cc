@@ -16,12 +16,14 @@ void HTTPResponseParser::initialize_new_message()
         throw runtime_error( "HTTPResponseParser: response without matching request" );
     }
 
-    message_in_progress_.set_request( requests_.front() );
+    message_in_progress_.set_request( requests_.front().first );
+    message_in_progress_.set_body_sink( requests_.front().second );
 
     requests_.pop();
 }
 
-void HTTPResponseParser::new_request_arrived( const HTTPRequest & request )
+void HTTPResponseParser::new_request_arrived( const HTTPRequest & request,
+                                              const HTTPMessage::BodySink & body_sink )
 {
-    requests_.push( request );
+    requests_.emplace( request, body_sink );
 }
@@ -11,12 +11,15 @@ class HTTPResponseParser : public HTTPMessageSequence<HTTPResponse>
 {
 private:
     /* Need this to handle RFC 2616 section 4.4 rule 1 */
-    std::queue<HTTPRequest> requests_ {};
+    std::queue<std::pair<HTTPRequest, HTTPMessage::BodySink>> requests_ {};
 
     void initialize_new_message() override;
 
 public:
-    void new_request_arrived( const HTTPRequest & request );
+    /* if a body sink is given, the body of the matching response is handed
+       to it as it arrives, instead of being buffered in the response */
+    void new_request_arrived( const HTTPRequest & request,
+                              const HTTPMessage::BodySink & body_sink = {} );
     unsigned int pending_requests() const { return requests_.size(); }
 };
 
@@ -58,7 +58,8 @@ Poller::Action::Action( NBSecureSocket & s_socket,
                ( s_socket.state() == NBSecureSocket::State::needs_ssl_write_to_accept ) or
                ( s_socket.state() == NBSecureSocket::State::needs_ssl_write_to_write ) or
                ( s_socket.state() == NBSecureSocket::State::needs_ssl_write_to_read ) or
-               ( s_socket.state() == NBSecureSocket::State::ready and s_when_interested() );
+               ( s_socket.state() == NBSecureSocket::State::ready and
+                 ( not s_when_interested or s_when_interested() ) );
       };
 
   }
@@ -101,7 +102,8 @@ Poller::Action::Action( NBSecureSocket & s_socket,
                ( s_socket.state() == NBSecureSocket::State::needs_ssl_read_to_accept ) or
                ( s_socket.state() == NBSecureSocket::State::needs_ssl_read_to_write ) or
                ( s_socket.state() == NBSecureSocket::State::needs_ssl_read_to_read ) or
-               ( s_socket.state() == NBSecureSocket::State::ready and s_when_interested() );
+               ( s_socket.state() == NBSecureSocket::State::ready and
+                 ( not s_when_interested or s_when_interested() ) );
       };
   }
 }
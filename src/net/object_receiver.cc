@@ -0,0 +1,72 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "object_receiver.hh"
+
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "util/exception.hh"
+
+using namespace std;
+
+ObjectReceiver::ObjectReceiver( const roost::path & filename,
+                                const Optional<mode_t> & mode,
+                                const Optional<string> & content_hash )
+  : filename_( filename ), mode_( mode ), content_hash_( content_hash )
+{}
+
+UniqueFile & ObjectReceiver::file()
+{
+  if ( not file_ ) {
+    file_ = make_unique<UniqueFile>( filename_.string() );
+  }
+
+  return *file_;
+}
+
+void ObjectReceiver::write( const char * data, const size_t length )
+{
+  const string chunk { data, length };
+  file().fd().write( chunk );
+
+  if ( content_hash_.initialized() ) {
+    hash_function_.update( chunk );
+  }
+
+  storage::compression::counters().get_uncompressed += length;
+}
+
+void ObjectReceiver::append( const string & data )
+{
+  storage::compression::counters().get_received += data.size();
+  decoder_.append( data, [this] ( const char * chunk, const size_t length )
+                         { write( chunk, length ); } );
+}
+
+void ObjectReceiver::commit()
+{
+  decoder_.finish( [this] ( const char * chunk, const size_t length )
+                   { write( chunk, length ); } );
+
+  if ( content_hash_.initialized() and hash_function_.finish_hex() != *content_hash_ ) {
+    throw runtime_error( "content hash mismatch for " + filename_.string() );
+  }
+
+  if ( mode_.initialized() ) {
+    CheckSystemCall( "fchmod", fchmod( file().fd().fd_num(), *mode_ ) );
+  }
+
+  const string temp_filename = file().name();
+  file_.reset();
+
+  roost::rename( temp_filename, filename_ );
+  committed_ = true;
+}
+
+ObjectReceiver::~ObjectReceiver()
+{
+  if ( file_ and not committed_ ) {
+    unlink( file_->name().c_str() );
+  }
+}
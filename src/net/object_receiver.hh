@@ -0,0 +1,50 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef OBJECT_RECEIVER_HH
+#define OBJECT_RECEIVER_HH
+
+#include <string>
+#include <memory>
+#include <sys/types.h>
+
+#include "compression.hh"
+#include "util/digest.hh"
+#include "util/optional.hh"
+#include "util/path.hh"
+#include "util/temp_file.hh"
+
+/* Writes a downloaded object to a temporary file next to its destination as
+   it arrives, decompressing and hashing it on the way, and moves it into
+   place once the whole object is there. An object that isn't committed is
+   removed. */
+class ObjectReceiver
+{
+private:
+  roost::path filename_;
+  Optional<mode_t> mode_;
+  Optional<std::string> content_hash_;
+
+  std::unique_ptr<UniqueFile> file_ { nullptr };
+  digest::SHA256 hash_function_ {};
+  storage::ObjectDecoder decoder_ {};
+  bool committed_ { false };
+
+  UniqueFile & file();
+  void write( const char * data, const size_t length );
+
+public:
+  /* content_hash, if given, is the hex SHA-256 the object must have */
+  ObjectReceiver( const roost::path & filename,
+                  const Optional<mode_t> & mode = {},
+                  const Optional<std::string> & content_hash = {} );
+
+  void append( const std::string & data );
+  void commit();
+
+  ~ObjectReceiver();
+
+  ObjectReceiver( const ObjectReceiver & ) = delete;
+  ObjectReceiver & operator=( const ObjectReceiver & ) = delete;
+};
+
+#endif /* OBJECT_RECEIVER_HH */
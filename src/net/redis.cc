@@ -2,190 +2,457 @@
 
 #include "net/redis.hh"
 
-#include <thread>
-#include <memory>
+#include <set>
 #include <stdexcept>
-#include <cstring>
+#include <algorithm>
 #include <fcntl.h>
-#include <sys/time.h>
-#include <hiredis/hiredis.h>
 
+#include "net/object_receiver.hh"
 #include "util/exception.hh"
-#include "util/file_descriptor.hh"
-#include "util/optional.hh"
+#include "util/path.hh"
 
 using namespace std;
+using namespace PollerShortNames;
 
-void Redis::upload_files( const vector<storage::PutRequest> & upload_requests,
-                          const function<void( const storage::PutRequest & )> & success_callback )
+using ReplyType = RESPParser::Reply::Type;
+
+/* how long the blocking calls wait for the server to say anything */
+static constexpr int TIMEOUT_MS = 30 * 1000;
+
+static const RedisClientConfig & checked( const RedisClientConfig & config )
+{
+  if ( config.max_connections == 0 or config.max_pipeline_depth == 0
+       or config.max_batch_size == 0 ) {
+    throw runtime_error( "redis client needs a connection, a pipeline and a batch size" );
+  }
+
+  return config;
+}
+
+Redis::Redis( const RedisClientConfig & config )
+  : config_( checked( config ) ), address_( config.ip, config.port ),
+    own_poller_( make_unique<Poller>() ), poller_( *own_poller_ )
+{}
+
+Redis::Redis( const RedisClientConfig & config, Poller & poller )
+  : config_( checked( config ) ), address_( config.ip, config.port ),
+    own_poller_( nullptr ), poller_( poller )
+{}
+
+Redis::~Redis()
+{
+  /* someone else's poller would keep the connections alive */
+  if ( own_poller_ == nullptr ) {
+    set<int> fds;
+
+    for ( const auto & connection : connections_ ) {
+      fds.insert( connection->socket().fd_num() );
+    }
+
+    poller_.remove_actions( fds );
+  }
+}
+
+shared_ptr<Redis::Connection> Redis::open_connection()
+{
+  auto connection = make_shared<Connection>();
+  connection->socket().set_blocking( false );
+  connection->socket().connect_nonblock( address_ );
+  connections_.push_back( connection );
+
+  auto fderror_callback =
+    [this, connection]
+    {
+      fail_connection( connection, "connection to redis server failed" );
+      dispatch();
+    };
+
+  poller_.add_action(
+    Poller::Action(
+      connection->socket(), Direction::Out,
+      [connection] ()
+      {
+        connection->write_some();
+        return ResultType::Continue;
+      },
+      [connection] { return connection->something_to_write(); },
+      fderror_callback
+    )
+  );
+
+  poller_.add_action(
+    Poller::Action(
+      connection->socket(), Direction::In,
+      [this, connection] ()
+      {
+        const string data = connection->socket().read();
+
+        if ( data.empty() ) {
+          fail_connection( connection, "redis server closed the connection" );
+          dispatch();
+          return ResultType::CancelAll;
+        }
+
+        connection->parser.parse( data );
+
+        if ( not connection->accepting and connection->in_flight.empty() ) {
+          fail_connection( connection, {} );
+          dispatch();
+          return ResultType::CancelAll;
+        }
+
+        dispatch();
+        return ResultType::Continue;
+      },
+      {},
+      fderror_callback
+    )
+  );
+
+  if ( config_.password.length() ) {
+    vector<string> arguments { "AUTH" };
+
+    if ( config_.username.length() ) {
+      arguments.push_back( config_.username );
+    }
+
+    arguments.push_back( config_.password );
+
+    /* the commands behind a failed AUTH get their own errors, and nothing
+       more is sent on the connection */
+    Command auth;
+    auth.text = resp::command( arguments );
+    auth.handler.done =
+      [weak_connection=weak_ptr<Connection>( connection )] ( const RESPParser::Reply & reply )
+      {
+        auto connection = weak_connection.lock();
+
+        if ( connection and reply.type != ReplyType::Status ) {
+          connection->accepting = false;
+        }
+      };
+    auth.failure_callback = [] ( const string & ) {};
+
+    send( *connection, move( auth ) );
+  }
+
+  return connection;
+}
+
+void Redis::fail_connection( const shared_ptr<Connection> & connection,
+                             const string & error )
+{
+  if ( connection->closed ) {
+    return;
+  }
+
+  connection->closed = true;
+  connection->accepting = false;
+  connections_.erase( remove( connections_.begin(), connections_.end(), connection ),
+                      connections_.end() );
+
+  auto in_flight = move( connection->in_flight );
+  connection->in_flight.clear();
+
+  for ( const auto & failure_callback : in_flight ) {
+    failure_callback( error );
+  }
+}
+
+void Redis::send( Connection & connection, Command && command )
+{
+  if ( command.filename.length() ) {
+    FileDescriptor file { CheckSystemCall( "open (" + command.filename + ")",
+                                           open( command.filename.c_str(), O_RDONLY ) ) };
+
+    connection.enqueue_write( command.text );
+    connection.enqueue_file( move( file ) );
+    connection.enqueue_write( "\r\n" );
+  }
+  else {
+    connection.enqueue_write( command.text );
+  }
+
+  /* the reply is for the oldest command in flight */
+  Connection * const connection_ptr = &connection;
+  auto done = move( command.handler.done );
+
+  command.handler.done =
+    [connection_ptr, done] ( const RESPParser::Reply & reply )
+    {
+      connection_ptr->in_flight.pop_front();
+
+      if ( done ) {
+        done( reply );
+      }
+    };
+
+  connection.in_flight.push_back( move( command.failure_callback ) );
+  connection.parser.new_command( move( command.handler ) );
+}
+
+void Redis::dispatch()
+{
+  while ( not waiting_.empty() ) {
+    /* the connection with the fewest commands in flight, or a new one if
+       they are all busy and the pool isn't full */
+    shared_ptr<Connection> connection;
+
+    for ( const auto & candidate : connections_ ) {
+      if ( candidate->accepting and
+           ( connection == nullptr or
+             candidate->in_flight.size() < connection->in_flight.size() ) ) {
+        connection = candidate;
+      }
+    }
+
+    if ( ( connection == nullptr or connection->in_flight.size() )
+         and connections_.size() < config_.max_connections ) {
+      connection = open_connection();
+    }
+
+    if ( connection == nullptr or connection->in_flight.size() >= config_.max_pipeline_depth ) {
+      break;
+    }
+
+    Command command = move( waiting_.front() );
+    waiting_.pop();
+    send( *connection, move( command ) );
+  }
+}
+
+size_t Redis::pending() const
+{
+  size_t count = waiting_.size();
+
+  for ( const auto & connection : connections_ ) {
+    count += connection->in_flight.size();
+  }
+
+  return count;
+}
+
+void Redis::put( const vector<storage::PutRequest> & requests,
+                 const function<void( const storage::PutRequest & )> & success_callback,
+                 const FailureCallback & failure_callback )
+{
+  for ( const storage::PutRequest & request : requests ) {
+    Command command;
+    command.text = resp::command_header( { "SET", request.object_key },
+                                         roost::file_size( request.filename ) );
+    command.filename = request.filename.string();
+
+    command.handler.done =
+      [request, success_callback, failure_callback] ( const RESPParser::Reply & reply )
+      {
+        if ( reply.type == ReplyType::Status ) {
+          success_callback( request );
+        }
+        else {
+          failure_callback( request.object_key, ( reply.type == ReplyType::Error )
+                                                ? reply.text : "unexpected reply to SET" );
+        }
+      };
+
+    command.failure_callback =
+      [object_key=request.object_key, failure_callback] ( const string & error )
+      { failure_callback( object_key, error ); };
+
+    waiting_.emplace( move( command ) );
+  }
+
+  dispatch();
+}
+
+namespace {
+
+  /* the objects of one MGET, which arrive one after the other */
+  struct MultiGet
+  {
+    vector<storage::GetRequest> requests {};
+    unique_ptr<ObjectReceiver> receiver { nullptr };
+    size_t finished { 0 };
+
+    ObjectReceiver & receiver_for( const size_t index )
+    {
+      if ( receiver == nullptr ) {
+        const storage::GetRequest & request = requests.at( index );
+        receiver = make_unique<ObjectReceiver>( request.filename, request.mode,
+                                                request.content_hash );
+      }
+
+      return *receiver;
+    }
+  };
+
+}
+
+void Redis::get( const vector<storage::GetRequest> & requests,
+                 const function<void( const storage::GetRequest & )> & success_callback,
+                 const FailureCallback & failure_callback )
+{
+  for ( size_t first = 0; first < requests.size(); first += config_.max_batch_size ) {
+    auto batch = make_shared<MultiGet>();
+    batch->requests.assign( requests.begin() + first,
+                            requests.begin() + min( requests.size(), first + config_.max_batch_size ) );
+
+    vector<string> arguments { batch->requests.size() == 1 ? "GET" : "MGET" };
+
+    for ( const storage::GetRequest & request : batch->requests ) {
+      arguments.push_back( request.object_key );
+    }
+
+    /* the objects that haven't arrived have failed */
+    auto fail_rest =
+      [batch, failure_callback] ( const string & error )
+      {
+        batch->receiver.reset();
+
+        while ( batch->finished < batch->requests.size() ) {
+          failure_callback( batch->requests[ batch->finished++ ].object_key, error );
+        }
+      };
+
+    Command command;
+    command.text = resp::command( arguments );
+
+    command.handler.data =
+      [batch] ( const size_t index, const char * data, const size_t length )
+      { batch->receiver_for( index ).append( { data, length } ); };
+
+    command.handler.bulk_done =
+      [batch, success_callback, failure_callback] ( const size_t index, const bool nil )
+      {
+        const storage::GetRequest & request = batch->requests.at( index );
+        batch->finished = index + 1;
+
+        if ( nil ) {
+          batch->receiver.reset();
+          failure_callback( request.object_key, "no such object" );
+          return;
+        }
+
+        try {
+          batch->receiver_for( index ).commit();
+          batch->receiver.reset();
+        }
+        catch ( const exception & e ) {
+          batch->receiver.reset();
+          failure_callback( request.object_key, e.what() );
+          return;
+        }
+
+        success_callback( request );
+      };
+
+    command.handler.done =
+      [fail_rest] ( const RESPParser::Reply & reply )
+      {
+        fail_rest( ( reply.type == ReplyType::Error ) ? reply.text : "unexpected reply to MGET" );
+      };
+
+    command.failure_callback = fail_rest;
+    waiting_.emplace( move( command ) );
+  }
+
+  dispatch();
+}
+
+void Redis::wait()
 {
-  const size_t thread_count = config_.max_threads;
-  const size_t batch_size = config_.max_batch_size;
-  struct timeval redis_timeout = { 1, 500000 }; /* 1.5 seconds */
-
-  vector<thread> threads;
-  for ( size_t thread_index = 0; thread_index < thread_count; thread_index++ ) {
-    if ( thread_index < upload_requests.size() ) {
-      threads.emplace_back(
-        [&] ( const size_t index )
-        {
-          shared_ptr<redisContext> redis_context {
-            redisConnectWithTimeout( config_.ip.c_str(), config_.port, redis_timeout ),
-            redisFree
-          };
-
-          if ( redis_context == nullptr or redis_context->err ) {
-            throw runtime_error( "error connecting to redis server" );
-          }
-
-          if ( config_.password.length() ) {
-            shared_ptr<redisReply> auth_reply {
-              (redisReply *)redisCommand( redis_context.get(), "AUTH %s", config_.password.c_str() ),
-              freeReplyObject
-            };
-
-            if ( auth_reply == nullptr or
-                 auth_reply->type == REDIS_REPLY_ERROR ) {
-              throw runtime_error( "could not authenticate to redis server" );
-            }
-          }
-
-          for ( size_t first_file_idx = index;
-                first_file_idx < upload_requests.size();
-                first_file_idx += thread_count * batch_size ) {
-
-            size_t expected_responses = 0;
-
-            for ( size_t file_id = first_file_idx;
-                  file_id < min( upload_requests.size(), first_file_idx + thread_count * batch_size );
-                  file_id += thread_count ) {
-              const string & filename = upload_requests.at( file_id ).filename.string();
-              const string & object_key = upload_requests.at( file_id ).object_key;
-
-              string contents;
-              FileDescriptor file { CheckSystemCall( "open " + filename, open( filename.c_str(), O_RDONLY ) ) };
-              while ( not file.eof() ) { contents.append( file.read() ); }
-              file.close();
-
-              redisAppendCommand( redis_context.get(),
-                                  "SET %s %b", object_key.c_str(),
-                                  contents.data(), contents.length() );
-              expected_responses++;
-            }
-
-            size_t response_count = 0;
-
-            while ( response_count != expected_responses ) {
-              /* drain responses */
-              redisReply * reply_ptr;
-
-              if ( redisGetReply( redis_context.get(), (void **)&reply_ptr ) != REDIS_OK ) {
-                throw runtime_error( "failed to get response from redis" );
-              }
-
-              shared_ptr<redisReply> reply { reply_ptr, freeReplyObject };
-
-              const size_t response_index = first_file_idx + response_count * thread_count;
-              success_callback( upload_requests[ response_index ] );
-
-              response_count++;
-            }
-          }
-        }, thread_index
-      );
+  if ( own_poller_ == nullptr ) {
+    throw runtime_error( "redis client runs on someone else's poller" );
+  }
+
+  while ( pending() ) {
+    const Poller::Result result = poller_.poll( TIMEOUT_MS );
+
+    if ( result.result == Poller::Result::Type::Timeout ) {
+      throw runtime_error( "timed out waiting for redis server" );
+    }
+    else if ( result.result == Poller::Result::Type::Exit ) {
+      throw runtime_error( "redis client stopped with commands in flight" );
     }
   }
+}
+
+void Redis::upload_files( const vector<storage::PutRequest> & upload_requests,
+                          const function<void( const storage::PutRequest & )> & success_callback )
+{
+  string first_error;
+
+  put( upload_requests, success_callback,
+       [&first_error] ( const string & object_key, const string & error )
+       {
+         if ( first_error.empty() ) {
+           first_error = "upload failed for " + object_key + ": " + error;
+         }
+       } );
 
-  for ( auto & thread : threads ) {
-    thread.join();
+  wait();
+
+  if ( first_error.length() ) {
+    throw runtime_error( first_error );
   }
 }
 
 void Redis::download_files( const vector<storage::GetRequest> & download_requests,
                             const function<void( const storage::GetRequest & )> & success_callback )
 {
-  const size_t thread_count = config_.max_threads;
-  const size_t batch_size = config_.max_batch_size;
-  struct timeval redis_timeout = { 1, 500000 }; /* 1.5 seconds */
-
-  vector<thread> threads;
-  for ( size_t thread_index = 0; thread_index < thread_count; thread_index++ ) {
-    if ( thread_index < download_requests.size() ) {
-      threads.emplace_back(
-        [&] ( const size_t index )
-        {
-          shared_ptr<redisContext> redis_context {
-            redisConnectWithTimeout( config_.ip.c_str(), config_.port, redis_timeout ),
-            redisFree
-          };
-
-          if ( redis_context == nullptr or redis_context->err ) {
-            throw runtime_error( "error connecting to redis server" );
-          }
-
-          if ( config_.password.length() ) {
-            shared_ptr<redisReply> auth_reply {
-              (redisReply *)redisCommand( redis_context.get(), "AUTH %s", config_.password.c_str() ),
-              freeReplyObject
-            };
-
-            if ( auth_reply == nullptr or
-                 auth_reply->type == REDIS_REPLY_ERROR ) {
-              throw runtime_error( "could not authenticate to redis server" );
-            }
-          }
-
-          for ( size_t first_file_idx = index;
-                first_file_idx < download_requests.size();
-                first_file_idx += thread_count * batch_size ) {
-
-            size_t expected_responses = 0;
-
-            for ( size_t file_id = first_file_idx;
-                  file_id < min( download_requests.size(), first_file_idx + thread_count * batch_size );
-                  file_id += thread_count ) {
-              const string & object_key = download_requests.at( file_id ).object_key;
-              redisAppendCommand( redis_context.get(), "GET %s", object_key.c_str() );
-              expected_responses++;
-            }
-
-            size_t response_count = 0;
-
-            while ( response_count != expected_responses ) {
-              /* drain responses */
-              redisReply * reply_ptr;
-
-              if ( redisGetReply( redis_context.get(), (void **)&reply_ptr ) != REDIS_OK ) {
-                throw runtime_error( "failed to get response from redis" );
-              }
-
-              shared_ptr<redisReply> reply { reply_ptr, freeReplyObject };
-
-              if ( reply->type != REDIS_REPLY_STRING or
-                   reply->str == nullptr ) {
-                throw runtime_error( "unexpected response from redis" );
-              }
-
-              string str_data { reply->str, static_cast<uint32_t>( reply->len ) };
-
-              const size_t response_index = first_file_idx + response_count * thread_count;
-              const string & filename = download_requests.at( response_index ).filename.string();
-
-              roost::atomic_create( str_data, filename,
-                                    download_requests[ response_index ].mode.initialized(),
-                                    download_requests[ response_index ].mode.get_or( 0 ) );
-
-              success_callback( download_requests[ response_index ] );
-
-              response_count++;
-            }
-          }
-        }, thread_index
-      );
-    }
+  string first_error;
+
+  get( download_requests, success_callback,
+       [&first_error] ( const string & object_key, const string & error )
+       {
+         if ( first_error.empty() ) {
+           first_error = "download failed for " + object_key + ": " + error;
+         }
+       } );
+
+  wait();
+
+  if ( first_error.length() ) {
+    throw runtime_error( first_error );
   }
+}
+
+vector<bool> Redis::lookup_files( const vector<string> & object_keys )
+{
+  vector<bool> found( object_keys.size(), false );
+  string first_error;
+
+  auto fail = [&first_error] ( const string & error )
+              {
+                if ( first_error.empty() ) {
+                  first_error = "lookup failed: " + error;
+                }
+              };
+
+  for ( size_t i = 0; i < object_keys.size(); i++ ) {
+    Command command;
+    command.text = resp::command( { "EXISTS", object_keys[ i ] } );
+
+    command.handler.done =
+      [&found, fail, i] ( const RESPParser::Reply & reply )
+      {
+        if ( reply.type == ReplyType::Integer ) {
+          found[ i ] = ( reply.integer != 0 );
+        }
+        else {
+          fail( ( reply.type == ReplyType::Error ) ? reply.text : "unexpected reply to EXISTS" );
+        }
+      };
+
+    command.failure_callback = fail;
+    waiting_.emplace( move( command ) );
+  }
+
+  dispatch();
+  wait();
 
-  for ( auto & thread : threads ) {
-    thread.join();
+  if ( first_error.length() ) {
+    throw runtime_error( first_error );
   }
+
+  return found;
 }
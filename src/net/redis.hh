@@ -5,9 +5,18 @@
 
 #include <vector>
 #include <string>
+#include <deque>
+#include <queue>
+#include <memory>
 #include <functional>
 
+#include "execution/connection.hh"
+#include "net/address.hh"
 #include "net/requests.hh"
+#include "net/resp.hh"
+#include "net/socket.hh"
+#include "util/file_descriptor.hh"
+#include "util/poller.hh"
 
 struct RedisClientConfig
 {
@@ -17,20 +26,83 @@ struct RedisClientConfig
   std::string username {};
   std::string password {};
 
-  size_t max_threads { 32 };
-  size_t max_batch_size { 32 };
+  size_t max_connections { 4 };
+  size_t max_pipeline_depth { 32 }; /* commands in flight on a connection */
+  size_t max_batch_size { 32 };     /* keys in an MGET */
 };
 
+/* A Redis client that pipelines its commands over a small pool of
+   non-blocking connections. Values are streamed from the disk as they are
+   sent, and to the disk as they arrive, so only a buffer of each is in
+   memory. The client runs on a poller: its own, for the blocking calls, or
+   an event loop's, in which case the callbacks are called from the loop. */
 class Redis
 {
+public:
+  typedef std::function<void( const std::string & /* object_key */,
+                              const std::string & /* error */ )> FailureCallback;
+
 private:
+  struct Command
+  {
+    std::string text {};
+    std::string filename {};  /* sent after the text, followed by "\r\n" */
+
+    RESPParser::Handler handler {};
+    std::function<void( const std::string & /* error */ )> failure_callback {};
+  };
+
+  /* the values are sent from their files, as the socket takes them */
+  struct Connection : public TCPConnection
+  {
+    RESPParser parser {};
+    std::deque<std::function<void( const std::string & )>> in_flight {};
+    bool accepting { true };  /* new commands can go on this connection */
+    bool closed { false };
+  };
+
   RedisClientConfig config_;
+  Address address_;
+
+  std::unique_ptr<Poller> own_poller_;
+  Poller & poller_;
+
+  std::vector<std::shared_ptr<Connection>> connections_ {};
+  std::queue<Command> waiting_ {};
+
+  std::shared_ptr<Connection> open_connection();
+  void fail_connection( const std::shared_ptr<Connection> & connection,
+                        const std::string & error );
+
+  void send( Connection & connection, Command && command );
+  void dispatch();
+
+  /* runs the client's own poller until every command has its reply */
+  void wait();
 
 public:
-  Redis( const RedisClientConfig & config )
-    : config_( config )
-  {}
+  /* a client with a poller of its own, for the blocking calls */
+  Redis( const RedisClientConfig & config );
+
+  /* a client that runs on someone else's poller */
+  Redis( const RedisClientConfig & config, Poller & poller );
+
+  ~Redis();
+
+  /* SETs the objects, one command each */
+  void put( const std::vector<storage::PutRequest> & requests,
+            const std::function<void( const storage::PutRequest & )> & success_callback,
+            const FailureCallback & failure_callback );
 
+  /* GETs the objects, up to max_batch_size of them in an MGET */
+  void get( const std::vector<storage::GetRequest> & requests,
+            const std::function<void( const storage::GetRequest & )> & success_callback,
+            const FailureCallback & failure_callback );
+
+  /* the number of commands that haven't had their replies yet */
+  size_t pending() const;
+
+  /* the blocking calls, which throw if any of the objects failed */
   void upload_files( const std::vector<storage::PutRequest> & upload_requests,
                      const std::function<void( const storage::PutRequest & )> & success_callback
                        = []( const storage::PutRequest & ){} );
@@ -38,6 +110,12 @@ public:
   void download_files( const std::vector<storage::GetRequest> & download_requests,
                        const std::function<void( const storage::GetRequest & )> & success_callback
                          = []( const storage::GetRequest & ){} );
+
+  /* which of the objects the server has, by pipelined EXISTS commands */
+  std::vector<bool> lookup_files( const std::vector<std::string> & object_keys );
+
+  Redis( const Redis & ) = delete;
+  Redis & operator=( const Redis & ) = delete;
 };
 
 #endif /* NET_REDIS_HH */
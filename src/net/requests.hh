@@ -34,6 +34,10 @@ namespace storage {
     roost::path filename;
     Optional<mode_t> mode { false };
 
+    /* if set, the hex SHA-256 of the object, which the backends that stream
+       their downloads check the object against */
+    Optional<std::string> content_hash { false };
+
     GetRequest( const std::string & object_key,
                 const roost::path & filename )
       : object_key( object_key ), filename( filename ) {}
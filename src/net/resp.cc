@@ -0,0 +1,233 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "resp.hh"
+
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+
+/* error messages are the only lines of any length */
+static constexpr size_t MAX_LINE_LENGTH = 64 * 1024;
+
+static string bulk_string( const string & str )
+{
+  return "$" + to_string( str.length() ) + "\r\n" + str + "\r\n";
+}
+
+string resp::command( const vector<string> & arguments )
+{
+  string output = "*" + to_string( arguments.size() ) + "\r\n";
+
+  for ( const string & argument : arguments ) {
+    output.append( bulk_string( argument ) );
+  }
+
+  return output;
+}
+
+string resp::command_header( const vector<string> & arguments, const uint64_t length )
+{
+  string output = "*" + to_string( arguments.size() + 1 ) + "\r\n";
+
+  for ( const string & argument : arguments ) {
+    output.append( bulk_string( argument ) );
+  }
+
+  return output + "$" + to_string( length ) + "\r\n";
+}
+
+static int64_t parse_integer( const string & str )
+{
+  size_t end = 0;
+  int64_t value = 0;
+
+  try {
+    value = stoll( str, &end );
+  }
+  catch ( const exception & ) {
+    end = 0;
+  }
+
+  if ( str.empty() or end != str.length() ) {
+    throw runtime_error( "invalid integer in RESP reply: " + str );
+  }
+
+  return value;
+}
+
+RESPParser::Handler & RESPParser::handler()
+{
+  if ( handlers_.empty() ) {
+    throw runtime_error( "RESP reply without a command" );
+  }
+
+  return handlers_.front();
+}
+
+void RESPParser::reply_done()
+{
+  Handler finished = move( handlers_.front() );
+  handlers_.pop_front();
+
+  const Reply reply = move( reply_ );
+  reply_ = {};
+  in_array_ = false;
+  element_ = 0;
+
+  /* the handler may well send another command */
+  if ( finished.done ) {
+    finished.done( reply );
+  }
+}
+
+void RESPParser::value_done( const Reply::Type type )
+{
+  const bool bulk = ( type == Reply::Type::Bulk or type == Reply::Type::Nil );
+
+  if ( bulk and handler().bulk_done ) {
+    handler().bulk_done( element_, type == Reply::Type::Nil );
+  }
+
+  if ( in_array_ and ++element_ < static_cast<size_t>( reply_.integer ) ) {
+    return;
+  }
+
+  reply_done();
+}
+
+void RESPParser::parse_line( const string & line )
+{
+  handler();
+
+  if ( expect_terminator_ ) {
+    if ( not line.empty() ) {
+      throw runtime_error( "bulk string longer than announced in RESP reply" );
+    }
+
+    expect_terminator_ = false;
+    value_done( Reply::Type::Bulk );
+    return;
+  }
+
+  if ( line.empty() ) {
+    throw runtime_error( "empty line in RESP reply" );
+  }
+
+  const string value = line.substr( 1 );
+
+  /* the elements of an array don't change the reply, which is the array */
+  Reply element;
+  Reply & reply = in_array_ ? element : reply_;
+
+  switch ( line[ 0 ] ) {
+  case '+':
+    reply.type = Reply::Type::Status;
+    reply.text = value;
+    value_done( reply.type );
+    break;
+
+  case '-':
+    reply.type = Reply::Type::Error;
+    reply.text = value;
+    value_done( reply.type );
+    break;
+
+  case ':':
+    reply.type = Reply::Type::Integer;
+    reply.integer = parse_integer( value );
+    value_done( reply.type );
+    break;
+
+  case '$':
+    reply.integer = parse_integer( value );
+
+    if ( reply.integer < 0 ) {
+      reply.type = Reply::Type::Nil;
+      value_done( reply.type );
+    }
+    else {
+      reply.type = Reply::Type::Bulk;
+      bulk_left_ = reply.integer;
+
+      if ( bulk_left_ > 0 ) {
+        state_ = State::Bulk;
+      }
+      else {
+        expect_terminator_ = true;
+      }
+    }
+
+    break;
+
+  case '*':
+    if ( in_array_ ) {
+      throw runtime_error( "nested arrays in RESP replies are not supported" );
+    }
+
+    reply_.integer = parse_integer( value );
+    reply_.type = ( reply_.integer < 0 ) ? Reply::Type::Nil : Reply::Type::Array;
+
+    if ( reply_.integer > 0 ) {
+      in_array_ = true;
+    }
+    else {
+      reply_done();
+    }
+
+    break;
+
+  default:
+    throw runtime_error( "invalid RESP reply type: " + line.substr( 0, 1 ) );
+  }
+}
+
+void RESPParser::parse( const string & data )
+{
+  size_t pos = 0;
+
+  while ( pos < data.length() ) {
+    if ( state_ == State::Bulk ) {
+      const size_t length = min<uint64_t>( bulk_left_, data.length() - pos );
+
+      if ( handler().data ) {
+        handler().data( element_, data.data() + pos, length );
+      }
+
+      pos += length;
+      bulk_left_ -= length;
+
+      if ( bulk_left_ == 0 ) {
+        state_ = State::Line;
+        expect_terminator_ = true;
+      }
+
+      continue;
+    }
+
+    const size_t end = data.find( '\n', pos );
+
+    if ( end == string::npos ) {
+      line_.append( data, pos, string::npos );
+
+      if ( line_.length() > MAX_LINE_LENGTH ) {
+        throw runtime_error( "RESP line too long" );
+      }
+
+      break;
+    }
+
+    line_.append( data, pos, end - pos + 1 );
+    pos = end + 1;
+
+    if ( line_.length() < 2 or line_[ line_.length() - 2 ] != '\r' ) {
+      throw runtime_error( "RESP line without a carriage return" );
+    }
+
+    line_.resize( line_.length() - 2 );
+
+    const string line = move( line_ );
+    line_.clear();
+    parse_line( line );
+  }
+}
@@ -0,0 +1,80 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef NET_RESP_HH
+#define NET_RESP_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <cstdint>
+
+/* The Redis protocol (RESP). Commands go out as arrays of bulk strings. */
+namespace resp {
+
+  std::string command( const std::vector<std::string> & arguments );
+
+  /* the beginning of a command whose last argument, `length` bytes long,
+     is sent on its own and followed by "\r\n" */
+  std::string command_header( const std::vector<std::string> & arguments,
+                              const uint64_t length );
+
+}
+
+/* Parses a stream of replies, one for each command that was sent. The
+   contents of bulk strings aren't kept: they are handed to the command's
+   handler in pieces, as they arrive. Arrays can hold bulk strings, but not
+   other arrays, which is all that MGET needs. */
+class RESPParser
+{
+public:
+  struct Reply
+  {
+    enum class Type { Status, Error, Integer, Bulk, Nil, Array } type { Type::Nil };
+    std::string text {};    /* of statuses and errors */
+    int64_t integer { 0 };  /* of integers; the size of bulk strings and arrays */
+  };
+
+  struct Handler
+  {
+    /* a piece of a bulk string: the reply itself (index 0), or the index-th
+       element of an array */
+    std::function<void( const size_t index, const char * data,
+                        const size_t length )> data {};
+
+    /* a bulk string, or a nil, is complete */
+    std::function<void( const size_t index, const bool nil )> bulk_done {};
+
+    /* the whole reply is in */
+    std::function<void( const Reply & reply )> done {};
+  };
+
+private:
+  enum class State { Line, Bulk } state_ { State::Line };
+
+  std::string line_ {};
+  bool expect_terminator_ { false };  /* the "\r\n" after a bulk string */
+  uint64_t bulk_left_ { 0 };
+
+  Reply reply_ {};
+  bool in_array_ { false };
+  size_t element_ { 0 };
+
+  std::deque<Handler> handlers_ {};
+
+  Handler & handler();
+  void parse_line( const std::string & line );
+  void value_done( const Reply::Type type );
+  void reply_done();
+
+public:
+  /* the reply to a command that was just sent goes to `handler` */
+  void new_command( Handler && handler ) { handlers_.emplace_back( std::move( handler ) ); }
+
+  void parse( const std::string & data );
+
+  /* the number of replies that haven't come yet */
+  size_t pending() const { return handlers_.size(); }
+};
+
+#endif /* NET_RESP_HH */
@@ -4,7 +4,9 @@
 
 #include <cassert>
 #include <thread>
+#include <memory>
 #include <fcntl.h>
+#include <unistd.h>
 #include <sys/types.h>
 
 #include "socket.hh"
@@ -12,8 +14,8 @@
 #include "http_request.hh"
 #include "http_response_parser.hh"
 #include "awsv4_sig.hh"
+#include "object_receiver.hh"
 #include "util/exception.hh"
-#include "util/temp_file.hh"
 
 using namespace std;
 using namespace storage;
@@ -49,10 +51,31 @@ S3PutRequest::S3PutRequest( const AWSCredentials & credentials,
                           content_hash );
 }
 
+S3PutRequest::S3PutRequest( const AWSCredentials & credentials,
+                            const string & endpoint, const string & region,
+                            const string & object, const size_t content_length,
+                            const string & content_hash )
+  : AWSRequest( credentials, region, "PUT /" + object + " HTTP/1.1", {} )
+{
+  assert( content_hash.length() > 0 );
+
+  headers_[ "host" ] = endpoint;
+  headers_[ "content-length" ] = to_string( content_length );
+
+  if ( credentials.session_token().initialized() ) {
+    headers_[ "x-amz-security-token" ] = *credentials.session_token();
+  }
+
+  AWSv4Sig::sign_request( "PUT\n/" + object,
+                          credentials_.secret_key(), credentials_.access_key(),
+                          region_, "s3", request_date_, {}, headers_,
+                          content_hash );
+}
+
 S3GetRequest::S3GetRequest( const AWSCredentials & credentials,
                             const string & endpoint, const string & region,
-                            const string & object )
-  : AWSRequest( credentials, region, "GET /" + object + " HTTP/1.1", {} )
+                            const string & object, const string & method )
+  : AWSRequest( credentials, region, method + " /" + object + " HTTP/1.1", {} )
 {
   headers_[ "host" ] = endpoint;
 
@@ -60,7 +83,7 @@ S3GetRequest::S3GetRequest( const AWSCredentials & credentials,
     headers_[ "x-amz-security-token" ] = *credentials.session_token();
   }
 
-  AWSv4Sig::sign_request( "GET\n/" + object,
+  AWSv4Sig::sign_request( method + "\n/" + object,
                           credentials_.secret_key(), credentials_.access_key(),
                           region_, "s3", request_date_, {}, headers_,
                           {} );
@@ -73,16 +96,62 @@ TCPSocket tcp_connection( const Address & address )
   return sock;
 }
 
+/* sends the contents of a file, one buffer at a time, and returns the
+   number of bytes sent */
+static size_t send_file( SecureSocket & socket, const string & filename )
+{
+  FileDescriptor file { CheckSystemCall( "open " + filename, open( filename.c_str(), O_RDONLY ) ) };
+  posix_fadvise( file.fd_num(), 0, 0, POSIX_FADV_SEQUENTIAL );
+
+  thread_local vector<char> buffer( BUFFER_SIZE );
+  size_t total_sent = 0;
+
+  while ( true ) {
+    const ssize_t bytes_read = CheckSystemCall( "read " + filename,
+      ::read( file.fd_num(), buffer.data(), buffer.size() ) );
+
+    if ( bytes_read == 0 ) {
+      break;
+    }
+
+    socket.write( buffer.data(), bytes_read );
+    total_sent += bytes_read;
+  }
+
+  return total_sent;
+}
+
 S3Client::S3Client( const AWSCredentials & credentials,
                     const S3ClientConfig & config )
   : credentials_( credentials ), config_( config )
 {}
 
+string S3Client::endpoint( const string & bucket ) const
+{
+  return ( config_.endpoint.length() > 0 ) ? config_.endpoint
+                                           : S3::endpoint( config_.region, bucket );
+}
+
+HTTPRequest S3Client::put_request( const string & bucket,
+                                   const PutRequest & request,
+                                   const size_t content_length ) const
+{
+  return S3PutRequest { credentials_, endpoint( bucket ), config_.region,
+                        request.object_key, content_length,
+                        request.content_hash.get_or( UNSIGNED_PAYLOAD ) }.to_http_request();
+}
+
+HTTPRequest S3Client::get_request( const string & bucket,
+                                   const GetRequest & request ) const
+{
+  return S3GetRequest { credentials_, endpoint( bucket ), config_.region,
+                        request.object_key }.to_http_request();
+}
+
 void S3Client::download_file( const string & bucket, const string & object,
                               const roost::path & filename )
 {
-  const string endpoint = ( config_.endpoint.length() > 0 )
-                          ? config_.endpoint : S3::endpoint( config_.region, bucket );
+  const string endpoint = this->endpoint( bucket );
   const Address s3_address { endpoint, "https" };
 
   SSLContext ssl_context;
@@ -92,13 +161,11 @@ void S3Client::download_file( const string & bucket, const string & object,
 
   S3GetRequest request { credentials_, endpoint, config_.region, object };
   HTTPRequest outgoing_request = request.to_http_request();
-  responses.new_request_arrived( outgoing_request );
+  ObjectReceiver receiver { filename };
+  responses.new_request_arrived( outgoing_request,
+    [&receiver] ( const string & data ) { receiver.append( data ); } );
   s3.write( outgoing_request.str() );
 
-  FileDescriptor file { CheckSystemCall( "open",
-    open( filename.string().c_str(), O_RDWR | O_TRUNC | O_CREAT,
-          S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH ) ) };
-
   while ( responses.empty() ) {
     responses.parse( s3.read() );
   }
@@ -107,7 +174,7 @@ void S3Client::download_file( const string & bucket, const string & object,
     throw runtime_error( "HTTP failure in S3Client::download_file( " + bucket + ", " + object + " ): " + responses.front().first_line() );
   }
   else {
-    file.write( responses.front().body(), true );
+    receiver.commit();
   }
 }
 
@@ -115,8 +182,7 @@ void S3Client::upload_files( const string & bucket,
                              const vector<PutRequest> & upload_requests,
                              const function<void( const PutRequest & )> & success_callback )
 {
-  const string endpoint = ( config_.endpoint.length() > 0 )
-                          ? config_.endpoint : S3::endpoint( config_.region, bucket );
+  const string endpoint = this->endpoint( bucket );
   const Address s3_address { endpoint, "https" };
 
   const size_t thread_count = config_.max_threads;
@@ -141,21 +207,20 @@ void S3Client::upload_files( const string & bucket,
                   file_id < min( upload_requests.size(), first_file_idx + thread_count * batch_size );
                   file_id += thread_count ) {
               const string & filename = upload_requests.at( file_id ).filename.string();
-              const string & object_key = upload_requests.at( file_id ).object_key;
-              string hash = upload_requests.at( file_id ).content_hash.get_or( UNSIGNED_PAYLOAD );
-
-              string contents;
-              FileDescriptor file { CheckSystemCall( "open " + filename, open( filename.c_str(), O_RDONLY ) ) };
-              while ( not file.eof() ) { contents.append( file.read() ); }
-              file.close();
 
-              S3PutRequest request { credentials_, endpoint, config_.region,
-                                     object_key, contents, hash };
+              /* the body is streamed from the file, so only one buffer of
+                 it is in memory at a time */
+              const size_t content_length = roost::file_size( filename );
 
-              HTTPRequest outgoing_request = request.to_http_request();
+              HTTPRequest outgoing_request = put_request( bucket, upload_requests.at( file_id ),
+                                                          content_length );
               responses.new_request_arrived( outgoing_request );
 
-              s3.write( outgoing_request.str() );
+              s3.write( outgoing_request.headers_str() );
+
+              if ( send_file( s3, filename ) != content_length ) {
+                throw runtime_error( "file changed during upload: " + filename );
+              }
             }
 
             size_t response_count = 0;
@@ -191,8 +256,7 @@ void S3Client::download_files( const std::string & bucket,
                                const std::vector<storage::GetRequest> & download_requests,
                                const std::function<void( const storage::GetRequest & )> & success_callback )
 {
-  const string endpoint = ( config_.endpoint.length() > 0 )
-                          ? config_.endpoint : S3::endpoint( config_.region, bucket );
+  const string endpoint = this->endpoint( bucket );
   const Address s3_address { endpoint, "https" };
 
   const size_t thread_count = config_.max_threads;
@@ -215,15 +279,22 @@ void S3Client::download_files( const std::string & bucket,
 
             size_t expected_responses = 0;
 
+            /* each response body is written to disk as it arrives */
+            vector<unique_ptr<ObjectReceiver>> receivers;
+
             for ( size_t file_id = first_file_idx;
                   file_id < min( download_requests.size(), first_file_idx + thread_count * batch_size );
                   file_id += thread_count ) {
-              const string & object_key = download_requests.at( file_id ).object_key;
+              const GetRequest & download_request = download_requests.at( file_id );
 
-              S3GetRequest request { credentials_, endpoint, config_.region, object_key };
+              receivers.emplace_back( make_unique<ObjectReceiver>( download_request.filename,
+                                                                   download_request.mode,
+                                                                   download_request.content_hash ) );
 
-              HTTPRequest outgoing_request = request.to_http_request();
-              responses.new_request_arrived( outgoing_request );
+              HTTPRequest outgoing_request = get_request( bucket, download_request );
+              ObjectReceiver & receiver = *receivers.back();
+              responses.new_request_arrived( outgoing_request,
+                [&receiver] ( const string & data ) { receiver.append( data ); } );
 
               s3.write( outgoing_request.str() );
               expected_responses++;
@@ -243,11 +314,9 @@ void S3Client::download_files( const std::string & bucket,
                 }
                 else {
                   const size_t response_index = first_file_idx + response_count * thread_count;
-                  const string & filename = download_requests.at( response_index ).filename.string();
 
-                  roost::atomic_create( responses.front().body(), filename,
-                                        download_requests[ response_index ].mode.initialized(),
-                                        download_requests[ response_index ].mode.get_or( 0 ) );
+                  receivers.at( response_count )->commit();
+                  receivers.at( response_count ).reset();
 
                   success_callback( download_requests[ response_index ] );
                 }
@@ -266,3 +335,76 @@ void S3Client::download_files( const std::string & bucket,
     thread.join();
   }
 }
+
+vector<bool> S3Client::lookup_files( const string & bucket,
+                                     const vector<string> & object_keys )
+{
+  const string endpoint = this->endpoint( bucket );
+  const Address s3_address { endpoint, "https" };
+
+  const size_t thread_count = config_.max_threads;
+  const size_t batch_size = config_.max_batch_size;
+
+  /* vector<bool> can't be written from more than one thread */
+  vector<char> found( object_keys.size(), false );
+
+  vector<thread> threads;
+  for ( size_t thread_index = 0; thread_index < thread_count; thread_index++ ) {
+    if ( thread_index < object_keys.size() ) {
+      threads.emplace_back(
+        [&] ( const size_t index )
+        {
+          for ( size_t first_file_idx = index;
+                first_file_idx < object_keys.size();
+                first_file_idx += thread_count * batch_size ) {
+            SSLContext ssl_context;
+            HTTPResponseParser responses;
+            SecureSocket s3 = ssl_context.new_secure_socket( tcp_connection( s3_address ) );
+
+            s3.connect();
+
+            for ( size_t file_id = first_file_idx;
+                  file_id < min( object_keys.size(), first_file_idx + thread_count * batch_size );
+                  file_id += thread_count ) {
+              HTTPRequest outgoing_request = S3HeadRequest { credentials_, endpoint, config_.region,
+                                                             object_keys.at( file_id ) }.to_http_request();
+              responses.new_request_arrived( outgoing_request );
+              s3.write( outgoing_request.str() );
+            }
+
+            size_t response_count = 0;
+
+            while ( responses.pending_requests() ) {
+              /* drain responses */
+              responses.parse( s3.read() );
+              if ( not responses.empty() ) {
+                const size_t response_index = first_file_idx + response_count * thread_count;
+                const string status = responses.front().status_code();
+
+                /* without the permission to list the bucket, a missing
+                   object is a 403 */
+                if ( status == "200" ) {
+                  found[ response_index ] = true;
+                }
+                else if ( status != "404" and status != "403" ) {
+                  throw runtime_error( "HTTP failure in looking up '" +
+                                       object_keys.at( response_index ) +
+                                       "': " + responses.front().first_line() );
+                }
+
+                responses.pop();
+                response_count++;
+              }
+            }
+          }
+        }, thread_index
+      );
+    }
+  }
+
+  for ( auto & thread : threads ) {
+    thread.join();
+  }
+
+  return { found.begin(), found.end() };
+}
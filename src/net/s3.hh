@@ -29,14 +29,37 @@ public:
                 const std::string & endpoint, const std::string & region,
                 const std::string & object, const std::string & contents,
                 const std::string & content_hash = {} );
+
+  /* a request whose body (of content_length bytes) the caller streams after
+     the headers; content_hash can't be computed here, so it must be given */
+  S3PutRequest( const AWSCredentials & credentials,
+                const std::string & endpoint, const std::string & region,
+                const std::string & object, const size_t content_length,
+                const std::string & content_hash );
 };
 
 class S3GetRequest : public AWSRequest
 {
+protected:
+  S3GetRequest( const AWSCredentials & credentials,
+                const std::string & endpoint, const std::string & region,
+                const std::string & object, const std::string & method );
+
 public:
   S3GetRequest( const AWSCredentials & credentials,
                 const std::string & endpoint, const std::string & region,
-                const std::string & object );
+                const std::string & object )
+    : S3GetRequest( credentials, endpoint, region, object, "GET" ) {}
+};
+
+/* the headers a get would have, but not the object */
+class S3HeadRequest : public S3GetRequest
+{
+public:
+  S3HeadRequest( const AWSCredentials & credentials,
+                 const std::string & endpoint, const std::string & region,
+                 const std::string & object )
+    : S3GetRequest( credentials, endpoint, region, object, "HEAD" ) {}
 };
 
 struct S3ClientConfig
@@ -57,6 +80,16 @@ public:
   S3Client( const AWSCredentials & credentials,
             const S3ClientConfig & config = {} );
 
+  std::string endpoint( const std::string & bucket ) const;
+
+  /* signed requests for one object, for callers that run the transfer
+     themselves; the body of a put is streamed after its headers_str() */
+  HTTPRequest put_request( const std::string & bucket,
+                           const storage::PutRequest & request,
+                           const size_t content_length ) const;
+  HTTPRequest get_request( const std::string & bucket,
+                           const storage::GetRequest & request ) const;
+
   void download_file( const std::string & bucket,
                       const std::string & object,
                       const roost::path & filename );
@@ -70,6 +103,10 @@ public:
                        const std::vector<storage::GetRequest> & download_requests,
                        const std::function<void( const storage::GetRequest & )> & success_callback
                          = []( const storage::GetRequest & ){} );
+
+  /* which of the objects are in the bucket, by pipelined HEAD requests */
+  std::vector<bool> lookup_files( const std::string & bucket,
+                                  const std::vector<std::string> & object_keys );
 };
 
 #endif /* S3_HH */
@@ -160,10 +160,15 @@ string SecureSocket::read( const bool register_as_write )
 }
 
 void SecureSocket::write( const string & message, const bool register_as_read )
+{
+    write( message.data(), message.length(), register_as_read );
+}
+
+void SecureSocket::write( const char * data, const size_t length, const bool register_as_read )
 {
     /* SSL_write returns with success if complete contents of message are written */
     ERR_clear_error();
-    ssize_t bytes_written = SSL_write( ssl_.get(), message.data(), message.length() );
+    ssize_t bytes_written = SSL_write( ssl_.get(), data, length );
 
     if ( bytes_written <= 0 ) {
         int error_return = SSL_get_error( ssl_.get(), bytes_written );
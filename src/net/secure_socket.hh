@@ -47,6 +47,7 @@ public:
 
     std::string read( const bool register_as_write = false );
     void write( const std::string & message, const bool register_as_read = false );
+    void write( const char * data, const size_t length, const bool register_as_read = false );
     int get_error( const int return_value );
 };
 
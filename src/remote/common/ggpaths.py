@@ -1,6 +1,8 @@
 #!/usr/bin/env python3
 
 import os
+import mmap
+import struct
 
 GG_DIR = os.environ.get('GG_DIR')
 
@@ -13,42 +15,88 @@ if not os.path.isabs(GG_DIR):
 class GGPaths:
     blobs = os.path.join(GG_DIR, "blobs")
     reductions = os.path.join(GG_DIR, "reductions")
+    reduction_index = os.path.join(reductions, "index")
 
+    # where gg-execute runs the thunks (see gg::paths::scratch)
+    scratch = os.environ.get('GG_SCRATCH_DIR') or "/tmp"
+
+    # objects are sharded by the first two characters of their hash
+    # (see gg::paths::blob)
     @classmethod
     def blob_path(cls, blob_hash):
-        return os.path.join(cls.blobs, blob_hash)
+        if len(blob_hash) != 52 or blob_hash[0] not in "TV":
+            return os.path.join(cls.blobs, blob_hash)
 
-    @classmethod
-    def reduction_path(cls, blob_hash):
-        return os.path.join(cls.reductions, blob_hash)
+        shard = os.path.join(cls.blobs, blob_hash[1:3].replace('.', '-'))
+        os.makedirs(shard, exist_ok=True)
+        return os.path.join(shard, blob_hash)
 
     @classmethod
     def object_url(cls, bucket, key):
         return "https://{bucket}.s3.amazonaws.com/{key}".format(bucket=bucket, key=key)
 
+def _fnv1a(data, value=0xcbf29ce484222325):
+    for byte in data:
+        value ^= byte
+        value = (value * 0x100000001b3) & 0xffffffffffffffff
+    return value
+
 class GGCache:
+    # the layout of the reduction index (see src/util/mapped_hash_table.hh)
+    HEADER = struct.Struct("=8sIIQQQQ")
+    HEADER_SIZE = 4096
+    RECORD = struct.Struct("=QIIQ")
+    MAGIC = b"GGHTABLE"
+    VERSION = 1
+
+    @classmethod
+    def _lookup(cls, index, key):
+        magic, version, _, bucket_count, end, _, _ = cls.HEADER.unpack_from(index, 0)
+
+        if magic != cls.MAGIC or version != cls.VERSION:
+            raise Exception("invalid reduction index")
+
+        end = min(end, len(index))
+        data_start = cls.HEADER_SIZE + 8 * bucket_count
+        bucket = _fnv1a(key) % bucket_count
+        offset, = struct.unpack_from("=Q", index, cls.HEADER_SIZE + 8 * bucket)
+
+        while offset != 0:
+            if offset < data_start or offset + cls.RECORD.size > end:
+                return None
+
+            next_offset, key_len, value_len, checksum = cls.RECORD.unpack_from(index, offset)
+            payload_start = offset + cls.RECORD.size
+            payload_end = payload_start + key_len + value_len
+
+            if payload_end > end:
+                return None
+
+            payload = index[payload_start:payload_end]
+            unsigned = cls.RECORD.pack(next_offset, key_len, value_len, 0)
+
+            if _fnv1a(payload, _fnv1a(unsigned)) != checksum:
+                return None
+
+            if payload[:key_len] == key:
+                return payload[key_len:].decode()
+
+            offset = next_offset
+
+        return None
+
     @classmethod
     def check(cls, thunk_hash, output_tag=None):
         key = thunk_hash
         if output_tag:
             key += ("#%s" % output_tag)
 
-        rpath = GGPaths.reduction_path(key)
-
-        if not os.path.exists(rpath):
+        if not os.path.exists(GGPaths.reduction_index):
             return None
 
-        with open(rpath, "r") as fin:
-            data = fin.read()
-            data = data.split(" ")
-            return data[0]
-
-    @classmethod
-    def insert(cls, old_hash, new_hash):
-        rpath = GGPaths.reduction_path(old_hash)
-
-        with open(rpath, "w") as fout:
-            fout.write(new_hash)
+        with open(GGPaths.reduction_index, "rb") as fin:
+            with mmap.mmap(fin.fileno(), 0, access=mmap.ACCESS_READ) as index:
+                return cls._lookup(index, key.encode())
 
 def make_gg_dirs():
     os.makedirs(GGPaths.blobs, exist_ok=True)
@@ -53,7 +53,7 @@ def handler(request):
                 make_executable(blob_path)
 
     # Remove old thunk-execute directories
-    os.system("rm -rf /tmp/thunk-execute.*")
+    os.system("rm -rf {}/thunk-execute.*".format(GGPaths.scratch))
 
     # Execute the thunk, and upload the result
     command = ["gg-execute-static",
@@ -76,10 +76,9 @@ def handler(request):
             output_hash = GGCache.check(thunk['hash'], output_tag)
 
             if not output_hash:
-                return json.dumps({
-                    'returnCode': return_code,
-                    'stdout': stdout
-                })
+                # gg-execute stopped before it got to this thunk
+                outputs = None
+                break
 
             data = None
             if is_hash_for_thunk(output_hash):
@@ -94,13 +93,18 @@ def handler(request):
                 'data': data
             }]
 
+        # gg-execute stops at the first thunk that fails, so none of the
+        # ones after it ran
+        if outputs is None:
+            break
+
         executed_thunks += [{
             'thunkHash': thunk['hash'],
             'outputs': outputs
         }]
 
     return json.dumps({
-        'returnCode': 0,
-        'stdout': '',
+        'returnCode': return_code,
+        'stdout': stdout if return_code else '',
         'executedThunks': executed_thunks
     })
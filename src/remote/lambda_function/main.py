@@ -33,7 +33,7 @@ def handler(event, context):
     timelog = event.get('timelog')
 
     # Remove old thunk-execute directories
-    os.system("rm -rf /tmp/thunk-execute.*")
+    os.system("rm -rf {}/thunk-execute.*".format(GGPaths.scratch))
 
     # Write thunks to disk
 
@@ -93,10 +93,9 @@ def handler(event, context):
             output_hash = GGCache.check(thunk['hash'], output_tag)
 
             if not output_hash:
-                return {
-                    'returnCode': return_code,
-                    'stdout': stdout
-                }
+                # gg-execute stopped before it got to this thunk
+                outputs = None
+                break
 
             data = None
             if is_hash_for_thunk(output_hash):
@@ -111,13 +110,18 @@ def handler(event, context):
                 'data': data
             }]
 
+        # gg-execute stops at the first thunk that fails, so none of the
+        # ones after it ran
+        if outputs is None:
+            break
+
         executed_thunks += [{
             'thunkHash': thunk['hash'],
             'outputs': outputs
         }]
 
     return {
-        'returnCode': 0,
-        'stdout': '',
+        'returnCode': return_code,
+        'stdout': stdout if return_code else '',
         'executedThunks': executed_thunks
     }
@@ -12,11 +12,13 @@ SandboxedProcess::SandboxedProcess( const string & name,
                                     const string & working_directory,
                                     const unordered_map<string, Permissions> & allowed_files,
                                     function<int()> && child_procedure,
-                                    function<void()> && preparation_procedure )
+                                    function<void()> && preparation_procedure,
+                                    const bool seccomp )
   : tracer_( name, move( child_procedure ),
              bind( &SandboxedProcess::syscall_entry, this, placeholders::_1 ),
              bind( &SandboxedProcess::syscall_exit,  this, placeholders::_1 ),
-             move( preparation_procedure ) ),
+             move( preparation_procedure ),
+             seccomp ? SystemCallFilter::all_except( untraced_syscalls() ) : SystemCallFilter {} ),
     working_directory_( working_directory )
 {
   for ( const auto & allowed_file : allowed_files ) {
@@ -142,11 +144,9 @@ bool SandboxedProcess::rename_entry( const SystemCallInvocation & syscall )
          ( dst_perms.initialized() ) and ( dst_perms->write );
 }
 
-void SandboxedProcess::syscall_entry( TracedThreadInfo & tcb )
+bool SandboxedProcess::forbidden( const long syscall_no )
 {
-  SystemCallInvocation & syscall = tcb.syscall_invocation.get();
-
-  switch ( syscall.syscall_no() ) {
+  switch ( syscall_no ) {
   case SYS_chroot:
   case SYS_stat:
   case SYS_lstat:
@@ -180,6 +180,36 @@ void SandboxedProcess::syscall_entry( TracedThreadInfo & tcb )
   case SYS_getcpu:
   case SYS_mkdir:
   case SYS_socket:
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+vector<long> SandboxedProcess::untraced_syscalls()
+{
+  /* everything that syscall_entry() would let through without a look at
+     its arguments */
+  vector<long> syscalls;
+
+  for ( size_t syscall_no = 0; syscall_no < syscall_count(); syscall_no++ ) {
+    const SystemCallSignature & signature = syscall_signature( syscall_no );
+
+    if ( signature.complete() and not ( signature.flags() & TRACE_FILE )
+         and not forbidden( syscall_no ) ) {
+      syscalls.push_back( syscall_no );
+    }
+  }
+
+  return syscalls;
+}
+
+void SandboxedProcess::syscall_entry( TracedThreadInfo & tcb )
+{
+  SystemCallInvocation & syscall = tcb.syscall_invocation.get();
+
+  if ( forbidden( syscall.syscall_no() ) ) {
     throw SandboxViolation( "Forbidden syscall", tcb.syscall_invocation->to_string() );
   }
 
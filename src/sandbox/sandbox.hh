@@ -5,6 +5,7 @@
 
 #include <sys/stat.h>
 #include <string>
+#include <vector>
 #include <functional>
 #include <unordered_map>
 #include <unordered_set>
@@ -44,12 +45,21 @@ private:
   void syscall_entry( TracedThreadInfo & tcb );
   void syscall_exit( const TracedThreadInfo & tcb );
 
+  static bool forbidden( const long syscall_no );
+
+  /* the system calls that the sandbox always allows, which the seccomp
+     filter lets through without stopping the process */
+  static std::vector<long> untraced_syscalls();
+
 public:
+  /* with `seccomp`, only the file-related, forbidden and unknown system calls
+     stop the process; otherwise, every system call does */
   SandboxedProcess( const std::string & name,
                     const std::string & working_directory,
                     const std::unordered_map<std::string, Permissions> & allowed_files,
                     std::function<int()> && child_procedure,
-                    std::function<void()> && preparation_procedure = [](){} );
+                    std::function<void()> && preparation_procedure = [](){},
+                    const bool seccomp = SystemCallFilter::available() );
 
   /* throws an exception if sandbox violation happens. */
   void execute();
@@ -3,6 +3,7 @@
 #include "backend.hh"
 
 #include <iostream>
+#include <map>
 #include <regex>
 #include <stdexcept>
 
@@ -10,21 +11,169 @@
 #include "storage/backend_s3.hh"
 #include "storage/backend_gs.hh"
 #include "storage/backend_redis.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "util/digest.hh"
 #include "util/optional.hh"
 #include "util/uri.hh"
 
 using namespace std;
+using namespace storage;
 
-bool StorageBackend::is_available( const std::string & hash )
+void StorageBackend::prepare_compression()
 {
-  return roost::exists( remote_index_path_ / hash );
+  unique_lock<mutex> lock { encoder_mutex_ };
+
+  if ( encoder_ != nullptr ) {
+    return;
+  }
+
+  string dictionary;
+
+  if ( dictionary_hash_.length() ) {
+    if ( not gg::blobs::exists( dictionary_hash_ ) ) {
+      /* dictionaries are never compressed (see ObjectEncoder) */
+      GetRequest request { dictionary_hash_, gg::paths::blob( dictionary_hash_ ) };
+      request.content_hash.initialize( gg::hash::to_hex( dictionary_hash_ ) );
+      download_files( { request }, []( const GetRequest & ){} );
+    }
+
+    dictionary = gg::blobs::read( dictionary_hash_ );
+    compression::add_dictionary( dictionary );
+  }
+
+  /* there's an encoder even if compression is off, for the objects that
+     have to be compressed anyway */
+  encoder_ = make_unique<ObjectEncoder>( compression_, dictionary );
+}
+
+PreparedPut StorageBackend::prepare_put( const PutRequest & request )
+{
+  prepare_compression();
+
+  PreparedPut prepared { request };
+  prepared.compressed = encoder_->encode( request.filename,
+                                          ( gg::paths::scratch() / "gg-put" ).string() );
+
+  compression::Counters & counters = compression::counters();
+  const size_t size = roost::file_size( request.filename );
+  counters.put_uncompressed += size;
+
+  if ( prepared.compressed == nullptr ) {
+    counters.put_sent += size;
+    return prepared;
+  }
+
+  prepared.request.filename = prepared.compressed->name();
+  prepared.request.content_hash.clear();
+  counters.put_sent += roost::file_size( prepared.request.filename );
+  return prepared;
+}
+
+void StorageBackend::put( const vector<PutRequest> & requests,
+                          const PutCallback & success_callback )
+{
+  vector<PreparedPut> prepared;
+  vector<PutRequest> sent;
+  map<string, const PutRequest *> original;
+
+  prepared.reserve( requests.size() );
+  sent.reserve( requests.size() );
+
+  for ( const PutRequest & request : requests ) {
+    prepared.push_back( prepare_put( request ) );
+    sent.push_back( prepared.back().request );
+    original.emplace( request.object_key, &request );
+  }
+
+  upload_files( sent,
+                [&original, &success_callback] ( const PutRequest & request )
+                { success_callback( *original.at( request.object_key ) ); } );
+}
+
+void StorageBackend::get( const vector<GetRequest> & requests,
+                          const GetCallback & success_callback )
+{
+  prepare_compression();
+  download_files( requests, success_callback );
+}
+
+string StorageBackend::endpoint() const
+{
+  throw runtime_error( "storage backend does not sign requests" );
+}
+
+HTTPRequest StorageBackend::put_request( const PutRequest &, const size_t ) const
+{
+  throw runtime_error( "storage backend does not sign requests" );
+}
+
+HTTPRequest StorageBackend::get_request( const GetRequest & ) const
+{
+  throw runtime_error( "storage backend does not sign requests" );
+}
+
+vector<bool> StorageBackend::lookup_files( const vector<string> & object_keys )
+{
+  return vector<bool>( object_keys.size(), false );
+}
+
+RemoteIndex & StorageBackend::remote_index()
+{
+  unique_lock<mutex> lock { remote_index_mutex_ };
+
+  if ( remote_index_ == nullptr ) {
+    remote_index_ = make_unique<RemoteIndex>( remote_index_path_ );
+  }
+
+  return *remote_index_;
+}
+
+bool StorageBackend::is_available( const string & hash )
+{
+  return remote_index().contains( hash );
+}
+
+void StorageBackend::set_available( const string & hash )
+{
+  remote_index().insert( hash );
 }
 
-void StorageBackend::set_available( const std::string & hash )
+vector<bool> StorageBackend::find_available( const vector<string> & hashes )
 {
-  roost::atomic_create( "", remote_index_path_ / hash );
+  vector<bool> available( hashes.size(), false );
+  vector<string> unknown;
+  vector<size_t> unknown_index;
+
+  for ( size_t i = 0; i < hashes.size(); i++ ) {
+    if ( is_available( hashes[ i ] ) ) {
+      available[ i ] = true;
+    }
+    else {
+      unknown.push_back( hashes[ i ] );
+      unknown_index.push_back( i );
+    }
+  }
+
+  if ( unknown.empty() ) {
+    return available;
+  }
+
+  const vector<bool> found = lookup_files( unknown );
+  vector<string> found_keys;
+
+  for ( size_t i = 0; i < unknown.size(); i++ ) {
+    if ( found.at( i ) ) {
+      available[ unknown_index[ i ] ] = true;
+      found_keys.push_back( unknown[ i ] );
+    }
+  }
+
+  if ( not found_keys.empty() ) {
+    remote_index().insert( found_keys );
+  }
+
+  return available;
 }
 
 
@@ -66,6 +215,29 @@ unique_ptr<StorageBackend> StorageBackend::create_backend( const string & uri )
 
   if ( backend != nullptr ) {
     backend->remote_index_path_ = gg::paths::remote( digest::sha256( uri ) );
+
+    auto & options = endpoint.options;
+
+    if ( options.count( "compression" ) ) {
+      if ( options[ "compression" ] == "zstd" ) {
+        backend->compression_.enabled = true;
+      }
+      else if ( options[ "compression" ] != "none" ) {
+        throw runtime_error( "unknown compression: " + options[ "compression" ] );
+      }
+    }
+
+    if ( options.count( "compression-level" ) ) {
+      backend->compression_.level = stoi( options[ "compression-level" ] );
+    }
+
+    if ( options.count( "compression-min-size" ) ) {
+      backend->compression_.min_size = stoul( options[ "compression-min-size" ] );
+    }
+
+    if ( options.count( "dictionary" ) ) {
+      backend->dictionary_hash_ = options[ "dictionary" ];
+    }
   }
 
   return backend;
@@ -7,29 +7,96 @@
 #include <string>
 #include <functional>
 #include <memory>
+#include <mutex>
 
+#include "net/compression.hh"
+#include "net/http_request.hh"
+#include "net/redis.hh"
 #include "net/requests.hh"
+#include "storage/remote_index.hh"
 #include "util/optional.hh"
 #include "util/path.hh"
+#include "util/temp_file.hh"
 
 typedef std::function<void( const storage::PutRequest & )> PutCallback;
 typedef std::function<void( const storage::GetRequest & )> GetCallback;
 
+/* what actually goes up for a put: the object, or its compressed form */
+struct PreparedPut
+{
+  storage::PutRequest request;
+  std::unique_ptr<TempFile> compressed { nullptr };
+
+  PreparedPut( const storage::PutRequest & request ) : request( request ) {}
+};
+
 class StorageBackend
 {
-protected:
+private:
+  storage::CompressionOptions compression_ {};
+  std::string dictionary_hash_ {};
+
+  std::mutex encoder_mutex_ {};
+  std::unique_ptr<storage::ObjectEncoder> encoder_ { nullptr };
+
   roost::path remote_index_path_ {};
+  std::mutex remote_index_mutex_ {};
+  std::unique_ptr<RemoteIndex> remote_index_ { nullptr };
+
+  RemoteIndex & remote_index();
+
+protected:
+  /* the transfers themselves, with the objects as they are stored */
+  virtual void upload_files( const std::vector<storage::PutRequest> & requests,
+                             const PutCallback & success_callback ) = 0;
+
+  virtual void download_files( const std::vector<storage::GetRequest> & requests,
+                               const GetCallback & success_callback ) = 0;
+
+  /* which of the objects the storage has; a backend that can't tell says
+     it has none of them */
+  virtual std::vector<bool> lookup_files( const std::vector<std::string> & object_keys );
 
 public:
-  virtual void put( const std::vector<storage::PutRequest> & requests,
-                    const PutCallback & success_callback = []( const storage::PutRequest & ){} ) = 0;
+  /* objects are compressed on their way up, if the URI asks for it (see
+     create_backend), and decompressed by the receiver on their way down */
+  void put( const std::vector<storage::PutRequest> & requests,
+            const PutCallback & success_callback = []( const storage::PutRequest & ){} );
+
+  void get( const std::vector<storage::GetRequest> & requests,
+            const GetCallback & success_callback = []( const storage::GetRequest & ){} );
 
-  virtual void get( const std::vector<storage::GetRequest> & requests,
-                    const GetCallback & success_callback = []( const storage::GetRequest & ){} ) = 0;
+  /* loads the compression dictionary, fetching it first if it's not in the
+     local blob store; put() and get() do this on their own */
+  void prepare_compression();
 
+  /* for callers that run the upload themselves; the request keeps its
+     object key, but its file may be a temporary, compressed one */
+  PreparedPut prepare_put( const storage::PutRequest & request );
+
+  /* backends that store objects over HTTPS can hand out signed requests
+     instead of running the transfers themselves, so that the transfers can
+     run on an event loop (see AsyncStorage) */
+  virtual bool signs_requests() const { return false; }
+  virtual std::string endpoint() const;
+  virtual HTTPRequest put_request( const storage::PutRequest & request,
+                                   const size_t content_length ) const;
+  virtual HTTPRequest get_request( const storage::GetRequest & request ) const;
+
+  /* backends that speak the Redis protocol hand out their client's
+     configuration, for the same reason */
+  virtual Optional<RedisClientConfig> redis_config() const { return {}; }
+
+  /* what the local index says the storage has; it only knows about the
+     objects that were uploaded or looked up from this machine */
   bool is_available( const std::string & hash );
   void set_available( const std::string & hash );
 
+  /* which of the objects the storage has. The ones that the local index
+     doesn't know about are looked up in the storage, all in one batch, and
+     the ones that turn up there are added to the index. */
+  std::vector<bool> find_available( const std::vector<std::string> & hashes );
+
   static std::unique_ptr<StorageBackend> create_backend( const std::string & uri );
 
   virtual ~StorageBackend() {}
@@ -11,14 +11,19 @@ GoogleStorageBackend::GoogleStorageBackend( const GoogleStorageCredentials & cre
              { "", bucket + ".storage.googleapis.com", 32, 1 } ), bucket_( bucket )
 {}
 
-void GoogleStorageBackend::put( const std::vector<PutRequest> & requests,
-                                const PutCallback & success_callback )
+void GoogleStorageBackend::upload_files( const std::vector<PutRequest> & requests,
+                                         const PutCallback & success_callback )
 {
   client_.upload_files( bucket_, requests, success_callback );
 }
 
-void GoogleStorageBackend::get( const std::vector<GetRequest> & requests,
-                                const GetCallback & success_callback )
+void GoogleStorageBackend::download_files( const std::vector<GetRequest> & requests,
+                                           const GetCallback & success_callback )
 {
   client_.download_files( bucket_, requests, success_callback );
 }
+
+std::vector<bool> GoogleStorageBackend::lookup_files( const std::vector<std::string> & object_keys )
+{
+  return client_.lookup_files( bucket_, object_keys );
+}
@@ -9,14 +9,15 @@
 
 class LocalStorageBackend : public StorageBackend
 {
-public:
-  LocalStorageBackend() {}
+protected:
+  void upload_files( const std::vector<storage::PutRequest> &,
+                     const PutCallback & ) override {}
 
-  void put( const std::vector<storage::PutRequest> &,
-            const PutCallback & = []( const storage::PutRequest & ){} ) {}
+  void download_files( const std::vector<storage::GetRequest> &,
+                       const GetCallback & ) override {}
 
-  void get( const std::vector<storage::GetRequest> &,
-            const GetCallback & = []( const storage::GetRequest & ){} ) {}
+public:
+  LocalStorageBackend() {}
 };
 
 #endif /* STORAGE_BACKEND_LOCAL_HH */
@@ -5,14 +5,22 @@
 using namespace std;
 using namespace storage;
 
-void RedisStorageBackend::put( const std::vector<PutRequest> & requests,
-                               const PutCallback & success_callback )
+/* each call has a client, and connections, of its own, so that the backend
+   can be used from more than one thread */
+
+void RedisStorageBackend::upload_files( const std::vector<PutRequest> & requests,
+                                        const PutCallback & success_callback )
+{
+  Redis { config_ }.upload_files( requests, success_callback );
+}
+
+void RedisStorageBackend::download_files( const std::vector<GetRequest> & requests,
+                                          const GetCallback & success_callback )
 {
-  client_.upload_files( requests, success_callback );
+  Redis { config_ }.download_files( requests, success_callback );
 }
 
-void RedisStorageBackend::get( const std::vector<GetRequest> & requests,
-                               const GetCallback & success_callback )
+std::vector<bool> RedisStorageBackend::lookup_files( const std::vector<std::string> & object_keys )
 {
-  client_.download_files( requests, success_callback );
+  return Redis { config_ }.lookup_files( object_keys );
 }
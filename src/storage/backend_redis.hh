@@ -9,19 +9,23 @@
 class RedisStorageBackend : public StorageBackend
 {
 private:
-  Redis client_;
+  RedisClientConfig config_;
+
+protected:
+  void upload_files( const std::vector<storage::PutRequest> & requests,
+                     const PutCallback & success_callback ) override;
+
+  void download_files( const std::vector<storage::GetRequest> & requests,
+                       const GetCallback & success_callback ) override;
+
+  std::vector<bool> lookup_files( const std::vector<std::string> & object_keys ) override;
 
 public:
   RedisStorageBackend( RedisClientConfig & config )
-    : client_( config )
+    : config_( config )
   {}
 
-  void put( const std::vector<storage::PutRequest> & requests,
-            const PutCallback & success_callback = []( const storage::PutRequest & ){} ) override;
-
-  void get( const std::vector<storage::GetRequest> & requests,
-            const GetCallback & success_callback = []( const storage::GetRequest & ){} ) override;
-
+  Optional<RedisClientConfig> redis_config() const override { return RedisClientConfig( config_ ); }
 };
 
 #endif /* STORAGE_BACKEND_REDIS_HH */
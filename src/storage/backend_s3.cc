@@ -11,14 +11,19 @@ S3StorageBackend::S3StorageBackend( const AWSCredentials & credentials,
   : client_( credentials, { s3_region } ), bucket_( s3_bucket )
 {}
 
-void S3StorageBackend::put( const std::vector<PutRequest> & requests,
-                            const PutCallback & success_callback )
+void S3StorageBackend::upload_files( const std::vector<PutRequest> & requests,
+                                     const PutCallback & success_callback )
 {
   client_.upload_files( bucket_, requests, success_callback );
 }
 
-void S3StorageBackend::get( const std::vector<GetRequest> & requests,
-                            const GetCallback & success_callback )
+void S3StorageBackend::download_files( const std::vector<GetRequest> & requests,
+                                       const GetCallback & success_callback )
 {
   client_.download_files( bucket_, requests, success_callback );
 }
+
+std::vector<bool> S3StorageBackend::lookup_files( const std::vector<std::string> & object_keys )
+{
+  return client_.lookup_files( bucket_, object_keys );
+}
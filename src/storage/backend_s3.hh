@@ -13,16 +13,29 @@ private:
   S3Client client_;
   std::string bucket_;
 
+protected:
+  void upload_files( const std::vector<storage::PutRequest> & requests,
+                     const PutCallback & success_callback ) override;
+
+  void download_files( const std::vector<storage::GetRequest> & requests,
+                       const GetCallback & success_callback ) override;
+
+  std::vector<bool> lookup_files( const std::vector<std::string> & object_keys ) override;
+
 public:
   S3StorageBackend( const AWSCredentials & credentials,
                     const std::string & s3_bucket,
                     const std::string & s3_region );
 
-  void put( const std::vector<storage::PutRequest> & requests,
-            const PutCallback & success_callback = []( const storage::PutRequest & ){} ) override;
+  bool signs_requests() const override { return true; }
+  std::string endpoint() const override { return client_.endpoint( bucket_ ); }
+
+  HTTPRequest put_request( const storage::PutRequest & request,
+                           const size_t content_length ) const override
+  { return client_.put_request( bucket_, request, content_length ); }
 
-  void get( const std::vector<storage::GetRequest> & requests,
-            const GetCallback & success_callback = []( const storage::GetRequest & ){} ) override;
+  HTTPRequest get_request( const storage::GetRequest & request ) const override
+  { return client_.get_request( bucket_, request ); }
 
 };
 
@@ -0,0 +1,66 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "remote_index.hh"
+
+#include <unistd.h>
+
+#include "util/exception.hh"
+
+using namespace std;
+
+RemoteIndex::RemoteIndex( const roost::path & path )
+  : table_( path.string() + ".index" ), filter_( path.string() + ".bloom" )
+{
+  if ( roost::exists_and_is_directory( path ) ) {
+    import_legacy_entries( path );
+  }
+}
+
+void RemoteIndex::import_legacy_entries( const roost::path & legacy_directory )
+{
+  vector<string> object_keys;
+
+  try {
+    object_keys = roost::get_directory_listing( legacy_directory );
+  }
+  catch ( const unix_error & ) {
+    /* another process moved them first */
+    return;
+  }
+
+  insert( object_keys );
+
+  for ( const string & object_key : object_keys ) {
+    unlink( ( legacy_directory / object_key ).string().c_str() );
+  }
+
+  rmdir( legacy_directory.string().c_str() );
+}
+
+bool RemoteIndex::contains( const string & object_key ) const
+{
+  return filter_.may_contain( object_key )
+         and table_.get( object_key ).initialized();
+}
+
+void RemoteIndex::insert( const string & object_key )
+{
+  table_.put( object_key, {} );
+  filter_.add( object_key );
+}
+
+void RemoteIndex::insert( const vector<string> & object_keys )
+{
+  vector<pair<string, string>> entries;
+  entries.reserve( object_keys.size() );
+
+  for ( const string & object_key : object_keys ) {
+    entries.emplace_back( object_key, string {} );
+  }
+
+  table_.put( entries );
+
+  for ( const string & object_key : object_keys ) {
+    filter_.add( object_key );
+  }
+}
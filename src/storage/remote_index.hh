@@ -0,0 +1,36 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef STORAGE_REMOTE_INDEX_HH
+#define STORAGE_REMOTE_INDEX_HH
+
+#include <string>
+#include <vector>
+
+#include "util/bloom_filter.hh"
+#include "util/mapped_hash_table.hh"
+#include "util/path.hh"
+
+/* What a storage backend is known to have, kept across runs in two files
+   next to each other: a hash table of the object keys (<path>.index), and
+   a Bloom filter in front of it (<path>.bloom), so that most objects that
+   the storage doesn't have are turned away without a look at the table.
+   The index used to be a directory of empty files, one per object, at
+   <path>; it is moved into the table the first time it's opened. */
+class RemoteIndex
+{
+private:
+  MappedHashTable table_;
+  BloomFilter filter_;
+
+  void import_legacy_entries( const roost::path & legacy_directory );
+
+public:
+  RemoteIndex( const roost::path & path );
+
+  bool contains( const std::string & object_key ) const;
+
+  void insert( const std::string & object_key );
+  void insert( const std::vector<std::string> & object_keys );
+};
+
+#endif /* STORAGE_REMOTE_INDEX_HH */
@@ -0,0 +1,333 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "blob_store.hh"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "thunk/ggutils.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+
+using namespace std;
+
+constexpr size_t BlobStore::DEFAULT_PACK_THRESHOLD;
+constexpr uint64_t BlobStore::PACK_SIZE_LIMIT;
+
+static uint64_t file_size( const FileDescriptor & fd )
+{
+  struct stat file_info;
+  CheckSystemCall( "fstat", fstat( fd.fd_num(), &file_info ) );
+  return file_info.st_size;
+}
+
+BlobStore::BlobStore( const size_t pack_threshold )
+  : pack_threshold_( pack_threshold ),
+    pack_index_( gg::paths::packs() / "index" )
+{}
+
+BlobStore & BlobStore::local()
+{
+  static BlobStore store;
+  return store;
+}
+
+roost::path BlobStore::pack_path( const uint32_t pack )
+{
+  return gg::paths::packs() / ( "pack-" + to_string( pack ) );
+}
+
+Optional<BlobStore::PackEntry> BlobStore::find_packed( const string & hash ) const
+{
+  const Optional<string> value = pack_index_.get( hash );
+
+  if ( not value.initialized() or value->length() != sizeof( PackEntry ) ) {
+    return {};
+  }
+
+  PackEntry entry;
+  memcpy( &entry, value->data(), sizeof( entry ) );
+  return { true, entry };
+}
+
+bool BlobStore::loose_exists( const string & hash ) const
+{
+  const roost::path object_path = gg::paths::blob( hash );
+
+  if ( roost::exists( object_path ) ) {
+    return true;
+  }
+
+  /* someone might have put the object where it was stored before blobs/
+     was sharded */
+  const roost::path flat_path = gg::paths::flat_blob( hash );
+
+  if ( flat_path == object_path ) {
+    return false;
+  }
+
+  if ( rename( flat_path.string().c_str(), object_path.string().c_str() ) == 0 ) {
+    return true;
+  }
+  else if ( errno != ENOENT ) {
+    throw unix_error( "rename " + flat_path.string() );
+  }
+
+  return false;
+}
+
+bool BlobStore::exists( const string & hash ) const
+{
+  return find_packed( hash ).initialized() or loose_exists( hash );
+}
+
+shared_ptr<MMapRegion> BlobStore::map_pack( const uint32_t pack, const uint64_t end )
+{
+  lock_guard<mutex> lock { maps_mutex_ };
+
+  auto it = pack_maps_.find( pack );
+
+  if ( it != pack_maps_.end() and it->second->length() >= end ) {
+    return it->second;
+  }
+
+  const roost::path path = pack_path( pack );
+  FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
+                                         open( path.string().c_str(), O_RDONLY | O_CLOEXEC ) ) };
+
+  /* the packfile will probably keep growing, so we map more than it holds;
+     only the parts that were written before they were indexed are read */
+  const uint64_t map_size = max( { 2 * PACK_SIZE_LIMIT, file_size( file ), end } );
+  auto region = make_shared<MMapRegion>( map_size, PROT_READ, MAP_SHARED, file.fd_num() );
+
+  pack_maps_[ pack ] = region;
+  return region;
+}
+
+BlobView BlobStore::map( const string & hash )
+{
+  const Optional<PackEntry> entry = find_packed( hash );
+
+  if ( entry.initialized() ) {
+    auto region = map_pack( entry->pack, entry->offset + entry->length );
+    return { region, entry->offset, entry->length };
+  }
+
+  if ( not loose_exists( hash ) ) {
+    throw runtime_error( "object not found: " + hash );
+  }
+
+  const roost::path object_path = gg::paths::blob( hash );
+  FileDescriptor file { CheckSystemCall( "open (" + object_path.string() + ")",
+                                         open( object_path.string().c_str(), O_RDONLY | O_CLOEXEC ) ) };
+  const uint64_t size = file_size( file );
+
+  if ( size == 0 ) {
+    return { nullptr, 0, 0 };
+  }
+
+  auto region = make_shared<MMapRegion>( size, PROT_READ, MAP_PRIVATE, file.fd_num() );
+  return { region, 0, size };
+}
+
+string BlobStore::read( const string & hash )
+{
+  return map( hash ).str();
+}
+
+roost::path BlobStore::path( const string & hash )
+{
+  const roost::path object_path = gg::paths::blob( hash );
+
+  if ( loose_exists( hash ) ) {
+    return object_path;
+  }
+
+  if ( not find_packed( hash ).initialized() ) {
+    throw runtime_error( "object not found: " + hash );
+  }
+
+  /* the object stays in its packfile, too */
+  roost::atomic_create( read( hash ), object_path, true, 0400 );
+  return object_path;
+}
+
+bool BlobStore::append_to_pack( const string & hash, const string & data )
+{
+  lock_guard<mutex> lock { write_mutex_ };
+
+  while ( true ) {
+    const uint32_t pack = pack_index_.flags();
+    const roost::path path = pack_path( pack );
+
+    FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
+                                           open( path.string().c_str(),
+                                                 O_WRONLY | O_CREAT | O_CLOEXEC, 0644 ) ) };
+
+    /* the lock is released when the file is closed */
+    file.block_for_exclusive_lock();
+
+    const uint64_t offset = CheckSystemCall( "lseek", lseek( file.fd_num(), 0, SEEK_END ) );
+
+    if ( offset >= PACK_SIZE_LIMIT ) {
+      /* whoever gets here first moves everyone on to the next packfile */
+      if ( pack_index_.flags() == pack ) {
+        pack_index_.set_flags( pack + 1 );
+      }
+
+      continue;
+    }
+
+    /* another process might have packed the same object in the meantime */
+    if ( find_packed( hash ).initialized() ) {
+      return true;
+    }
+
+    if ( not data.empty() ) {
+      file.write( data );
+    }
+
+    /* if the index is full, the bytes we just wrote are never read */
+    const PackEntry entry { pack, 0, offset, data.length() };
+    return pack_index_.put( hash, string( reinterpret_cast<const char *>( &entry ),
+                                          sizeof( entry ) ) );
+  }
+}
+
+void BlobStore::insert( const string & hash, const string & data,
+                        const bool executable )
+{
+  if ( exists( hash ) ) {
+    return;
+  }
+
+  /* the object is stored loose if the pack index has no room left for it */
+  if ( executable or data.length() > pack_threshold_
+       or not append_to_pack( hash, data ) ) {
+    roost::atomic_create( data, gg::paths::blob( hash ), true,
+                          executable ? 0500 : 0400 );
+  }
+}
+
+void BlobStore::insert_file( const roost::path & src, const string & hash )
+{
+  if ( loose_exists( hash ) ) {
+    return;
+  }
+
+  const mode_t permission = roost::is_executable( src ) ? 0500 : 0400;
+  roost::copy_then_rename( src, gg::paths::blob( hash ), true, permission );
+}
+
+void BlobStore::move_file( const roost::path & src, const string & hash )
+{
+  if ( loose_exists( hash ) ) {
+    roost::remove( src );
+    return;
+  }
+
+  roost::move_file( src, gg::paths::blob( hash ) );
+}
+
+string BlobStore::capture_file( const roost::path & src )
+{
+  FileDescriptor file { CheckSystemCall( "open (" + src.string() + ")",
+                                         open( src.string().c_str(), O_RDONLY ) ) };
+
+  posix_fadvise( file.fd_num(), 0, 0, POSIX_FADV_SEQUENTIAL );
+
+  struct stat file_info;
+  CheckSystemCall( "fstat", fstat( file.fd_num(), &file_info ) );
+
+  static const dev_t blobs_device =
+    [] ()
+    {
+      struct stat blobs_info;
+      CheckSystemCall( "stat", stat( gg::paths::blobs().string().c_str(), &blobs_info ) );
+      return blobs_info.st_dev;
+    }();
+
+  /* on the same filesystem, the file is renamed into place once it's hashed */
+  if ( file_info.st_dev == blobs_device ) {
+    const string hash = gg::hash::stream( file );
+    move_file( src, hash );
+    return hash;
+  }
+
+  /* otherwise, it's copied into an unnamed file in the store while it's
+     hashed, which is linked in under the hash at the end */
+  const int copy_fd = open( gg::paths::blobs().string().c_str(), O_TMPFILE | O_WRONLY,
+                            file_info.st_mode & 07777 );
+
+  if ( copy_fd < 0 ) {
+    if ( errno != EOPNOTSUPP and errno != EISDIR ) {
+      throw unix_error( "open (O_TMPFILE)" );
+    }
+
+    /* no unnamed files on this filesystem */
+    const string hash = gg::hash::stream( file );
+    move_file( src, hash );
+    return hash;
+  }
+
+  FileDescriptor copy { copy_fd };
+
+  const string hash = gg::hash::stream( file, {},
+    [&copy] ( const char * data, const size_t length )
+    {
+      for ( size_t written = 0; written < length; ) {
+        written += CheckSystemCall( "write", ::write( copy.fd_num(), data + written,
+                                                      length - written ) );
+      }
+    } );
+
+  if ( not loose_exists( hash ) ) {
+    const string copy_path = "/proc/self/fd/" + to_string( copy.fd_num() );
+
+    if ( linkat( AT_FDCWD, copy_path.c_str(),
+                 AT_FDCWD, gg::paths::blob( hash ).string().c_str(), AT_SYMLINK_FOLLOW ) < 0
+         and errno != EEXIST ) {
+      throw unix_error( "linkat" );
+    }
+  }
+
+  roost::remove( src );
+  return hash;
+}
+
+void BlobStore::clear()
+{
+  lock_guard<mutex> write_lock { write_mutex_ };
+  lock_guard<mutex> maps_lock { maps_mutex_ };
+
+  const roost::path blobs_path = gg::paths::blobs();
+  const roost::path packs_path = gg::paths::packs();
+  const roost::path index_path = packs_path / "index";
+
+  for ( const string & name : roost::get_directory_listing( blobs_path ) ) {
+    const roost::path entry = blobs_path / name;
+
+    if ( entry == packs_path ) {
+      for ( const string & pack : roost::get_directory_listing( packs_path ) ) {
+        if ( packs_path / pack != index_path ) {
+          roost::remove( packs_path / pack );
+        }
+      }
+    }
+    else if ( roost::is_directory( entry ) ) {
+      roost::empty_directory( entry );
+    }
+    else if ( name != ".sharded" ) {
+      roost::remove( entry );
+    }
+  }
+
+  pack_index_.clear();
+  pack_index_.set_flags( 0 );
+  pack_maps_.clear();
+}
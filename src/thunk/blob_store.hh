@@ -0,0 +1,125 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef BLOB_STORE_HH
+#define BLOB_STORE_HH
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+#include <sys/types.h>
+
+#include "util/mapped_hash_table.hh"
+#include "util/mmap_region.hh"
+#include "util/optional.hh"
+#include "util/path.hh"
+
+/* a read-only view of the contents of an object; the memory stays mapped for
+   as long as the view (or a copy of it) is around */
+class BlobView
+{
+private:
+  std::shared_ptr<MMapRegion> region_;
+  size_t offset_;
+  size_t size_;
+
+public:
+  BlobView( const std::shared_ptr<MMapRegion> & region,
+            const size_t offset, const size_t size )
+    : region_( region ), offset_( offset ), size_( size )
+  {}
+
+  const char * data() const { return region_ ? region_->addr() + offset_ : ""; }
+  size_t size() const { return size_; }
+  std::string str() const { return { data(), size_ }; }
+};
+
+/* The local object store. Every object is a file of its own under the
+   sharded blobs/ directory, except for the small objects that are inserted
+   from memory, which are appended to packfiles under blobs/packs and found
+   through an index. A packed object is extracted to a file of its own only
+   when someone asks for its path. */
+class BlobStore
+{
+public:
+  static constexpr size_t DEFAULT_PACK_THRESHOLD = 64 * 1024;
+
+private:
+  /* a packfile stops taking new objects once it grows beyond this size */
+  static constexpr uint64_t PACK_SIZE_LIMIT = 64 * 1024 * 1024;
+
+  struct PackEntry
+  {
+    uint32_t pack;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t length;
+  };
+
+  size_t pack_threshold_;
+
+  /* the index also keeps the number of the packfile we're appending to,
+     in its flags */
+  MappedHashTable pack_index_;
+
+  std::mutex write_mutex_ {};
+  std::mutex maps_mutex_ {};
+  std::unordered_map<uint32_t, std::shared_ptr<MMapRegion>> pack_maps_ {};
+
+  static roost::path pack_path( const uint32_t pack );
+
+  Optional<PackEntry> find_packed( const std::string & hash ) const;
+  std::shared_ptr<MMapRegion> map_pack( const uint32_t pack, const uint64_t end );
+  bool append_to_pack( const std::string & hash, const std::string & data );
+
+  /* is the object stored as a file of its own? */
+  bool loose_exists( const std::string & hash ) const;
+
+public:
+  BlobStore( const size_t pack_threshold = DEFAULT_PACK_THRESHOLD );
+
+  bool exists( const std::string & hash ) const;
+
+  /* returns the path to a file holding the object */
+  roost::path path( const std::string & hash );
+
+  BlobView map( const std::string & hash );
+  std::string read( const std::string & hash );
+
+  /* small objects that are not executable go into a packfile */
+  void insert( const std::string & hash, const std::string & data,
+               const bool executable = false );
+
+  /* copies the file into the store, keeping its executable bit */
+  void insert_file( const roost::path & src, const std::string & hash );
+
+  /* moves the file into the store */
+  void move_file( const roost::path & src, const std::string & hash );
+
+  /* hashes the file and moves it into the store, reading it only once;
+     returns its hash */
+  std::string capture_file( const roost::path & src );
+
+  /* removes all the objects */
+  void clear();
+
+  static BlobStore & local();
+};
+
+namespace gg {
+  namespace blobs {
+    inline bool exists( const std::string & hash ) { return BlobStore::local().exists( hash ); }
+    inline roost::path path( const std::string & hash ) { return BlobStore::local().path( hash ); }
+    inline BlobView map( const std::string & hash ) { return BlobStore::local().map( hash ); }
+    inline std::string read( const std::string & hash ) { return BlobStore::local().read( hash ); }
+
+    inline void insert( const std::string & hash, const std::string & data,
+                        const bool executable = false )
+    {
+      BlobStore::local().insert( hash, data, executable );
+    }
+  }
+}
+
+#endif /* BLOB_STORE_HH */
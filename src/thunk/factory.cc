@@ -8,6 +8,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#include "blob_store.hh"
 #include "ggutils.hh"
 #include "manifest.hh"
 #include "placeholder.hh"
@@ -48,6 +49,37 @@ ThunkFactory::Data::Data( const string & filename,
   }
 }
 
+vector<ThunkFactory::Data> ThunkFactory::Data::from_files( const vector<string> & filenames )
+{
+  vector<Data> result( filenames.size() );
+  vector<size_t> values;
+  vector<roost::path> value_paths;
+
+  for ( size_t i = 0; i < filenames.size(); i++ ) {
+    const string filename = roost::path( filenames[ i ] ).lexically_normal().string();
+
+    if ( ThunkPlaceholder::read( filename ).initialized() ) {
+      result[ i ] = Data { filenames[ i ] };
+    }
+    else {
+      values.push_back( i );
+      value_paths.emplace_back( filename );
+    }
+  }
+
+  /* as in the constructor, anything that isn't a placeholder is a value,
+     even if it happens to look like a thunk */
+  const vector<string> hashes = gg::hash::files( value_paths, false,
+                                                 { true, ObjectType::Value } );
+
+  for ( size_t i = 0; i < values.size(); i++ ) {
+    result[ values[ i ] ] = Data { filenames[ values[ i ] ], {},
+                                   ObjectType::Value, hashes[ i ] };
+  }
+
+  return result;
+}
+
 Thunk ThunkFactory::create_thunk( const Function & function,
                                   const vector<Data> & data,
                                   const vector<Data> & executables,
@@ -140,8 +172,7 @@ string ThunkFactory::generate( const Function & function,
     string manifest_hash = gg::hash::compute( manifest_data,
                                               ObjectType::Value );
     thunk_data.emplace_back( manifest_hash, string {} );
-    roost::atomic_create( manifest_data,
-                          gg::paths::blob( manifest_hash ), true, 0400 );
+    gg::blobs::insert( manifest_hash, manifest_data );
     thunk_function.envars().push_back( "GG_MANIFEST=" + thunk::data_placeholder( manifest_hash ) );
   }
 
@@ -154,10 +185,10 @@ string ThunkFactory::generate( const Function & function,
         }
 
         roost::path source_path = datum.real_filename();
-        roost::path target_path = gg::paths::blob( gg::hash::base( datum.hash() ) );
+        const string hash = gg::hash::base( datum.hash() );
 
-        if ( not roost::exists( target_path ) ) {
-          roost::copy_then_rename( source_path, target_path, true, executable ? 0500 : 0400 );
+        if ( not gg::blobs::exists( hash ) ) {
+          roost::copy_then_rename( source_path, gg::paths::blob( hash ), true, executable ? 0500 : 0400 );
         }
       };
 
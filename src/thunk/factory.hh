@@ -37,6 +37,10 @@ public:
           const gg::ObjectType & type = gg::ObjectType::Value,
           const std::string & hash = {} );
 
+    /* same as constructing one Data per file, but the files are hashed
+       together, through gg::hash::files */
+    static std::vector<Data> from_files( const std::vector<std::string> & filenames );
+
     const std::string & filename() const { return filename_; }
     const std::string & real_filename() const { return real_filename_; }
     const std::string & hash() const { return hash_; }
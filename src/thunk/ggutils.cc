@@ -4,7 +4,15 @@
 
 #include <sstream>
 #include <iomanip>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <algorithm>
+#include <cerrno>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/fcntl.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -16,7 +24,7 @@
 #include "util/digest.hh"
 #include "util/exception.hh"
 #include "util/file_descriptor.hh"
-#include "util/tokenize.hh"
+#include "util/mapped_hash_table.hh"
 #include "util/util.hh"
 #include "util/xdg.hh"
 
@@ -119,12 +127,96 @@ namespace gg {
       return gg_dir;
     }
 
+    /* objects are spread over the subdirectories of blobs/, named after the
+       first two characters of their hash ('.' is spelled '-', so that no
+       shard is called '..') */
+    bool is_sharded( const string & name )
+    {
+      return name.length() == gg::hash::length
+             and ( name[ 0 ] == 'T' or name[ 0 ] == 'V' );
+    }
+
+    string shard_name( const string & hash )
+    {
+      string shard = hash.substr( 1, 2 );
+      replace( shard.begin(), shard.end(), '.', '-' );
+      return shard;
+    }
+
+    void create_blob_shards( const roost::path & blobs_path )
+    {
+      const roost::path marker = blobs_path / ".sharded";
+
+      if ( roost::exists( marker ) ) {
+        return;
+      }
+
+      const static string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                     "abcdefghijklmnopqrstuvwxyz"
+                                     "0123456789_-";
+
+      for ( const char first : alphabet ) {
+        for ( const char second : alphabet ) {
+          const roost::path shard = blobs_path / string { first, second };
+
+          if ( mkdir( shard.string().c_str(), 0755 ) != 0 and errno != EEXIST ) {
+            throw unix_error( "mkdir " + shard.string() );
+          }
+        }
+      }
+
+      /* move the objects that were stored in the old, flat layout */
+      for ( const string & name : roost::get_directory_listing( blobs_path ) ) {
+        if ( not is_sharded( name ) ) {
+          continue;
+        }
+
+        const roost::path target = blobs_path / shard_name( name ) / name;
+
+        /* another process might be moving the same objects */
+        if ( ::rename( ( blobs_path / name ).string().c_str(),
+                       target.string().c_str() ) != 0 and errno != ENOENT ) {
+          throw unix_error( "rename " + name );
+        }
+      }
+
+      roost::atomic_create( "", marker );
+    }
+
     roost::path blobs()
     {
-      const static roost::path blobs_path = get_inner_directory( "blobs" );
+      const static roost::path blobs_path =
+        [] ()
+        {
+          const roost::path path = get_inner_directory( "blobs" );
+          create_blob_shards( path );
+          return path;
+        }();
+
       return blobs_path;
     }
 
+    roost::path scratch()
+    {
+      const static roost::path scratch_path =
+        [] ()
+        {
+          const char * envar = getenv( "GG_SCRATCH_DIR" );
+          const roost::path path { ( envar == nullptr or *envar == '\0' ) ? "/tmp" : envar };
+
+          if ( not roost::exists( path ) ) {
+            roost::create_directories( path );
+          }
+          else if ( not roost::is_directory( path ) ) {
+            throw runtime_error( path.string() + " is not a directory" );
+          }
+
+          return path;
+        }();
+
+      return scratch_path;
+    }
+
     roost::path reductions()
     {
       const static roost::path reductions_path = get_inner_directory( "reductions" );
@@ -168,13 +260,28 @@ namespace gg {
     }
 
     roost::path blob( const string & hash )
+    {
+      if ( is_sharded( hash ) ) {
+        return blobs() / shard_name( hash ) / hash;
+      }
+
+      return blobs() / hash;
+    }
+
+    roost::path flat_blob( const string & hash )
     {
       return blobs() / hash;
     }
 
-    roost::path reduction( const string & hash )
+    roost::path packs()
     {
-      return reductions() / hash;
+      const static roost::path packs_path = get_inner_directory( "blobs/packs" );
+      return packs_path;
+    }
+
+    roost::path reduction_index()
+    {
+      return reductions() / "index";
     }
 
     roost::path metadata( const string & hash )
@@ -197,11 +304,9 @@ namespace gg {
       return remote_dir;
     }
 
-    roost::path hash_cache_entry( const string & filename, const struct stat & stat_entry )
+    roost::path hash_cache_index()
     {
-      const string cache_key = to_string( stat_entry.st_dev ) + "-"
-        + to_string( stat_entry.st_ino ) + "-" + roost::rbasename( filename ).string();
-      return hash_cache() / cache_key;
+      return hash_cache() / "index";
     }
 
     roost::path dependency_cache_entry( const string & cache_key )
@@ -239,28 +344,116 @@ namespace gg {
       return uri;
     }
 
+    string reduction_key( const string & thunk_hash )
+    {
+      return "reductions/" + thunk_hash;
+    }
+
+    /* one line for every output, in order: the hash and the tag */
+    string serialize_reduction( const vector<ThunkOutput> & outputs )
+    {
+      string data;
+
+      for ( const ThunkOutput & output : outputs ) {
+        data += output.hash + " " + output.tag + "\n";
+      }
+
+      return data;
+    }
+
+    vector<ThunkOutput> parse_reduction( const string & data )
+    {
+      vector<ThunkOutput> outputs;
+      istringstream lines { data };
+
+      for ( string line; getline( lines, line ); ) {
+        const size_t space = line.find( ' ' );
+
+        if ( space == string::npos ) {
+          throw runtime_error( "invalid reduction record" );
+        }
+
+        outputs.emplace_back( line.substr( 0, space ), line.substr( space + 1 ) );
+      }
+
+      if ( outputs.empty() ) {
+        throw runtime_error( "empty reduction record" );
+      }
+
+      return outputs;
+    }
+
   }
 
   namespace cache {
 
+    /* set in the index once the reductions that were stored the old way,
+       one file per thunk under .gg/reductions, are moved into it */
+    constexpr uint64_t LEGACY_ENTRIES_IMPORTED = 0x1;
+
+    void import_legacy_entries( MappedHashTable & index )
+    {
+      if ( index.flags() & LEGACY_ENTRIES_IMPORTED ) {
+        return;
+      }
+
+      vector<pair<string, string>> entries;
+      vector<roost::path> legacy_files;
+
+      for ( const string & name : roost::get_directory_listing( gg::paths::reductions() ) ) {
+        const roost::path entry_path = gg::paths::reductions() / name;
+
+        if ( entry_path == gg::paths::reduction_index() ) {
+          continue;
+        }
+
+        const string contents = roost::read_file( entry_path );
+
+        if ( contents.length() < gg::hash::length ) {
+          continue;
+        }
+
+        entries.emplace_back( name, contents.substr( 0, gg::hash::length ) );
+        legacy_files.push_back( entry_path );
+      }
+
+      index.put( entries );
+      index.set_flags( index.flags() | LEGACY_ENTRIES_IMPORTED );
+
+      for ( const roost::path & legacy_file : legacy_files ) {
+        /* another process might be importing the same entries */
+        unlink( legacy_file.string().c_str() );
+      }
+    }
+
+    MappedHashTable & reduction_index()
+    {
+      static MappedHashTable index { gg::paths::reduction_index() };
+      static once_flag import_flag;
+
+      call_once( import_flag, import_legacy_entries, ref( index ) );
+      return index;
+    }
+
     Optional<ReductionResult> check( const string & thunk_hash )
     {
-      roost::path reduction { gg::paths::reduction( thunk_hash ) };
+      Optional<string> output_hash = reduction_index().get( thunk_hash );
 
-      if ( not roost::exists( reduction ) ) {
+      if ( not output_hash.initialized() ) {
         return {}; // no reductions are available
       }
 
-      FileDescriptor cache_entry { CheckSystemCall( "open( " + reduction.string() + " )",
-                                                    open( reduction.string().c_str(), O_RDONLY ) ) };
-      const string output_hash = cache_entry.read_exactly( gg::hash::length );
-
-      return ReductionResult { output_hash };
+      return ReductionResult { move( *output_hash ) };
     }
 
     void insert( const string & old_hash, const string & new_hash )
     {
-      roost::atomic_create( new_hash, gg::paths::reduction( old_hash ) );
+      reduction_index().put( old_hash, new_hash );
+    }
+
+    void clear()
+    {
+      reduction_index().clear();
     }
 
   }
@@ -283,70 +476,212 @@ namespace gg {
       return thunk_hash + "#" + output_tag;
     }
 
-    string compute( const string & input, const ObjectType type )
+    string format( const ObjectType type, string && digest, const uint64_t length )
     {
-      string ret { move( digest::sha256( input ) ) };
       ostringstream output_sstr;
 
-      replace( ret.begin(), ret.end(), '-', '.' );
-      output_sstr << to_underlying( type ) << ret << setfill( '0' )
-                  << setw( 8 ) << hex << input.length();
+      replace( digest.begin(), digest.end(), '-', '.' );
+      output_sstr << to_underlying( type ) << digest << setfill( '0' )
+                  << setw( 8 ) << hex << length;
       return output_sstr.str();
     }
 
+    string compute( const string & input, const ObjectType type )
+    {
+      return format( type, digest::sha256( input ), input.length() );
+    }
+
+    string stream( FileDescriptor & file, Optional<ObjectType> type,
+                   const function<void( const char *, const size_t )> & sink )
+    {
+      digest::SHA256 hash_function;
+
+      const string magic = file.read_exactly( thunk::MAGIC_NUMBER.size(), true );
+      hash_function.update( magic );
+
+      if ( sink ) {
+        sink( magic.data(), magic.size() );
+      }
+
+      if ( not type.initialized() ) {
+        type = ( magic == thunk::MAGIC_NUMBER ) ? ObjectType::Thunk : ObjectType::Value;
+      }
+
+      /* the rest of the file is hashed one buffer at a time, so hashing a
+         large file takes no more memory than hashing a small one */
+      thread_local vector<char> buffer( BUFFER_SIZE );
+
+      while ( true ) {
+        const ssize_t bytes_read = CheckSystemCall( "read",
+                                                    ::read( file.fd_num(), buffer.data(), buffer.size() ) );
+
+        if ( bytes_read == 0 ) {
+          break;
+        }
+
+        hash_function.update( buffer.data(), bytes_read );
+
+        if ( sink ) {
+          sink( buffer.data(), bytes_read );
+        }
+      }
+
+      return format( *type, hash_function.finish(), hash_function.length() );
+    }
+
     string file_force( const roost::path & path, Optional<ObjectType> type )
     {
       FileDescriptor file { CheckSystemCall( "open (" + path.string() + ")",
                                              open( path.string().c_str(), O_RDONLY ) ) };
 
-      string contents;
-      while ( not file.eof() ) { contents += file.read(); }
+      posix_fadvise( file.fd_num(), 0, 0, POSIX_FADV_SEQUENTIAL );
+      return stream( file, type );
+    }
 
-      if ( not type.initialized() ) {
-        type = ( contents.size() >= thunk::MAGIC_NUMBER.size() and
-                 contents.compare( 0, thunk::MAGIC_NUMBER.size(),
-                                   gg::thunk::MAGIC_NUMBER ) == 0 )
-               ? ObjectType::Thunk : ObjectType::Value;
+    /* the hash cache maps "dev-ino-basename" of a file to the size, mtime
+       and ctime the file had when it was hashed, followed by its hash */
+    MappedHashTable & cache_index()
+    {
+      static MappedHashTable index { gg::paths::hash_cache_index() };
+      return index;
+    }
+
+    string cache_key( const roost::path & path, const struct stat & file_stat )
+    {
+      return to_string( file_stat.st_dev ) + "-" + to_string( file_stat.st_ino )
+             + "-" + roost::rbasename( path ).string();
+    }
+
+    string cache_validator( const struct stat & file_stat )
+    {
+      const int64_t fields[] = { file_stat.st_size,
+                                 file_stat.st_mtim.tv_sec, file_stat.st_mtim.tv_nsec,
+                                 file_stat.st_ctim.tv_sec, file_stat.st_ctim.tv_nsec };
+
+      return { reinterpret_cast<const char *>( fields ), sizeof( fields ) };
+    }
+
+    Optional<string> cache_lookup( const string & key, const struct stat & file_stat )
+    {
+      Optional<string> entry = cache_index().get( key );
+      const string validator = cache_validator( file_stat );
+
+      if ( not entry.initialized()
+           or entry->length() != validator.length() + gg::hash::length
+           or entry->compare( 0, validator.length(), validator ) != 0 ) {
+        return {};
       }
 
-      return gg::hash::compute( contents, *type );
+      return entry->substr( validator.length() );
     }
 
-    string file( const roost::path & path, Optional<ObjectType> type )
+    struct stat stat_file( const roost::path & path )
     {
       struct stat file_stat;
-      CheckSystemCall( "stat", stat( path.string().c_str(), &file_stat ) );
-      const auto cache_entry_path = gg::paths::hash_cache_entry( path.string(), file_stat );
+      CheckSystemCall( "stat (" + path.string() + ")",
+                       stat( path.string().c_str(), &file_stat ) );
+      return file_stat;
+    }
+
+    /* calls function( i ) for i in [0, count) on a few threads, and rethrows
+       the first exception any of the calls threw */
+    void parallel_for( const size_t count, const function<void( const size_t )> & function )
+    {
+      atomic<size_t> next { 0 };
+      exception_ptr error;
+      mutex error_mutex;
+
+      auto worker =
+        [&] ()
+        {
+          for ( size_t i = next++; i < count; i = next++ ) {
+            try {
+              function( i );
+            }
+            catch ( ... ) {
+              lock_guard<mutex> lock { error_mutex };
+              if ( not error ) { error = current_exception(); }
+            }
+          }
+        };
+
+      const size_t thread_count = min<size_t>( max( 1u, thread::hardware_concurrency() ),
+                                               count );
+      vector<thread> threads;
+
+      for ( size_t i = 1; i < thread_count; i++ ) {
+        threads.emplace_back( worker );
+      }
+
+      worker();
+
+      for ( thread & t : threads ) {
+        t.join();
+      }
+
+      if ( error ) {
+        rethrow_exception( error );
+      }
+    }
+
+    string file( const roost::path & path, Optional<ObjectType> type )
+    {
+      const struct stat file_stat = stat_file( path );
+      const string key = cache_key( path, file_stat );
+      Optional<string> cached_hash = cache_lookup( key, file_stat );
+
+      if ( cached_hash.initialized() and
+           ( not type.initialized() or gg::hash::type( *cached_hash ) == *type ) ) {
+        return move( *cached_hash );
+      }
 
-      if ( roost::exists( cache_entry_path ) ) {
-        string cache_entry = roost::read_file( cache_entry_path );
-        vector<string> cache_contents = split( cache_entry, " " );
+      const string computed_hash = gg::hash::file_force( path, type );
+      cache_index().put( key, cache_validator( file_stat ) + computed_hash );
+      return computed_hash;
+    }
 
-        if ( cache_contents.size() != 6 ) {
-          throw runtime_error( "bad cache entry: " + cache_entry_path.string() );
+    vector<string> files( const vector<roost::path> & paths, const bool force,
+                          Optional<ObjectType> type )
+    {
+      vector<string> hashes( paths.size() );
+      vector<struct stat> stats( force ? 0 : paths.size() );
+      vector<size_t> misses;
+
+      for ( size_t i = 0; i < paths.size(); i++ ) {
+        if ( force ) {
+          misses.push_back( i );
+          continue;
         }
 
-        if ( cache_contents.at( 0 ) == to_string( file_stat.st_size )
-             and cache_contents.at( 1 ) == to_string( file_stat.st_mtim.tv_sec )
-             and cache_contents.at( 2 ) == to_string( file_stat.st_mtim.tv_nsec )
-             and cache_contents.at( 3 ) == to_string( file_stat.st_ctim.tv_sec )
-             and cache_contents.at( 4 ) == to_string( file_stat.st_ctim.tv_nsec ) ) {
-          /* cache hit! */
-          return cache_contents.at( 5 );
+        stats[ i ] = stat_file( paths[ i ] );
+        Optional<string> cached_hash = cache_lookup( cache_key( paths[ i ], stats[ i ] ),
+                                                     stats[ i ] );
+
+        if ( cached_hash.initialized() and
+             ( not type.initialized() or gg::hash::type( *cached_hash ) == *type ) ) {
+          hashes[ i ] = move( *cached_hash );
+        }
+        else {
+          misses.push_back( i );
         }
       }
 
-      const string computed_hash = gg::hash::file_force( path, type );
+      parallel_for( misses.size(),
+        [&] ( const size_t i ) { hashes[ misses[ i ] ] = file_force( paths[ misses[ i ] ], type ); } );
 
-      roost::atomic_create( to_string( file_stat.st_size ) + " "
-                            + to_string( file_stat.st_mtim.tv_sec ) + " "
-                            + to_string( file_stat.st_mtim.tv_nsec ) + " "
-                            + to_string( file_stat.st_ctim.tv_sec ) + " "
-                            + to_string( file_stat.st_ctim.tv_nsec ) + " "
-                            + computed_hash,
-                            cache_entry_path );
+      if ( not force and not misses.empty() ) {
+        vector<pair<string, string>> entries;
 
-      return computed_hash;
+        for ( const size_t i : misses ) {
+          entries.emplace_back( cache_key( paths[ i ], stats[ i ] ),
+                                cache_validator( stats[ i ] ) + hashes[ i ] );
+        }
+
+        /* one lock acquisition for the whole batch */
+        cache_index().put( entries );
+      }
+
+      return hashes;
     }
 
     string to_hex( const string & gghash )
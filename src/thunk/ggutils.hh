@@ -6,10 +6,12 @@
 #include <string>
 #include <stdexcept>
 #include <vector>
+#include <functional>
 #include <sys/types.h>
 
 #include "manifest.hh"
 #include "thunk.hh"
+#include "util/file_descriptor.hh"
 #include "util/path.hh"
 #include "util/optional.hh"
 
@@ -24,12 +26,23 @@ namespace gg {
     roost::path dependency_cache();
     roost::path inclue_cache();
     roost::path blueprints();
+    roost::path packs();
 
+    /* where thunks are executed: /tmp, unless GG_SCRATCH_DIR says otherwise.
+       the outputs are renamed into blobs/ if it's on the same filesystem,
+       and copied as they're hashed if not */
+    roost::path scratch();
+
+    /* where the object would be stored as a file of its own; the objects
+       should be accessed through gg::blobs (see blob_store.hh) */
     roost::path blob( const std::string & hash );
-    roost::path reduction( const std::string & hash );
+
+    /* where the object was stored before blobs/ was sharded */
+    roost::path flat_blob( const std::string & hash );
+    roost::path reduction_index();
     roost::path metadata( const std::string & hash );
     roost::path remote( const std::string & hash );
-    roost::path hash_cache_entry( const std::string & filename, const struct stat & stat_entry );
+    roost::path hash_cache_index();
     roost::path dependency_cache_entry( const std::string & cache_key );
     roost::path include_cache_entry( const std::string & hash );
     roost::path blueprint( const std::string & hash );
@@ -39,6 +52,13 @@ namespace gg {
 
   namespace remote {
     std::string storage_backend_uri();
+
+    /* an execution that uploads its outputs also uploads a record of them
+       under this key, so that a coordinator that never heard back can find
+       out how the thunk was reduced */
+    std::string reduction_key( const std::string & thunk_hash );
+    std::string serialize_reduction( const std::vector<ThunkOutput> & outputs );
+    std::vector<ThunkOutput> parse_reduction( const std::string & data );
   }
 
   namespace cache {
@@ -49,6 +69,9 @@ namespace gg {
 
     Optional<ReductionResult> check( const std::string & thunk_hash );
     void insert( const std::string & old_hash, const std::string & new_hash );
+
+    /* forgets all the reductions */
+    void clear();
   }
 
   namespace hash {
@@ -63,6 +86,20 @@ namespace gg {
     std::string compute( const std::string & input, const ObjectType type );
     std::string file( const roost::path & path, Optional<ObjectType> type = {} );
     std::string file_force( const roost::path & path, Optional<ObjectType> type = {} );
+
+    /* hashes the rest of `file` one buffer at a time, handing every buffer
+       to `sink` as well */
+    std::string stream( FileDescriptor & file, Optional<ObjectType> type = {},
+                        const std::function<void( const char *, const size_t )> & sink = {} );
+
+    /* hashes a batch of files: the hash cache is consulted once per file,
+       the misses are hashed in parallel, and the new cache entries are
+       written together; force skips the hash cache, and type is forced on
+       the files, as it is by file() */
+    std::vector<std::string> files( const std::vector<roost::path> & paths,
+                                    const bool force = false,
+                                    Optional<ObjectType> type = {} );
+
     std::string to_hex( const std::string & gghash );
 
     uint32_t size( const std::string & gghash );
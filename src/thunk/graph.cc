@@ -3,7 +3,11 @@
 #include "graph.hh"
 
 #include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cmath>
 
+#include "blob_store.hh"
 #include "ggutils.hh"
 #include "thunk.hh"
 #include "thunk_reader.hh"
@@ -13,38 +17,128 @@ using namespace std;
 using namespace gg;
 using namespace gg::thunk;
 
+ExecutionGraph::ID ExecutionGraph::intern( const string & hash )
+{
+  const ID id = ids_.intern( hash );
+
+  if ( id >= nodes_.size() ) {
+    nodes_.resize( id + 1 );
+  }
+
+  return id;
+}
+
+ExecutionGraph::ID ExecutionGraph::find( const string & hash ) const
+{
+  return ids_.find( hash );
+}
+
+const Thunk & ExecutionGraph::thunk_at( const ID id ) const
+{
+  if ( id >= nodes_.size() or not nodes_[ id ].thunk ) {
+    throw out_of_range( "thunk not found in the execution graph" );
+  }
+
+  return *nodes_[ id ].thunk;
+}
+
+Thunk & ExecutionGraph::thunk_at( const ID id )
+{
+  return const_cast<Thunk &>( static_cast<const ExecutionGraph *>( this )->thunk_at( id ) );
+}
+
+const vector<ExecutionGraph::ID> & ExecutionGraph::referencing_at( const ID id ) const
+{
+  if ( id >= nodes_.size() or not ( nodes_[ id ].flags & TRACKED ) ) {
+    throw out_of_range( "no referencing thunks in the execution graph" );
+  }
+
+  return nodes_[ id ].referencing;
+}
+
+void ExecutionGraph::add_referencing( const ID id, const ID referencing_id )
+{
+  Node & node = nodes_[ id ];
+  node.flags |= TRACKED;
+
+  /* a thunk's dependencies are sorted by hash, so the outputs of the same
+     thunk come one after another, and looking at the last entry is enough
+     to keep the list free of repeats */
+  if ( node.referencing.empty() or node.referencing.back() != referencing_id ) {
+    node.referencing.push_back( referencing_id );
+  }
+}
+
+vector<string> ExecutionGraph::hashes( const vector<ID> & ids ) const
+{
+  vector<string> result;
+  result.reserve( ids.size() );
+
+  for ( const ID id : ids ) {
+    result.push_back( ids_.hash( id ) );
+  }
+
+  return result;
+}
+
+bool ExecutionGraph::has_thunk( const string & hash ) const
+{
+  const ID id = find( hash );
+  return id < nodes_.size() and nodes_[ id ].thunk;
+}
+
 string ExecutionGraph::add_thunk( const string & full_hash )
 {
   const string hash = gg::hash::base( full_hash );
-  const string & updated = updated_hash( hash );
+  const ID id = intern( hash );
+  const ID updated = nodes_[ id ].updated;
 
-  if ( thunks_.count( updated ) ) {
-    return updated;
+  if ( updated != HashInterner::NONE and nodes_[ updated ].thunk ) {
+    return ids_.hash( updated );
   }
 
-  if ( thunks_.count( hash ) ) {
+  if ( nodes_[ id ].thunk ) {
     return hash;
   }
 
-  Thunk thunk { move( ThunkReader::read( gg::paths::blob( hash ), hash ) ) };
+  unique_ptr<Thunk> thunk;
+  auto staged_it = staged_.find( id );
+
+  if ( staged_it != staged_.end() ) {
+    thunk = move( staged_it->second );
+    staged_.erase( staged_it );
+  }
+  else {
+    thunk = make_unique<Thunk>( move( ThunkReader::read( gg::blobs::map( hash ), hash ) ) );
+  }
 
   /* creating the entry */
-  referencing_thunks_[ hash ];
+  nodes_[ id ].flags |= TRACKED;
+
+  for ( const Thunk::DataItem & item : thunk->values() ) {
+    const ID value_id = intern( item.first );
 
-  for ( const Thunk::DataItem & item : thunk.values() ) {
-    value_dependencies_.emplace( item.first );
+    if ( not ( nodes_[ value_id ].flags & VALUE_DEPENDENCY ) ) {
+      nodes_[ value_id ].flags |= VALUE_DEPENDENCY;
+      value_dependencies_.push_back( value_id );
+    }
   }
 
-  for ( const Thunk::DataItem & item : thunk.executables() ) {
-    executable_dependencies_.emplace( item.first );
+  for ( const Thunk::DataItem & item : thunk->executables() ) {
+    const ID executable_id = intern( item.first );
+
+    if ( not ( nodes_[ executable_id ].flags & EXECUTABLE_DEPENDENCY ) ) {
+      nodes_[ executable_id ].flags |= EXECUTABLE_DEPENDENCY;
+      executable_dependencies_.push_back( executable_id );
+    }
   }
 
   vector<pair<string, string>> updates_to_thunk;
 
-  for ( const Thunk::DataItem & item : thunk.thunks() ) {
+  for ( const Thunk::DataItem & item : thunk->thunks() ) {
     const string item_base = gg::hash::base( item.first );
     const string item_updated = add_thunk( item_base );
-    referencing_thunks_[ item_updated ].emplace( hash );
+    add_referencing( find( item_updated ), id );
 
     if ( item_updated != item_base ) {
       updates_to_thunk.emplace_back( item_base, item_updated );
@@ -53,57 +147,85 @@ string ExecutionGraph::add_thunk( const string & full_hash )
 
   for ( const pair<string, string> & update : updates_to_thunk ) {
     vector<ThunkOutput> new_outputs;
-    for ( const auto & output : thunk.outputs() ) {
+    for ( const auto & output : thunk->outputs() ) {
       new_outputs.emplace_back( update.second, output );
     }
 
-    thunk.update_data( update.first, new_outputs );
+    thunk->update_data( update.first, new_outputs );
   }
 
-  thunks_.emplace( piecewise_construct,
-                   forward_as_tuple( hash ),
-                   forward_as_tuple( move( thunk ) ) );
+  nodes_[ id ].thunk = move( thunk );
+  thunk_count_++;
 
   return hash;
 }
 
-void ExecutionGraph::update_hash( const string & old_hash,
+void ExecutionGraph::stage_thunk( const string & hash, unique_ptr<Thunk> && thunk )
+{
+  const ID id = intern( hash );
+
+  if ( not nodes_[ id ].thunk ) {
+    staged_.emplace( id, move( thunk ) );
+  }
+}
+
+void ExecutionGraph::update_hash( const ID old_id,
                                   const vector<ThunkOutput> & outputs )
 {
+  const string old_hash = ids_.hash( old_id );
   const string & new_hash = outputs.front().hash;
+  const ID new_id = intern( new_hash );
 
   /* updating the hash chain */
   if ( gg::hash::type( new_hash ) == gg::ObjectType::Thunk ) {
-    if ( original_hashes_.count( old_hash ) == 0 ) {
-      original_hashes_[ new_hash ] = old_hash;
-      updated_hashes_[ old_hash ] = new_hash;
+    const ID original_id = nodes_[ old_id ].original;
+
+    if ( original_id == HashInterner::NONE ) {
+      nodes_[ new_id ].original = old_id;
+      nodes_[ old_id ].updated = new_id;
     }
     else {
-      original_hashes_[ new_hash ] = original_hashes_[ old_hash ];
-      updated_hashes_[ original_hashes_[ old_hash ] ] = new_hash;
-      original_hashes_.erase( old_hash );
+      nodes_[ new_id ].original = original_id;
+      nodes_[ original_id ].updated = new_id;
+      nodes_[ old_id ].original = HashInterner::NONE;
     }
   }
 
   /* updating the thunks that are referencing this thunk */
-  for ( const string & referencing_thunk_hash : referencing_thunks_.at( old_hash ) ) {
-    Thunk & referencing_thunk = thunks_.at( referencing_thunk_hash );
-    referencing_thunk.update_data( old_hash, outputs );
+  for ( const ID referencing_id : referencing_at( old_id ) ) {
+    thunk_at( referencing_id ).update_data( old_hash, outputs );
   }
 
   /* we don't need the old thunk entry */
-  thunks_.erase( old_hash );
+  if ( nodes_[ old_id ].thunk ) {
+    nodes_[ old_id ].thunk.reset();
+    thunk_count_--;
+  }
+
+  if ( old_id < critical_paths_.size() ) {
+    critical_paths_[ old_id ] = numeric_limits<double>::quiet_NaN();
+  }
 
   /* we don't need the old referencing thunks list */
-  referencing_thunks_[ new_hash ] = move( referencing_thunks_.at( old_hash ) );
-  referencing_thunks_.erase( old_hash );
+  if ( new_id != old_id ) {
+    nodes_[ new_id ].referencing = move( nodes_[ old_id ].referencing );
+    nodes_[ new_id ].flags |= TRACKED;
+    nodes_[ old_id ].referencing = {};
+    nodes_[ old_id ].flags &= ~TRACKED;
+
+    if ( update_callback_ ) {
+      update_callback_( old_hash, new_hash );
+    }
+  }
 }
 
 Optional<unordered_set<string>>
 ExecutionGraph::force_thunk( const string & old_hash,
                              vector<ThunkOutput> && original_outputs )
 {
-  if ( thunks_.count( old_hash ) == 0 ) {
+  const ID old_id = find( old_hash );
+
+  if ( old_id >= nodes_.size() or not nodes_[ old_id ].thunk ) {
     return { false };
   }
 
@@ -119,10 +241,15 @@ ExecutionGraph::force_thunk( const string & old_hash,
     actual_new_hash = add_thunk( actual_new_hash );
   }
 
-  update_hash( old_hash, outputs );
+  update_hash( old_id, outputs );
+
+  const ID new_id = find( actual_new_hash );
+
+  /* a copy, since update_hash() below moves these lists around */
+  const vector<ID> referencing = referencing_at( new_id );
 
-  for ( const string & referencing_thunk_hash : referencing_thunks_.at( actual_new_hash ) ) {
-    Thunk & referencing_thunk = thunks_.at( referencing_thunk_hash );
+  for ( const ID referencing_id : referencing ) {
+    Thunk & referencing_thunk = thunk_at( referencing_id );
 
     if ( referencing_thunk.can_be_executed() ) {
       const string referencing_thunk_new_hash = ThunkWriter::write( referencing_thunk );
@@ -132,11 +259,13 @@ ExecutionGraph::force_thunk( const string & old_hash,
         new_outputs.emplace_back( referencing_thunk_new_hash, output );
       }
 
-      thunks_.emplace( piecewise_construct,
-                       forward_as_tuple( referencing_thunk_new_hash ),
-                       forward_as_tuple( move( referencing_thunk ) ) );
+      const ID referencing_new_id = intern( referencing_thunk_new_hash );
 
-      update_hash( referencing_thunk_hash, new_outputs );
+      if ( not nodes_[ referencing_new_id ].thunk ) {
+        nodes_[ referencing_new_id ].thunk = move( nodes_[ referencing_id ].thunk );
+      }
+
+      update_hash( referencing_id, new_outputs );
       next_to_execute.emplace( move( referencing_thunk_new_hash ) );
     }
   }
@@ -147,7 +276,8 @@ ExecutionGraph::force_thunk( const string & old_hash,
   else {
     /* the thunk has been reducted to a value. we don't need to keep
     the list of thunks that are referencing it anymore. */
-    referencing_thunks_.erase( actual_new_hash );
+    nodes_[ new_id ].referencing = {};
+    nodes_[ new_id ].flags &= ~TRACKED;
   }
 
   return { true, move( next_to_execute ) };
@@ -157,34 +287,93 @@ unordered_set<string> ExecutionGraph::order_one_dependencies( const string & inp
 {
   const string hash = gg::hash::base( input_hash );
 
-  if ( thunks_.count( hash ) == 0 ) {
+  if ( not has_thunk( hash ) ) {
     throw runtime_error( "thunk hash not found in the execution graph" );
   }
 
-  const Thunk & thunk = thunks_.at( hash );
+  /* the dependencies are shared between many thunks, so every thunk is
+     visited only once */
+  unordered_set<string> result;
+  vector<bool> visited( nodes_.size() );
+  vector<ID> to_visit { find( hash ) };
+
+  while ( not to_visit.empty() ) {
+    const ID id = to_visit.back();
+    to_visit.pop_back();
+
+    if ( visited[ id ] ) {
+      continue;
+    }
+
+    visited[ id ] = true;
+    const Thunk & thunk = thunk_at( id );
+
+    if ( thunk.can_be_executed() ) {
+      result.insert( ids_.hash( id ) );
+      continue;
+    }
+
+    for ( const Thunk::DataItem & item : thunk.thunks() ) {
+      const ID dependency = find( gg::hash::base( item.first ) );
+
+      if ( dependency == HashInterner::NONE ) {
+        throw runtime_error( "thunk hash not found in the execution graph" );
+      }
+
+      to_visit.push_back( dependency );
+    }
+  }
+
+  return result;
+}
+
+double ExecutionGraph::critical_path( const string & hash,
+                                      const function<double( const Thunk & )> & weight )
+{
+  return critical_path( find( hash ), weight );
+}
+
+double ExecutionGraph::critical_path( const ID id,
+                                      const function<double( const Thunk & )> & weight )
+{
+  if ( id < critical_paths_.size() and not isnan( critical_paths_[ id ] ) ) {
+    return critical_paths_[ id ];
+  }
+
+  double downstream = 0.0;
 
-  if ( thunk.can_be_executed() ) {
-    return { hash };
+  if ( id < nodes_.size() and ( nodes_[ id ].flags & TRACKED ) ) {
+    for ( const ID referencing_id : nodes_[ id ].referencing ) {
+      if ( nodes_[ referencing_id ].thunk ) {
+        downstream = max( downstream, critical_path( referencing_id, weight ) );
+      }
+    }
   }
 
-  unordered_set<string> result;
+  const double result = weight( thunk_at( id ) ) + downstream;
 
-  for ( const Thunk::DataItem & item : thunk.thunks() ) {
-    auto subresult = order_one_dependencies( item.first );
-    result.insert( subresult.begin(), subresult.end() );
+  if ( id >= critical_paths_.size() ) {
+    critical_paths_.resize( nodes_.size(), numeric_limits<double>::quiet_NaN() );
   }
 
+  critical_paths_[ id ] = result;
   return result;
 }
 
 string ExecutionGraph::updated_hash( const string & original_hash ) const
 {
-  return updated_hashes_.count( original_hash ) ? updated_hashes_.at( original_hash )
-                                                : original_hash;
+  const ID id = find( original_hash );
+
+  return ( id < nodes_.size() and nodes_[ id ].updated != HashInterner::NONE )
+         ? ids_.hash( nodes_[ id ].updated )
+         : original_hash;
 }
 
 string ExecutionGraph::original_hash( const string & updated_hash ) const
 {
-  return original_hashes_.count( updated_hash ) ? original_hashes_.at( updated_hash )
-                                                : updated_hash;
+  const ID id = find( updated_hash );
+
+  return ( id < nodes_.size() and nodes_[ id ].original != HashInterner::NONE )
+         ? ids_.hash( nodes_[ id ].original )
+         : updated_hash;
 }
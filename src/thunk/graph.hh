@@ -5,53 +5,124 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 #include <map>
 #include <set>
+#include <cstdint>
 #include <unordered_map>
 #include <unordered_set>
 #include <mutex>
+#include <functional>
 
 #include "thunk/thunk.hh"
+#include "thunk/hash_interner.hh"
 #include "util/optional.hh"
 
 class ExecutionGraph
 {
 private:
-  std::unordered_map<std::string, gg::thunk::Thunk> thunks_ {};
-
-  std::unordered_map<std::string, std::unordered_set<std::string>> referencing_thunks_ {};
-
-  std::unordered_set<std::string> value_dependencies_ {};
-  std::unordered_set<std::string> executable_dependencies_ {};
-
-  std::unordered_map<std::string, std::string> original_hashes_ {};
-  std::unordered_map<std::string, std::string> updated_hashes_ {};
-
-  void update_hash( const std::string & old_hash,
+  typedef HashInterner::ID ID;
+
+  enum NodeFlags : uint8_t
+  {
+    /* has a (possibly empty) list of referencing thunks */
+    TRACKED = 1 << 0,
+    VALUE_DEPENDENCY = 1 << 1,
+    EXECUTABLE_DEPENDENCY = 1 << 2,
+  };
+
+  /* everything the graph knows about an interned hash. the thunk is kept
+     behind a pointer, so that a node is small for the many hashes that
+     are only values, and so that references to a thunk stay valid while
+     nodes_ grows. */
+  struct Node
+  {
+    std::unique_ptr<gg::thunk::Thunk> thunk {};
+    std::vector<ID> referencing {};
+    ID original { HashInterner::NONE };
+    ID updated { HashInterner::NONE };
+    uint8_t flags { 0 };
+  };
+
+  HashInterner ids_ {};
+  std::vector<Node> nodes_ {};
+  size_t thunk_count_ { 0 };
+
+  std::vector<ID> value_dependencies_ {};
+  std::vector<ID> executable_dependencies_ {};
+
+  /* thunks that were read ahead of time, and are taken from here (instead
+     of being read again) once they are added to the graph */
+  std::unordered_map<ID, std::unique_ptr<gg::thunk::Thunk>> staged_ {};
+
+  /* the critical path lengths computed so far, by ID; NaN where there's
+     none. a thunk's length is dropped once the thunk is gone. */
+  std::vector<double> critical_paths_ {};
+
+  /* called with the old and the new hash whenever a hash is updated */
+  std::function<void( const std::string &, const std::string & )> update_callback_ {};
+
+  ID intern( const std::string & hash );
+  ID find( const std::string & hash ) const;
+
+  const gg::thunk::Thunk & thunk_at( const ID id ) const;
+  gg::thunk::Thunk & thunk_at( const ID id );
+  const std::vector<ID> & referencing_at( const ID id ) const;
+  void add_referencing( const ID id, const ID referencing_id );
+
+  std::vector<std::string> hashes( const std::vector<ID> & ids ) const;
+
+  void update_hash( const ID old_id,
                     const std::vector<gg::ThunkOutput> & outputs );
 
+  double critical_path( const ID id,
+                        const std::function<double( const gg::thunk::Thunk & )> & weight );
+
 public:
   std::string add_thunk( const std::string & hash );
 
+  /* hands over a thunk that add_thunk() would otherwise have to read */
+  void stage_thunk( const std::string & hash,
+                    std::unique_ptr<gg::thunk::Thunk> && thunk );
+  void clear_staged() { staged_.clear(); }
+
+  void set_update_callback( const std::function<void( const std::string &,
+                                                      const std::string & )> & callback )
+  { update_callback_ = callback; }
+
   Optional<std::unordered_set<std::string>>
   force_thunk( const std::string & old_hash,
                std::vector<gg::ThunkOutput> && outputs );
 
-  const std::unordered_set<std::string> &
-  value_dependencies() const { return value_dependencies_; }
+  std::vector<std::string>
+  value_dependencies() const { return hashes( value_dependencies_ ); }
 
-  const std::unordered_set<std::string> &
-  executable_dependencies() const { return executable_dependencies_; }
+  std::vector<std::string>
+  executable_dependencies() const { return hashes( executable_dependencies_ ); }
 
   std::unordered_set<std::string>
   order_one_dependencies( const std::string & hash ) const;
 
   const gg::thunk::Thunk &
-  get_thunk( const std::string & hash ) const { return thunks_.at( hash ); }
+  get_thunk( const std::string & hash ) const { return thunk_at( find( hash ) ); }
+
+  bool has_thunk( const std::string & hash ) const;
+
+  std::vector<std::string>
+  referencing_thunks( const std::string & hash ) const { return hashes( referencing_at( find( hash ) ) ); }
+
+  /* length of the longest path from this thunk to a target, where every thunk
+     on the path (including this one) contributes `weight( thunk )`. the
+     lengths are remembered, so clear_critical_paths() has to be called
+     whenever the weights change. */
+  double critical_path( const std::string & hash,
+                        const std::function<double( const gg::thunk::Thunk & )> & weight );
+
+  void clear_critical_paths() { critical_paths_.clear(); }
 
   std::string updated_hash( const std::string & original_hash ) const;
   std::string original_hash( const std::string & updated_hash ) const;
-  size_t size() const { return thunks_.size(); }
+  size_t size() const { return thunk_count_; }
 };
 
 #endif /* GRAPH_HH */
@@ -0,0 +1,144 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "graph_loader.hh"
+
+#include <algorithm>
+
+#include "blob_store.hh"
+#include "ggutils.hh"
+#include "thunk_reader.hh"
+
+using namespace std;
+using namespace gg::thunk;
+
+constexpr size_t GraphLoader::HANDOVER_BATCH_SIZE;
+
+GraphLoader::GraphLoader( const vector<string> & targets, const size_t thread_count )
+{
+  for ( const string & target : targets ) {
+    const string hash = gg::hash::base( target );
+
+    if ( seen_.insert( hash ).second ) {
+      to_load_.push_back( hash );
+    }
+  }
+
+  const size_t count = ( thread_count > 0 )
+                     ? thread_count
+                     : max( 1u, thread::hardware_concurrency() );
+
+  for ( size_t i = 0; i < count; i++ ) {
+    threads_.emplace_back( [this] () { work(); } );
+  }
+}
+
+GraphLoader::~GraphLoader()
+{
+  {
+    lock_guard<mutex> lock { mutex_ };
+    stopping_ = true;
+  }
+
+  work_available_.notify_all();
+
+  for ( thread & t : threads_ ) {
+    t.join();
+  }
+}
+
+void GraphLoader::work()
+{
+  unique_lock<mutex> lock { mutex_ };
+
+  while ( true ) {
+    work_available_.wait( lock,
+      [this] () { return stopping_ or not to_load_.empty() or reading_ == 0; } );
+
+    /* there's nothing left to read, and no thread that's reading could add
+       anything to read */
+    if ( stopping_ or to_load_.empty() ) {
+      break;
+    }
+
+    const string hash = move( to_load_.front() );
+    to_load_.pop_front();
+    reading_++;
+    lock.unlock();
+
+    unique_ptr<Thunk> thunk;
+    vector<string> dependencies;
+
+    try {
+      thunk = make_unique<Thunk>( ThunkReader::read( gg::blobs::map( hash ), hash ) );
+
+      for ( const Thunk::DataItem & item : thunk->thunks() ) {
+        dependencies.push_back( gg::hash::base( item.first ) );
+      }
+    }
+    catch ( ... ) {
+      lock.lock();
+      reading_--;
+
+      if ( not error_ ) {
+        error_ = current_exception();
+      }
+
+      stopping_ = true;
+      work_available_.notify_all();
+      thunks_available_.notify_all();
+      break;
+    }
+
+    const bool leaf = dependencies.empty();
+    lock.lock();
+
+    for ( string & dependency : dependencies ) {
+      if ( seen_.insert( dependency ).second ) {
+        to_load_.push_back( move( dependency ) );
+        work_available_.notify_one();
+      }
+    }
+
+    loaded_.push_back( { hash, move( thunk ) } );
+    reading_--;
+
+    if ( finished_reading() ) {
+      work_available_.notify_all();
+      thunks_available_.notify_all();
+    }
+    else if ( leaf or loaded_.size() >= HANDOVER_BATCH_SIZE ) {
+      /* a leaf can start running right away; the rest are handed over in
+         batches, so the caller isn't woken up for every one of them */
+      thunks_available_.notify_one();
+    }
+  }
+}
+
+vector<GraphLoader::LoadedThunk> GraphLoader::take( const bool wait )
+{
+  unique_lock<mutex> lock { mutex_ };
+
+  if ( wait ) {
+    thunks_available_.wait( lock,
+      [this] () { return not loaded_.empty() or error_ or finished_reading(); } );
+  }
+
+  if ( error_ ) {
+    rethrow_exception( error_ );
+  }
+
+  vector<LoadedThunk> result;
+  result.swap( loaded_ );
+  return result;
+}
+
+bool GraphLoader::done()
+{
+  lock_guard<mutex> lock { mutex_ };
+
+  if ( error_ ) {
+    rethrow_exception( error_ );
+  }
+
+  return finished_reading() and loaded_.empty();
+}
@@ -0,0 +1,70 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef GRAPH_LOADER_HH
+#define GRAPH_LOADER_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <unordered_set>
+
+#include "thunk/thunk.hh"
+
+/* reads the target thunks and all the thunks they depend on, with a pool of
+   threads. a thunk is read once, however many thunks depend on it. the
+   thunks that have been read are handed over in batches, on the caller's
+   thread, in no particular order. */
+class GraphLoader
+{
+public:
+  struct LoadedThunk
+  {
+    std::string hash;
+    std::unique_ptr<gg::thunk::Thunk> thunk;
+  };
+
+private:
+  static constexpr size_t HANDOVER_BATCH_SIZE = 256;
+
+  std::mutex mutex_ {};
+  std::condition_variable work_available_ {};
+  std::condition_variable thunks_available_ {};
+
+  std::deque<std::string> to_load_ {};
+  std::unordered_set<std::string> seen_ {};
+  std::vector<LoadedThunk> loaded_ {};
+
+  /* the number of thunks that are being read right now */
+  size_t reading_ { 0 };
+  bool stopping_ { false };
+  std::exception_ptr error_ {};
+
+  std::vector<std::thread> threads_ {};
+
+  bool finished_reading() const { return to_load_.empty() and reading_ == 0; }
+  void work();
+
+public:
+  /* `thread_count` 0 means one thread per core */
+  GraphLoader( const std::vector<std::string> & targets,
+               const size_t thread_count = 0 );
+
+  ~GraphLoader();
+
+  GraphLoader( const GraphLoader & ) = delete;
+  GraphLoader & operator=( const GraphLoader & ) = delete;
+
+  /* returns the thunks that were read since the last call. if `wait` is set,
+     waits until there's at least one, unless everything has been read. */
+  std::vector<LoadedThunk> take( const bool wait );
+
+  /* everything has been read and taken */
+  bool done();
+};
+
+#endif /* GRAPH_LOADER_HH */
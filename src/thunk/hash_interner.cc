@@ -0,0 +1,62 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "hash_interner.hh"
+
+#include <stdexcept>
+
+using namespace std;
+
+constexpr HashInterner::ID HashInterner::NONE;
+constexpr HashInterner::ID HashInterner::PROBE;
+
+size_t HashInterner::IDHash::operator()( const ID id ) const
+{
+  return std::hash<string>()( interner->resolve( id ) );
+}
+
+bool HashInterner::IDEqual::operator()( const ID a, const ID b ) const
+{
+  return interner->resolve( a ) == interner->resolve( b );
+}
+
+HashInterner::HashInterner()
+  : index_( 0, IDHash { this }, IDEqual { this } )
+{}
+
+const string & HashInterner::resolve( const ID id ) const
+{
+  return ( id == PROBE ) ? *probe_ : hashes_[ id ];
+}
+
+HashInterner::ID HashInterner::find( const string & hash ) const
+{
+  probe_ = &hash;
+  auto it = index_.find( PROBE );
+  probe_ = nullptr;
+
+  return ( it == index_.end() ) ? NONE : *it;
+}
+
+HashInterner::ID HashInterner::intern( const string & hash )
+{
+  const ID existing = find( hash );
+
+  if ( existing != NONE ) {
+    return existing;
+  }
+
+  if ( hashes_.size() >= PROBE ) {
+    throw runtime_error( "too many hashes to intern" );
+  }
+
+  const ID id = hashes_.size();
+  hashes_.push_back( hash );
+  index_.insert( id );
+  return id;
+}
+
+void HashInterner::reserve( const size_t count )
+{
+  hashes_.reserve( count );
+  index_.reserve( count );
+}
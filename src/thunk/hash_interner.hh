@@ -0,0 +1,62 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef HASH_INTERNER_HH
+#define HASH_INTERNER_HH
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <unordered_set>
+
+/* maps every hash it sees to a dense 32-bit ID, starting from zero, so that
+   the per-object state can live in flat arrays indexed by ID. each hash is
+   stored once: the index only holds IDs, and looks the strings up in
+   hashes_ (a lookup by string goes through the `probe_` ID). */
+class HashInterner
+{
+public:
+  typedef uint32_t ID;
+  static constexpr ID NONE = std::numeric_limits<ID>::max();
+
+private:
+  static constexpr ID PROBE = NONE - 1;
+
+  struct IDHash
+  {
+    const HashInterner * interner;
+    size_t operator()( const ID id ) const;
+  };
+
+  struct IDEqual
+  {
+    const HashInterner * interner;
+    bool operator()( const ID a, const ID b ) const;
+  };
+
+  std::vector<std::string> hashes_ {};
+  std::unordered_set<ID, IDHash, IDEqual> index_;
+
+  mutable const std::string * probe_ { nullptr };
+
+  const std::string & resolve( const ID id ) const;
+
+public:
+  HashInterner();
+
+  HashInterner( const HashInterner & ) = delete;
+  HashInterner & operator=( const HashInterner & ) = delete;
+
+  /* returns the hash's ID, assigning the next one if it's new */
+  ID intern( const std::string & hash );
+
+  /* returns the hash's ID, or NONE if it has never been interned */
+  ID find( const std::string & hash ) const;
+
+  const std::string & hash( const ID id ) const { return hashes_.at( id ); }
+  size_t size() const { return hashes_.size(); }
+
+  void reserve( const size_t count );
+};
+
+#endif /* HASH_INTERNER_HH */
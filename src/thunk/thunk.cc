@@ -11,6 +11,7 @@
 #include <regex>
 
 #include "protobufs/util.hh"
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "thunk/factory.hh"
 #include "thunk/placeholder.hh"
@@ -181,9 +182,24 @@ int Thunk::execute() const
   auto replace_data_placeholder =
     []( string & str ) -> void
     {
-      if ( regex_search( str, DATA_PLACEHOLDER_REGEX ) ) {
-        string new_path = regex_replace( str, DATA_PLACEHOLDER_REGEX, gg::paths::blob( "$1" ).string() );
-        swap( str, new_path );
+      /* the path to an object depends on its hash, and a packed object has
+         to be extracted first (see BlobStore), so the placeholders can't be
+         replaced by a format string */
+      string new_str;
+      auto last = str.cbegin();
+      bool replaced = false;
+
+      for ( sregex_iterator it { str.cbegin(), str.cend(), DATA_PLACEHOLDER_REGEX };
+            it != sregex_iterator {}; it++ ) {
+        new_str.append( last, ( *it )[ 0 ].first );
+        new_str.append( gg::blobs::path( ( *it )[ 1 ].str() ).string() );
+        last = ( *it )[ 0 ].second;
+        replaced = true;
+      }
+
+      if ( replaced ) {
+        new_str.append( last, str.cend() );
+        swap( str, new_str );
       }
     };
 
@@ -196,7 +212,7 @@ int Thunk::execute() const
     replace_data_placeholder( envar );
   }
 
-  const roost::path thunk_path = gg::paths::blob( hash() );
+  const roost::path thunk_path = gg::blobs::path( hash() );
 
   // preparing envp
   envars.insert( envars.end(), {
@@ -219,7 +235,7 @@ int Thunk::execute() const
     cerr << exec_string;
   }
 
-  if ( ( retval = ezexec( gg::paths::blob( function_.hash() ).string(),
+  if ( ( retval = ezexec( gg::blobs::path( function_.hash() ).string(),
                           args, envars ) ) < 0 ) {
     throw runtime_error( "execvpe failed" );
   }
@@ -405,15 +421,15 @@ Thunk::get_allowed_files() const
   unordered_map<string, Permissions> allowed_files;
 
   for ( const DataItem & item : values_ ) {
-    allowed_files[ gg::paths::blob( item.first ).string() ] = { true, false, false };
+    allowed_files[ gg::blobs::path( item.first ).string() ] = { true, false, false };
   }
 
   for ( const DataItem & item : executables_ ) {
-    allowed_files[ gg::paths::blob( item.first ).string() ] = { true, false, true };
+    allowed_files[ gg::blobs::path( item.first ).string() ] = { true, false, true };
   }
 
   allowed_files[ gg::paths::blobs().string() ] = { true, false, false };
-  allowed_files[ gg::paths::blob( hash() ).string() ] = { true, false, false };
+  allowed_files[ gg::blobs::path( hash() ).string() ] = { true, false, false };
 
   for ( const string & output : outputs_ ) {
     allowed_files[ output ] = { true, true, false };
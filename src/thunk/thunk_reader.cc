@@ -24,7 +24,10 @@ Thunk ThunkReader::read( const roost::path & path, const std::string & hash )
   ProtobufDeserializer deserializer { path.string() };
   protobuf::Thunk thunk_proto;
 
-  deserializer.read_string( MAGIC_NUMBER.length() ); /* skipping the magic number */
+  if ( deserializer.read_string( MAGIC_NUMBER.length() ) != MAGIC_NUMBER ) {
+    throw runtime_error( "not a thunk: " + path.string() );
+  }
+
   deserializer.read_protobuf( thunk_proto );
 
   Thunk thunk { thunk_proto };
@@ -35,3 +38,26 @@ Thunk ThunkReader::read( const roost::path & path, const std::string & hash )
 
   return thunk;
 }
+
+Thunk ThunkReader::read( const BlobView & data, const std::string & hash )
+{
+  protobuf::Thunk thunk_proto;
+
+  if ( data.size() < MAGIC_NUMBER.length()
+       or MAGIC_NUMBER.compare( 0, string::npos, data.data(), MAGIC_NUMBER.length() ) != 0 ) {
+    throw runtime_error( "not a thunk" );
+  }
+
+  if ( not thunk_proto.ParseFromArray( data.data() + MAGIC_NUMBER.length(),
+                                       data.size() - MAGIC_NUMBER.length() ) ) {
+    throw runtime_error( "could not parse thunk" );
+  }
+
+  Thunk thunk { thunk_proto };
+
+  if ( hash.length() > 0 ) {
+    thunk.set_hash( hash );
+  }
+
+  return thunk;
+}
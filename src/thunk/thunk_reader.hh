@@ -7,6 +7,7 @@
 
 #include "protobufs/gg.pb.h"
 #include "thunk/thunk.hh"
+#include "thunk/blob_store.hh"
 #include "util/serialization.hh"
 #include "util/path.hh"
 
@@ -18,4 +19,5 @@ private:
 public:
   static bool is_thunk( const roost::path & path );
   static gg::thunk::Thunk read( const roost::path & path, const std::string & hash = {} );
+  static gg::thunk::Thunk read( const BlobView & data, const std::string & hash = {} );
 };
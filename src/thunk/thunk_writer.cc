@@ -5,6 +5,7 @@
 #include <iostream>
 #include <fstream>
 
+#include "thunk/blob_store.hh"
 #include "thunk/ggutils.hh"
 #include "util/digest.hh"
 #include "util/path.hh"
@@ -21,11 +22,11 @@ string ThunkWriter::write( const Thunk & thunk, const roost::path & path )
                                                ObjectType::Thunk );
   thunk.set_hash( thunk_hash );
 
-  roost::path target_path { ( not path.empty() ) ? path
-                                                 : paths::blob( thunk_hash ) };
-
-  if ( not roost::exists( target_path ) ) {
-    roost::atomic_create( serialized_thunk, target_path, true, 0400 );
+  if ( path.empty() ) {
+    blobs::insert( thunk_hash, serialized_thunk );
+  }
+  else if ( not roost::exists( path ) ) {
+    roost::atomic_create( serialized_thunk, path, true, 0400 );
   }
 
   return thunk_hash;
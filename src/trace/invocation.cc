@@ -151,6 +151,16 @@ void SystemCallInvocation::fetch_arguments()
   }
 }
 
+long SystemCallInvocation::raw_argument( const uint8_t argnum ) const
+{
+  return get_syscall_arg<long>( argnum );
+}
+
+string SystemCallInvocation::string_argument( const uint8_t argnum ) const
+{
+  return get_syscall_arg<string>( argnum );
+}
+
 std::string SystemCallInvocation::name()
 {
   if ( signature_.initialized() ) {
@@ -74,6 +74,10 @@ public:
 
   void fetch_arguments();
 
+  /* read an argument, whether the signature describes it or not */
+  long raw_argument( const uint8_t argnum ) const;
+  std::string string_argument( const uint8_t argnum ) const;
+
   void set_retval( const long return_value ) { return_value_.reset( return_value ); }
 
   template<typename T>
@@ -64,10 +64,22 @@ const SystemCallSignature & syscall_signature( const size_t syscall_no )
   {{
 '''
 out_end = '''\
-  };
+  }};
+
+  /* system calls newer than the table have no signature */
+  static const SystemCallSignature unknown_syscall {{ -1, "unknown", {{}} }};
+
+  if ( syscall_no >= syscall_count() ) {{
+    return unknown_syscall;
+  }}
 
   return syscall_signatures[ syscall_no ];
-}
+}}
+
+size_t syscall_count()
+{{
+  return {count};
+}}
 '''
 
 strace_flags = {
@@ -187,7 +199,7 @@ def generate(sysent_path, ctags_path, output_path):
             fout.write(item_template.format(**syscall))
             i += 1
 
-        fout.write(out_end)
+        fout.write(out_end.format(count=i))
 
 if __name__ == '__main__':
     if len(sys.argv) < 3:
@@ -3583,5 +3583,17 @@ const SystemCallSignature & syscall_signature( const size_t syscall_no )
 
   };
 
+  /* system calls newer than the table have no signature */
+  static const SystemCallSignature unknown_syscall { -1, "unknown", {} };
+
+  if ( syscall_no >= syscall_count() ) {
+    return unknown_syscall;
+  }
+
   return syscall_signatures[ syscall_no ];
 }
+
+size_t syscall_count()
+{
+  return 333;
+}
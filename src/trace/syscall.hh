@@ -79,6 +79,8 @@ public:
   bool complete() const { return complete_; }
 };
 
+/* the system calls past the end of the table have an incomplete signature */
 extern const SystemCallSignature & syscall_signature( const size_t syscall_no );
+extern size_t syscall_count();
 
 #endif /* SYSCALL_HH */
@@ -7,7 +7,12 @@
 #include <sys/wait.h>
 #include <sys/user.h>
 #include <sys/stat.h>
+#include <sys/prctl.h>
 #include <linux/limits.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <stddef.h>
 #include <signal.h>
 #include <errno.h>
 #include <cstring>
@@ -20,10 +25,63 @@ using namespace std;
 
 template <typename T> void zero( T & x ) { memset( &x, 0, sizeof( x ) ); }
 
+SystemCallFilter::SystemCallFilter( const vector<long> & syscalls, const bool traced )
+{
+  const uint32_t listed = traced ? SECCOMP_RET_TRACE : SECCOMP_RET_ALLOW;
+  const uint32_t others = traced ? SECCOMP_RET_ALLOW : SECCOMP_RET_TRACE;
+
+  /* the system calls of other ABIs always go to the tracer */
+  program_ = {
+    BPF_STMT( BPF_LD | BPF_W | BPF_ABS, offsetof( seccomp_data, arch ) ),
+    BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>( AUDIT_ARCH_X86_64 ), 1, 0 ),
+    BPF_STMT( BPF_RET | BPF_K, SECCOMP_RET_TRACE ),
+    BPF_STMT( BPF_LD | BPF_W | BPF_ABS, offsetof( seccomp_data, nr ) ),
+  };
+
+  for ( const long syscall_no : syscalls ) {
+    program_.push_back( BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>( syscall_no ), 0, 1 ) );
+    program_.push_back( BPF_STMT( BPF_RET | BPF_K, listed ) );
+  }
+
+  program_.push_back( BPF_STMT( BPF_RET | BPF_K, others ) );
+}
+
+SystemCallFilter SystemCallFilter::only( const vector<long> & traced_syscalls )
+{
+  return { traced_syscalls, true };
+}
+
+SystemCallFilter SystemCallFilter::all_except( const vector<long> & untraced_syscalls )
+{
+  return { untraced_syscalls, false };
+}
+
+void SystemCallFilter::install() const
+{
+  if ( not active() ) {
+    return;
+  }
+
+  sock_fprog program;
+  program.len = program_.size();
+  program.filter = const_cast<sock_filter *>( program_.data() );
+
+  CheckSystemCall( "prctl(PR_SET_NO_NEW_PRIVS)", prctl( PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0 ) );
+  CheckSystemCall( "prctl(PR_SET_SECCOMP)", prctl( PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program ) );
+}
+
+bool SystemCallFilter::available()
+{
+  /* EINVAL means the kernel was built without seccomp */
+  return prctl( PR_GET_SECCOMP, 0, 0, 0, 0 ) >= 0;
+}
+
 TracerFlock::TracerFlock( const ProcessTracer::entry_type & before_entry_function,
-                          const ProcessTracer::exit_type & after_exit_function )
+                          const ProcessTracer::exit_type & after_exit_function,
+                          const SystemCallFilter & filter )
   : before_entry_function_( before_entry_function ),
-    after_exit_function_( after_exit_function )
+    after_exit_function_( after_exit_function ),
+    filter_( filter )
 {}
 
 void TracerFlock::insert( const pid_t tracee_pid )
@@ -32,7 +90,33 @@ void TracerFlock::insert( const pid_t tracee_pid )
     throw runtime_error( "bad attempt to insert pid " + to_string( tracee_pid ) );
   }
 
-  tracers_.emplace( make_pair( tracee_pid, tracee_pid ) );
+  tracers_.emplace( piecewise_construct, forward_as_tuple( tracee_pid ),
+                    forward_as_tuple( tracee_pid, filter_.active() ) );
+}
+
+void TracerFlock::announce( const pid_t tracee_pid, const bool released )
+{
+  auto tracer = tracers_.find( tracee_pid );
+
+  if ( tracer != tracers_.end() and tracer->second.waiting_for_parent() ) {
+    tracer->second.start( released );
+  }
+  else {
+    newborns_[ tracee_pid ] = released;
+  }
+}
+
+Optional<bool> TracerFlock::take_announcement( const pid_t tracee_pid )
+{
+  auto newborn = newborns_.find( tracee_pid );
+
+  if ( newborn == newborns_.end() ) {
+    return {};
+  }
+
+  const bool released = newborn->second;
+  newborns_.erase( newborn );
+  return { true, released };
 }
 
 void TracerFlock::remove( const pid_t tracee_pid )
@@ -120,8 +204,8 @@ void TracerFlock::add_child_process( ChildProcess && child_process )
   children_.insert( make_pair( child_process.pid(), move( child_process ) ) );
 }
 
-ProcessTracer::ProcessTracer( const pid_t tracee_pid )
-  : tracee_pid_( tracee_pid )
+ProcessTracer::ProcessTracer( const pid_t tracee_pid, const bool seccomp )
+  : tracee_pid_( tracee_pid ), seccomp_( seccomp )
 {}
 
 void ProcessTracer::set_ptrace_options() const
@@ -134,7 +218,32 @@ void ProcessTracer::set_ptrace_options() const
                                                  PTRACE_O_TRACEFORK |
                                                  PTRACE_O_TRACEVFORK |
                                                  PTRACE_O_TRACECLONE |
-                                                 PTRACE_O_EXITKILL ) );
+                                                 PTRACE_O_EXITKILL |
+                                                 ( seccomp_ ? PTRACE_O_TRACESECCOMP : 0 ) ) );
+}
+
+void ProcessTracer::syscall_entry( TracerFlock & flock,
+                                   const entry_type & before_entry_function )
+{
+  errno = 0;
+  const long syscall_no = ptrace( PTRACE_PEEKUSER, tracee_pid_, sizeof( long ) * ORIG_RAX );
+  if ( errno ) { throw unix_error( "ptrace" ); }
+
+  info_.syscall_invocation.initialize( tracee_pid_, syscall_no );
+  before_entry_function( info_, flock );
+
+  if ( seccomp_ and info_.detach ) {
+    info_.detach = false;
+    info_.syscall_invocation.clear();
+    released_ = true;
+  }
+}
+
+void ProcessTracer::start( const bool released )
+{
+  waiting_for_parent_ = false;
+  released_ = released;
+  resume( 0 );
 }
 
 /* blocking wait on one process */
@@ -171,6 +280,19 @@ bool ProcessTracer::handle_one_event( TracerFlock & flock,
 
     set_ptrace_options();
     options_set_ = true;
+
+    if ( seccomp_ ) {
+      const Optional<bool> released = flock.take_announcement( tracee_pid_ );
+
+      if ( not released.initialized() ) {
+        /* we got here before the parent's fork event */
+        waiting_for_parent_ = true;
+        return false;
+      }
+
+      start( *released );
+      return false;
+    }
   } else if ( (infop.si_status & 0xff) == SIGTRAP ) {
     const unsigned int ptrace_event = (infop.si_status & 0xff00) >> 8;
 
@@ -178,13 +300,35 @@ bool ProcessTracer::handle_one_event( TracerFlock & flock,
     case PTRACE_EVENT_FORK:
     case PTRACE_EVENT_VFORK:
     case PTRACE_EVENT_CLONE:
-      /* ignore these events; we will trace the process when it shows up with a SIGSTOP */
+      /* we will trace the process when it shows up with a SIGSTOP */
+      if ( seccomp_ ) {
+        long child_pid;
+        CheckSystemCall( "ptrace(PTRACE_GETEVENTMSG)",
+                         ptrace( PTRACE_GETEVENTMSG, tracee_pid_, nullptr, &child_pid ) );
+        flock.announce( child_pid, released_ );
+      }
+
       break;
 
     case PTRACE_EVENT_EXIT:
       return true;
       break;
 
+    case PTRACE_EVENT_SECCOMP:
+      /* the filter sent us a system call; this is its entry, and resume()
+         will make sure that we see its exit too */
+      if ( released_ ) {
+        break;
+      }
+
+      syscall_entry( flock, before_entry_function );
+
+      if ( info_.pause ) {
+        return false;
+      }
+
+      break;
+
     case PTRACE_EVENT_EXEC:
       {
         /* get former thread ID */
@@ -206,12 +350,7 @@ bool ProcessTracer::handle_one_event( TracerFlock & flock,
   } else if ( infop.si_status == (SIGTRAP | 0x80) ) {
     if ( not info_.syscall_invocation.initialized() ) {
       /* syscall entry */
-      errno = 0;
-      const long syscall_no = ptrace( PTRACE_PEEKUSER, tracee_pid_, sizeof( long ) * ORIG_RAX );
-      if ( errno ) { throw unix_error( "ptrace" ); }
-
-      info_.syscall_invocation.initialize( tracee_pid_, syscall_no );
-      before_entry_function( info_, flock );
+      syscall_entry( flock, before_entry_function );
 
       if ( info_.detach ) {
         /* set the process free */
@@ -251,7 +390,10 @@ bool ProcessTracer::handle_one_event( TracerFlock & flock,
 
 ProcessTracer::ProcessTracer( ProcessTracer && pt )
   : tracee_pid_( pt.tracee_pid_ ),
+    seccomp_( pt.seccomp_ ),
     options_set_( pt.options_set_ ),
+    released_( pt.released_ ),
+    waiting_for_parent_( pt.waiting_for_parent_ ),
     info_( pt.info_ )
 {
   pt.tracee_pid_ = -1;
@@ -268,18 +410,27 @@ Tracer::Tracer( const std::string & name,
                 function<int()> && child_procedure,
                 const ProcessTracer::entry_type & before_entry_function,
                 const ProcessTracer::exit_type & after_exit_function,
-                function<void()> && preparation_procedure )
-  : flock_( before_entry_function, after_exit_function )
+                function<void()> && preparation_procedure,
+                const SystemCallFilter & filter )
+  : flock_( before_entry_function, after_exit_function, filter )
 {
   /* create a ChildProcess that will be traced */
   ChildProcess tp { name,
-      [preparation_procedure, child_procedure]() {
+      [this, preparation_procedure, child_procedure]() {
       preparation_procedure();
       CheckSystemCall( "ptrace(TRACEME)", ptrace( PTRACE_TRACEME ) );
       raise( SIGSTOP );
+
+      /* the tracer has set PTRACE_O_TRACESECCOMP by now */
+      flock_.filter().install();
       return child_procedure(); } };
 
   flock_.insert( tp.pid() );
+
+  if ( filter.active() ) {
+    flock_.announce( tp.pid(), false );
+  }
+
   flock_.add_child_process( move( tp ) );
 }
 
@@ -305,5 +456,12 @@ void ProcessTracer::resume( const int signal )
 {
   info_.pause = false;
 
-  CheckSystemCall( "ptrace(SYSCALL)", ptrace( PTRACE_SYSCALL, tracee_pid_, nullptr, signal ) );
+  /* under the filter, the tracee runs freely until the filter stops it,
+     unless we're waiting for the exit of a system call it sent us */
+  if ( seccomp_ and not info_.syscall_invocation.initialized() ) {
+    CheckSystemCall( "ptrace(CONT)", ptrace( PTRACE_CONT, tracee_pid_, nullptr, signal ) );
+  }
+  else {
+    CheckSystemCall( "ptrace(SYSCALL)", ptrace( PTRACE_SYSCALL, tracee_pid_, nullptr, signal ) );
+  }
 }
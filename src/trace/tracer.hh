@@ -4,7 +4,9 @@
 #define TRACER_HH
 
 #include <map>
+#include <vector>
 #include <functional>
+#include <linux/filter.h>
 
 #include "syscall.hh"
 #include "invocation.hh"
@@ -20,6 +22,31 @@ struct TracedThreadInfo
   bool pause = false;
 };
 
+/* which system calls stop a tracee. under a seccomp-BPF filter, the others
+   run without the tracer ever hearing about them. */
+class SystemCallFilter
+{
+private:
+  std::vector<sock_filter> program_ {};
+
+  SystemCallFilter( const std::vector<long> & syscalls, const bool traced );
+
+public:
+  /* no filter: the tracee stops for every system call */
+  SystemCallFilter() {}
+
+  static SystemCallFilter only( const std::vector<long> & traced_syscalls );
+  static SystemCallFilter all_except( const std::vector<long> & untraced_syscalls );
+
+  bool active() const { return not program_.empty(); }
+
+  /* called by the tracee, once the tracer has set its options */
+  void install() const;
+
+  /* can this kernel filter system calls with seccomp? */
+  static bool available();
+};
+
 class TracerFlock;
 
 class ProcessTracer
@@ -31,13 +58,28 @@ public:
 private:
   pid_t tracee_pid_;
 
+  /* the tracee runs under a seccomp filter, and only stops for the system
+     calls it sends us */
+  bool seccomp_;
+
   bool options_set_ = false;
   void set_ptrace_options() const;
 
+  /* a tracee under a filter can't be detached, as the system calls that
+     the filter sends to the tracer would fail. when it asks to be, the
+     tracer stops listening to it and to its children instead. */
+  bool released_ = false;
+
+  /* a new tracee under a filter waits for its parent to say whether it's
+     released before it runs */
+  bool waiting_for_parent_ = false;
+
   TracedThreadInfo info_ { tracee_pid_ };
 
+  void syscall_entry( TracerFlock & flock, const entry_type & before_entry_function );
+
 public:
-  ProcessTracer( const pid_t tracee_pid );
+  ProcessTracer( const pid_t tracee_pid, const bool seccomp = false );
   ~ProcessTracer();
 
   /* handle one event from the tracee.
@@ -51,6 +93,9 @@ public:
   bool is_paused() const { return info_.pause; }
   void resume( const int signal );
 
+  bool waiting_for_parent() const { return waiting_for_parent_; }
+  void start( const bool released );
+
   ProcessTracer( const ProcessTracer & ) = delete;
   ProcessTracer & operator=( const ProcessTracer & ) = delete;
 
@@ -62,18 +107,30 @@ class TracerFlock
 private:
   ProcessTracer::entry_type before_entry_function_;
   ProcessTracer::exit_type after_exit_function_;
+  SystemCallFilter filter_;
 
   std::map<pid_t, ChildProcess> children_ {};
   std::map<pid_t, ProcessTracer> tracers_ {};
   std::map<pid_t, pid_t> tracers_waiting_for_children_ {};
 
+  /* new tracees that their parents have told us about, but that haven't
+     shown up yet, and whether they're released */
+  std::map<pid_t, bool> newborns_ {};
+
 public:
   TracerFlock( const ProcessTracer::entry_type & before_entry_function,
-               const ProcessTracer::exit_type & after_exit_function );
+               const ProcessTracer::exit_type & after_exit_function,
+               const SystemCallFilter & filter = {} );
+
+  const SystemCallFilter & filter() const { return filter_; }
 
   void insert( const pid_t tracee_pid );
   void remove( const pid_t tracee_pid );
 
+  /* under a filter: a tracee was born, to a parent that was released or not */
+  void announce( const pid_t tracee_pid, const bool released );
+  Optional<bool> take_announcement( const pid_t tracee_pid );
+
   void add_child_process( ChildProcess && child_process );
   void resume_after_termination( const pid_t child_to_wait_for,
                                  const pid_t tracee_to_resume );
@@ -91,7 +148,8 @@ public:
           std::function<int()> && child_procedure,
           const ProcessTracer::entry_type & before_entry_function,
           const ProcessTracer::exit_type & after_exit_function,
-          std::function<void()> && preparation_procedure = [](){} );
+          std::function<void()> && preparation_procedure = [](){},
+          const SystemCallFilter & filter = {} );
 
   void loop_until_done() { flock_.loop_until_all_done(); }
 };
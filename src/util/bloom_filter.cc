@@ -0,0 +1,149 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "bloom_filter.hh"
+
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "exception.hh"
+#include "mapped_hash_table.hh"
+
+using namespace std;
+
+constexpr uint64_t BloomFilter::DEFAULT_BIT_COUNT;
+constexpr uint32_t BloomFilter::DEFAULT_HASH_COUNT;
+constexpr uint32_t BloomFilter::VERSION;
+constexpr uint64_t BloomFilter::HEADER_SIZE;
+
+static const char FILTER_MAGIC[ 8 ] = { 'G', 'G', 'B', 'L', 'O', 'O', 'M', '1' };
+
+/* the finalizer of splitmix64, to get a second, independent-looking hash */
+static uint64_t mix( uint64_t x )
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  x ^= x >> 31;
+  return x;
+}
+
+static FileDescriptor open_filter( const roost::path & path )
+{
+  return { CheckSystemCall( "open (" + path.string() + ")",
+                            open( path.string().c_str(),
+                                  O_RDWR | O_CREAT | O_CLOEXEC, 0644 ) ) };
+}
+
+/* creates a new, empty filter (or checks the header of an existing one)
+   and maps the file into memory */
+MMapRegion BloomFilter::map_filter( const roost::path & path,
+                                    const FileDescriptor & fd,
+                                    const uint64_t bit_count,
+                                    const uint32_t hash_count )
+{
+  Header header;
+
+  CheckSystemCall( "flock", flock( fd.fd_num(), LOCK_EX ) );
+
+  struct stat file_info;
+  CheckSystemCall( "fstat", fstat( fd.fd_num(), &file_info ) );
+  uint64_t size = file_info.st_size;
+
+  if ( size == 0 ) {
+    if ( bit_count == 0 or bit_count % 64 != 0 or hash_count == 0 ) {
+      flock( fd.fd_num(), LOCK_UN );
+      throw runtime_error( "bloom filter needs a multiple of 64 bits, and a hash" );
+    }
+
+    memcpy( header.magic, FILTER_MAGIC, sizeof( header.magic ) );
+    header.version = VERSION;
+    header.hash_count = hash_count;
+    header.bit_count = bit_count;
+
+    size = HEADER_SIZE + bit_count / 8;
+    CheckSystemCall( "ftruncate", ftruncate( fd.fd_num(), size ) );
+    CheckSystemCall( "pwrite", pwrite( fd.fd_num(), &header, sizeof( header ), 0 ) );
+  }
+  else if ( size < HEADER_SIZE
+            or pread( fd.fd_num(), &header, sizeof( header ), 0 ) != sizeof( header )
+            or memcmp( header.magic, FILTER_MAGIC, sizeof( header.magic ) ) != 0
+            or header.version != VERSION
+            or header.hash_count == 0 or header.bit_count == 0
+            or header.bit_count % 64 != 0
+            or HEADER_SIZE + header.bit_count / 8 != size ) {
+    flock( fd.fd_num(), LOCK_UN );
+    throw runtime_error( "not a bloom filter: " + path.string() );
+  }
+
+  flock( fd.fd_num(), LOCK_UN );
+  return { size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.fd_num() };
+}
+
+BloomFilter::BloomFilter( const roost::path & path,
+                          const uint64_t bit_count,
+                          const uint32_t hash_count )
+  : path_( path ), fd_( open_filter( path ) ),
+    region_( map_filter( path_, fd_, bit_count, hash_count ) )
+{
+  static_assert( sizeof( Header ) == 24, "unexpected filter header size" );
+}
+
+const BloomFilter::Header & BloomFilter::header() const
+{
+  return *reinterpret_cast<const Header *>( region_.addr() );
+}
+
+uint64_t * BloomFilter::words() const
+{
+  return reinterpret_cast<uint64_t *>( region_.addr() + HEADER_SIZE );
+}
+
+template<class Function>
+void BloomFilter::for_each_bit( const string & key, Function && function ) const
+{
+  /* double hashing: the i-th bit is h1 + i * h2 */
+  const uint64_t h1 = mix( MappedHashTable::hash( key ) );
+  const uint64_t h2 = mix( h1 ) | 1;
+  const uint64_t bit_count = header().bit_count;
+
+  for ( uint32_t i = 0; i < header().hash_count; i++ ) {
+    const uint64_t bit = ( h1 + i * h2 ) % bit_count;
+
+    if ( not function( words()[ bit / 64 ], uint64_t( 1 ) << ( bit % 64 ) ) ) {
+      break;
+    }
+  }
+}
+
+void BloomFilter::add( const string & key )
+{
+  for_each_bit( key,
+    [] ( uint64_t & word, const uint64_t mask )
+    {
+      if ( ( __atomic_load_n( &word, __ATOMIC_RELAXED ) & mask ) == 0 ) {
+        __atomic_fetch_or( &word, mask, __ATOMIC_RELEASE );
+      }
+
+      return true;
+    } );
+}
+
+bool BloomFilter::may_contain( const string & key ) const
+{
+  bool found = true;
+
+  for_each_bit( key,
+    [&found] ( uint64_t & word, const uint64_t mask )
+    {
+      found = ( __atomic_load_n( &word, __ATOMIC_ACQUIRE ) & mask ) != 0;
+      return found;
+    } );
+
+  return found;
+}
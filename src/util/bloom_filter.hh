@@ -0,0 +1,62 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef BLOOM_FILTER_HH
+#define BLOOM_FILTER_HH
+
+#include <string>
+#include <cstdint>
+
+#include "file_descriptor.hh"
+#include "mmap_region.hh"
+#include "path.hh"
+
+/* A Bloom filter of strings that lives in a single file and is mapped into
+   memory. Bits are only ever set, with atomic ORs, so any number of
+   processes can add to it and test it at once. A key that was never added
+   is turned away for sure; any other key is only probably there. The
+   filter doesn't grow: past about bit_count / 10 keys, it says "probably"
+   more and more often. */
+class BloomFilter
+{
+public:
+  static constexpr uint64_t DEFAULT_BIT_COUNT = 1 << 23; /* 1 MiB */
+  static constexpr uint32_t DEFAULT_HASH_COUNT = 7;
+
+private:
+  struct Header
+  {
+    char magic[ 8 ];
+    uint32_t version;
+    uint32_t hash_count;
+    uint64_t bit_count;
+  };
+
+  static constexpr uint32_t VERSION = 1;
+  static constexpr uint64_t HEADER_SIZE = 4096;
+
+  roost::path path_;
+  FileDescriptor fd_;
+  MMapRegion region_;
+
+  static MMapRegion map_filter( const roost::path & path, const FileDescriptor & fd,
+                                const uint64_t bit_count, const uint32_t hash_count );
+
+  const Header & header() const;
+  uint64_t * words() const;
+
+  /* calls `function` with the word and the mask of each of the key's bits */
+  template<class Function> void for_each_bit( const std::string & key,
+                                              Function && function ) const;
+
+public:
+  BloomFilter( const roost::path & path,
+               const uint64_t bit_count = DEFAULT_BIT_COUNT,
+               const uint32_t hash_count = DEFAULT_HASH_COUNT );
+
+  void add( const std::string & key );
+  bool may_contain( const std::string & key ) const;
+
+  const roost::path & path() const { return path_; }
+};
+
+#endif /* BLOOM_FILTER_HH */
@@ -2,24 +2,317 @@
 
 #include "digest.hh"
 
-#include <crypto++/sha.h>
-#include <crypto++/hex.h>
-#include <crypto++/base64.h>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define DIGEST_HAVE_SHA_NI 1
+#endif
 
-using namespace CryptoPP;
 using namespace std;
 
-string digest::sha256( const string & input )
+constexpr size_t digest::SHA256::BLOCK_SIZE;
+
+namespace {
+
+  const uint32_t K[ 64 ] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  };
+
+  inline uint32_t rotr( const uint32_t x, const int n )
+  {
+    return ( x >> n ) | ( x << ( 32 - n ) );
+  }
+
+  void compress_generic( uint32_t state[ 8 ], const uint8_t * data, size_t blocks )
+  {
+    uint32_t w[ 64 ];
+
+    for ( ; blocks > 0; blocks--, data += digest::SHA256::BLOCK_SIZE ) {
+      for ( size_t i = 0; i < 16; i++ ) {
+        w[ i ] = ( uint32_t( data[ 4 * i ] ) << 24 ) | ( uint32_t( data[ 4 * i + 1 ] ) << 16 )
+               | ( uint32_t( data[ 4 * i + 2 ] ) << 8 ) | uint32_t( data[ 4 * i + 3 ] );
+      }
+
+      for ( size_t i = 16; i < 64; i++ ) {
+        const uint32_t s0 = rotr( w[ i - 15 ], 7 ) ^ rotr( w[ i - 15 ], 18 ) ^ ( w[ i - 15 ] >> 3 );
+        const uint32_t s1 = rotr( w[ i - 2 ], 17 ) ^ rotr( w[ i - 2 ], 19 ) ^ ( w[ i - 2 ] >> 10 );
+        w[ i ] = w[ i - 16 ] + s0 + w[ i - 7 ] + s1;
+      }
+
+      uint32_t a = state[ 0 ], b = state[ 1 ], c = state[ 2 ], d = state[ 3 ];
+      uint32_t e = state[ 4 ], f = state[ 5 ], g = state[ 6 ], h = state[ 7 ];
+
+      for ( size_t i = 0; i < 64; i++ ) {
+        const uint32_t S1 = rotr( e, 6 ) ^ rotr( e, 11 ) ^ rotr( e, 25 );
+        const uint32_t ch = ( e & f ) ^ ( ~e & g );
+        const uint32_t t1 = h + S1 + ch + K[ i ] + w[ i ];
+        const uint32_t S0 = rotr( a, 2 ) ^ rotr( a, 13 ) ^ rotr( a, 22 );
+        const uint32_t maj = ( a & b ) ^ ( a & c ) ^ ( b & c );
+        const uint32_t t2 = S0 + maj;
+
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+      }
+
+      state[ 0 ] += a; state[ 1 ] += b; state[ 2 ] += c; state[ 3 ] += d;
+      state[ 4 ] += e; state[ 5 ] += f; state[ 6 ] += g; state[ 7 ] += h;
+    }
+  }
+
+#ifdef DIGEST_HAVE_SHA_NI
+#define SHA_NI_TARGET __attribute__(( target( "sha,sse4.1" ) ))
+
+  /* four rounds, using the message words in w */
+  SHA_NI_TARGET __attribute__(( always_inline ))
+  inline void sha_ni_rounds( __m128i & state0, __m128i & state1,
+                             const __m128i w, const uint32_t * k )
+  {
+    __m128i message = _mm_add_epi32( w, _mm_loadu_si128( reinterpret_cast<const __m128i *>( k ) ) );
+    state1 = _mm_sha256rnds2_epu32( state1, state0, message );
+    message = _mm_shuffle_epi32( message, 0x0E );
+    state0 = _mm_sha256rnds2_epu32( state0, state1, message );
+  }
+
+  /* the next four message words, from the previous sixteen */
+  SHA_NI_TARGET __attribute__(( always_inline ))
+  inline __m128i sha_ni_schedule( const __m128i w0, const __m128i w1,
+                                  const __m128i w2, const __m128i w3 )
+  {
+    const __m128i next = _mm_add_epi32( _mm_sha256msg1_epu32( w0, w1 ),
+                                        _mm_alignr_epi8( w3, w2, 4 ) );
+    return _mm_sha256msg2_epu32( next, w3 );
+  }
+
+  SHA_NI_TARGET
+  void compress_sha_ni( uint32_t state[ 8 ], const uint8_t * data, size_t blocks )
+  {
+    const __m128i BYTE_SWAP = _mm_set_epi64x( 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL );
+
+    /* the instructions want the state as ABEF and CDGH */
+    __m128i tmp = _mm_loadu_si128( reinterpret_cast<const __m128i *>( &state[ 0 ] ) );
+    __m128i state1 = _mm_loadu_si128( reinterpret_cast<const __m128i *>( &state[ 4 ] ) );
+
+    tmp = _mm_shuffle_epi32( tmp, 0xB1 );
+    state1 = _mm_shuffle_epi32( state1, 0x1B );
+    __m128i state0 = _mm_alignr_epi8( tmp, state1, 8 );
+    state1 = _mm_blend_epi16( state1, tmp, 0xF0 );
+
+    for ( ; blocks > 0; blocks--, data += digest::SHA256::BLOCK_SIZE ) {
+      const __m128i abef_save = state0;
+      const __m128i cdgh_save = state1;
+
+      const __m128i * input = reinterpret_cast<const __m128i *>( data );
+      __m128i w0 = _mm_shuffle_epi8( _mm_loadu_si128( input ), BYTE_SWAP );
+      __m128i w1 = _mm_shuffle_epi8( _mm_loadu_si128( input + 1 ), BYTE_SWAP );
+      __m128i w2 = _mm_shuffle_epi8( _mm_loadu_si128( input + 2 ), BYTE_SWAP );
+      __m128i w3 = _mm_shuffle_epi8( _mm_loadu_si128( input + 3 ), BYTE_SWAP );
+
+      sha_ni_rounds( state0, state1, w0, K );
+      sha_ni_rounds( state0, state1, w1, K + 4 );
+      sha_ni_rounds( state0, state1, w2, K + 8 );
+      sha_ni_rounds( state0, state1, w3, K + 12 );
+
+      for ( size_t i = 16; i < 64; i += 16 ) {
+        w0 = sha_ni_schedule( w0, w1, w2, w3 );
+        sha_ni_rounds( state0, state1, w0, K + i );
+        w1 = sha_ni_schedule( w1, w2, w3, w0 );
+        sha_ni_rounds( state0, state1, w1, K + i + 4 );
+        w2 = sha_ni_schedule( w2, w3, w0, w1 );
+        sha_ni_rounds( state0, state1, w2, K + i + 8 );
+        w3 = sha_ni_schedule( w3, w0, w1, w2 );
+        sha_ni_rounds( state0, state1, w3, K + i + 12 );
+      }
+
+      state0 = _mm_add_epi32( state0, abef_save );
+      state1 = _mm_add_epi32( state1, cdgh_save );
+    }
+
+    tmp = _mm_shuffle_epi32( state0, 0x1B );
+    state1 = _mm_shuffle_epi32( state1, 0xB1 );
+    state0 = _mm_blend_epi16( tmp, state1, 0xF0 );
+    state1 = _mm_alignr_epi8( state1, tmp, 8 );
+
+    _mm_storeu_si128( reinterpret_cast<__m128i *>( &state[ 0 ] ), state0 );
+    _mm_storeu_si128( reinterpret_cast<__m128i *>( &state[ 4 ] ), state1 );
+  }
+
+  bool cpu_has_sha_ni()
+  {
+    unsigned int eax, ebx, ecx, edx;
+
+    if ( not __get_cpuid( 1, &eax, &ebx, &ecx, &edx )
+         or not ( ecx & bit_SSSE3 ) or not ( ecx & bit_SSE4_1 ) ) {
+      return false;
+    }
+
+    if ( not __get_cpuid_count( 7, 0, &eax, &ebx, &ecx, &edx ) ) {
+      return false;
+    }
+
+    return ebx & ( 1 << 29 ); /* SHA */
+  }
+#endif
+
+  typedef void ( * CompressFunction )( uint32_t state[ 8 ], const uint8_t * data, size_t blocks );
+
+  struct Implementation
+  {
+    CompressFunction compress;
+    const char * name;
+  };
+
+  const Implementation & selected_implementation()
+  {
+    static const Implementation selected =
+      [] () -> Implementation
+      {
+#ifdef DIGEST_HAVE_SHA_NI
+        if ( cpu_has_sha_ni() ) {
+          return { compress_sha_ni, "sha-ni" };
+        }
+#endif
+        return { compress_generic, "generic" };
+      }();
+
+    return selected;
+  }
+
+  string base64url( const uint8_t * data, const size_t length )
+  {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+    string output;
+    output.reserve( ( length * 4 + 2 ) / 3 );
+
+    for ( size_t i = 0; i < length; i += 3 ) {
+      const uint32_t chunk = ( uint32_t( data[ i ] ) << 16 )
+                           | ( i + 1 < length ? uint32_t( data[ i + 1 ] ) << 8 : 0 )
+                           | ( i + 2 < length ? uint32_t( data[ i + 2 ] ) : 0 );
+
+      output += alphabet[ ( chunk >> 18 ) & 0x3f ];
+      output += alphabet[ ( chunk >> 12 ) & 0x3f ];
+      if ( i + 1 < length ) { output += alphabet[ ( chunk >> 6 ) & 0x3f ]; }
+      if ( i + 2 < length ) { output += alphabet[ chunk & 0x3f ]; }
+    }
+
+    return output;
+  }
+
+}
+
+digest::SHA256::SHA256()
+  : state_ { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+             0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 },
+    buffer_()
+{}
+
+void digest::SHA256::update( const char * data, size_t length )
 {
-  SHA256 hash_function;
-  string ret;
+  const uint8_t * input = reinterpret_cast<const uint8_t *>( data );
+  const CompressFunction compress = selected_implementation().compress;
+
+  total_length_ += length;
+
+  if ( buffer_length_ > 0 ) {
+    const size_t to_copy = min( length, BLOCK_SIZE - buffer_length_ );
+    memcpy( buffer_ + buffer_length_, input, to_copy );
+    buffer_length_ += to_copy;
+    input += to_copy;
+    length -= to_copy;
+
+    if ( buffer_length_ < BLOCK_SIZE ) {
+      return;
+    }
+
+    compress( state_, buffer_, 1 );
+    buffer_length_ = 0;
+  }
+
+  /* the whole blocks are hashed straight from the input */
+  const size_t blocks = length / BLOCK_SIZE;
+
+  if ( blocks > 0 ) {
+    compress( state_, input, blocks );
+    input += blocks * BLOCK_SIZE;
+    length -= blocks * BLOCK_SIZE;
+  }
+
+  memcpy( buffer_, input, length );
+  buffer_length_ = length;
+}
+
+void digest::SHA256::finalize( uint8_t output[ DIGEST_SIZE ] )
+{
+  const uint64_t bit_length = total_length_ * 8;
+  const CompressFunction compress = selected_implementation().compress;
+
+  buffer_[ buffer_length_++ ] = 0x80;
+
+  if ( buffer_length_ > BLOCK_SIZE - 8 ) {
+    memset( buffer_ + buffer_length_, 0, BLOCK_SIZE - buffer_length_ );
+    compress( state_, buffer_, 1 );
+    buffer_length_ = 0;
+  }
+
+  memset( buffer_ + buffer_length_, 0, BLOCK_SIZE - 8 - buffer_length_ );
 
-  /* Each stage of the Crypto++ pipeline will delete the pointer it owns
-     (https://www.cryptopp.com/wiki/Pipelining) */
+  for ( size_t i = 0; i < 8; i++ ) {
+    buffer_[ BLOCK_SIZE - 1 - i ] = static_cast<uint8_t>( bit_length >> ( 8 * i ) );
+  }
 
-  StringSource s( input, true,
-                  new HashFilter( hash_function,
-                                  new Base64URLEncoder( new StringSink( ret ), false ) ) );
+  compress( state_, buffer_, 1 );
+  buffer_length_ = 0;
 
-  return ret;
+  for ( size_t i = 0; i < 8; i++ ) {
+    output[ 4 * i ] = static_cast<uint8_t>( state_[ i ] >> 24 );
+    output[ 4 * i + 1 ] = static_cast<uint8_t>( state_[ i ] >> 16 );
+    output[ 4 * i + 2 ] = static_cast<uint8_t>( state_[ i ] >> 8 );
+    output[ 4 * i + 3 ] = static_cast<uint8_t>( state_[ i ] );
+  }
+}
+
+string digest::SHA256::finish()
+{
+  uint8_t output[ DIGEST_SIZE ];
+  finalize( output );
+  return base64url( output, sizeof( output ) );
+}
+
+string digest::SHA256::finish_hex()
+{
+  static const char digits[] = "0123456789abcdef";
+
+  uint8_t output[ DIGEST_SIZE ];
+  finalize( output );
+
+  string hex;
+  hex.reserve( 2 * DIGEST_SIZE );
+
+  for ( const uint8_t byte : output ) {
+    hex += digits[ byte >> 4 ];
+    hex += digits[ byte & 0xf ];
+  }
+
+  return hex;
+}
+
+const char * digest::SHA256::implementation()
+{
+  return selected_implementation().name;
+}
+
+string digest::sha256( const string & input )
+{
+  SHA256 hash_function;
+  hash_function.update( input );
+  return hash_function.finish();
 }
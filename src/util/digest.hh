@@ -4,9 +4,47 @@
 #define DIGEST_HH
 
 #include <string>
+#include <cstdint>
+#include <cstddef>
 
 namespace digest
 {
+  /* Incremental SHA-256. The compression function uses the SHA extensions
+     (SHA-NI) when the CPU has them, and portable code otherwise. */
+  class SHA256
+  {
+  public:
+    static constexpr size_t BLOCK_SIZE = 64;
+    static constexpr size_t DIGEST_SIZE = 32;
+
+  private:
+    uint32_t state_[ 8 ];
+    uint8_t buffer_[ BLOCK_SIZE ];
+    size_t buffer_length_ { 0 };
+    uint64_t total_length_ { 0 };
+
+    void finalize( uint8_t output[ DIGEST_SIZE ] );
+
+  public:
+    SHA256();
+
+    void update( const char * data, const size_t length );
+    void update( const std::string & data ) { update( data.data(), data.length() ); }
+
+    /* returns the digest, base64url-encoded without padding; the object
+       can't be updated afterwards */
+    std::string finish();
+
+    /* same as finish(), but the digest is in lowercase hex */
+    std::string finish_hex();
+
+    uint64_t length() const { return total_length_; }
+
+    /* the name of the compression function that's in use */
+    static const char * implementation();
+  };
+
+  /* base64url(sha256(input)), without padding */
   std::string sha256( const std::string & input );
 }
 
@@ -13,6 +13,9 @@ class IPCSocket : public FileDescriptor
 public:
   IPCSocket();
 
+  /* a connected socket, as returned by accept() */
+  IPCSocket( FileDescriptor && fd ) : FileDescriptor( std::move( fd ) ) {}
+
   void bind( const std::string & path );
   void connect( const std::string & path );
 
@@ -0,0 +1,570 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "mapped_hash_table.hh"
+
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "exception.hh"
+#include "temp_file.hh"
+
+using namespace std;
+
+constexpr uint64_t MappedHashTable::DEFAULT_BUCKET_COUNT;
+constexpr uint64_t MappedHashTable::DEFAULT_MAX_SIZE;
+constexpr uint64_t MappedHashTable::MAX_LOAD_FACTOR;
+constexpr uint32_t MappedHashTable::VERSION;
+constexpr uint64_t MappedHashTable::HEADER_SIZE;
+constexpr uint64_t MappedHashTable::GROWTH_STEP;
+
+static const char TABLE_MAGIC[ 8 ] = { 'G', 'G', 'H', 'T', 'A', 'B', 'L', 'E' };
+
+static uint64_t round_up( const uint64_t value, const uint64_t multiple )
+{
+  return ( ( value + multiple - 1 ) / multiple ) * multiple;
+}
+
+static uint64_t fnv1a( const char * data, const size_t length,
+                       uint64_t hash = 14695981039346656037ull )
+{
+  for ( size_t i = 0; i < length; i++ ) {
+    hash ^= static_cast<uint8_t>( data[ i ] );
+    hash *= 1099511628211ull;
+  }
+
+  return hash;
+}
+
+/* holds an exclusive flock() on a file for as long as it lives */
+class FileLock
+{
+private:
+  const FileDescriptor & fd_;
+
+public:
+  FileLock( const FileDescriptor & fd )
+    : fd_( fd )
+  {
+    CheckSystemCall( "flock", flock( fd_.fd_num(), LOCK_EX ) );
+  }
+
+  ~FileLock()
+  {
+    flock( fd_.fd_num(), LOCK_UN );
+  }
+
+  FileLock( const FileLock & ) = delete;
+  FileLock & operator=( const FileLock & ) = delete;
+};
+
+static uint64_t file_size( const FileDescriptor & fd )
+{
+  struct stat file_info;
+  CheckSystemCall( "fstat", fstat( fd.fd_num(), &file_info ) );
+  return file_info.st_size;
+}
+
+static FileDescriptor open_table( const roost::path & path )
+{
+  return { CheckSystemCall( "open (" + path.string() + ")",
+                            open( path.string().c_str(),
+                                  O_RDWR | O_CREAT | O_CLOEXEC, 0644 ) ) };
+}
+
+/* unlike a sparse ftruncate(), this fails right away when the disk is full,
+   instead of with a SIGBUS once the new pages are written to */
+static bool allocate( const FileDescriptor & fd, const uint64_t old_size,
+                      const uint64_t new_size )
+{
+  return posix_fallocate( fd.fd_num(), old_size, new_size - old_size ) == 0;
+}
+
+/* creates the header of a new table (or checks the header of an existing
+   one) and maps the file into memory. The mapping is as large as the table
+   can ever grow, so it never has to move: the pages beyond the end of the
+   file are only touched after the file is extended to cover them. */
+MMapRegion MappedHashTable::map_table( const roost::path & path,
+                                       const FileDescriptor & fd,
+                                       const uint64_t bucket_count,
+                                       const uint64_t max_size )
+{
+  Header header;
+
+  FileLock lock { fd };
+  const uint64_t size = file_size( fd );
+
+  if ( size == 0 ) {
+    if ( bucket_count == 0 ) {
+      throw runtime_error( "hash table needs at least one bucket" );
+    }
+
+    const uint64_t data_start = HEADER_SIZE + bucket_count * sizeof( uint64_t );
+
+    memcpy( header.magic, TABLE_MAGIC, sizeof( header.magic ) );
+    header.version = VERSION;
+    header.retired = 0;
+    header.bucket_count = bucket_count;
+    header.end = data_start;
+    header.entry_count = 0;
+    header.flags = 0;
+
+    if ( not allocate( fd, 0, data_start + GROWTH_STEP ) ) {
+      throw runtime_error( "could not allocate the hash table: " + path.string() );
+    }
+
+    CheckSystemCall( "pwrite", pwrite( fd.fd_num(), &header, sizeof( header ), 0 ) );
+  }
+  else {
+    if ( size < HEADER_SIZE
+         or pread( fd.fd_num(), &header, sizeof( header ), 0 ) != sizeof( header )
+         or memcmp( header.magic, TABLE_MAGIC, sizeof( header.magic ) ) != 0 ) {
+      throw runtime_error( "not a hash table: " + path.string() );
+    }
+
+    if ( header.version != VERSION ) {
+      throw runtime_error( "unsupported hash table version: " + path.string() );
+    }
+
+    if ( header.bucket_count == 0
+         or HEADER_SIZE + header.bucket_count * sizeof( uint64_t ) > size
+         or header.end > size ) {
+      throw runtime_error( "corrupted hash table: " + path.string() );
+    }
+  }
+
+  const uint64_t map_size = max( max_size, file_size( fd ) );
+  return { map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd.fd_num() };
+}
+
+MappedHashTable::Table::Table( FileDescriptor && fd, MMapRegion && region )
+  : fd( move( fd ) ), region( move( region ) )
+{
+  if ( data_start() > this->region.length() ) {
+    throw runtime_error( "hash table does not fit in the mapping" );
+  }
+}
+
+MappedHashTable::MappedHashTable( const roost::path & path,
+                                  const uint64_t bucket_count,
+                                  const uint64_t max_size )
+  : path_( path ), bucket_count_( bucket_count ), max_size_( max_size )
+{
+  static_assert( sizeof( Header ) == 48, "unexpected table header size" );
+  static_assert( sizeof( RecordHeader ) % sizeof( uint64_t ) == 0,
+                 "records must stay aligned" );
+
+  open_current( nullptr );
+}
+
+MappedHashTable::~MappedHashTable() {}
+
+void MappedHashTable::open_current( const Table * retired ) const
+{
+  lock_guard<mutex> lock { tables_mutex_ };
+
+  /* another thread got here first */
+  if ( table_.load( memory_order_acquire ) != retired ) {
+    return;
+  }
+
+  FileDescriptor fd = open_table( path_ );
+  MMapRegion region = map_table( path_, fd, bucket_count_, max_size_ );
+
+  tables_.push_back( make_unique<Table>( move( fd ), move( region ) ) );
+  table_.store( tables_.back().get(), memory_order_release );
+}
+
+MappedHashTable::Table & MappedHashTable::table() const
+{
+  Table * current = table_.load( memory_order_acquire );
+
+  while ( __atomic_load_n( &current->header().retired, __ATOMIC_ACQUIRE ) ) {
+    open_current( current );
+    current = table_.load( memory_order_acquire );
+  }
+
+  return *current;
+}
+
+MappedHashTable::Header & MappedHashTable::Table::header() const
+{
+  return *reinterpret_cast<Header *>( region.addr() );
+}
+
+uint64_t * MappedHashTable::Table::buckets() const
+{
+  return reinterpret_cast<uint64_t *>( region.addr() + HEADER_SIZE );
+}
+
+uint64_t MappedHashTable::Table::data_start() const
+{
+  return HEADER_SIZE + header().bucket_count * sizeof( uint64_t );
+}
+
+uint64_t MappedHashTable::hash( const string & str )
+{
+  return fnv1a( str.data(), str.length() );
+}
+
+uint64_t MappedHashTable::Table::bucket_of( const string & key ) const
+{
+  return hash( key ) % header().bucket_count;
+}
+
+const MappedHashTable::RecordHeader *
+MappedHashTable::Table::record_at( const uint64_t offset, const uint64_t end ) const
+{
+  const uint64_t limit = min( end, static_cast<uint64_t>( region.length() ) );
+
+  if ( offset < data_start() or offset % sizeof( uint64_t ) != 0
+       or offset + sizeof( RecordHeader ) > limit ) {
+    return nullptr;
+  }
+
+  const RecordHeader * record = reinterpret_cast<const RecordHeader *>( region.addr() + offset );
+
+  if ( offset + sizeof( RecordHeader ) + record->key_length + record->value_length > limit ) {
+    return nullptr;
+  }
+
+  RecordHeader unsigned_record = *record;
+  unsigned_record.checksum = 0;
+
+  const char * payload = reinterpret_cast<const char *>( record + 1 );
+  uint64_t checksum = fnv1a( reinterpret_cast<const char *>( &unsigned_record ),
+                             sizeof( unsigned_record ) );
+  checksum = fnv1a( payload, record->key_length + record->value_length, checksum );
+
+  if ( checksum != record->checksum ) {
+    /* a torn record; whatever it points to can't be trusted either */
+    return nullptr;
+  }
+
+  return record;
+}
+
+Optional<string> MappedHashTable::Table::find( const string & key,
+                                               const uint64_t head, const uint64_t end ) const
+{
+  uint64_t offset = head;
+
+  while ( offset != 0 ) {
+    const RecordHeader * record = record_at( offset, end );
+
+    if ( record == nullptr ) {
+      break;
+    }
+
+    const char * payload = reinterpret_cast<const char *>( record + 1 );
+
+    if ( record->key_length == key.length()
+         and memcmp( payload, key.data(), key.length() ) == 0 ) {
+      return { true, payload + record->key_length, record->value_length };
+    }
+
+    offset = record->next;
+  }
+
+  return {};
+}
+
+Optional<string> MappedHashTable::get( const string & key ) const
+{
+  const Table & current = table();
+
+  /* the writer moves the end before it publishes the new head, so loading
+     them in the opposite order never yields a head beyond the end */
+  const uint64_t head = __atomic_load_n( &current.buckets()[ current.bucket_of( key ) ],
+                                         __ATOMIC_ACQUIRE );
+  const uint64_t end = __atomic_load_n( &current.header().end, __ATOMIC_ACQUIRE );
+
+  return current.find( key, head, end );
+}
+
+template<class Function>
+void MappedHashTable::with_write_lock( Function && function )
+{
+  /* flock() doesn't exclude the threads that share our file descriptor */
+  lock_guard<mutex> thread_lock { write_mutex_ };
+
+  /* the table might have been rebuilt while we waited for the lock */
+  while ( true ) {
+    const Table & current = table();
+    write_lock_ = make_unique<FileLock>( current.fd );
+
+    if ( not __atomic_load_n( &current.header().retired, __ATOMIC_ACQUIRE ) ) {
+      break;
+    }
+
+    write_lock_.reset();
+  }
+
+  try {
+    function();
+  }
+  catch ( const exception & ) {
+    write_lock_.reset();
+    throw;
+  }
+
+  write_lock_.reset();
+}
+
+bool MappedHashTable::reserve( const uint64_t size )
+{
+  const Table & current = table();
+
+  if ( size > current.region.length() ) {
+    return false;
+  }
+
+  const uint64_t old_size = file_size( current.fd );
+
+  if ( old_size < size ) {
+    const uint64_t new_size = min( static_cast<uint64_t>( current.region.length() ),
+                                   round_up( size, GROWTH_STEP ) );
+    return allocate( current.fd, old_size, new_size );
+  }
+
+  return true;
+}
+
+/* writes a record into space that is already allocated */
+void MappedHashTable::write_record( char * target, const uint64_t next,
+                                    const string & key, const string & value )
+{
+  RecordHeader record;
+  record.next = next;
+  record.key_length = key.length();
+  record.value_length = value.length();
+  record.checksum = 0;
+
+  uint64_t checksum = fnv1a( reinterpret_cast<const char *>( &record ), sizeof( record ) );
+  checksum = fnv1a( key.data(), key.length(), checksum );
+  checksum = fnv1a( value.data(), value.length(), checksum );
+  record.checksum = checksum;
+
+  memcpy( target, &record, sizeof( record ) );
+  memcpy( target + sizeof( record ), key.data(), key.length() );
+  memcpy( target + sizeof( record ) + key.length(), value.data(), value.length() );
+}
+
+bool MappedHashTable::rebuild( const uint64_t extra_size )
+{
+  Table & old_table = table();
+  const Header & old_header = old_table.header();
+
+  /* the newest record of each key, which is the first one on its chain */
+  vector<const RecordHeader *> live;
+  uint64_t live_size = 0;
+  unordered_set<string> seen_keys;
+
+  for ( uint64_t i = 0; i < old_header.bucket_count; i++ ) {
+    seen_keys.clear();
+
+    for ( uint64_t offset = old_table.buckets()[ i ]; offset != 0; ) {
+      const RecordHeader * record = old_table.record_at( offset, old_header.end );
+
+      if ( record == nullptr ) {
+        break;
+      }
+
+      if ( seen_keys.emplace( reinterpret_cast<const char *>( record + 1 ),
+                              record->key_length ).second ) {
+        live.push_back( record );
+        live_size += round_up( sizeof( RecordHeader ) + record->key_length
+                               + record->value_length, sizeof( uint64_t ) );
+      }
+
+      offset = record->next;
+    }
+  }
+
+  uint64_t bucket_count = old_header.bucket_count;
+  while ( bucket_count < live.size() ) {
+    bucket_count *= 2;
+  }
+
+  const uint64_t data_start = HEADER_SIZE + bucket_count * sizeof( uint64_t );
+  const uint64_t needed_size = data_start + live_size + extra_size;
+
+  if ( needed_size > max_size_ ) {
+    old_table.full = true;
+    return false;
+  }
+
+  /* the new file is complete before it's renamed into place */
+  UniqueFile new_file { path_.string() };
+  const string new_path = new_file.name();
+
+  try {
+    FileDescriptor & fd = new_file.fd();
+    CheckSystemCall( "fchmod", fchmod( fd.fd_num(), 0644 ) );
+
+    if ( not allocate( fd, 0, min( max_size_, round_up( needed_size, GROWTH_STEP ) ) ) ) {
+      CheckSystemCall( "unlink", unlink( new_path.c_str() ) );
+      old_table.full = true;
+      return false;
+    }
+
+    MMapRegion region { max_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE,
+                        fd.fd_num() };
+    Header & header = *reinterpret_cast<Header *>( region.addr() );
+    uint64_t * buckets = reinterpret_cast<uint64_t *>( region.addr() + HEADER_SIZE );
+
+    memcpy( header.magic, TABLE_MAGIC, sizeof( header.magic ) );
+    header.version = VERSION;
+    header.retired = 0;
+    header.bucket_count = bucket_count;
+    header.entry_count = live.size();
+    header.flags = old_header.flags;
+
+    uint64_t end = data_start;
+
+    for ( const RecordHeader * record : live ) {
+      const char * payload = reinterpret_cast<const char *>( record + 1 );
+      const string key { payload, record->key_length };
+      const string value { payload + record->key_length, record->value_length };
+      uint64_t & head = buckets[ hash( key ) % bucket_count ];
+
+      write_record( region.addr() + end, head, key, value );
+      head = end;
+      end += round_up( sizeof( RecordHeader ) + key.length() + value.length(),
+                       sizeof( uint64_t ) );
+    }
+
+    header.end = end;
+
+    /* if it's still this full, rebuilding it again wouldn't be worth it */
+    auto new_table = make_unique<Table>( move( fd ), move( region ) );
+    new_table->full = ( needed_size > max_size_ / 2 );
+
+    /* nobody can open the new table before we hold its lock */
+    auto new_lock = make_unique<FileLock>( new_table->fd );
+    roost::rename( new_path, path_ );
+    __atomic_store_n( &old_table.header().retired, 1, __ATOMIC_RELEASE );
+
+    {
+      lock_guard<mutex> lock { tables_mutex_ };
+      tables_.push_back( move( new_table ) );
+      table_.store( tables_.back().get(), memory_order_release );
+    }
+
+    write_lock_ = move( new_lock );
+  }
+  catch ( const exception & ) {
+    if ( roost::exists( new_path ) ) {
+      unlink( new_path.c_str() );
+    }
+
+    throw;
+  }
+
+  return true;
+}
+
+bool MappedHashTable::append( const string & key, const string & value )
+{
+  if ( key.length() > UINT32_MAX or value.length() > UINT32_MAX ) {
+    throw runtime_error( "hash table entry is too large" );
+  }
+
+  Table * current = &table();
+
+  const Optional<string> current_value =
+    current->find( key, current->buckets()[ current->bucket_of( key ) ], current->header().end );
+  if ( current_value.initialized() and *current_value == value ) {
+    return true;
+  }
+
+  const uint64_t record_size = round_up( sizeof( RecordHeader ) + key.length() + value.length(),
+                                         sizeof( uint64_t ) );
+
+  const bool crowded = current->header().entry_count
+                       >= MAX_LOAD_FACTOR * current->header().bucket_count;
+  const bool out_of_room = current->header().end + record_size > current->region.length();
+
+  if ( ( crowded or out_of_room ) and not current->full and rebuild( record_size ) ) {
+    current = &table();
+  }
+
+  uint64_t & head = current->buckets()[ current->bucket_of( key ) ];
+  const uint64_t end = current->header().end;
+
+  /* it's a cache, so when there's no room left, the entry is dropped */
+  if ( not reserve( end + record_size ) ) {
+    current->full = true;
+    return false;
+  }
+
+  write_record( current->region.addr() + end, head, key, value );
+
+  /* first the record, then the end, then the head (see get()) */
+  __atomic_store_n( &current->header().end, end + record_size, __ATOMIC_RELEASE );
+  __atomic_store_n( &head, end, __ATOMIC_RELEASE );
+  __atomic_store_n( &current->header().entry_count, current->header().entry_count + 1,
+                    __ATOMIC_RELAXED );
+
+  return true;
+}
+
+bool MappedHashTable::put( const string & key, const string & value )
+{
+  bool stored = false;
+  with_write_lock( [&] { stored = append( key, value ); } );
+  return stored;
+}
+
+bool MappedHashTable::put( const vector<pair<string, string>> & entries )
+{
+  bool stored = true;
+
+  with_write_lock(
+    [&]
+    {
+      for ( const auto & entry : entries ) {
+        stored = append( entry.first, entry.second ) and stored;
+      }
+    } );
+
+  return stored;
+}
+
+void MappedHashTable::clear()
+{
+  with_write_lock(
+    [&]
+    {
+      Table & current = table();
+
+      for ( uint64_t i = 0; i < current.header().bucket_count; i++ ) {
+        __atomic_store_n( &current.buckets()[ i ], 0, __ATOMIC_RELEASE );
+      }
+
+      __atomic_store_n( &current.header().end, current.data_start(), __ATOMIC_RELEASE );
+      __atomic_store_n( &current.header().entry_count, 0, __ATOMIC_RELAXED );
+      current.full = false;
+    } );
+}
+
+uint64_t MappedHashTable::flags() const
+{
+  return __atomic_load_n( &table().header().flags, __ATOMIC_ACQUIRE );
+}
+
+void MappedHashTable::set_flags( const uint64_t flags )
+{
+  with_write_lock( [&] { __atomic_store_n( &table().header().flags, flags, __ATOMIC_RELEASE ); } );
+}
+
+uint64_t MappedHashTable::size() const
+{
+  return __atomic_load_n( &table().header().entry_count, __ATOMIC_RELAXED );
+}
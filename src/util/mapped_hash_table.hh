@@ -0,0 +1,144 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef MAPPED_HASH_TABLE_HH
+#define MAPPED_HASH_TABLE_HH
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+#include "file_descriptor.hh"
+#include "mmap_region.hh"
+#include "optional.hh"
+#include "path.hh"
+
+/* A string-to-string hash table that lives in a single file and is mapped
+   into memory. Records are only ever appended to the file, and a record
+   becomes visible when the head of its bucket is atomically pointed at it,
+   so a crashed writer can only leave unreachable bytes behind. Lookups take
+   no locks. Writers serialize on an exclusive flock() of the file, so any
+   number of processes can insert into the same table.
+
+   When the chains get too long, or the file reaches its maximum size, the
+   writer rebuilds the table into a new file, with more buckets and without
+   the entries that newer ones hide, and renames it over the old one. The
+   old file is marked as retired, and whoever still has it mapped moves on to
+   the new one. It's a cache: if the entries still don't fit, or the disk is
+   full, new entries are dropped. */
+class FileLock;
+
+class MappedHashTable
+{
+public:
+  static constexpr uint64_t DEFAULT_BUCKET_COUNT = 1 << 16;
+  static constexpr uint64_t DEFAULT_MAX_SIZE = 1ull << 32;
+
+  /* the table is rebuilt with more buckets past this many records each */
+  static constexpr uint64_t MAX_LOAD_FACTOR = 4;
+
+private:
+  struct Header
+  {
+    char magic[ 8 ];
+    uint32_t version;
+    uint32_t retired; /* the table was rebuilt into a new file */
+    uint64_t bucket_count;
+    uint64_t end; /* offset just past the last record */
+    uint64_t entry_count;
+    uint64_t flags;
+  };
+
+  struct RecordHeader
+  {
+    uint64_t next;
+    uint32_t key_length;
+    uint32_t value_length;
+    uint64_t checksum;
+  };
+
+  static constexpr uint32_t VERSION = 1;
+  static constexpr uint64_t HEADER_SIZE = 4096;
+  static constexpr uint64_t GROWTH_STEP = 4 * 1024 * 1024;
+
+  /* one generation of the table's file */
+  struct Table
+  {
+    FileDescriptor fd;
+    MMapRegion region;
+
+    /* rebuilding it wouldn't free enough room to be worth it */
+    bool full { false };
+
+    Table( FileDescriptor && fd, MMapRegion && region );
+
+    Header & header() const;
+    uint64_t * buckets() const;
+    uint64_t data_start() const;
+    uint64_t bucket_of( const std::string & key ) const;
+
+    const RecordHeader * record_at( const uint64_t offset, const uint64_t end ) const;
+    Optional<std::string> find( const std::string & key,
+                                const uint64_t head, const uint64_t end ) const;
+  };
+
+  roost::path path_;
+  uint64_t bucket_count_;
+  uint64_t max_size_;
+
+  /* the older generations stay mapped, as readers might still be in them */
+  mutable std::vector<std::unique_ptr<Table>> tables_ {};
+  mutable std::atomic<Table *> table_ { nullptr };
+  mutable std::mutex tables_mutex_ {};
+
+  std::mutex write_mutex_ {};
+  std::unique_ptr<FileLock> write_lock_ { nullptr };
+
+  static MMapRegion map_table( const roost::path & path, const FileDescriptor & fd,
+                               const uint64_t bucket_count, const uint64_t max_size );
+
+  /* the current generation */
+  Table & table() const;
+  void open_current( const Table * retired ) const;
+
+  /* the caller must hold the write lock */
+  bool append( const std::string & key, const std::string & value );
+  bool reserve( const uint64_t size );
+  bool rebuild( const uint64_t extra_size );
+
+  static void write_record( char * target, const uint64_t next,
+                            const std::string & key, const std::string & value );
+
+  template<class Function> void with_write_lock( Function && function );
+
+public:
+  MappedHashTable( const roost::path & path,
+                   const uint64_t bucket_count = DEFAULT_BUCKET_COUNT,
+                   const uint64_t max_size = DEFAULT_MAX_SIZE );
+  ~MappedHashTable();
+
+  Optional<std::string> get( const std::string & key ) const;
+
+  /* a newer value for a key hides the older ones; returns false if the
+     table had no room left for (some of) the entries */
+  bool put( const std::string & key, const std::string & value );
+  bool put( const std::vector<std::pair<std::string, std::string>> & entries );
+
+  /* forget all the entries; readers in other processes must not be
+     looking up the table while it is cleared */
+  void clear();
+
+  /* flags that the users of the table can set, e.g. to mark a migration */
+  uint64_t flags() const;
+  void set_flags( const uint64_t flags );
+
+  uint64_t size() const;
+  const roost::path & path() const { return path_; }
+
+  static uint64_t hash( const std::string & str );
+};
+
+#endif /* MAPPED_HASH_TABLE_HH */
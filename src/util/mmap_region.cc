@@ -0,0 +1,59 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include "mmap_region.hh"
+
+#include <sys/mman.h>
+
+#include "exception.hh"
+
+using namespace std;
+
+MMapRegion::MMapRegion( const size_t length, const int prot, const int flags,
+                        const int fd, const off_t offset )
+  : addr_( nullptr ), length_( length )
+{
+  void * addr = mmap( nullptr, length, prot, flags, fd, offset );
+
+  if ( addr == MAP_FAILED ) {
+    throw unix_error( "mmap" );
+  }
+
+  addr_ = static_cast<char *>( addr );
+}
+
+MMapRegion::~MMapRegion()
+{
+  if ( addr_ == nullptr ) {
+    return;
+  }
+
+  try {
+    CheckSystemCall( "munmap", munmap( addr_, length_ ) );
+  }
+  catch ( const exception & e ) {
+    print_exception( "munmap", e );
+  }
+}
+
+MMapRegion::MMapRegion( MMapRegion && other )
+  : addr_( other.addr_ ), length_( other.length_ )
+{
+  other.addr_ = nullptr;
+  other.length_ = 0;
+}
+
+MMapRegion & MMapRegion::operator=( MMapRegion && other )
+{
+  if ( this != &other ) {
+    if ( addr_ != nullptr ) {
+      munmap( addr_, length_ );
+    }
+
+    addr_ = other.addr_;
+    length_ = other.length_;
+    other.addr_ = nullptr;
+    other.length_ = 0;
+  }
+
+  return *this;
+}
@@ -0,0 +1,34 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#ifndef MMAP_REGION_HH
+#define MMAP_REGION_HH
+
+#include <cstddef>
+#include <sys/types.h>
+
+/* a memory-mapped region that is unmapped when the object is destroyed */
+class MMapRegion
+{
+private:
+  char * addr_;
+  size_t length_;
+
+public:
+  MMapRegion( const size_t length, const int prot, const int flags,
+              const int fd, const off_t offset = 0 );
+
+  ~MMapRegion();
+
+  char * addr() const { return addr_; }
+  size_t length() const { return length_; }
+
+  /* allow move constructor and move assignment */
+  MMapRegion( MMapRegion && other );
+  MMapRegion & operator=( MMapRegion && other );
+
+  /* forbid copying */
+  MMapRegion( const MMapRegion & other ) = delete;
+  MMapRegion & operator=( const MMapRegion & other ) = delete;
+};
+
+#endif /* MMAP_REGION_HH */
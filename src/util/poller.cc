@@ -1,8 +1,6 @@
 /* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
 
 #include <algorithm>
-#include <numeric>
-#include <chrono>
 
 #include "poller.hh"
 #include "exception.hh"
@@ -10,6 +8,11 @@
 using namespace std;
 using namespace PollerShortNames;
 
+Poller::Poller()
+  : epoll_fd_( CheckSystemCall( "epoll_create1", epoll_create1( EPOLL_CLOEXEC ) ) ),
+    events_( MAX_EVENTS )
+{}
+
 void Poller::add_action( Poller::Action action )
 {
   /* the action won't be actually added until the next poll() function call.
@@ -22,85 +25,208 @@ unsigned int Poller::Action::service_count( void ) const
   return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
+bool Poller::Action::interested( void ) const
+{
+  /* don't poll in on fds that have had EOF */
+  if ( not active or ( direction == Direction::In and fd.eof() ) ) {
+    return false;
+  }
+
+  return not when_interested or when_interested();
+}
+
+void Poller::register_action( Action && action )
+{
+  const int fd = action.fd.fd_num();
+  auto state_it = fds_.find( fd );
+
+  if ( state_it == fds_.end() ) {
+    state_it = fds_.emplace( fd, FDState {} ).first;
+    state_it->second.fd = fd;
+
+    /* registered with no events; update_interest() fills them in */
+    epoll_event event {};
+    event.data.fd = fd;
+
+    if ( epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_ADD, fd, &event ) < 0 ) {
+      if ( errno == EBADF ) {
+        /* already closed, which poll(2) would report as POLLNVAL */
+        fds_.erase( state_it );
+        action.fderror_callback();
+        return;
+      }
+      else if ( errno != EPERM ) {
+        throw unix_error( "epoll_ctl" );
+      }
+
+      state_it->second.always_ready = true;
+      always_ready_fds_.push_back( fd );
+    }
+  }
+
+  FDState & state = state_it->second;
+
+  if ( action.when_interested and not state.dynamic ) {
+    state.dynamic = true;
+    dynamic_fds_.push_back( &state );
+  }
+
+  state.actions.emplace_back( move( action ) );
+  update_interest( state );
+}
+
+bool Poller::update_interest( FDState & state )
+{
+  uint32_t events = 0;
+
+  for ( const auto & action : state.actions ) {
+    if ( action.interested() ) {
+      events |= action.direction;
+    }
+  }
+
+  if ( events == state.events ) {
+    return true;
+  }
+
+  if ( not state.always_ready ) {
+    epoll_event event {};
+    event.events = events;
+    event.data.fd = state.fd;
+
+    if ( epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_MOD, state.fd, &event ) < 0 ) {
+      /* the fd was closed under us, which poll(2) would report as POLLNVAL */
+      if ( errno == EBADF or errno == ENOENT ) {
+        return false;
+      }
+
+      throw unix_error( "epoll_ctl" );
+    }
+  }
+
+  if ( state.events == 0 ) {
+    interested_count_++;
+  }
+  else if ( events == 0 ) {
+    interested_count_--;
+  }
+
+  state.events = events;
+  return true;
+}
+
 Poller::Result Poller::poll( const int timeout_ms )
 {
+  set<int> fds_to_remove;
+
   /* first, let's add all the actions that are waiting in the queue */
   while ( not action_add_queue_.empty() ) {
-    Action & action = action_add_queue_.front();
-    pollfds_.push_back( { action.fd.fd_num(), 0, 0 } );
-    actions_.emplace_back( move( action ) );
+    register_action( move( action_add_queue_.front() ) );
     action_add_queue_.pop();
   }
 
-  assert( pollfds_.size() == actions_.size() );
-
   if ( timeout_ms == 0 ) {
     throw runtime_error( "poll asked to busy-wait" );
   }
 
-  /* tell poll whether we care about each fd */
-  auto it_action = actions_.begin();
-  auto it_pollfd = pollfds_.begin();
-
-  for ( ; it_action != actions_.end() and it_pollfd != pollfds_.end()
-        ; it_action++, it_pollfd++ ) {
-    assert( it_pollfd->fd == it_action->fd.fd_num() );
-    it_pollfd->events = (it_action->active and it_action->when_interested())
-      ? it_action->direction : 0;
-
-    /* don't poll in on fds that have had EOF */
-    if ( it_action->direction == Direction::In
-       and it_action->fd.eof() ) {
-      it_pollfd->events = 0;
+  /* only the actions that decide for themselves are asked again */
+  for ( FDState * state : dynamic_fds_ ) {
+    if ( not update_interest( *state ) ) {
+      fds_to_remove.insert( state->fd );
     }
   }
 
-  /* Quit if no member in pollfds_ has a non-zero direction */
-  if ( not accumulate( pollfds_.begin(), pollfds_.end(), false,
-                       [] ( bool acc, pollfd x ) { return acc or x.events; } ) ) {
+  for ( const int fd : fds_to_remove ) {
+    fds_.at( fd ).actions.front().fderror_callback();
+  }
+
+  remove_actions( fds_to_remove );
+  fds_to_remove.clear();
+
+  /* quit if no fd is of interest */
+  if ( interested_count_ == 0 ) {
     return Result::Type::Exit;
   }
 
-  if ( 0 == CheckSystemCall( "poll", ::poll( &pollfds_[ 0 ], pollfds_.size(), timeout_ms ) ) ) {
+  const bool files_ready =
+    any_of( always_ready_fds_.begin(), always_ready_fds_.end(),
+            [this] ( const int fd ) { return fds_.at( fd ).events != 0; } );
+
+  size_t event_count =
+    CheckSystemCall( "epoll_wait", epoll_wait( epoll_fd_.fd_num(), &events_[ 0 ], MAX_EVENTS,
+                                               files_ready ? 0 : timeout_ms ) );
+
+  if ( files_ready ) {
+    events_.resize( MAX_EVENTS + always_ready_fds_.size() );
+
+    for ( const int fd : always_ready_fds_ ) {
+      if ( fds_.at( fd ).events ) {
+        events_[ event_count ].events = fds_.at( fd ).events;
+        events_[ event_count ].data.fd = fd;
+        event_count++;
+      }
+    }
+  }
+
+  if ( event_count == 0 ) {
     return Result::Type::Timeout;
   }
 
-  it_action = actions_.begin();
-  it_pollfd = pollfds_.begin();
+  for ( size_t e = 0; e < event_count; e++ ) {
+    const epoll_event & event = events_[ e ];
+    const int fd = event.data.fd;
 
-  set<int> fds_to_remove;
-  static int X = 0;
-  X++;
-  for ( ; it_action != actions_.end() and it_pollfd != pollfds_.end()
-        ; it_action++, it_pollfd++ ) {
-    if ( it_pollfd->revents & (POLLERR | POLLHUP | POLLNVAL) ) {
-      if ( fds_to_remove.count( it_pollfd->fd ) == 0 ) {
-        it_action->fderror_callback();
-        fds_to_remove.insert( it_pollfd->fd );
-      }
+    if ( fds_to_remove.count( fd ) or fds_.count( fd ) == 0 ) {
       continue;
     }
 
-    if ( it_pollfd->revents & it_pollfd->events ) {
-      /* we only want to call callback if revents includes
-        the event we asked for */
-      auto result = it_action->callback();
+    if ( event.events & ( EPOLLERR | EPOLLHUP ) ) {
+      fds_.at( fd ).actions.front().fderror_callback();
+      fds_to_remove.insert( fd );
+      continue;
+    }
+
+    /* the callbacks can add actions, but those wait in the queue, so the
+       fd's actions stay where they are */
+    for ( size_t i = 0; i < fds_.at( fd ).actions.size(); i++ ) {
+      Action & action = fds_.at( fd ).actions[ i ];
+
+      /* we only want to call callback if the event is the one we asked for */
+      if ( not ( event.events & action.direction ) or not action.interested() ) {
+        continue;
+      }
+
+      auto result = action.callback();
 
       switch ( result.result ) {
       case ResultType::Exit:
+        remove_actions( fds_to_remove );
         return Result( Result::Type::Exit, result.exit_status );
 
       case ResultType::Cancel:
-        it_action->active = false;
+        fds_.at( fd ).actions[ i ].active = false;
         break;
 
       case ResultType::CancelAll:
-        fds_to_remove.insert( it_pollfd->fd );
+        fds_to_remove.insert( fd );
         break;
 
       case ResultType::Continue:
         break;
       }
+
+      if ( fds_to_remove.count( fd ) or fds_.count( fd ) == 0 ) {
+        break;
+      }
+    }
+
+    if ( fds_to_remove.count( fd ) == 0 and fds_.count( fd ) ) {
+      FDState & state = fds_.at( fd );
+
+      if ( not update_interest( state ) ) {
+        state.actions.front().fderror_callback();
+        fds_to_remove.insert( fd );
+      }
     }
   }
 
@@ -115,17 +241,33 @@ void Poller::remove_actions( const set<int> & fd_nums )
     return;
   }
 
-  auto it_action = actions_.begin();
-  auto it_pollfd = pollfds_.begin();
+  auto removed = [&fd_nums] ( const int fd ) { return fd_nums.count( fd ) > 0; };
+
+  dynamic_fds_.erase( remove_if( dynamic_fds_.begin(), dynamic_fds_.end(),
+                                 [&removed] ( FDState * state )
+                                 { return removed( state->fd ); } ),
+                      dynamic_fds_.end() );
+  always_ready_fds_.erase( remove_if( always_ready_fds_.begin(), always_ready_fds_.end(), removed ),
+                           always_ready_fds_.end() );
+
+  for ( const int fd : fd_nums ) {
+    auto state_it = fds_.find( fd );
 
-  while ( it_action != actions_.end() and it_pollfd != pollfds_.end() ) {
-    if ( fd_nums.count( it_pollfd->fd ) ) {
-      it_action = actions_.erase( it_action );
-      it_pollfd = pollfds_.erase( it_pollfd );
+    if ( state_it == fds_.end() ) {
+      continue;
     }
-    else {
-      it_action++;
-      it_pollfd++;
+
+    const FDState & state = state_it->second;
+
+    if ( state.events ) {
+      interested_count_--;
+    }
+
+    if ( not state.always_ready ) {
+      /* the fd might be closed already, which took it out of the epoll set */
+      epoll_ctl( epoll_fd_.fd_num(), EPOLL_CTL_DEL, fd, nullptr );
     }
+
+    fds_.erase( state_it );
   }
 }
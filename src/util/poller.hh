@@ -6,10 +6,10 @@
 #include <functional>
 #include <vector>
 #include <cassert>
-#include <list>
 #include <set>
 #include <queue>
-#include <poll.h>
+#include <unordered_map>
+#include <sys/epoll.h>
 
 #include "file_descriptor.hh"
 
@@ -31,8 +31,11 @@ public:
     typedef std::function<Result(void)> CallbackType;
 
     FileDescriptor & fd;
-    enum PollDirection : short { In = POLLIN, Out = POLLOUT } direction;
+    enum PollDirection : uint32_t { In = EPOLLIN, Out = EPOLLOUT } direction;
     CallbackType callback;
+
+    /* empty means always interested; such actions cost nothing until their
+       fd is ready, the others are asked before every poll */
     std::function<bool(void)> when_interested;
     std::function<void(void)> fderror_callback;
     bool active;
@@ -40,7 +43,7 @@ public:
     Action( FileDescriptor & s_fd,
             const PollDirection & s_direction,
             const CallbackType & s_callback,
-            const std::function<bool(void)> & s_when_interested = [] () { return true; },
+            const std::function<bool(void)> & s_when_interested = {},
             const std::function<void(void)> & fderror_callback = [] () {} )
       : fd( s_fd ), direction( s_direction ), callback( s_callback ),
         when_interested( s_when_interested ),
@@ -49,16 +52,49 @@ public:
     Action( NBSecureSocket & s_socket,
             const PollDirection & s_direction,
             const CallbackType & s_callback,
-            const std::function<bool(void)> & s_when_interested = [] () { return true; },
+            const std::function<bool(void)> & s_when_interested = {},
             const std::function<void(void)> & fderror_callback = [] () {} );
 
     unsigned int service_count( void ) const;
+    bool interested( void ) const;
   };
 
 private:
+  /* the actions of one fd, which stays registered with epoll until its
+     actions are removed; only changes in interest are passed on */
+  struct FDState
+  {
+    int fd { -1 };
+    std::vector<Action> actions {};
+    uint32_t events { 0 };
+
+    /* one of the actions has a when_interested() */
+    bool dynamic { false };
+
+    /* epoll refuses regular files, which poll(2) considers always ready */
+    bool always_ready { false };
+  };
+
+  static constexpr size_t MAX_EVENTS = 1024;
+
+  FileDescriptor epoll_fd_;
   std::queue<Action> action_add_queue_ {};
-  std::list<Action> actions_ {};
-  std::vector<pollfd> pollfds_ {};
+  std::unordered_map<int, FDState> fds_ {};
+
+  /* the elements of an unordered_map stay where they are */
+  std::vector<FDState *> dynamic_fds_ {};
+  std::vector<int> always_ready_fds_ {};
+
+  /* the fds with a non-empty interest */
+  size_t interested_count_ { 0 };
+
+  std::vector<epoll_event> events_ {};
+
+  void register_action( Action && action );
+
+  /* asks the fd's actions what they're interested in and tells epoll if
+     that changed; false if the fd is gone */
+  bool update_interest( FDState & state );
 
 public:
   struct Result
@@ -69,7 +105,7 @@ public:
       : result( s_result ), exit_status( s_status ) {}
   };
 
-  Poller() {}
+  Poller();
 
   void add_action( Action action );
   Result poll( const int timeout_ms );
@@ -0,0 +1,98 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <string>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "thunk/blob_store.hh"
+#include "thunk/ggutils.hh"
+#include "util/exception.hh"
+#include "util/path.hh"
+
+using namespace std;
+using namespace gg;
+
+static void check( const bool condition, const string & message )
+{
+  if ( not condition ) {
+    throw runtime_error( "blob store test failed: " + message );
+  }
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    BlobStore store { 1024 };
+
+    /* a small object goes into a packfile */
+    const string small_data = "small object";
+    const string small_hash = gg::hash::compute( small_data, ObjectType::Value );
+
+    check( not store.exists( small_hash ), "object exists before insertion" );
+    store.insert( small_hash, small_data );
+    check( store.exists( small_hash ), "packed object doesn't exist" );
+    check( not roost::exists( paths::blob( small_hash ) ), "packed object has a file" );
+    check( store.read( small_hash ) == small_data, "packed object contents" );
+
+    /* ... until someone needs a path to it */
+    const roost::path small_path = store.path( small_hash );
+    check( roost::read_file( small_path ) == small_data, "extracted object contents" );
+    check( store.read( small_hash ) == small_data, "object contents after extraction" );
+
+    /* a large object gets a file of its own, in its shard */
+    const string large_data( 4096, 'x' );
+    const string large_hash = gg::hash::compute( large_data, ObjectType::Value );
+
+    store.insert( large_hash, large_data );
+    check( roost::exists( paths::blob( large_hash ) ), "large object has no file" );
+    check( roost::dirname( paths::blob( large_hash ) ) != paths::blobs(), "object is not sharded" );
+
+    const BlobView view = store.map( large_hash );
+    check( view.size() == large_data.size() and view.str() == large_data, "mapped object contents" );
+
+    /* an object in the old, flat layout is found and moved to its shard */
+    const string flat_data = "flat object";
+    const string flat_hash = gg::hash::compute( flat_data, ObjectType::Value );
+
+    roost::atomic_create( flat_data, paths::flat_blob( flat_hash ) );
+    check( store.exists( flat_hash ), "flat object doesn't exist" );
+    check( roost::exists( paths::blob( flat_hash ) ), "flat object wasn't moved" );
+    check( store.read( flat_hash ) == flat_data, "flat object contents" );
+
+    /* empty objects */
+    const string empty_hash = gg::hash::compute( "", ObjectType::Value );
+    store.insert( empty_hash, "" );
+    check( store.read( empty_hash ).empty(), "empty object contents" );
+
+    /* a file is hashed on its way into the store, and keeps its mode */
+    const string output_data( 3000, 'o' );
+    const roost::path output_path = paths::scratch() / ( "blob-store-test." + to_string( getpid() ) );
+
+    roost::atomic_create( output_data, output_path, true, 0755 );
+    const string output_hash = store.capture_file( output_path );
+    check( output_hash == gg::hash::compute( output_data, ObjectType::Value ), "captured object hash" );
+    check( not roost::exists( output_path ), "captured file was left behind" );
+    check( store.read( output_hash ) == output_data, "captured object contents" );
+    check( roost::is_executable( paths::blob( output_hash ) ), "captured object mode" );
+
+    bool threw = false;
+    try {
+      store.read( gg::hash::compute( "missing", ObjectType::Value ) );
+    }
+    catch ( const runtime_error & ) {
+      threw = true;
+    }
+
+    check( threw, "reading a missing object" );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "net/compression.hh"
+#include "thunk/ggutils.hh"
+#include "util/exception.hh"
+#include "util/path.hh"
+
+using namespace std;
+using namespace storage;
+
+static void check( const bool condition, const string & message )
+{
+  if ( not condition ) {
+    throw runtime_error( "compression test failed: " + message );
+  }
+}
+
+static roost::path scratch_file( const string & name, const string & contents )
+{
+  const roost::path path = gg::paths::scratch()
+                           / ( "compression-test." + to_string( getpid() ) + "." + name );
+  roost::atomic_create( contents, path );
+  return path;
+}
+
+/* what a receiver would write, given the object in pieces of `chunk_size` */
+static string decode( const string & stored, const size_t chunk_size )
+{
+  ObjectDecoder decoder;
+  string output;
+
+  auto sink = [&output] ( const char * data, const size_t length )
+              { output.append( data, length ); };
+
+  for ( size_t i = 0; i < stored.size(); i += chunk_size ) {
+    decoder.append( stored.substr( i, chunk_size ), sink );
+  }
+
+  decoder.finish( sink );
+  return output;
+}
+
+/* what the encoder would upload */
+static string encode( const ObjectEncoder & encoder, const roost::path & source )
+{
+  const auto compressed = encoder.encode( source, ( gg::paths::scratch() / "compression-test" ).string() );
+  return roost::read_file( compressed ? roost::path( compressed->name() ) : source );
+}
+
+static string source_file( const size_t index )
+{
+  string source;
+
+  for ( size_t i = 0; i < 40; i++ ) {
+    source += "static int function_" + to_string( index * 40 + i )
+              + "( const struct request * request, size_t length )\n{\n"
+              + "  if ( request->length != " + to_string( i * 7 + index ) + " ) {\n"
+              + "    return -EINVAL;\n  }\n\n  return process( request, length );\n}\n\n";
+  }
+
+  return source;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    vector<roost::path> files;
+
+    CompressionOptions options;
+    options.enabled = true;
+    const ObjectEncoder encoder { options };
+
+    /* a compressible object is compressed, and comes back the same */
+    const string text = source_file( 0 );
+    files.push_back( scratch_file( "text", text ) );
+
+    const string stored_text = encode( encoder, files.back() );
+    check( stored_text.compare( 0, compression::MAGIC.size(), compression::MAGIC ) == 0,
+           "text was not compressed" );
+    check( stored_text.size() < text.size() / 2, "text did not shrink" );
+    check( decode( stored_text, stored_text.size() ) == text, "text round trip" );
+    check( decode( stored_text, 3 ) == text, "text round trip, in small pieces" );
+
+    /* small objects, and objects that don't compress, go as they are */
+    const string small = "int main() { return 0; }\n";
+    files.push_back( scratch_file( "small", small ) );
+    check( encode( encoder, files.back() ) == small, "small object was compressed" );
+    check( decode( small, 5 ) == small, "small object round trip" );
+
+    const string gzipped = "\x1f\x8b" + string( 4096, 'g' );
+    files.push_back( scratch_file( "gzipped", gzipped ) );
+    check( encode( encoder, files.back() ) == gzipped, "gzip data was compressed" );
+
+    check( decode( "", 1 ).empty(), "empty object round trip" );
+
+    /* with compression off, nothing is compressed but the objects that look
+       compressed, so that they can't be mistaken for one */
+    const ObjectEncoder disabled { CompressionOptions {} };
+    check( encode( disabled, files[ 0 ] ) == text, "compressed with compression off" );
+
+    const string impostor = compression::MAGIC + "not really compressed";
+    files.push_back( scratch_file( "impostor", impostor ) );
+    const string stored_impostor = encode( disabled, files.back() );
+    check( stored_impostor != impostor, "impostor was not compressed" );
+    check( decode( stored_impostor, 4 ) == impostor, "impostor round trip" );
+
+    /* a cut-short object is an error */
+    bool threw = false;
+    try {
+      decode( stored_text.substr( 0, stored_text.size() - 4 ), 1024 );
+    }
+    catch ( const runtime_error & ) {
+      threw = true;
+    }
+    check( threw, "truncated object was accepted" );
+
+    /* a dictionary is needed to decompress the objects it compressed */
+    vector<string> samples;
+    for ( size_t i = 1; i <= 200; i++ ) {
+      samples.push_back( source_file( i ) );
+    }
+
+    const string dictionary = compression::train_dictionary( samples, 16 * 1024 );
+    const ObjectEncoder dictionary_encoder { options, dictionary };
+
+    const string stored_with_dictionary = encode( dictionary_encoder, files[ 0 ] );
+    check( stored_with_dictionary.size() < stored_text.size(), "dictionary did not help" );
+
+    threw = false;
+    try {
+      decode( stored_with_dictionary, 1024 );
+    }
+    catch ( const runtime_error & ) {
+      threw = true;
+    }
+    check( threw, "object decompressed without its dictionary" );
+
+    compression::add_dictionary( dictionary );
+    check( decode( stored_with_dictionary, 7 ) == text, "dictionary round trip" );
+
+    /* the dictionary itself is never compressed */
+    files.push_back( scratch_file( "dictionary", dictionary ) );
+    check( encode( dictionary_encoder, files.back() ) == dictionary, "dictionary was compressed" );
+
+    for ( const roost::path & file : files ) {
+      roost::remove( file );
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* drives requests at a mock service that can only run a few of them at a
+   time, and throttles the rest with a 429, the way Lambda does */
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <deque>
+#include <stdexcept>
+
+#include "execution/concurrency_limiter.hh"
+#include "execution/loop.hh"
+#include "net/http_request_parser.hh"
+#include "net/http_response.hh"
+#include "util/exception.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static void check( const bool condition, const string & message )
+{
+  if ( not condition ) {
+    throw runtime_error( "concurrency limiter test failed: " + message );
+  }
+}
+
+class ThrottlingService
+{
+private:
+  struct HeldResponse
+  {
+    steady_clock::time_point due;
+    weak_ptr<TCPConnection> connection;
+    string response;
+  };
+
+  size_t capacity_;
+  milliseconds job_time_;
+  size_t running_ { 0 };
+  deque<HeldResponse> held_ {};
+
+  static string make_response( const HTTPRequest & request, const string & status )
+  {
+    HTTPResponse response;
+    response.set_request( request );
+    response.set_first_line( "HTTP/1.1 " + status );
+    response.add_header( HTTPHeader { "Content-Length", "0" } );
+    response.done_with_headers();
+    response.read_in_body( "" );
+    return response.str();
+  }
+
+public:
+  ThrottlingService( ExecutionLoop & loop, const Address & address,
+                     const size_t capacity, const milliseconds job_time )
+    : capacity_( capacity ), job_time_( job_time )
+  {
+    loop.make_listener( address,
+      [this] ( ExecutionLoop & loop, TCPSocket && socket )
+      {
+        auto request_parser = make_shared<HTTPRequestParser>();
+
+        loop.add_connection<TCPSocket>( move( socket ),
+          [this, request_parser] ( shared_ptr<TCPConnection> connection, string && data )
+          {
+            request_parser->parse( data );
+
+            while ( not request_parser->empty() ) {
+              const HTTPRequest & request = request_parser->front();
+
+              if ( running_ < capacity_ ) {
+                running_++;
+                held_.push_back( { steady_clock::now() + job_time_, connection,
+                                   make_response( request, "200 OK" ) } );
+              }
+              else {
+                connection->enqueue_write( make_response( request, "429 Too Many Requests" ) );
+              }
+
+              request_parser->pop();
+            }
+
+            return true;
+          } );
+
+        return true;
+      } );
+  }
+
+  /* sends the responses of the jobs that are done */
+  void finish_jobs()
+  {
+    const auto now = steady_clock::now();
+
+    while ( not held_.empty() and held_.front().due <= now ) {
+      if ( auto connection = held_.front().connection.lock() ) {
+        connection->enqueue_write( held_.front().response );
+      }
+
+      held_.pop_front();
+      running_--;
+    }
+  }
+};
+
+struct RunResult
+{
+  size_t throttled { 0 };
+  size_t final_limit { 0 };
+};
+
+static RunResult run( ExecutionLoop & loop, ThrottlingService & service,
+                      const Address & address, ConcurrencyLimiter & limiter,
+                      const size_t count )
+{
+  HTTPRequest request;
+  request.set_first_line( "GET / HTTP/1.1" );
+  request.add_header( HTTPHeader { "Host", "mock" } );
+  request.done_with_headers();
+  request.read_in_body( "" );
+
+  RunResult result;
+  size_t in_flight = 0;
+  size_t succeeded = 0;
+
+  while ( succeeded < count ) {
+    while ( in_flight < limiter.limit() and not limiter.backing_off() ) {
+      in_flight++;
+
+      loop.make_http_request<TCPConnection>( "mock", address, request,
+        [&] ( const uint64_t, const string &, const HTTPResponse & response )
+        {
+          in_flight--;
+
+          if ( response.status_code() == "200" ) {
+            succeeded++;
+            limiter.success();
+          }
+          else {
+            result.throttled++;
+            limiter.overload();
+          }
+        },
+        [] ( const uint64_t, const string & )
+        { throw runtime_error( "request failed" ); } );
+    }
+
+    loop.loop_once( 1 );
+    service.finish_jobs();
+  }
+
+  while ( in_flight > 0 ) {
+    loop.loop_once( 1 );
+    service.finish_jobs();
+  }
+
+  result.final_limit = limiter.limit();
+  return result;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    const size_t capacity = 8;
+    const size_t cap = 64;
+    const size_t count = 400;
+
+    ExecutionLoop loop;
+    const Address address { "127.0.0.1", 9979 };
+    ThrottlingService service { loop, address, capacity, 5ms };
+
+    ConcurrencyLimiter::Options options;
+    options.min_backoff = 2ms;
+    options.max_backoff = 50ms;
+
+    /* a limiter that can't shrink, like a fixed max_jobs */
+    ConcurrencyLimiter::Options fixed_options = options;
+    fixed_options.decrease = 0.999999;
+    fixed_options.min_backoff = fixed_options.max_backoff = 0ms;
+
+    ConcurrencyLimiter fixed { cap, fixed_options };
+    const RunResult fixed_result = run( loop, service, address, fixed, count );
+
+    ConcurrencyLimiter adaptive { cap, options };
+    const RunResult adaptive_result = run( loop, service, address, adaptive, count );
+
+    cout << "fixed:    " << fixed_result.throttled << " throttled, limit "
+         << fixed_result.final_limit << endl
+         << "adaptive: " << adaptive_result.throttled << " throttled, limit "
+         << adaptive_result.final_limit << endl;
+
+    check( adaptive_result.throttled * 4 < fixed_result.throttled,
+           "the adaptive limit didn't cut down on throttling" );
+    check( adaptive_result.final_limit <= 2 * capacity,
+           "the limit didn't come down to the service's capacity" );
+    check( adaptive_result.final_limit >= 1, "the limit is zero" );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* builds a synthetic layered DAG of thunks, loads it into an ExecutionGraph
+   and forces every thunk in it with a made-up output, reporting the time
+   both take and the memory the graph holds on to; then loads it again with
+   the GraphLoader's threads */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <cstdlib>
+#include <unordered_set>
+#include <thread>
+
+#include "thunk/graph.hh"
+#include "thunk/graph_loader.hh"
+#include "thunk/ggutils.hh"
+#include "thunk/thunk.hh"
+#include "thunk/thunk_writer.hh"
+#include "util/exception.hh"
+#include "util/path.hh"
+#include "util/temp_dir.hh"
+
+using namespace std;
+using namespace std::chrono;
+using namespace gg::thunk;
+
+void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [NODES] [WIDTH]" << endl;
+}
+
+/* the resident set size of this process, in MiB */
+static double rss_mib( const string & field = "VmRSS:" )
+{
+  ifstream status { "/proc/self/status" };
+  string line;
+
+  while ( getline( status, line ) ) {
+    if ( line.compare( 0, field.length(), field ) == 0 ) {
+      return stoul( line.substr( field.length() ) ) / 1024.0;
+    }
+  }
+
+  return 0;
+}
+
+static void report( const string & name, const size_t count,
+                    const steady_clock::duration & elapsed )
+{
+  const double seconds = duration<double>( elapsed ).count();
+
+  cout << setw( 12 ) << left << name
+       << setw( 10 ) << right << count << " thunks"
+       << setw( 10 ) << fixed << setprecision( 2 ) << seconds << " s"
+       << setw( 12 ) << setprecision( 0 ) << ( count / seconds ) << " thunks/s"
+       << setw( 10 ) << setprecision( 1 ) << rss_mib() << " MiB RSS" << endl;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc > 3 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const size_t nodes = ( argc > 1 ) ? stoul( argv[ 1 ] ) : 1000000;
+    const size_t width = min( nodes, ( argc > 2 ) ? stoul( argv[ 2 ] ) : 1000 );
+
+    if ( width == 0 ) {
+      throw runtime_error( "the graph needs at least one node" );
+    }
+
+    UniqueDirectory work_dir { "graph-benchmark" };
+    const roost::path gg_dir = roost::canonical( work_dir.name() );
+    setenv( "GG_DIR", gg_dir.string().c_str(), true );
+
+    /* every thunk in the first layer reads a value of its own; the rest of
+       them take the outputs of two thunks in the layer before */
+    const string function_hash = gg::hash::compute( "function", gg::ObjectType::Value );
+
+    vector<string> layer;
+    vector<string> previous_layer;
+    size_t created = 0;
+
+    const double rss_before = rss_mib();
+    const auto create_start = steady_clock::now();
+
+    while ( created < nodes ) {
+      previous_layer.swap( layer );
+      layer.clear();
+
+      for ( size_t i = 0; i < width and created < nodes; i++, created++ ) {
+        vector<Thunk::DataItem> data;
+
+        if ( previous_layer.empty() ) {
+          data.emplace_back( gg::hash::compute( to_string( i ), gg::ObjectType::Value ), "" );
+        }
+        else {
+          data.emplace_back( previous_layer[ i % previous_layer.size() ], "" );
+          data.emplace_back( previous_layer[ ( i + 1 ) % previous_layer.size() ], "" );
+        }
+
+        Thunk thunk { { function_hash, { "f", to_string( created ) }, {} },
+                      move( data ), { { function_hash, "" } }, { "out" } };
+
+        layer.push_back( ThunkWriter::write( thunk ) );
+      }
+    }
+
+    cout << "created " << created << " thunks in "
+         << ( created + width - 1 ) / width << " layers in "
+         << fixed << setprecision( 2 )
+         << duration<double>( steady_clock::now() - create_start ).count()
+         << " s" << endl;
+
+    ExecutionGraph graph;
+
+    /* the last layer is the only one that isn't referenced by anything */
+    const auto load_start = steady_clock::now();
+
+    for ( const string & target : layer ) {
+      graph.add_thunk( target );
+    }
+
+    report( "load", graph.size(), steady_clock::now() - load_start );
+    const double rss_loaded = rss_mib();
+
+    deque<string> ready;
+    unordered_set<string> seen;
+
+    for ( const string & target : layer ) {
+      for ( const string & hash : graph.order_one_dependencies( target ) ) {
+        if ( seen.insert( hash ).second ) {
+          ready.push_back( hash );
+        }
+      }
+    }
+
+    size_t forced = 0;
+    const auto force_start = steady_clock::now();
+
+    while ( not ready.empty() ) {
+      const string hash = move( ready.front() );
+      ready.pop_front();
+
+      vector<gg::ThunkOutput> outputs;
+      outputs.emplace_back( gg::hash::compute( hash, gg::ObjectType::Value ), "out" );
+
+      Optional<unordered_set<string>> next = graph.force_thunk( hash, move( outputs ) );
+
+      if ( not next.initialized() ) {
+        throw runtime_error( "thunk was not in the graph: " + hash );
+      }
+
+      forced++;
+
+      for ( const string & next_hash : *next ) {
+        if ( seen.insert( next_hash ).second ) {
+          ready.push_back( next_hash );
+        }
+      }
+    }
+
+    report( "force", forced, steady_clock::now() - force_start );
+
+    if ( forced != created or graph.size() != 0 ) {
+      throw runtime_error( "forced " + to_string( forced ) + " out of "
+                           + to_string( created ) + " thunks" );
+    }
+
+    cout << "graph held " << fixed << setprecision( 1 )
+         << ( rss_loaded - rss_before ) << " MiB after loading, peak RSS "
+         << rss_mib( "VmHWM:" ) << " MiB" << endl;
+
+    ExecutionGraph parallel_graph;
+    const auto parallel_start = steady_clock::now();
+
+    {
+      GraphLoader loader { layer };
+
+      while ( not loader.done() ) {
+        for ( GraphLoader::LoadedThunk & loaded : loader.take( true ) ) {
+          parallel_graph.stage_thunk( loaded.hash, move( loaded.thunk ) );
+        }
+      }
+
+      for ( const string & target : layer ) {
+        parallel_graph.add_thunk( target );
+      }
+    }
+
+    report( "load (" + to_string( max( 1u, thread::hardware_concurrency() ) ) + "x)",
+            parallel_graph.size(), steady_clock::now() - parallel_start );
+
+    if ( parallel_graph.size() != created ) {
+      throw runtime_error( "loaded " + to_string( parallel_graph.size() ) + " out of "
+                           + to_string( created ) + " thunks" );
+    }
+
+    roost::remove_directory( gg_dir );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* compares the streaming gg::hash::file_force against the old pipeline, which
+   read the whole file into memory and hashed it with Crypto++, and hashing a
+   directory of small files one by one against gg::hash::files */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <crypto++/sha.h>
+#include <crypto++/base64.h>
+
+#include "thunk/ggutils.hh"
+#include "util/digest.hh"
+#include "util/exception.hh"
+#include "util/path.hh"
+#include "util/temp_dir.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [FILE-SIZE-MB] [SMALL-FILES]" << endl;
+}
+
+static string old_file_hash( const roost::path & path )
+{
+  const string contents = roost::read_file( path );
+  string digest;
+
+  CryptoPP::SHA256 hash_function;
+  CryptoPP::StringSource s( contents, true,
+    new CryptoPP::HashFilter( hash_function,
+      new CryptoPP::Base64URLEncoder( new CryptoPP::StringSink( digest ), false ) ) );
+
+  for ( char & c : digest ) {
+    if ( c == '-' ) { c = '.'; }
+  }
+
+  char length[ 9 ];
+  snprintf( length, sizeof( length ), "%08x", static_cast<uint32_t>( contents.length() ) );
+
+  return "V" + digest + length;
+}
+
+static void report( const string & name, const size_t bytes,
+                    const function<void()> & operation )
+{
+  const auto start = steady_clock::now();
+  operation();
+  const double seconds = duration<double>( steady_clock::now() - start ).count();
+
+  cout << setw( 28 ) << left << name
+       << setw( 10 ) << right << fixed << setprecision( 1 )
+       << ( bytes / seconds / ( 1024 * 1024 ) ) << " MB/s" << endl;
+}
+
+static string random_data( mt19937_64 & generator, const size_t length )
+{
+  string data( length, '\0' );
+  uniform_int_distribution<int> pick { 0, 255 };
+
+  for ( char & c : data ) {
+    c = static_cast<char>( pick( generator ) );
+  }
+
+  return data;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc > 3 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const size_t file_size = ( ( argc >= 2 ) ? stoull( argv[ 1 ] ) : 256 ) * 1024 * 1024;
+    const size_t small_count = ( argc == 3 ) ? stoull( argv[ 2 ] ) : 2000;
+    const size_t small_size = 64 * 1024;
+
+    cout << "sha-256 implementation: " << digest::SHA256::implementation() << endl;
+
+    UniqueDirectory work_dir { "hash-benchmark" };
+    const roost::path directory { work_dir.name() };
+
+    mt19937_64 generator { 0 };
+
+    const roost::path large_file = directory / "large";
+    roost::atomic_create( random_data( generator, file_size ), large_file );
+
+    string old_hash, new_hash;
+
+    report( "large file: read + crypto++", file_size,
+      [&] { old_hash = old_file_hash( large_file ); } );
+
+    report( "large file: streaming", file_size,
+      [&] { new_hash = gg::hash::file_force( large_file ); } );
+
+    if ( old_hash != new_hash ) {
+      throw runtime_error( "hash mismatch: " + old_hash + " != " + new_hash );
+    }
+
+    vector<roost::path> small_files;
+
+    for ( size_t i = 0; i < small_count; i++ ) {
+      small_files.emplace_back( directory / ( "small-" + to_string( i ) ) );
+      roost::atomic_create( random_data( generator, small_size ), small_files.back() );
+    }
+
+    vector<string> sequential, parallel;
+
+    report( "small files: sequential", small_count * small_size,
+      [&]
+      {
+        for ( const auto & path : small_files ) {
+          sequential.emplace_back( gg::hash::file_force( path ) );
+        }
+      } );
+
+    report( "small files: parallel", small_count * small_size,
+      [&] { parallel = gg::hash::files( small_files, true ); } );
+
+    if ( sequential != parallel ) {
+      throw runtime_error( "parallel hashes differ from sequential hashes" );
+    }
+
+    roost::remove_directory( work_dir.name() );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <fcntl.h>
+
+#include "thunk/factory.hh"
+#include "thunk/ggutils.hh"
+#include "thunk/thunk.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/path.hh"
+#include "util/temp_dir.hh"
+
+using namespace std;
+using namespace gg;
+
+static void check( const bool condition, const string & message )
+{
+  if ( not condition ) {
+    throw runtime_error( "hash cache test failed: " + message );
+  }
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    UniqueDirectory work_dir { "hash-cache-test" };
+    const roost::path directory { work_dir.name() };
+
+    vector<roost::path> paths;
+
+    for ( size_t i = 0; i < 16; i++ ) {
+      paths.emplace_back( directory / ( "file-" + to_string( i ) ) );
+      roost::atomic_create( string( i * 100, 'a' + i ), paths.back() );
+    }
+
+    /* a batch agrees with hashing the files one by one */
+    const vector<string> hashes = gg::hash::files( paths );
+
+    for ( size_t i = 0; i < paths.size(); i++ ) {
+      check( hashes[ i ] == gg::hash::file_force( paths[ i ] ), "batch hash of " + paths[ i ].string() );
+      check( gg::hash::file( paths[ i ] ) == hashes[ i ], "cached hash of " + paths[ i ].string() );
+    }
+
+    check( roost::exists( paths::hash_cache_index() ), "no hash cache index" );
+
+    /* an entry is invalidated when its file changes in place */
+    {
+      FileDescriptor file { CheckSystemCall( "open", open( paths[ 3 ].string().c_str(),
+                                                           O_WRONLY | O_TRUNC ) ) };
+      file.write( "changed" );
+    }
+
+    check( gg::hash::file( paths[ 3 ] ) == gg::hash::compute( "changed", ObjectType::Value ),
+           "stale entry was used" );
+    check( gg::hash::files( paths )[ 3 ] == gg::hash::compute( "changed", ObjectType::Value ),
+           "stale entry was used in a batch" );
+
+    /* a value that happens to start like a thunk is still a value, in a
+       batch as much as on its own */
+    const roost::path lookalike = directory / "lookalike";
+    roost::atomic_create( thunk::MAGIC_NUMBER + "not really a thunk", lookalike );
+    check( gg::hash::type( gg::hash::files( { lookalike } ).front() ) == ObjectType::Thunk,
+           "type of a thunk lookalike" );
+
+    const ThunkFactory::Data single { lookalike.string() };
+    const ThunkFactory::Data batched = ThunkFactory::Data::from_files( { lookalike.string() } ).front();
+    check( single.type() == ObjectType::Value and
+           gg::hash::type( single.hash() ) == ObjectType::Value, "single value data" );
+    check( batched.type() == ObjectType::Value and batched.hash() == single.hash(),
+           "batched value data" );
+
+    roost::remove_directory( work_dir.name() );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* sends requests to a mock HTTP endpoint that runs on the same loop, once with
+   a new connection for every request, and once over the keep-alive pool, with
+   and without pipelining */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <functional>
+
+#include "execution/loop.hh"
+#include "net/http_request_parser.hh"
+#include "net/http_response.hh"
+#include "util/exception.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [REQUESTS] [CONCURRENCY] [PORT]" << endl;
+}
+
+static void start_mock_endpoint( ExecutionLoop & loop, const Address & address )
+{
+  loop.make_listener( address,
+    [] ( ExecutionLoop & loop, TCPSocket && socket )
+    {
+      auto request_parser = make_shared<HTTPRequestParser>();
+
+      loop.add_connection<TCPSocket>( move( socket ),
+        [request_parser] ( shared_ptr<TCPConnection> connection, string && data )
+        {
+          request_parser->parse( data );
+
+          while ( not request_parser->empty() ) {
+            HTTPResponse response;
+            response.set_request( request_parser->front() );
+            request_parser->pop();
+
+            response.set_first_line( "HTTP/1.1 200 OK" );
+            response.add_header( HTTPHeader { "Content-Length", "2" } );
+            response.done_with_headers();
+            response.read_in_body( "OK" );
+            connection->enqueue_write( response.str() );
+          }
+
+          return true;
+        } );
+
+      return true;
+    } );
+}
+
+static HTTPRequest make_request()
+{
+  HTTPRequest request;
+  request.set_first_line( "GET / HTTP/1.1" );
+  request.add_header( HTTPHeader { "Host", "mock" } );
+  request.done_with_headers();
+  request.read_in_body( "" );
+  return request;
+}
+
+/* keeps `concurrency` requests outstanding until `count` of them are done */
+static void run( ExecutionLoop & loop, const size_t count, const size_t concurrency,
+                 const function<void( const function<void()> & )> & send )
+{
+  size_t started = 0;
+  size_t finished = 0;
+
+  function<void()> on_done;
+  on_done =
+    [&]
+    {
+      finished++;
+
+      if ( started < count ) {
+        started++;
+        send( on_done );
+      }
+    };
+
+  for ( ; started < min( count, concurrency ); started++ ) {
+    send( on_done );
+  }
+
+  while ( finished < count ) {
+    loop.loop_once();
+  }
+}
+
+static void report( const string & name, const size_t count,
+                    const steady_clock::duration & elapsed,
+                    const ExecutionLoop::ConnectionPoolStats & before,
+                    const ExecutionLoop::ConnectionPoolStats & after )
+{
+  const double seconds = duration<double>( elapsed ).count();
+
+  cout << setw( 20 ) << left << name
+       << setw( 10 ) << right << fixed << setprecision( 0 )
+       << ( count / seconds ) << " req/s"
+       << setw( 8 ) << ( after.connections_opened - before.connections_opened )
+       << " connections"
+       << setw( 8 ) << ( after.handshakes_avoided - before.handshakes_avoided )
+       << " handshakes avoided" << endl;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc > 4 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const size_t count = ( argc > 1 ) ? stoul( argv[ 1 ] ) : 20000;
+    const size_t concurrency = ( argc > 2 ) ? stoul( argv[ 2 ] ) : 64;
+    const uint16_t port = ( argc > 3 ) ? stoul( argv[ 3 ] ) : 9977;
+
+    /* a second endpoint, so that the pipelined pool starts out empty */
+    const Address address { "127.0.0.1", port };
+    const Address pipelined_address { "127.0.0.1", static_cast<uint16_t>( port + 1 ) };
+    const HTTPRequest request = make_request();
+
+    ExecutionLoop loop;
+    start_mock_endpoint( loop, address );
+    start_mock_endpoint( loop, pipelined_address );
+
+    auto failure = [] ( const uint64_t, const string & )
+    { throw runtime_error( "request failed" ); };
+
+    auto measure =
+      [&] ( const string & name, const function<void( const function<void()> & )> & send )
+      {
+        const auto before = loop.pool_stats();
+        const auto start = steady_clock::now();
+        run( loop, count, concurrency, send );
+        report( name, count, steady_clock::now() - start, before, loop.pool_stats() );
+      };
+
+    measure( "new connections",
+      [&] ( const function<void()> & done )
+      {
+        loop.make_http_request<TCPConnection>( "bench", address, request,
+          [done] ( const uint64_t, const string &, const HTTPResponse & ) { done(); },
+          failure );
+      } );
+
+    ExecutionLoop::ConnectionPoolOptions options;
+    options.max_connections = concurrency;
+    loop.set_pool_options<TCPConnection>( address, options );
+
+    auto send_pooled =
+      [&] ( const Address & endpoint )
+      {
+        return [&loop, &request, &failure, endpoint] ( const function<void()> & done )
+        {
+          loop.make_pooled_http_request<TCPConnection>( "bench", endpoint, request,
+            [done] ( const uint64_t, const string &, const HTTPResponse & ) { done(); },
+            failure );
+        };
+      };
+
+    measure( "keep-alive", send_pooled( address ) );
+
+    options.max_connections = max<size_t>( 1, concurrency / 8 );
+    options.pipeline_depth = 8;
+    loop.set_pool_options<TCPConnection>( pipelined_address, options );
+
+    measure( "keep-alive, depth 8", send_pooled( pipelined_address ) );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* runs a batch of tiny thunks on the local engine, once starting a gg-execute
+   for every thunk and once on a pool of gg-execute workers, and reports the
+   thunks per second of each. gg-execute has to be on the PATH. */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include "execution/engine_local.hh"
+#include "execution/loop.hh"
+#include "thunk/blob_store.hh"
+#include "thunk/ggutils.hh"
+#include "thunk/thunk.hh"
+#include "thunk/thunk_writer.hh"
+#include "util/exception.hh"
+#include "util/path.hh"
+#include "util/temp_dir.hh"
+
+using namespace std;
+using namespace std::chrono;
+using namespace gg::thunk;
+
+void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [THUNKS] [JOBS] [WORKERS]" << endl;
+}
+
+static vector<Thunk> make_thunks( const string & name, const size_t count )
+{
+  const string function = "#!/bin/sh\necho \"$1\" > out\n";
+  const string function_hash = gg::hash::compute( function, gg::ObjectType::Value );
+  gg::blobs::insert( function_hash, function, true );
+
+  vector<Thunk> thunks;
+
+  for ( size_t i = 0; i < count; i++ ) {
+    Thunk thunk { { function_hash, { "f", name + to_string( i ) }, {} },
+                  {}, { { function_hash, "" } }, { "out" } };
+    ThunkWriter::write( thunk );
+    thunks.push_back( move( thunk ) );
+  }
+
+  return thunks;
+}
+
+static void run( const string & name, const size_t count, const size_t jobs,
+                 const size_t workers )
+{
+  const vector<Thunk> thunks = make_thunks( name, count );
+
+  ExecutionLoop loop;
+  LocalExecutionEngine engine { false, jobs, workers };
+  size_t finished = 0;
+
+  engine.set_success_callback(
+    [&finished] ( const string &, vector<gg::ThunkOutput> &&, const float )
+    { finished++; } );
+
+  engine.set_failure_callback(
+    [] ( const string & hash, const JobStatus )
+    { throw runtime_error( "execution failed: " + hash ); } );
+
+  const auto start = steady_clock::now();
+  engine.init( loop );
+  size_t next = 0;
+
+  while ( finished < count ) {
+    while ( next < count and engine.job_count() < jobs ) {
+      engine.force_thunk( thunks[ next++ ], loop );
+    }
+
+    loop.loop_once( -1 );
+  }
+
+  const double seconds = duration<double>( steady_clock::now() - start ).count();
+
+  cout << setw( 12 ) << left << name
+       << setw( 8 ) << right << count << " thunks"
+       << setw( 10 ) << fixed << setprecision( 2 ) << seconds << " s"
+       << setw( 10 ) << setprecision( 0 ) << ( count / seconds ) << " thunks/s" << endl;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc > 4 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const size_t count = ( argc > 1 ) ? stoul( argv[ 1 ] ) : 2000;
+    const size_t jobs = ( argc > 2 ) ? stoul( argv[ 2 ] )
+                                     : max( 1u, thread::hardware_concurrency() );
+    const size_t workers = ( argc > 3 ) ? stoul( argv[ 3 ] )
+      : ( jobs + LocalExecutionEngine::JOBS_PER_WORKER - 1 ) / LocalExecutionEngine::JOBS_PER_WORKER;
+
+    if ( count == 0 or jobs == 0 or workers == 0 ) {
+      throw runtime_error( "thunks, jobs and workers must be positive" );
+    }
+
+    UniqueDirectory work_dir { "/tmp/local-engine-benchmark" };
+    const roost::path gg_dir = roost::canonical( work_dir.name() );
+    setenv( "GG_DIR", gg_dir.string().c_str(), true );
+
+    run( "fork/exec", count, jobs, 0 );
+    run( "pool", count, jobs, workers );
+
+    roost::remove_directory( gg_dir );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
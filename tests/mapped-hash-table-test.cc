@@ -0,0 +1,163 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "util/exception.hh"
+#include "util/mapped_hash_table.hh"
+#include "util/temp_file.hh"
+
+using namespace std;
+
+static void check( const bool condition, const string & message )
+{
+  if ( not condition ) {
+    throw runtime_error( "mapped hash table test failed: " + message );
+  }
+}
+
+static string key_for( const size_t writer, const size_t i )
+{
+  return "key-" + to_string( writer ) + "-" + to_string( i );
+}
+
+static string value_for( const size_t writer, const size_t i )
+{
+  return "value-" + to_string( i * 31 + writer );
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    TempFile table_file { "table" };
+
+    {
+      /* a few buckets, so that the chains get long */
+      MappedHashTable table { table_file.name(), 7 };
+
+      check( not table.get( "missing" ).initialized(), "lookup in an empty table" );
+
+      table.put( "key", "value" );
+      check( *table.get( "key" ) == "value", "simple lookup" );
+
+      table.put( "key", "newer value" );
+      check( *table.get( "key" ) == "newer value", "newer value hides the older one" );
+
+      table.put( "", "" );
+      check( table.get( "" ).initialized() and table.get( "" )->empty(), "empty key" );
+
+      table.set_flags( 0x5 );
+    }
+
+    {
+      /* the entries are still there after reopening the table */
+      MappedHashTable table { table_file.name() };
+      check( *table.get( "key" ) == "newer value", "lookup after reopening" );
+      check( table.flags() == 0x5, "flags after reopening" );
+
+      table.clear();
+      check( not table.get( "key" ).initialized(), "lookup after clear" );
+      check( table.size() == 0, "size after clear" );
+    }
+
+    {
+      /* the chains get too long, and the table is rebuilt with more buckets */
+      TempFile growing_table_file { "growing-table" };
+      MappedHashTable table { growing_table_file.name(), 7 };
+
+      for ( size_t i = 0; i < 1000; i++ ) {
+        check( table.put( key_for( 0, i ), value_for( 0, i ) ), "insert into a growing table" );
+      }
+
+      MappedHashTable reopened_table { growing_table_file.name() };
+
+      for ( size_t i = 0; i < 1000; i++ ) {
+        check( *table.get( key_for( 0, i ) ) == value_for( 0, i ), "lookup after rehashing" );
+        check( *reopened_table.get( key_for( 0, i ) ) == value_for( 0, i ),
+               "lookup in another copy after rehashing" );
+      }
+    }
+
+    {
+      /* a table that can't grow beyond 1 MiB */
+      TempFile small_table_file { "small-table" };
+      MappedHashTable table { small_table_file.name(), 64, 1 << 20 };
+      const string padding( 1024, 'x' );
+
+      /* the older values are compacted away */
+      for ( size_t round = 0; round < 100; round++ ) {
+        for ( size_t i = 0; i < 100; i++ ) {
+          check( table.put( key_for( 0, i ), padding + to_string( round ) ),
+                 "overwriting in a small table" );
+        }
+      }
+
+      check( *table.get( key_for( 0, 42 ) ) == padding + "99", "lookup after compaction" );
+
+      /* once it's full, new entries are dropped */
+      size_t stored = 0;
+      while ( table.put( key_for( 1, stored ), padding ) ) {
+        stored++;
+        check( stored < 2000, "a full table keeps taking entries" );
+      }
+
+      check( not table.get( key_for( 1, stored ) ).initialized(), "a dropped entry" );
+      check( *table.get( key_for( 1, 0 ) ) == padding, "lookup in a full table" );
+      check( *table.get( key_for( 0, 42 ) ) == padding + "99", "older lookup in a full table" );
+    }
+
+    /* many processes inserting at the same time into a new table, with few
+       enough buckets that it's rebuilt along the way */
+    TempFile shared_table_file { "shared-table" };
+    constexpr size_t WRITERS = 4;
+    constexpr size_t ENTRIES = 20000;
+
+    vector<pid_t> writers;
+
+    for ( size_t writer = 0; writer < WRITERS; writer++ ) {
+      const pid_t pid = CheckSystemCall( "fork", fork() );
+
+      if ( pid == 0 ) {
+        MappedHashTable table { shared_table_file.name(), 64 };
+
+        for ( size_t i = 0; i < ENTRIES; i++ ) {
+          table.put( key_for( writer, i ), value_for( writer, i ) );
+        }
+
+        _exit( EXIT_SUCCESS );
+      }
+
+      writers.push_back( pid );
+    }
+
+    for ( const pid_t pid : writers ) {
+      int status;
+      CheckSystemCall( "waitpid", waitpid( pid, &status, 0 ) );
+      check( WIFEXITED( status ) and WEXITSTATUS( status ) == 0, "writer process failed" );
+    }
+
+    MappedHashTable table { shared_table_file.name() };
+    check( table.size() == WRITERS * ENTRIES, "size after concurrent inserts" );
+
+    for ( size_t writer = 0; writer < WRITERS; writer++ ) {
+      for ( size_t i = 0; i < ENTRIES; i++ ) {
+        const Optional<string> value = table.get( key_for( writer, i ) );
+        check( value.initialized() and *value == value_for( writer, i ),
+               "lookup after concurrent inserts" );
+      }
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* breaks down what gg-execute spends around running a thunk, per phase: the
+   old way, with the thunk's directory under /tmp and its outputs hashed
+   through the hash cache and then moved, against the scratch root
+   (GG_SCRATCH_DIR) and BlobStore::capture_file. the thunk itself is a write
+   of its output. */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include "thunk/blob_store.hh"
+#include "thunk/ggutils.hh"
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/path.hh"
+#include "util/temp_dir.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [THUNKS=500] [OUTPUT-KB=256] [OLD-TEMP-ROOT=/tmp]" << endl;
+}
+
+static constexpr size_t LINK_COUNT = 8;
+
+struct Phases
+{
+  double prepare { 0 };
+  double store_outputs { 0 };
+  double cleanup { 0 };
+};
+
+static Phases run( const string & temp_root, const bool old_way,
+                   const size_t count, const string & output,
+                   const vector<string> & inputs )
+{
+  Phases phases;
+  auto last = steady_clock::now();
+
+  auto lap =
+    [&last] ( double & phase )
+    {
+      const auto now = steady_clock::now();
+      phase += duration<double, micro>( now - last ).count();
+      last = now;
+    };
+
+  for ( size_t i = 0; i < count; i++ ) {
+    last = steady_clock::now();
+
+    {
+      TempDirectory exec_dir { temp_root + "/thunk-execute" };
+      const roost::path exec_dir_path { exec_dir.name() };
+
+      for ( size_t j = 0; j < inputs.size(); j++ ) {
+        roost::symlink( gg::blobs::path( inputs[ j ] ), exec_dir_path / ( "in" + to_string( j ) ) );
+      }
+
+      lap( phases.prepare );
+
+      /* the thunk; every output is different, as they would be */
+      const roost::path outfile = exec_dir_path / "out";
+      roost::atomic_create( to_string( i ) + ( old_way ? "old" : "new" ) + output, outfile );
+      last = steady_clock::now();
+
+      if ( old_way ) {
+        BlobStore::local().move_file( outfile, gg::hash::file( outfile ) );
+      }
+      else {
+        BlobStore::local().capture_file( outfile );
+      }
+
+      lap( phases.store_outputs );
+
+      for ( size_t j = 0; j < inputs.size(); j++ ) {
+        roost::remove( exec_dir_path / ( "in" + to_string( j ) ) );
+      }
+    }
+
+    lap( phases.cleanup );
+  }
+
+  phases.prepare /= count;
+  phases.store_outputs /= count;
+  phases.cleanup /= count;
+  return phases;
+}
+
+static void print( const string & name, const Phases & phases )
+{
+  cout << setw( 34 ) << left << name << fixed << setprecision( 1 ) << right
+       << setw( 10 ) << phases.prepare
+       << setw( 10 ) << phases.store_outputs
+       << setw( 10 ) << phases.cleanup
+       << setw( 10 ) << ( phases.prepare + phases.store_outputs + phases.cleanup ) << endl;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc > 4 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const size_t count = ( argc > 1 ) ? stoul( argv[ 1 ] ) : 500;
+    const size_t output_size = ( ( argc > 2 ) ? stoul( argv[ 2 ] ) : 256 ) * 1024;
+    const string old_root = ( argc > 3 ) ? argv[ 3 ] : "/tmp";
+
+    if ( count == 0 ) {
+      throw runtime_error( "the number of thunks must be positive" );
+    }
+
+    UniqueDirectory work_dir { "/tmp/output-capture-benchmark" };
+    const roost::path gg_dir = roost::canonical( work_dir.name() );
+    setenv( "GG_DIR", gg_dir.string().c_str(), true );
+
+    vector<string> inputs;
+    for ( size_t i = 0; i < LINK_COUNT; i++ ) {
+      const string input = "input " + to_string( i ) + string( 100 * 1024, 'i' );
+      inputs.push_back( gg::hash::compute( input, gg::ObjectType::Value ) );
+      gg::blobs::insert( inputs.back(), input );
+    }
+
+    const string output( output_size, 'o' );
+
+    cout << count << " thunks, " << LINK_COUNT << " links, one "
+         << ( output_size / 1024 ) << " KiB output each (us/thunk)" << endl
+         << setw( 34 ) << left << "" << right
+         << setw( 10 ) << "prepare" << setw( 10 ) << "store" << setw( 10 ) << "cleanup"
+         << setw( 10 ) << "total" << endl;
+
+    print( "before: " + old_root + ", hash cache",
+           run( old_root, true, count, output, inputs ) );
+    print( "after: scratch root",
+           run( gg::paths::scratch().string(), false, count, output, inputs ) );
+
+    roost::remove_directory( gg_dir );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
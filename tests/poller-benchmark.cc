@@ -0,0 +1,119 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* measures the latency of one Poller iteration against the number of open
+   connections, when only one of them is ready. every connection is a pipe
+   with a reader and, in the second run, an idle writer whose when_interested()
+   is asked every time, like ExecutionLoop's connections with an empty write
+   buffer. */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <sys/resource.h>
+
+#include "util/exception.hh"
+#include "util/pipe.hh"
+#include "util/poller.hh"
+
+using namespace std;
+using namespace std::chrono;
+using namespace PollerShortNames;
+
+void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [MAX-CONNECTIONS=8192] [ITERATIONS=20000]" << endl;
+}
+
+static void run( const size_t connection_count, const size_t iterations,
+                 const bool writers )
+{
+  vector<pair<FileDescriptor, FileDescriptor>> pipes;
+  pipes.reserve( connection_count );
+
+  Poller poller;
+  size_t reads = 0;
+
+  for ( size_t i = 0; i < connection_count; i++ ) {
+    pipes.emplace_back( make_pipe() );
+    FileDescriptor & reader = pipes.back().first;
+    FileDescriptor & writer = pipes.back().second;
+
+    poller.add_action( Poller::Action( reader, Direction::In,
+      [&reader, &reads] () { reader.read(); reads++; return ResultType::Continue; } ) );
+
+    if ( not writers ) {
+      continue;
+    }
+
+    poller.add_action( Poller::Action( writer, Direction::Out,
+      [] () { return ResultType::Continue; },
+      [] () { return false; } ) );
+  }
+
+  /* the first iteration registers the actions */
+  FileDescriptor & active = pipes.front().second;
+  active.write( "x" );
+  poller.poll( -1 );
+
+  const auto start = steady_clock::now();
+
+  for ( size_t i = 0; i < iterations; i++ ) {
+    active.write( "x" );
+
+    if ( poller.poll( -1 ).result != Poller::Result::Type::Success ) {
+      throw runtime_error( "unexpected poll result" );
+    }
+  }
+
+  const double elapsed = duration<double, micro>( steady_clock::now() - start ).count();
+
+  if ( reads != iterations + 1 ) {
+    throw runtime_error( "missed a readable connection" );
+  }
+
+  cout << setw( 8 ) << right << connection_count << " connections"
+       << setw( 10 ) << fixed << setprecision( 2 ) << ( elapsed / iterations )
+       << " us/iteration" << ( writers ? " (with idle writers)" : "" ) << endl;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc > 3 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const size_t max_connections = ( argc > 1 ) ? stoul( argv[ 1 ] ) : 8192;
+    const size_t iterations = ( argc > 2 ) ? stoul( argv[ 2 ] ) : 20000;
+
+    /* two descriptors per connection */
+    rlimit limit;
+    CheckSystemCall( "getrlimit", getrlimit( RLIMIT_NOFILE, &limit ) );
+    limit.rlim_cur = limit.rlim_max;
+    CheckSystemCall( "setrlimit", setrlimit( RLIMIT_NOFILE, &limit ) );
+
+    for ( size_t count = 1; count <= max_connections; count *= 8 ) {
+      if ( 2 * count + 16 > limit.rlim_cur ) {
+        cerr << "skipping " << count << " connections: too many open files" << endl;
+        break;
+      }
+
+      run( count, iterations, false );
+      run( count, iterations, true );
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
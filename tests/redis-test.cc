@@ -0,0 +1,297 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "net/redis.hh"
+#include "net/resp.hh"
+#include "net/socket.hh"
+#include "util/exception.hh"
+#include "util/path.hh"
+#include "util/poller.hh"
+#include "util/temp_dir.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+static const string PASSWORD = "hunter2";
+
+static void check( const bool condition, const string & message )
+{
+  if ( not condition ) {
+    throw runtime_error( "redis test failed: " + message );
+  }
+}
+
+static string bulk( const string & str )
+{
+  return "$" + to_string( str.length() ) + "\r\n" + str + "\r\n";
+}
+
+/* just enough of a Redis server for the client, with the same parser
+   reading the commands (which are arrays of bulk strings) */
+class FakeServer
+{
+private:
+  struct Client
+  {
+    TCPSocket socket;
+    RESPParser parser {};
+    vector<string> arguments {};
+    string output {};
+    bool authenticated { false };
+
+    Client( TCPSocket && socket ) : socket( move( socket ) ) {}
+  };
+
+  map<string, string> store_ {};
+
+  string execute( Client & client )
+  {
+    const vector<string> & args = client.arguments;
+    const string & name = args.at( 0 );
+
+    if ( name == "AUTH" ) {
+      client.authenticated = ( args.back() == PASSWORD );
+      return client.authenticated ? "+OK\r\n" : "-WRONGPASS invalid password\r\n";
+    }
+    else if ( not client.authenticated ) {
+      return "-NOAUTH Authentication required.\r\n";
+    }
+    else if ( name == "SET" ) {
+      store_[ args.at( 1 ) ] = args.at( 2 );
+      return "+OK\r\n";
+    }
+    else if ( name == "EXISTS" ) {
+      return ":" + to_string( store_.count( args.at( 1 ) ) ) + "\r\n";
+    }
+    else if ( name == "GET" or name == "MGET" ) {
+      string reply = ( name == "MGET" ) ? "*" + to_string( args.size() - 1 ) + "\r\n" : "";
+
+      for ( size_t i = 1; i < args.size(); i++ ) {
+        reply += store_.count( args[ i ] ) ? bulk( store_.at( args[ i ] ) ) : "$-1\r\n";
+      }
+
+      return reply;
+    }
+
+    return "-ERR unknown command\r\n";
+  }
+
+  void expect_command( const shared_ptr<Client> & client )
+  {
+    RESPParser::Handler handler;
+    Client * const c = client.get();
+
+    handler.data = [c] ( const size_t index, const char * data, const size_t length )
+                   {
+                     c->arguments.resize( max( c->arguments.size(), index + 1 ) );
+                     c->arguments[ index ].append( data, length );
+                   };
+
+    handler.bulk_done = [c] ( const size_t index, const bool )
+                        { c->arguments.resize( max( c->arguments.size(), index + 1 ) ); };
+
+    handler.done = [this, client] ( const RESPParser::Reply & )
+                   {
+                     client->output += execute( *client );
+                     client->arguments.clear();
+                     expect_command( client );
+                   };
+
+    client->parser.new_command( move( handler ) );
+  }
+
+public:
+  void run( TCPSocket & listener )
+  {
+    Poller poller;
+
+    poller.add_action( Poller::Action( listener, Direction::In,
+      [&] ()
+      {
+        auto client = make_shared<Client>( listener.accept() );
+        expect_command( client );
+
+        poller.add_action( Poller::Action( client->socket, Direction::In,
+          [client] ()
+          {
+            const string data = client->socket.read();
+
+            if ( data.empty() ) {
+              return ResultType::CancelAll;
+            }
+
+            client->parser.parse( data );
+            return ResultType::Continue;
+          } ) );
+
+        poller.add_action( Poller::Action( client->socket, Direction::Out,
+          [client] ()
+          {
+            client->output.erase( 0, client->socket.write( client->output, false )
+                                     - client->output.cbegin() );
+            return ResultType::Continue;
+          },
+          [client] { return not client->output.empty(); } ) );
+
+        return ResultType::Continue;
+      } ) );
+
+    while ( true ) {
+      poller.poll( -1 );
+    }
+  }
+};
+
+static storage::PutRequest put_request( const roost::path & directory,
+                                        const string & key, const string & contents )
+{
+  roost::atomic_create( contents, directory / key );
+  return { directory / key, key };
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    TCPSocket listener;
+    listener.set_reuseaddr();
+    listener.bind( { "127.0.0.1", 0 } );
+    listener.listen();
+    const uint16_t port = listener.local_address().port();
+
+    const pid_t server_pid = CheckSystemCall( "fork", fork() );
+
+    if ( server_pid == 0 ) {
+      FakeServer {}.run( listener );
+      _exit( EXIT_FAILURE );
+    }
+
+    listener.close();
+
+    RedisClientConfig config;
+    config.ip = "127.0.0.1";
+    config.port = port;
+    config.password = PASSWORD;
+
+    /* small enough that the commands queue up, spread over the pool, and
+       share MGETs */
+    config.max_connections = 2;
+    config.max_pipeline_depth = 4;
+    config.max_batch_size = 3;
+
+    TempDirectory up_dir { "redis-test-up" };
+    TempDirectory down_dir { "redis-test-down" };
+    const roost::path up { up_dir.name() };
+    const roost::path down { down_dir.name() };
+
+    /* a large value, with line breaks in it, and an empty one */
+    string large;
+    for ( size_t i = 0; large.length() < 3 * 1024 * 1024; i++ ) {
+      large += to_string( i * 2654435761u ) + ( i % 7 ? "\r\n" : "$*\n" );
+    }
+
+    vector<storage::PutRequest> puts;
+    map<string, string> contents;
+
+    for ( size_t i = 0; i < 20; i++ ) {
+      const string key = "object-" + to_string( i );
+      contents[ key ] = ( i == 5 ) ? large : ( i == 6 ) ? "" : "value of " + key;
+      puts.push_back( put_request( up, key, contents[ key ] ) );
+    }
+
+    size_t uploaded = 0;
+    Redis { config }.upload_files( puts, [&] ( const storage::PutRequest & ) { uploaded++; } );
+    check( uploaded == puts.size(), "not every upload was reported" );
+
+    const vector<bool> found = Redis { config }.lookup_files( { "object-3", "missing", "object-5" } );
+    check( found == vector<bool> { true, false, true }, "lookup" );
+
+    vector<storage::GetRequest> gets;
+    for ( const auto & entry : contents ) {
+      gets.emplace_back( entry.first, down / entry.first );
+    }
+
+    Redis { config }.download_files( gets );
+
+    for ( const auto & entry : contents ) {
+      check( roost::read_file( down / entry.first ) == entry.second,
+             "download of " + entry.first );
+    }
+
+    /* a missing object fails on its own, in the middle of an MGET */
+    bool threw = false;
+    try {
+      Redis { config }.download_files( { { "object-1", down / "again-1" },
+                                         { "missing", down / "missing" },
+                                         { "object-2", down / "again-2" } } );
+    }
+    catch ( const runtime_error & ) {
+      threw = true;
+    }
+
+    check( threw and not roost::exists( down / "missing" ), "download of a missing object" );
+    check( roost::exists( down / "again-2" ), "download after a missing object" );
+
+    /* the commands behind a failed AUTH fail too */
+    RedisClientConfig wrong_password = config;
+    wrong_password.password = "hunter3";
+
+    threw = false;
+    try {
+      Redis { wrong_password }.upload_files( puts );
+    }
+    catch ( const runtime_error & ) {
+      threw = true;
+    }
+
+    check( threw, "upload with the wrong password" );
+
+    /* on someone else's poller, the client only moves when it's polled */
+    Poller poller;
+    size_t downloaded = 0;
+
+    {
+      Redis client { config, poller };
+      gets.clear();
+
+      for ( size_t i = 0; i < 7; i++ ) {
+        const string key = "object-" + to_string( i );
+        gets.emplace_back( key, down / ( "async-" + key ) );
+      }
+
+      client.get( gets, [&downloaded] ( const storage::GetRequest & ) { downloaded++; },
+                  [] ( const string & object_key, const string & error )
+                  { throw runtime_error( "async download of " + object_key + ": " + error ); } );
+
+      while ( client.pending() ) {
+        poller.poll( 10 * 1000 );
+      }
+    }
+
+    check( downloaded == gets.size(), "async download" );
+    check( roost::read_file( down / "async-object-5" ) == large, "async download of a large object" );
+
+    kill( server_pid, SIGKILL );
+    CheckSystemCall( "waitpid", waitpid( server_pid, nullptr, 0 ) );
+
+    roost::empty_directory( up );
+    roost::empty_directory( down );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
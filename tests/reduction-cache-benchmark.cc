@@ -0,0 +1,144 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* compares the single-file reduction index against the old layout, where
+   each reduction was a small file under .gg/reductions */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <fcntl.h>
+
+#include "util/exception.hh"
+#include "util/file_descriptor.hh"
+#include "util/mapped_hash_table.hh"
+#include "util/path.hh"
+#include "util/temp_dir.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [ENTRIES]" << endl;
+}
+
+static string random_hash( mt19937_64 & generator, const char type )
+{
+  static const string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                 "abcdefghijklmnopqrstuvwxyz0123456789_.";
+
+  string hash( 1, type );
+  uniform_int_distribution<size_t> pick { 0, alphabet.length() - 1 };
+
+  for ( size_t i = 0; i < 43; i++ ) {
+    hash += alphabet[ pick( generator ) ];
+  }
+
+  return hash + "0000abcd";
+}
+
+static void report( const string & name, const size_t count,
+                    const function<void()> & operation )
+{
+  const auto start = steady_clock::now();
+  operation();
+  const double seconds = duration<double>( steady_clock::now() - start ).count();
+
+  cout << setw( 28 ) << left << name
+       << setw( 12 ) << right << fixed << setprecision( 0 ) << ( count / seconds )
+       << " ops/s" << endl;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc > 2 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const size_t count = ( argc == 2 ) ? stoull( argv[ 1 ] ) : 100000;
+
+    mt19937_64 generator { 0 };
+    vector<pair<string, string>> entries;
+
+    for ( size_t i = 0; i < count; i++ ) {
+      entries.emplace_back( random_hash( generator, 'T' ), random_hash( generator, 'V' ) );
+    }
+
+    UniqueDirectory work_dir { "reduction-cache-benchmark" };
+    const roost::path directory { work_dir.name() + "/reductions" };
+    roost::create_directories( directory );
+
+    size_t hits = 0;
+
+    report( "files: insert", count,
+      [&]
+      {
+        for ( const auto & entry : entries ) {
+          roost::atomic_create( entry.second, directory / entry.first );
+        }
+      } );
+
+    report( "files: lookup", count,
+      [&]
+      {
+        for ( const auto & entry : entries ) {
+          const roost::path reduction = directory / entry.first;
+
+          if ( roost::exists( reduction ) ) {
+            FileDescriptor file { CheckSystemCall( "open", open( reduction.string().c_str(), O_RDONLY ) ) };
+            hits += file.read_exactly( entry.second.length() ).length() > 0;
+          }
+        }
+      } );
+
+    roost::empty_directory( directory );
+
+    MappedHashTable table { directory / "index" };
+
+    report( "mapped table: insert", count,
+      [&]
+      {
+        for ( const auto & entry : entries ) {
+          table.put( entry.first, entry.second );
+        }
+      } );
+
+    report( "mapped table: lookup", count,
+      [&]
+      {
+        for ( const auto & entry : entries ) {
+          hits += table.get( entry.first ).initialized();
+        }
+      } );
+
+    report( "mapped table: miss", count,
+      [&]
+      {
+        for ( const auto & entry : entries ) {
+          hits += table.get( entry.second ).initialized();
+        }
+      } );
+
+    roost::remove_directory( work_dir.name() );
+
+    if ( hits != 2 * count ) {
+      throw runtime_error( "lookups failed" );
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "execution/engine.hh"
+#include "execution/loop.hh"
+#include "execution/reductor.hh"
+#include "thunk/blob_store.hh"
+#include "thunk/ggutils.hh"
+#include "thunk/thunk.hh"
+#include "thunk/thunk_writer.hh"
+#include "util/exception.hh"
+#include "util/pipe.hh"
+
+using namespace std;
+using namespace gg;
+using namespace gg::thunk;
+using namespace PollerShortNames;
+
+static void check( const bool condition, const string & message )
+{
+  if ( not condition ) {
+    throw runtime_error( "reductor test failed: " + message );
+  }
+}
+
+/* finishes every job it's given on the next turn of the loop, and then
+   reports a failure for it, as a duplicate of the job that ran somewhere
+   else and failed would */
+class ScriptedEngine : public ExecutionEngine
+{
+private:
+  pair<FileDescriptor, FileDescriptor> wakeup_ { make_pipe() };
+  vector<string> pending_ {};
+
+  unordered_map<string, size_t> & runs_;
+  string & last_output_;
+
+  void finish_jobs()
+  {
+    const vector<string> jobs = move( pending_ );
+    pending_.clear();
+
+    for ( const string & hash : jobs ) {
+      const string output_hash = gg::hash::compute( "output of " + hash, ObjectType::Value );
+      last_output_ = output_hash;
+      runs_[ hash ]++;
+
+      gg::cache::insert( gg::hash::for_output( hash, "out" ), output_hash );
+      gg::cache::insert( hash, output_hash );
+
+      vector<ThunkOutput> outputs;
+      outputs.emplace_back( output_hash, "out" );
+      success_callback_( hash, move( outputs ), 0 );
+
+      failure_callback_( hash, JobStatus::OperationalFailure );
+    }
+  }
+
+public:
+  ScriptedEngine( unordered_map<string, size_t> & runs, string & last_output )
+    : ExecutionEngine( 4 ), runs_( runs ), last_output_( last_output )
+  {}
+
+  void init( ExecutionLoop & loop ) override
+  {
+    loop.poller().add_action( Poller::Action( wakeup_.first, Direction::In,
+      [this] ()
+      {
+        wakeup_.first.read();
+        finish_jobs();
+        return ResultType::Continue;
+      } ) );
+  }
+
+  void force_thunk( const Thunk & thunk, ExecutionLoop & ) override
+  {
+    pending_.push_back( thunk.hash() );
+    wakeup_.second.write( "x" );
+  }
+
+  bool is_remote() const override { return true; }
+  bool can_execute( const Thunk & ) const override { return true; }
+  size_t job_count() const override { return pending_.size(); }
+  string label() const override { return "scripted"; }
+};
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    /* a chain of three thunks, each one taking the output of the one before */
+    const string function_hash = gg::hash::compute( "function", ObjectType::Value );
+    const string input = "input";
+    const string input_hash = gg::hash::compute( input, ObjectType::Value );
+    gg::blobs::insert( input_hash, input );
+
+    string previous_hash = input_hash;
+
+    for ( size_t i = 0; i < 3; i++ ) {
+      Thunk thunk { { function_hash, { "f", to_string( i ) }, {} },
+                    { { previous_hash, "" } }, { { function_hash, "" } }, { "out" } };
+      previous_hash = ThunkWriter::write( thunk );
+    }
+
+    const string target_hash = previous_hash;
+
+    unordered_map<string, size_t> runs;
+    string last_output;
+
+    vector<unique_ptr<ExecutionEngine>> engines;
+    engines.emplace_back( make_unique<ScriptedEngine>( runs, last_output ) );
+
+    /* the late failures come for thunks that have already been forced, and
+       are no longer in the graph */
+    Reductor reductor { { target_hash }, move( engines ), {}, nullptr };
+    const vector<string> results = reductor.reduce();
+
+    check( results.size() == 1 and results.front() == last_output, "the final output" );
+    check( runs.size() == 3, "the number of thunks that ran" );
+
+    for ( const auto & run : runs ) {
+      check( run.second == 1, "a thunk ran more than once: " + run.first );
+    }
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "storage/remote_index.hh"
+#include "util/bloom_filter.hh"
+#include "util/exception.hh"
+#include "util/path.hh"
+#include "util/temp_dir.hh"
+#include "util/temp_file.hh"
+
+using namespace std;
+
+static void check( const bool condition, const string & message )
+{
+  if ( not condition ) {
+    throw runtime_error( "remote index test failed: " + message );
+  }
+}
+
+static string key_for( const size_t writer, const size_t i )
+{
+  return "object-" + to_string( writer ) + "-" + to_string( i );
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    /* a Bloom filter never turns away what was added to it, in this
+       process or in any other */
+    TempFile filter_file { "filter" };
+    constexpr size_t WRITERS = 4;
+    constexpr size_t ENTRIES = 5000;
+    constexpr uint64_t BIT_COUNT = 1 << 18;
+
+    vector<pid_t> writers;
+
+    for ( size_t writer = 0; writer < WRITERS; writer++ ) {
+      const pid_t pid = CheckSystemCall( "fork", fork() );
+
+      if ( pid == 0 ) {
+        BloomFilter filter { filter_file.name(), BIT_COUNT };
+
+        for ( size_t i = 0; i < ENTRIES; i++ ) {
+          filter.add( key_for( writer, i ) );
+        }
+
+        _exit( EXIT_SUCCESS );
+      }
+
+      writers.push_back( pid );
+    }
+
+    for ( const pid_t pid : writers ) {
+      int status;
+      CheckSystemCall( "waitpid", waitpid( pid, &status, 0 ) );
+      check( WIFEXITED( status ) and WEXITSTATUS( status ) == 0, "writer process failed" );
+    }
+
+    {
+      BloomFilter filter { filter_file.name() };
+
+      for ( size_t writer = 0; writer < WRITERS; writer++ ) {
+        for ( size_t i = 0; i < ENTRIES; i++ ) {
+          check( filter.may_contain( key_for( writer, i ) ), "false negative" );
+        }
+      }
+
+      /* 20000 keys in 2^18 bits, with 7 hashes, is about 0.1% false
+         positives */
+      size_t false_positives = 0;
+
+      for ( size_t i = 0; i < ENTRIES; i++ ) {
+        false_positives += filter.may_contain( key_for( WRITERS, i ) );
+      }
+
+      check( false_positives < ENTRIES / 100, "too many false positives" );
+    }
+
+    /* the remote index, and the directory of empty files that it replaces */
+    TempDirectory index_dir { "remote-index" };
+    const roost::path index_path = roost::path( index_dir.name() ) / "remote";
+
+    roost::create_directories( index_path );
+    roost::atomic_create( "", index_path / "legacy-object" );
+
+    {
+      RemoteIndex index { index_path };
+
+      check( not roost::exists( index_path ), "legacy directory was left behind" );
+      check( index.contains( "legacy-object" ), "legacy entry was not imported" );
+      check( not index.contains( "new-object" ), "index has an object before insertion" );
+
+      index.insert( "new-object" );
+      index.insert( vector<string> { "first-object", "second-object" } );
+      check( index.contains( "new-object" ), "index lacks an inserted object" );
+    }
+
+    {
+      RemoteIndex index { index_path };
+      check( index.contains( "legacy-object" ) and index.contains( "new-object" )
+             and index.contains( "first-object" ) and index.contains( "second-object" ),
+             "lookup after reopening" );
+      check( not index.contains( "other-object" ), "lookup of a missing object" );
+    }
+
+    roost::remove( index_path.string() + ".index" );
+    roost::remove( index_path.string() + ".bloom" );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
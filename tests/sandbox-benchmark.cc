@@ -0,0 +1,125 @@
+/* -*-mode:c++; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+
+/* runs a process that makes a lot of cheap system calls and a few opens,
+   once on its own and once in each kind of sandbox (ptrace, and seccomp
+   where the kernel has it), and reports how much slower the sandboxes are */
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+
+#include "sandbox/sandbox.hh"
+#include "util/child_process.hh"
+#include "util/exception.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [SYSCALLS] [OPENS]" << endl;
+}
+
+/* what the benchmark's process does: mostly system calls that the sandbox
+   allows without a look, and a few opens that it checks */
+static int busy_process( const size_t syscalls, const size_t opens )
+{
+  char buffer;
+
+  for ( size_t i = 0; i < opens; i++ ) {
+    /* glibc's open() is an openat(), which is forbidden */
+    const int fd = syscall( SYS_open, "/dev/zero", O_RDONLY );
+    if ( fd < 0 ) { return EXIT_FAILURE; }
+
+    for ( size_t j = 0; j < syscalls / opens; j++ ) {
+      if ( read( fd, &buffer, 1 ) != 1 ) { return EXIT_FAILURE; }
+    }
+
+    close( fd );
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void benchmark( const size_t syscalls, const size_t opens )
+{
+  const unordered_map<string, Permissions> allowed_files {
+    { "/dev/zero", { true, false, false } },
+  };
+
+  auto process = [syscalls, opens] () { return busy_process( syscalls, opens ); };
+
+  auto time =
+    [] ( const function<void()> & run )
+    {
+      const auto start = steady_clock::now();
+      run();
+      return duration<double>( steady_clock::now() - start ).count();
+    };
+
+  const double unsandboxed = time(
+    [&process] ()
+    {
+      ChildProcess child { "unsandboxed", process };
+      while ( not child.terminated() ) { child.wait(); }
+      if ( child.exit_status() ) { throw runtime_error( "benchmark process failed" ); }
+    } );
+
+  cout << syscalls << " system calls, " << opens << " opens" << endl
+       << fixed << setprecision( 3 )
+       << "  unsandboxed: " << setw( 8 ) << unsandboxed << " s" << endl;
+
+  for ( const bool seccomp : { false, true } ) {
+    if ( seccomp and not SystemCallFilter::available() ) {
+      continue;
+    }
+
+    const double sandboxed = time(
+      [&process, &allowed_files, seccomp] ()
+      {
+        SandboxedProcess sp { "benchmark", ".", allowed_files, process, [](){}, seccomp };
+        sp.execute();
+      } );
+
+    cout << "  " << ( seccomp ? "seccomp:    " : "ptrace:     " )
+         << setw( 8 ) << sandboxed << " s ("
+         << setprecision( 1 ) << ( sandboxed / unsandboxed ) << "x)"
+         << setprecision( 3 ) << endl;
+  }
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort();
+    }
+
+    if ( argc > 3 ) {
+      usage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+
+    const size_t syscalls = ( argc > 1 ) ? stoul( argv[ 1 ] ) : 20000;
+    const size_t opens = ( argc > 2 ) ? stoul( argv[ 2 ] ) : 200;
+
+    if ( opens == 0 or syscalls < opens ) {
+      throw runtime_error( "there must be at least one open, and a system call for each" );
+    }
+
+    benchmark( syscalls, opens );
+  }
+  catch ( const exception & e ) {
+    print_exception( argv[ 0 ], e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
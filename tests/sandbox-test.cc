@@ -18,6 +18,147 @@ void usage( const char * argv0 )
   cerr << argv0 << endl;
 }
 
+static constexpr size_t total_tests = 5;
+
+/* returns the number of tests that went as expected */
+static size_t run_tests( const bool seccomp )
+{
+  size_t successful_tests = 0;
+
+  /* test 1 */
+  unordered_map<string, Permissions> allowed_files_1 {
+    { "/dev/null", { true, true, true } }
+  };
+
+  SandboxedProcess sp_1(
+    "sp_1",
+    ".",
+    allowed_files_1,
+    []()
+    {
+      /* XXX before, this was actually open( "/dev/null" ), but for
+        some unknown reason, it was compiled to openat( -100, "/dev/null")
+        in Ubuntu 17.10. Weird, right? */
+      execl( "/dev/null", "/dev/null" );
+      return 0;
+    },
+    [](){},
+    seccomp
+  );
+
+  try {
+    sp_1.execute();
+    successful_tests++;
+  }
+  catch (...) {}
+
+  /* test 2 */
+  unordered_map<string, Permissions> allowed_files_2 {
+    { "/dev/null", { true, true, true } },
+    { "/dev/zero", { false, true, true } },
+  };
+
+  SandboxedProcess sp_2(
+    "sp_2",
+    ".",
+    allowed_files_2,
+    []()
+    {
+      close( open( "/dev/null", O_WRONLY ) );
+      close( open( "/dev/zero", O_RDONLY ) );
+      return 0;
+    },
+    [](){},
+    seccomp
+  );
+
+  try {
+    sp_2.execute();
+  }
+  catch (...) {
+    successful_tests++;
+  }
+
+  /* test 3 */
+  unordered_map<string, Permissions> allowed_files_3 {
+    { "/dev/zero", { true, true, true } },
+    { "/dev/null", { true, true, true } },
+  };
+
+  SandboxedProcess sp_3(
+    "sp_3",
+    ".",
+    allowed_files_3,
+    []()
+    {
+      struct stat buf;
+      stat( "/dev/random", &buf );
+      return 0;
+    },
+    [](){},
+    seccomp
+  );
+
+  try {
+    sp_3.execute();
+  }
+  catch (...) {
+    successful_tests++;
+  }
+
+  /* test 4 */
+  unordered_map<string, Permissions> allowed_files_4 {
+    { "/bin/blahblah", { true, false, true } },
+  };
+
+  SandboxedProcess sp_4(
+    "sp_4",
+    ".",
+    allowed_files_4,
+    []()
+    {
+      execl( "/bin/blahblah", "/bin/blahblah" );
+      return 0;
+    },
+    [](){},
+    seccomp
+  );
+
+  try {
+    sp_4.execute();
+    successful_tests++;
+  }
+  catch (...) {
+  }
+
+  /* test 5 */
+  unordered_map<string, Permissions> allowed_files_5 {
+    { "/bin/ls", { true, false, false } },
+  };
+
+  SandboxedProcess sp_5(
+    "sp_5",
+    ".",
+    allowed_files_5,
+    []()
+    {
+      execl( "/bin/ls", "/bin/ls" );
+      return 0;
+    },
+    [](){},
+    seccomp
+  );
+
+  try {
+    sp_5.execute();
+  }
+  catch (...) {
+    successful_tests++;
+  }
+
+  return successful_tests;
+}
+
 int main( int argc, char * argv[] )
 {
   try {
@@ -30,131 +171,16 @@ int main( int argc, char * argv[] )
       return EXIT_FAILURE;
     }
 
-    const size_t total_tests = 5;
-    size_t successful_tests = 0;
-
-    /* test 1 */
-    unordered_map<string, Permissions> allowed_files_1 {
-      { "/dev/null", { true, true, true } }
-    };
-
-    SandboxedProcess sp_1(
-      "sp_1",
-      ".",
-      allowed_files_1,
-      []()
-      {
-        /* XXX before, this was actually open( "/dev/null" ), but for
-          some unknown reason, it was compiled to openat( -100, "/dev/null")
-          in Ubuntu 17.10. Weird, right? */
-        execl( "/dev/null", "/dev/null" );
-        return 0;
-      }
-    );
-
-    try {
-      sp_1.execute();
-      successful_tests++;
-    }
-    catch (...) {}
-
-    /* test 2 */
-    unordered_map<string, Permissions> allowed_files_2 {
-      { "/dev/null", { true, true, true } },
-      { "/dev/zero", { false, true, true } },
-    };
-
-    SandboxedProcess sp_2(
-      "sp_2",
-      ".",
-      allowed_files_2,
-      []()
-      {
-        close( open( "/dev/null", O_WRONLY ) );
-        close( open( "/dev/zero", O_RDONLY ) );
-        return 0;
-      }
-    );
-
-    try {
-      sp_2.execute();
-    }
-    catch (...) {
-      successful_tests++;
-    }
-
-    /* test 3 */
-    unordered_map<string, Permissions> allowed_files_3 {
-      { "/dev/zero", { true, true, true } },
-      { "/dev/null", { true, true, true } },
-    };
-
-    SandboxedProcess sp_3(
-      "sp_3",
-      ".",
-      allowed_files_3,
-      []()
-      {
-        struct stat buf;
-        stat( "/dev/random", &buf );
-        return 0;
-      }
-    );
-
-    try {
-      sp_3.execute();
-    }
-    catch (...) {
-      successful_tests++;
-    }
-
-    /* test 4 */
-    unordered_map<string, Permissions> allowed_files_4 {
-      { "/bin/blahblah", { true, false, true } },
-    };
-
-    SandboxedProcess sp_4(
-      "sp_4",
-      ".",
-      allowed_files_4,
-      []()
-      {
-        execl( "/bin/blahblah", "/bin/blahblah" );
-        return 0;
-      }
-    );
-
-    try {
-      sp_4.execute();
-      successful_tests++;
-    }
-    catch (...) {
+    if ( run_tests( false ) != total_tests ) {
+      cerr << "ptrace sandbox failed" << endl;
+      return EXIT_FAILURE;
     }
 
-    /* test 5 */
-    unordered_map<string, Permissions> allowed_files_5 {
-      { "/bin/ls", { true, false, false } },
-    };
-
-    SandboxedProcess sp_5(
-      "sp_5",
-      ".",
-      allowed_files_5,
-      []()
-      {
-        execl( "/bin/ls", "/bin/ls" );
-        return 0;
-      }
-    );
-
-    try {
-      sp_5.execute();
-    }
-    catch (...) {
-      successful_tests++;
+    if ( SystemCallFilter::available() and run_tests( true ) != total_tests ) {
+      cerr << "seccomp sandbox failed" << endl;
+      return EXIT_FAILURE;
     }
 
-    return successful_tests != total_tests;
   }
   catch ( const exception &  e ) {
     print_exception( argv[ 0 ], e );
@@ -6,6 +6,8 @@
 #include <chrono>
 #include <google/protobuf/text_format.h>
 
+#include "thunk/blob_store.hh"
+#include "thunk/ggutils.hh"
 #include "thunk/thunk_reader.hh"
 #include "thunk/thunk_writer.hh"
 #include "thunk/thunk.hh"
@@ -60,10 +62,41 @@ int main( int argc, char * argv[] )
     // Now reading it back
     Thunk thunk { move( ThunkReader::read( temp_file.name() ) ) };
 
-    if ( thunk == original_thunk ) {
-      return EXIT_SUCCESS;
+    if ( not ( thunk == original_thunk ) ) {
+      return EXIT_FAILURE;
+    }
+
+    // ... and from the blob store
+    const string thunk_hash = gg::hash::compute( contents, gg::ObjectType::Thunk );
+    gg::blobs::insert( thunk_hash, contents );
+
+    if ( not ( ThunkReader::read( gg::blobs::map( thunk_hash ) ) == original_thunk ) ) {
+      return EXIT_FAILURE;
+    }
+
+    // something that isn't a thunk can't be read as one, even if it parses
+    const string value = contents.substr( MAGIC_NUMBER.length() );
+    const string value_hash = gg::hash::compute( value, gg::ObjectType::Value );
+    gg::blobs::insert( value_hash, value );
+    roost::atomic_create( value, temp_file.name() );
+
+    size_t rejected = 0;
+
+    try {
+      ThunkReader::read( gg::blobs::map( value_hash ) );
     }
-    else {
+    catch ( const runtime_error & ) {
+      rejected++;
+    }
+
+    try {
+      ThunkReader::read( temp_file.name() );
+    }
+    catch ( const runtime_error & ) {
+      rejected++;
+    }
+
+    if ( rejected != 2 ) {
       return EXIT_FAILURE;
     }
 